@@ -41,8 +41,7 @@ use rpc::v1::types::Bytes as BytesJson;
 use secp256k1::PublicKey;
 use serde_json::{self as json, Value as Json};
 use sha3::{Digest, Keccak256};
-use std::cmp::Ordering;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 use std::ops::Deref;
 use std::path::PathBuf;
 use std::str::FromStr;
@@ -61,6 +60,10 @@ use super::{BalanceError, BalanceFut, CoinBalance, CoinProtocol, CoinTransportMe
 pub use ethcore_transaction::SignedTransaction as SignedEthTx;
 pub use rlp;
 
+mod log_scanner;
+use self::log_scanner::{scan_logs, LogsBlockRange, ScanDirection};
+mod nonce_allocator;
+use self::nonce_allocator::NonceAllocator;
 mod web3_transport;
 use self::web3_transport::Web3Transport;
 use common::mm_number::MmNumber;
@@ -269,9 +272,10 @@ pub enum EthAddressFormat {
 
 #[cfg_attr(test, mockable)]
 impl EthCoinImpl {
-    /// Gets Transfer events from ERC20 smart contract `addr` between `from_block` and `to_block`
+    /// Gets Transfer events from ERC20 smart contract `addr` between `from_block` and `to_block` from the `web3` node
     fn erc20_transfer_events(
         &self,
+        web3: &Web3<Web3Transport>,
         contract: Address,
         from_addr: Option<Address>,
         to_addr: Option<Address>,
@@ -293,7 +297,7 @@ impl EthCoinImpl {
             filter = filter.limit(l);
         }
 
-        Box::new(self.web3.eth().logs(filter.build()).map_err(|e| ERRL!("{}", e)))
+        Box::new(web3.eth().logs(filter.build()).map_err(|e| ERRL!("{}", e)))
     }
 
     /// Gets ETH traces from ETH node between addresses in `from_block` and `to_block`
@@ -431,9 +435,23 @@ impl EthCoinImpl {
         Box::new(self.web3.eth().estimate_gas(req, None))
     }
 
+    /// Returns the web3 of every node, the logs of the block ranges requested concurrently are spread over them.
+    fn logs_web3s(&self) -> Vec<Web3<Web3Transport>> {
+        let mut web3s: Vec<_> = self
+            .web3_instances
+            .iter()
+            .map(|instance| instance.web3.clone())
+            .collect();
+        if web3s.is_empty() {
+            web3s.push(self.web3.clone());
+        }
+        web3s
+    }
+
     /// Gets `ReceiverSpent` events from etomic swap smart contract since `from_block`
     fn spend_events(
         &self,
+        web3: &Web3<Web3Transport>,
         swap_contract_address: Address,
         from_block: u64,
         to_block: u64,
@@ -446,12 +464,13 @@ impl EthCoinImpl {
             .address(vec![swap_contract_address])
             .build();
 
-        Box::new(self.web3.eth().logs(filter).map_err(|e| ERRL!("{}", e)))
+        Box::new(web3.eth().logs(filter).map_err(|e| ERRL!("{}", e)))
     }
 
     /// Gets `SenderRefunded` events from etomic swap smart contract since `from_block`
     fn refund_events(
         &self,
+        web3: &Web3<Web3Transport>,
         swap_contract_address: Address,
         from_block: u64,
         to_block: u64,
@@ -464,7 +483,7 @@ impl EthCoinImpl {
             .address(vec![swap_contract_address])
             .build();
 
-        Box::new(self.web3.eth().logs(filter).map_err(|e| ERRL!("{}", e)))
+        Box::new(web3.eth().logs(filter).map_err(|e| ERRL!("{}", e)))
     }
 
     /// Try to parse address from string.
@@ -549,7 +568,7 @@ async fn withdraw_impl(ctx: MmArc, coin: EthCoin, req: WithdrawRequest) -> Withd
         eth_value -= total_fee;
         wei_amount -= total_fee;
     };
-    let _nonce_lock = NONCE_LOCK
+    let mut nonce_lock = NONCE_LOCK
         .lock(|_start, _now| {
             if ctx.is_stopping() {
                 let error = "MM is stopping, aborting withdraw_impl in NONCE_LOCK".to_owned();
@@ -559,10 +578,14 @@ async fn withdraw_impl(ctx: MmArc, coin: EthCoin, req: WithdrawRequest) -> Withd
         })
         .await?;
     let nonce_fut = get_addr_nonce(coin.my_address, coin.web3_instances.clone()).compat();
-    let nonce = match select(nonce_fut, Timer::sleep(30.)).await {
+    let pending_nonce = match select(nonce_fut, Timer::sleep(30.)).await {
         Either::Left((nonce_res, _)) => nonce_res.map_to_mm(WithdrawError::Transport)?,
         Either::Right(_) => return MmError::err(WithdrawError::Transport("Get address nonce timed out".to_owned())),
     };
+    // the withdrawal is broadcasted by the user later, so the nonce isn't reserved,
+    // but it must not collide with the in-flight swap transactions
+    let nonce = nonce_lock.next_nonce(coin.chain_id, coin.my_address, pending_nonce);
+    drop(nonce_lock);
     let tx = UnSignedEthTx {
         nonce,
         value: eth_value,
@@ -1149,7 +1172,7 @@ impl MarketCoinOps for EthCoin {
                 };
 
                 let events = match selfi
-                    .spend_events(swap_contract_address, from_block, current_block)
+                    .spend_events(&selfi.web3, swap_contract_address, from_block, current_block)
                     .compat()
                     .await
                 {
@@ -1236,11 +1259,11 @@ pub fn signed_eth_tx_from_bytes(bytes: &[u8]) -> Result<SignedEthTx, String> {
 }
 
 // We can use a shared nonce lock for all ETH coins.
-// It's highly likely that we won't experience any issues with it as we won't need to send "a lot" of transactions concurrently.
-// For ETH it makes even more sense because different ERC20 tokens can be running on same ETH blockchain.
-// So we would need to handle shared locks anyway.
+// Different ERC20 tokens can be running on same ETH blockchain, so their nonces are allocated by the same allocator.
+// The lock is held until the transaction is broadcasted only, the nonces of the next transactions are reserved locally
+// without waiting for the nodes to count the previous ones.
 lazy_static! {
-    static ref NONCE_LOCK: TimedAsyncMutex<()> = TimedAsyncMutex::new(());
+    static ref NONCE_LOCK: TimedAsyncMutex<NonceAllocator> = TimedAsyncMutex::new(NonceAllocator::default());
 }
 
 type EthTxFut = Box<dyn Future<Item = SignedEthTx, Error = String> + Send + 'static>;
@@ -1259,23 +1282,40 @@ async fn sign_and_send_transaction_impl(
             &[&"sign-and-send"]
         };
     };
-    let _nonce_lock = NONCE_LOCK
-        .lock(|start, now| {
-            if ctx.is_stopping() {
-                return ERR!("MM is stopping, aborting sign_and_send_transaction_impl in NONCE_LOCK");
-            }
-            if start < now {
-                status.status(tags!(), "Waiting for NONCE_LOCK…")
-            }
-            Ok(0.5)
-        })
-        .await;
+    let mut nonce_allocator = try_s!(
+        NONCE_LOCK
+            .lock(|start, now| {
+                if ctx.is_stopping() {
+                    return ERR!("MM is stopping, aborting sign_and_send_transaction_impl in NONCE_LOCK");
+                }
+                if start < now {
+                    status.status(tags!(), "Waiting for NONCE_LOCK…")
+                }
+                Ok(0.5)
+            })
+            .await
+    );
     status.status(tags!(), "get_addr_nonce…");
-    let nonce = try_s!(
+    let pending_nonce = try_s!(
         get_addr_nonce(coin.my_address, coin.web3_instances.clone())
             .compat()
             .await
     );
+    let nonce = nonce_allocator.next_nonce(coin.chain_id, coin.my_address, pending_nonce);
+    // the transactions with the lower nonces have to be counted by the nodes before this one is mined
+    for raw in nonce_allocator.stuck_txs(coin.chain_id, coin.my_address, now_ms() / 1000) {
+        status.status(tags!(), "send_raw_transaction of the stuck transaction…");
+        if let Err(e) = coin
+            .web3
+            .eth()
+            .send_raw_transaction(web3::types::Bytes(raw))
+            .compat()
+            .await
+        {
+            // the nodes might know the transaction already
+            log!("Error " [e] " broadcasting the stuck " [coin.ticker()] " transaction again");
+        }
+    }
     status.status(tags!(), "get_gas_price…");
     let gas_price = try_s!(coin.get_gas_price().compat().await);
     let tx = UnSignedEthTx {
@@ -1287,38 +1327,17 @@ async fn sign_and_send_transaction_impl(
         gas_price,
     };
     let signed = tx.sign(coin.key_pair.secret(), coin.chain_id);
-    let bytes = web3::types::Bytes(rlp::encode(&signed).to_vec());
+    let bytes = rlp::encode(&signed).to_vec();
     status.status(tags!(), "send_raw_transaction…");
     try_s!(
         coin.web3
             .eth()
-            .send_raw_transaction(bytes)
+            .send_raw_transaction(web3::types::Bytes(bytes.clone()))
             .map_err(|e| ERRL!("{}", e))
             .compat()
             .await
     );
-    status.status(tags!(), "get_addr_nonce…");
-    loop {
-        // Check every second till ETH nodes recognize that nonce is increased
-        // Parity has reliable "nextNonce" method that always returns correct nonce for address
-        // But we can't expect that all nodes will always be Parity.
-        // Some of ETH forks use Geth only so they don't have Parity nodes at all.
-        let new_nonce = match get_addr_nonce(coin.my_address, coin.web3_instances.clone())
-            .compat()
-            .await
-        {
-            Ok(n) => n,
-            Err(e) => {
-                log!("Error " [e] " getting " [coin.ticker()] " " [coin.my_address] " nonce");
-                // we can just keep looping in case of error hoping it will go away
-                continue;
-            },
-        };
-        if new_nonce > nonce {
-            break;
-        };
-        Timer::sleep(1.).await;
-    }
+    nonce_allocator.broadcasted(coin.chain_id, coin.my_address, nonce, bytes, now_ms() / 1000);
     Ok(signed)
 }
 
@@ -1865,7 +1884,40 @@ impl EthCoin {
     #[allow(clippy::cognitive_complexity)]
     #[cfg_attr(target_arch = "wasm32", allow(dead_code))]
     async fn process_erc20_history(&self, token_addr: H160, ctx: &MmArc) {
-        let delta = U256::from(10000);
+        let web3s = self.logs_web3s();
+        // AP: AFAIK ETH RPC doesn't support conditional filters like `get this OR this` so we have
+        // to run several queries to get transfer events including our address as sender `or` receiver
+        let query_transfer_events = |idx: usize, from_block: u64, to_block: u64| {
+            let web3 = &web3s[idx % web3s.len()];
+            let from_events = self
+                .erc20_transfer_events(
+                    web3,
+                    token_addr,
+                    Some(self.my_address),
+                    None,
+                    BlockNumber::Number(from_block),
+                    BlockNumber::Number(to_block),
+                    None,
+                )
+                .compat();
+            let to_events = self
+                .erc20_transfer_events(
+                    web3,
+                    token_addr,
+                    None,
+                    Some(self.my_address),
+                    BlockNumber::Number(from_block),
+                    BlockNumber::Number(to_block),
+                    None,
+                )
+                .compat();
+            async move {
+                let (mut from_events, to_events) = futures::future::try_join(from_events, to_events).await?;
+                from_events.extend(to_events);
+                Ok::<_, String>(from_events)
+            }
+        };
+        let mut logs_range = LogsBlockRange::new(self.logs_block_range);
 
         let mut success_iteration = 0i32;
         loop {
@@ -1906,53 +1958,17 @@ impl EthCoin {
                 "blocks_left": u64::from(saved_events.earliest_block),
             }));
 
-            // AP: AFAIK ETH RPC doesn't support conditional filters like `get this OR this` so we have
-            // to run several queries to get transfer events including our address as sender `or` receiver
-            // TODO refactor this to batch requests instead of single request per query
             if saved_events.earliest_block > 0.into() {
-                let before_earliest = if saved_events.earliest_block >= delta {
-                    saved_events.earliest_block - delta
-                } else {
-                    0.into()
-                };
-
-                let from_events_before_earliest = match self
-                    .erc20_transfer_events(
-                        token_addr,
-                        Some(self.my_address),
-                        None,
-                        BlockNumber::Number(before_earliest.into()),
-                        BlockNumber::Number((saved_events.earliest_block - 1).into()),
-                        None,
-                    )
-                    .compat()
-                    .await
-                {
-                    Ok(events) => events,
-                    Err(e) => {
-                        ctx.log.log(
-                            "",
-                            &[&"tx_history", &self.ticker],
-                            &ERRL!("Error {} on erc20_transfer_events, retrying", e),
-                        );
-                        Timer::sleep(10.).await;
-                        continue;
-                    },
-                };
-
-                let to_events_before_earliest = match self
-                    .erc20_transfer_events(
-                        token_addr,
-                        None,
-                        Some(self.my_address),
-                        BlockNumber::Number(before_earliest.into()),
-                        BlockNumber::Number((saved_events.earliest_block - 1).into()),
-                        None,
-                    )
-                    .compat()
-                    .await
+                let scanned = match scan_logs(
+                    &mut logs_range,
+                    0,
+                    saved_events.earliest_block.low_u64() - 1,
+                    ScanDirection::Backward,
+                    &query_transfer_events,
+                )
+                .await
                 {
-                    Ok(events) => events,
+                    Ok(scanned) => scanned,
                     Err(e) => {
                         ctx.log.log(
                             "",
@@ -1964,58 +1980,25 @@ impl EthCoin {
                     },
                 };
 
-                let total_length = from_events_before_earliest.len() + to_events_before_earliest.len();
-                mm_counter!(ctx.metrics, "tx.history.response.total_length", total_length as u64,
+                mm_counter!(ctx.metrics, "tx.history.response.total_length", scanned.logs.len() as u64,
                     "coin" => self.ticker.clone(), "client" => "ethereum", "method" => "erc20_transfer_events");
 
-                saved_events.events.extend(from_events_before_earliest);
-                saved_events.events.extend(to_events_before_earliest);
-                saved_events.earliest_block = if before_earliest > 0.into() {
-                    before_earliest - 1
-                } else {
-                    0.into()
-                };
+                saved_events.events.extend(scanned.logs);
+                saved_events.earliest_block = scanned.from_block.into();
                 self.store_erc20_events(&ctx, &saved_events);
             }
 
             if current_block > saved_events.latest_block {
-                let from_events_after_latest = match self
-                    .erc20_transfer_events(
-                        token_addr,
-                        Some(self.my_address),
-                        None,
-                        BlockNumber::Number((saved_events.latest_block + 1).into()),
-                        BlockNumber::Number(current_block.into()),
-                        None,
-                    )
-                    .compat()
-                    .await
-                {
-                    Ok(events) => events,
-                    Err(e) => {
-                        ctx.log.log(
-                            "",
-                            &[&"tx_history", &self.ticker],
-                            &ERRL!("Error {} on erc20_transfer_events, retrying", e),
-                        );
-                        Timer::sleep(10.).await;
-                        continue;
-                    },
-                };
-
-                let to_events_after_latest = match self
-                    .erc20_transfer_events(
-                        token_addr,
-                        None,
-                        Some(self.my_address),
-                        BlockNumber::Number((saved_events.latest_block + 1).into()),
-                        BlockNumber::Number(current_block.into()),
-                        None,
-                    )
-                    .compat()
-                    .await
+                let scanned = match scan_logs(
+                    &mut logs_range,
+                    saved_events.latest_block.low_u64() + 1,
+                    current_block.low_u64(),
+                    ScanDirection::Forward,
+                    &query_transfer_events,
+                )
+                .await
                 {
-                    Ok(events) => events,
+                    Ok(scanned) => scanned,
                     Err(e) => {
                         ctx.log.log(
                             "",
@@ -2027,13 +2010,11 @@ impl EthCoin {
                     },
                 };
 
-                let total_length = from_events_after_latest.len() + to_events_after_latest.len();
-                mm_counter!(ctx.metrics, "tx.history.response.total_length", total_length as u64,
+                mm_counter!(ctx.metrics, "tx.history.response.total_length", scanned.logs.len() as u64,
                     "coin" => self.ticker.clone(), "client" => "ethereum", "method" => "erc20_transfer_events");
 
-                saved_events.events.extend(from_events_after_latest);
-                saved_events.events.extend(to_events_after_latest);
-                saved_events.latest_block = current_block;
+                saved_events.events.extend(scanned.logs);
+                saved_events.latest_block = scanned.to_block.into();
                 self.store_erc20_events(&ctx, &saved_events);
             }
 
@@ -2046,20 +2027,23 @@ impl EthCoin {
             let mut all_events: Vec<_> = all_events.into_iter().map(|(_, log)| log).collect();
             all_events.sort_by(|a, b| b.block_number.unwrap().cmp(&a.block_number.unwrap()));
 
+            let existing_history = match self.load_history_from_file(ctx).compat().await {
+                Ok(history) => history,
+                Err(e) => {
+                    ctx.log.log(
+                        "",
+                        &[&"tx_history", &self.ticker],
+                        &ERRL!("Error {} on 'load_history_from_file', stop the history loop", e),
+                    );
+                    return;
+                },
+            };
+            let mut existing_ids: HashSet<BytesJson> =
+                existing_history.into_iter().map(|item| item.internal_id).collect();
+
             for event in all_events {
-                let mut existing_history = match self.load_history_from_file(ctx).compat().await {
-                    Ok(history) => history,
-                    Err(e) => {
-                        ctx.log.log(
-                            "",
-                            &[&"tx_history", &self.ticker],
-                            &ERRL!("Error {} on 'load_history_from_file', stop the history loop", e),
-                        );
-                        return;
-                    },
-                };
                 let internal_id = BytesJson::from(sha256(&json::to_vec(&event).unwrap()).to_vec());
-                if existing_history.iter().any(|item| item.internal_id == internal_id) {
+                if existing_ids.contains(&internal_id) {
                     // the transaction already imported
                     continue;
                 };
@@ -2196,21 +2180,12 @@ impl EthCoin {
                     timestamp: block.timestamp.into(),
                 };
 
-                existing_history.push(details);
-                existing_history.sort_unstable_by(|a, b| {
-                    if a.block_height == 0 {
-                        Ordering::Less
-                    } else if b.block_height == 0 {
-                        Ordering::Greater
-                    } else {
-                        b.block_height.cmp(&a.block_height)
-                    }
-                });
-                if let Err(e) = self.save_history_to_file(&ctx, existing_history).compat().await {
+                existing_ids.insert(details.internal_id.clone());
+                if let Err(e) = self.upsert_history_txs(&ctx, vec![details]).compat().await {
                     ctx.log.log(
                         "",
                         &[&"tx_history", &self.ticker],
-                        &ERRL!("Error {} on 'save_history_to_file', stop the history loop", e),
+                        &ERRL!("Error {} on 'upsert_history_txs', stop the history loop", e),
                     );
                     return;
                 }
@@ -2283,7 +2258,7 @@ impl EthCoin {
                 "blocks_left": u64::from(saved_traces.earliest_block),
             }));
 
-            let mut existing_history = match self.load_history_from_file(ctx).compat().await {
+            let existing_history = match self.load_history_from_file(ctx).compat().await {
                 Ok(history) => history,
                 Err(e) => {
                     ctx.log.log(
@@ -2294,6 +2269,8 @@ impl EthCoin {
                     return;
                 },
             };
+            let mut existing_ids: HashSet<BytesJson> =
+                existing_history.into_iter().map(|item| item.internal_id).collect();
 
             // AP: AFAIK ETH RPC doesn't support conditional filters like `get this OR this` so we have
             // to run several queries to get trace events including our address as sender `or` receiver
@@ -2427,8 +2404,7 @@ impl EthCoin {
             for trace in saved_traces.traces {
                 let hash = sha256(&json::to_vec(&trace).unwrap());
                 let internal_id = BytesJson::from(hash.to_vec());
-                let processed = existing_history.iter().find(|tx| tx.internal_id == internal_id);
-                if processed.is_some() {
+                if existing_ids.contains(&internal_id) {
                     continue;
                 }
 
@@ -2564,22 +2540,12 @@ impl EthCoin {
                     timestamp: block.timestamp.into(),
                 };
 
-                existing_history.push(details);
-                existing_history.sort_unstable_by(|a, b| {
-                    if a.block_height == 0 {
-                        Ordering::Less
-                    } else if b.block_height == 0 {
-                        Ordering::Greater
-                    } else {
-                        b.block_height.cmp(&a.block_height)
-                    }
-                });
-
-                if let Err(e) = self.save_history_to_file(&ctx, existing_history.clone()).compat().await {
+                existing_ids.insert(details.internal_id.clone());
+                if let Err(e) = self.upsert_history_txs(&ctx, vec![details]).compat().await {
                     ctx.log.log(
                         "",
                         &[&"tx_history", &self.ticker],
-                        &ERRL!("Error {} on 'save_history_to_file', stop the history loop", e),
+                        &ERRL!("Error {} on 'upsert_history_txs', stop the history loop", e),
                     );
                     return;
                 }
@@ -2628,59 +2594,60 @@ impl EthCoin {
             current_block = search_from_block;
         }
 
+        let spent_signature = try_s!(SWAP_CONTRACT.event("ReceiverSpent")).signature();
+        let web3s = self.logs_web3s();
+        // the spend and refund events of the ranges are requested concurrently
+        let query_events = |idx: usize, from_block: u64, to_block: u64| {
+            let web3 = &web3s[idx % web3s.len()];
+            let spend_events = self
+                .spend_events(web3, swap_contract_address, from_block, to_block)
+                .compat();
+            let refund_events = self
+                .refund_events(web3, swap_contract_address, from_block, to_block)
+                .compat();
+            async move {
+                let (mut spend_events, refund_events) = futures::future::try_join(spend_events, refund_events).await?;
+                spend_events.extend(refund_events);
+                Ok::<_, String>(spend_events)
+            }
+        };
+        let mut logs_range = LogsBlockRange::new(self.logs_block_range);
         let mut from_block = search_from_block;
 
         loop {
-            let to_block = current_block.min(from_block + self.logs_block_range);
-
-            let spend_events = try_s!(self.spend_events(swap_contract_address, from_block, to_block).wait());
-            let found = spend_events.iter().find(|event| &event.data.0[..32] == id.as_slice());
-
-            if let Some(event) = found {
-                match event.transaction_hash {
-                    Some(tx_hash) => {
-                        let transaction = match try_s!(self.web3.eth().transaction(TransactionId::Hash(tx_hash)).wait())
-                        {
-                            Some(t) => t,
-                            None => {
-                                return ERR!("Found ReceiverSpent event, but transaction {:02x} is missing", tx_hash)
-                            },
-                        };
-
-                        return Ok(Some(FoundSwapTxSpend::Spent(TransactionEnum::from(try_s!(
-                            signed_tx_from_web3_tx(transaction)
-                        )))));
-                    },
-                    None => return ERR!("Found ReceiverSpent event, but it doesn't have tx_hash"),
-                }
-            }
-
-            let refund_events = try_s!(self.refund_events(swap_contract_address, from_block, to_block).wait());
-            let found = refund_events.iter().find(|event| &event.data.0[..32] == id.as_slice());
+            let scan_fut = scan_logs(
+                &mut logs_range,
+                from_block,
+                current_block,
+                ScanDirection::Forward,
+                &query_events,
+            );
+            let scanned = try_s!(Box::pin(scan_fut).compat().wait());
+            let found = scanned.logs.iter().find(|event| &event.data.0[..32] == id.as_slice());
 
             if let Some(event) = found {
-                match event.transaction_hash {
-                    Some(tx_hash) => {
-                        let transaction = match try_s!(self.web3.eth().transaction(TransactionId::Hash(tx_hash)).wait())
-                        {
-                            Some(t) => t,
-                            None => {
-                                return ERR!("Found SenderRefunded event, but transaction {:02x} is missing", tx_hash)
-                            },
-                        };
-
-                        return Ok(Some(FoundSwapTxSpend::Refunded(TransactionEnum::from(try_s!(
-                            signed_tx_from_web3_tx(transaction)
-                        )))));
-                    },
-                    None => return ERR!("Found SenderRefunded event, but it doesn't have tx_hash"),
-                }
+                let is_spent = event.topics.first() == Some(&spent_signature);
+                let event_name = if is_spent { "ReceiverSpent" } else { "SenderRefunded" };
+                let tx_hash = match event.transaction_hash {
+                    Some(tx_hash) => tx_hash,
+                    None => return ERR!("Found {} event, but it doesn't have tx_hash", event_name),
+                };
+                let transaction = match try_s!(self.web3.eth().transaction(TransactionId::Hash(tx_hash)).wait()) {
+                    Some(t) => t,
+                    None => return ERR!("Found {} event, but transaction {:02x} is missing", event_name, tx_hash),
+                };
+                let transaction = TransactionEnum::from(try_s!(signed_tx_from_web3_tx(transaction)));
+                return if is_spent {
+                    Ok(Some(FoundSwapTxSpend::Spent(transaction)))
+                } else {
+                    Ok(Some(FoundSwapTxSpend::Refunded(transaction)))
+                };
             }
 
-            if to_block >= current_block {
+            if scanned.to_block >= current_block {
                 break;
             }
-            from_block = to_block;
+            from_block = scanned.to_block + 1;
         }
 
         Ok(None)
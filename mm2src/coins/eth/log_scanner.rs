@@ -0,0 +1,322 @@
+//! The logs are requested by several block ranges at once, the ranges are sized adaptively:
+//! a range is halved once a node refuses it as too large (the providers limit the range or the number of results),
+//! and it's doubled while the responses are sparse, so the history of a fresh wallet is scanned by few requests.
+//! The rate limited requests are retried with an exponential backoff.
+
+use common::executor::Timer;
+use futures::future::join_all;
+use std::future::Future;
+
+/// The number of the block ranges requested concurrently.
+pub const CONCURRENT_RANGES: usize = 4;
+/// The range isn't grown beyond this number of blocks.
+const MAX_LOGS_BLOCK_RANGE: u64 = 100_000;
+/// The range is grown if every response of the batch has fewer logs.
+const SPARSE_LOGS_COUNT: usize = 100;
+
+/// The number of the retries of the rate limited requests before the error is returned.
+const MAX_RATE_LIMITED_RETRIES: u32 = 5;
+/// The delay in seconds before the first retry of the rate limited requests, it's doubled on every next retry.
+const RATE_LIMITED_BACKOFF: f64 = 1.;
+
+/// The errors the providers refuse the too large ranges or the too many results with, e.g.
+/// "query returned more than 10000 results", "Log response size exceeded", "exceed maximum block range: 5000".
+/// They're matched by the result count and the range phrases only, as the rate limit errors "exceed" a "limit" too.
+const RANGE_TOO_LARGE_ERRORS: &[&str] = &[
+    "returned more than",
+    "too many results",
+    "response size exceeded",
+    "block range",
+    "range too",
+    "range is too",
+];
+
+/// The errors the providers refuse the requests sent too often with, e.g. "project ID request rate exceeded",
+/// "daily request count exceeded, request rate limited", "429 Too Many Requests".
+const RATE_LIMITED_ERRORS: &[&str] = &[
+    "rate limit",
+    "rate exceeded",
+    "request count exceeded",
+    "too many requests",
+];
+
+fn error_contains_any(error: &str, patterns: &[&str]) -> bool {
+    let error = error.to_lowercase();
+    patterns.iter().any(|pattern| error.contains(pattern))
+}
+
+fn is_range_too_large(error: &str) -> bool { error_contains_any(error, RANGE_TOO_LARGE_ERRORS) }
+
+fn is_rate_limited(error: &str) -> bool { error_contains_any(error, RATE_LIMITED_ERRORS) }
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum ScanDirection {
+    Forward,
+    Backward,
+}
+
+/// The logs found in the `from_block..=to_block` range.
+#[derive(Debug)]
+pub struct ScannedLogs<T> {
+    pub logs: Vec<T>,
+    pub from_block: u64,
+    pub to_block: u64,
+}
+
+/// The number of blocks requested by one query, adjusted by the responses.
+#[derive(Debug)]
+pub struct LogsBlockRange {
+    blocks: u64,
+    max_blocks: u64,
+}
+
+impl LogsBlockRange {
+    pub fn new(blocks: u64) -> LogsBlockRange {
+        let blocks = blocks.max(1);
+        LogsBlockRange {
+            blocks,
+            max_blocks: blocks.max(MAX_LOGS_BLOCK_RANGE),
+        }
+    }
+
+    fn grow(&mut self) { self.blocks = self.blocks.saturating_mul(2).min(self.max_blocks) }
+
+    /// Returns false if the range can't be shrunk anymore.
+    fn shrink(&mut self) -> bool {
+        if self.blocks == 1 {
+            return false;
+        }
+        self.blocks /= 2;
+        true
+    }
+
+    /// Splits the `from_block..=to_block` into at most `CONCURRENT_RANGES` ranges starting from the scan direction side.
+    fn split(&self, from_block: u64, to_block: u64, direction: ScanDirection) -> Vec<(u64, u64)> {
+        let mut ranges = Vec::with_capacity(CONCURRENT_RANGES);
+        match direction {
+            ScanDirection::Forward => {
+                let mut start = from_block;
+                while ranges.len() < CONCURRENT_RANGES {
+                    let end = start.saturating_add(self.blocks - 1).min(to_block);
+                    ranges.push((start, end));
+                    if end == to_block {
+                        break;
+                    }
+                    start = end + 1;
+                }
+            },
+            ScanDirection::Backward => {
+                let mut end = to_block;
+                while ranges.len() < CONCURRENT_RANGES {
+                    let start = end.saturating_sub(self.blocks - 1).max(from_block);
+                    ranges.push((start, end));
+                    if start == from_block {
+                        break;
+                    }
+                    end = start - 1;
+                }
+            },
+        }
+        ranges
+    }
+}
+
+/// Requests one batch of the logs scanning the `from_block..=to_block` range in the `direction`.
+/// The `query` is called with the index of the range in the batch (to spread the requests over the nodes)
+/// and the range bounds.
+/// Returns the logs of the contiguous scanned part of the range, it starts from the `to_block` if scanned backward
+/// and from the `from_block` if scanned forward, so the caller can checkpoint the progress and continue.
+/// If the first range is rate limited, the batch is retried after the backoff delay.
+pub async fn scan_logs<T, F, Fut>(
+    range: &mut LogsBlockRange,
+    from_block: u64,
+    to_block: u64,
+    direction: ScanDirection,
+    query: F,
+) -> Result<ScannedLogs<T>, String>
+where
+    F: Fn(usize, u64, u64) -> Fut,
+    Fut: Future<Output = Result<Vec<T>, String>>,
+{
+    if from_block > to_block {
+        return ERR!("Invalid logs block range {}..={}", from_block, to_block);
+    }
+
+    let mut rate_limited_retries = 0;
+    loop {
+        let ranges = range.split(from_block, to_block, direction);
+        let results = join_all(
+            ranges
+                .iter()
+                .enumerate()
+                .map(|(idx, (start, end))| query(idx, *start, *end)),
+        )
+        .await;
+
+        let mut scanned: Option<ScannedLogs<T>> = None;
+        let mut is_sparse = true;
+        let mut is_too_large = false;
+        let mut rate_limited = None;
+        for ((start, end), result) in ranges.into_iter().zip(results) {
+            let logs = match result {
+                Ok(logs) => logs,
+                Err(e) => {
+                    is_too_large = is_range_too_large(&e);
+                    if is_rate_limited(&e) {
+                        rate_limited = Some(e);
+                    } else if scanned.is_none() && !is_too_large {
+                        return Err(e);
+                    }
+                    // the ranges following the failed one can't be checkpointed
+                    break;
+                },
+            };
+            is_sparse &= logs.len() < SPARSE_LOGS_COUNT;
+            match scanned.as_mut() {
+                Some(scanned) => {
+                    scanned.logs.extend(logs);
+                    scanned.from_block = scanned.from_block.min(start);
+                    scanned.to_block = scanned.to_block.max(end);
+                },
+                None => {
+                    scanned = Some(ScannedLogs {
+                        logs,
+                        from_block: start,
+                        to_block: end,
+                    })
+                },
+            }
+        }
+
+        if let Some(e) = rate_limited {
+            match scanned {
+                Some(scanned) => return Ok(scanned),
+                None if rate_limited_retries < MAX_RATE_LIMITED_RETRIES => {
+                    Timer::sleep(RATE_LIMITED_BACKOFF * 2f64.powi(rate_limited_retries as i32)).await;
+                    rate_limited_retries += 1;
+                    continue;
+                },
+                None => return ERR!("{}", e),
+            }
+        }
+
+        if is_too_large {
+            let shrunk = range.shrink();
+            match scanned {
+                Some(scanned) => return Ok(scanned),
+                // the first range is refused, retry it shrunk
+                None if shrunk => continue,
+                None => return ERR!("The logs of the single block {} are refused as too large", from_block),
+            }
+        }
+
+        if is_sparse {
+            range.grow();
+        }
+        // the first range is scanned at least as there is no error
+        return scanned.ok_or_else(|| ERRL!("No logs block ranges requested"));
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use common::block_on;
+    use futures::future::ready;
+    use std::sync::Mutex;
+
+    #[test]
+    fn test_logs_block_range_split() {
+        let range = LogsBlockRange::new(10);
+        assert_eq!(range.split(0, 100, ScanDirection::Forward), vec![
+            (0, 9),
+            (10, 19),
+            (20, 29),
+            (30, 39)
+        ]);
+        assert_eq!(range.split(0, 100, ScanDirection::Backward), vec![
+            (91, 100),
+            (81, 90),
+            (71, 80),
+            (61, 70)
+        ]);
+        assert_eq!(range.split(5, 20, ScanDirection::Forward), vec![(5, 14), (15, 20)]);
+        assert_eq!(range.split(5, 20, ScanDirection::Backward), vec![(11, 20), (5, 10)]);
+        assert_eq!(range.split(7, 7, ScanDirection::Backward), vec![(7, 7)]);
+    }
+
+    #[test]
+    fn test_scan_logs_adapts_range() {
+        let mut range = LogsBlockRange::new(10);
+        // the sparse logs grow the range
+        let scanned = block_on(scan_logs(&mut range, 0, 1000, ScanDirection::Forward, |_, _, _| {
+            ready(Ok(Vec::<u32>::new()))
+        }))
+        .unwrap();
+        assert_eq!((scanned.from_block, scanned.to_block), (0, 39));
+        assert_eq!(range.blocks, 20);
+
+        // the node refuses the ranges larger than 5 blocks
+        let requested = Mutex::new(Vec::new());
+        let scanned = block_on(scan_logs(
+            &mut range,
+            0,
+            1000,
+            ScanDirection::Backward,
+            |_, start, end| {
+                requested.lock().unwrap().push((start, end));
+                if end - start >= 5 {
+                    ready(Err("query returned more than 10000 results".to_owned()))
+                } else {
+                    ready(Ok(vec![0u32; SPARSE_LOGS_COUNT]))
+                }
+            },
+        ))
+        .unwrap();
+        // 20 -> 10 -> 5 blocks
+        assert_eq!(range.blocks, 5);
+        assert_eq!((scanned.from_block, scanned.to_block), (981, 1000));
+        assert_eq!(scanned.logs.len(), 4 * SPARSE_LOGS_COUNT);
+        assert_eq!(requested.lock().unwrap().len(), 12);
+
+        // the other errors are returned
+        let err = block_on(scan_logs(&mut range, 0, 1000, ScanDirection::Forward, |_, _, _| {
+            ready(Err::<Vec<u32>, _>("Connection refused".to_owned()))
+        }))
+        .unwrap_err();
+        assert!(err.contains("Connection refused"));
+        assert_eq!(range.blocks, 5);
+    }
+
+    #[test]
+    fn test_scan_logs_errors() {
+        assert!(is_range_too_large("query returned more than 10000 results"));
+        assert!(is_range_too_large("Log response size exceeded."));
+        assert!(is_range_too_large("exceed maximum block range: 5000"));
+        assert!(!is_range_too_large("project ID request rate exceeded"));
+        assert!(!is_range_too_large(
+            "daily request count exceeded, request rate limited"
+        ));
+        assert!(is_rate_limited("project ID request rate exceeded"));
+        assert!(is_rate_limited("daily request count exceeded, request rate limited"));
+        assert!(is_rate_limited("429 Too Many Requests"));
+        assert!(!is_rate_limited("query returned more than 10000 results"));
+
+        // the rate limited batch is retried with the same range
+        let mut range = LogsBlockRange::new(10);
+        let requested = Mutex::new(0);
+        let scanned = block_on(scan_logs(&mut range, 0, 1000, ScanDirection::Forward, |_, _, _| {
+            let mut requested = requested.lock().unwrap();
+            *requested += 1;
+            if *requested == 1 {
+                ready(Err("project ID request rate exceeded".to_owned()))
+            } else {
+                ready(Ok(vec![0u32; SPARSE_LOGS_COUNT]))
+            }
+        }))
+        .unwrap();
+        assert_eq!((scanned.from_block, scanned.to_block), (0, 39));
+        assert_eq!(*requested.lock().unwrap(), CONCURRENT_RANGES + CONCURRENT_RANGES);
+        assert_eq!(range.blocks, 10);
+    }
+}
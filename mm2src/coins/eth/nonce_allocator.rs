@@ -0,0 +1,119 @@
+//! The nonces reserved locally for the transactions sent from the same address.
+//!
+//! Once a transaction is broadcasted the next one gets the following nonce without waiting for the nodes
+//! to count the previous one, so the sends of the concurrent swaps are pipelined instead of being serialized.
+//! The allocation is reconciled with the pending nonce the nodes report before every send:
+//! the transactions the nodes count are forgotten, the first nonce not taken by the in-flight transactions
+//! is allocated (so a gap left by a dropped transaction is filled), and the in-flight transactions
+//! the nodes don't see for too long are broadcasted again.
+
+use ethereum_types::{Address, U256};
+use std::collections::{BTreeMap, HashMap};
+
+/// How long in seconds an in-flight transaction might be not counted by the nodes before it's broadcasted again.
+const REBROADCAST_INTERVAL: u64 = 60;
+
+struct InFlightTx {
+    raw: Vec<u8>,
+    broadcasted_at: u64,
+}
+
+/// The nonces of the different chains are independent, the ERC20 tokens share the nonces of their chain.
+type SenderKey = (Option<u64>, Address);
+
+#[derive(Default)]
+pub struct NonceAllocator {
+    /// The transactions broadcasted but not counted by the nodes yet by their nonces.
+    in_flight: HashMap<SenderKey, BTreeMap<U256, InFlightTx>>,
+}
+
+impl NonceAllocator {
+    /// Forgets the transactions the nodes count already (having the nonces less than the `pending_nonce`)
+    /// and returns the first nonce not taken by the rest in-flight transactions.
+    pub fn next_nonce(&mut self, chain_id: Option<u64>, address: Address, pending_nonce: U256) -> U256 {
+        let txs = match self.in_flight.get_mut(&(chain_id, address)) {
+            Some(txs) => txs,
+            None => return pending_nonce,
+        };
+        *txs = txs.split_off(&pending_nonce);
+        if txs.is_empty() {
+            self.in_flight.remove(&(chain_id, address));
+            return pending_nonce;
+        }
+
+        let mut nonce = pending_nonce;
+        while txs.contains_key(&nonce) {
+            nonce += U256::from(1);
+        }
+        nonce
+    }
+
+    /// Returns the raw in-flight transactions not counted by the nodes for `REBROADCAST_INTERVAL`, oldest nonces first.
+    /// Should be called after `next_nonce` forgot the transactions the nodes count.
+    pub fn stuck_txs(&mut self, chain_id: Option<u64>, address: Address, now: u64) -> Vec<Vec<u8>> {
+        let txs = match self.in_flight.get_mut(&(chain_id, address)) {
+            Some(txs) => txs,
+            None => return Vec::new(),
+        };
+        txs.values_mut()
+            .filter(|tx| tx.broadcasted_at + REBROADCAST_INTERVAL <= now)
+            .map(|tx| {
+                tx.broadcasted_at = now;
+                tx.raw.clone()
+            })
+            .collect()
+    }
+
+    /// Reserves the `nonce` for the broadcasted transaction.
+    pub fn broadcasted(&mut self, chain_id: Option<u64>, address: Address, nonce: U256, raw: Vec<u8>, now: u64) {
+        self.in_flight
+            .entry((chain_id, address))
+            .or_insert_with(BTreeMap::new)
+            .insert(nonce, InFlightTx {
+                raw,
+                broadcasted_at: now,
+            });
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_nonce_allocator() {
+        let chain_id = Some(1);
+        let address = Address::default();
+        let mut allocator = NonceAllocator::default();
+        assert_eq!(allocator.next_nonce(chain_id, address, 5.into()), 5.into());
+
+        // the nodes don't count the broadcasted transactions yet
+        allocator.broadcasted(chain_id, address, 5.into(), vec![5], 0);
+        assert_eq!(allocator.next_nonce(chain_id, address, 5.into()), 6.into());
+        allocator.broadcasted(chain_id, address, 6.into(), vec![6], 0);
+        assert_eq!(allocator.next_nonce(chain_id, address, 5.into()), 7.into());
+        // the other chain nonces are independent
+        assert_eq!(allocator.next_nonce(Some(2), address, 5.into()), 5.into());
+
+        // the transaction 5 is counted, the transaction 6 is stuck
+        assert_eq!(allocator.next_nonce(chain_id, address, 6.into()), 7.into());
+        assert!(allocator
+            .stuck_txs(chain_id, address, REBROADCAST_INTERVAL - 1)
+            .is_empty());
+        assert_eq!(allocator.stuck_txs(chain_id, address, REBROADCAST_INTERVAL), vec![
+            vec![6]
+        ]);
+        // it's not broadcasted again until the next interval
+        assert!(allocator
+            .stuck_txs(chain_id, address, REBROADCAST_INTERVAL + 1)
+            .is_empty());
+
+        // the nonce 8 is taken while the nonce 7 isn't, the gap is filled first
+        allocator.broadcasted(chain_id, address, 8.into(), vec![8], 0);
+        assert_eq!(allocator.next_nonce(chain_id, address, 6.into()), 7.into());
+
+        // all the transactions are counted
+        assert_eq!(allocator.next_nonce(chain_id, address, 10.into()), 10.into());
+        assert!(allocator.in_flight.is_empty());
+    }
+}
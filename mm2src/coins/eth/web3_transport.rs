@@ -24,6 +24,15 @@ fn single_response<T: Deref<Target = [u8]>>(response: T) -> Result<Json, Error>
     }
 }
 
+/// The name of the RPC method to trace the request by.
+fn call_method(request: &Call) -> &str {
+    match request {
+        Call::MethodCall(call) => &call.method,
+        Call::Notification(notification) => &notification.method,
+        _ => "invalid",
+    }
+}
+
 #[derive(Clone, Debug)]
 pub struct Web3Transport {
     id: Arc<AtomicUsize>,
@@ -106,6 +115,7 @@ async fn send_request(
     uris: Vec<http::Uri>,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
 ) -> Result<Json, Error> {
+    let _span = trace_span!("web3", "{}", call_method(&request));
     use common::executor::Timer;
     use common::wio::slurp_reqʹ;
     use futures::future::{select, Either};
@@ -163,6 +173,7 @@ async fn send_request(
     uris: Vec<http::Uri>,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
 ) -> Result<Json, Error> {
+    let _span = trace_span!("web3", "{}", call_method(&request));
     let request_payload = to_string(&request);
 
     let mut transport_errors = Vec::new();
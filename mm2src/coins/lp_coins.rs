@@ -53,7 +53,8 @@ use std::fmt;
 use std::num::NonZeroUsize;
 use std::ops::Deref;
 use std::path::PathBuf;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex, Weak};
+use std::time::Duration;
 
 // using custom copy of try_fus as futures crate was renamed to futures01
 macro_rules! try_fus {
@@ -83,12 +84,13 @@ use eth::{eth_coin_from_conf_and_request, EthCoin, EthTxFeeDetails, SignedEthTx}
 
 pub mod utxo;
 use utxo::qtum::{self, qtum_coin_from_conf_and_request, QtumCoin};
+use utxo::rpc_clients::ElectrumClientImpl;
 use utxo::utxo_common::big_decimal_from_sat_unsigned;
 use utxo::utxo_standard::{utxo_standard_coin_from_conf_and_request, UtxoStandardCoin};
 use utxo::{GenerateTxError, UtxoFeeDetails, UtxoTx};
 
 pub mod qrc20;
-use qrc20::{qrc20_coin_from_conf_and_request, Qrc20Coin, Qrc20FeeDetails};
+use qrc20::{qrc20_coin_from_conf_and_request, PlatformTxCache, Qrc20Coin, Qrc20FeeDetails};
 
 #[doc(hidden)]
 #[allow(unused_variables)]
@@ -96,7 +98,7 @@ pub mod test_coin;
 pub use test_coin::TestCoin;
 
 pub mod tx_history_db;
-use tx_history_db::{TxHistoryDb, TxHistoryError, TxHistoryOps, TxHistoryResult};
+use tx_history_db::{PagingFrom, TxHistoryDb, TxHistoryError, TxHistoryOps, TxHistoryPage, TxHistoryResult};
 
 #[cfg(all(not(target_arch = "wasm32"), feature = "zhtlc"))]
 pub mod z_coin;
@@ -800,6 +802,33 @@ pub trait MmCoin: SwapOps + MarketCoinOps + fmt::Debug + Send + Sync + 'static {
         Box::new(fut.boxed().compat())
     }
 
+    /// Adds the new transactions to the tx history and replaces the ones with the same `internal_id`
+    /// without rewriting the whole history.
+    fn upsert_history_txs(&self, ctx: &MmArc, txs: Vec<TransactionDetails>) -> TxHistoryFut<()> {
+        let coins_ctx = CoinsContext::from_ctx(&ctx).unwrap();
+        let ticker = self.ticker().to_owned();
+        let my_address = self.my_address().unwrap_or_default();
+
+        let fut = async move {
+            let mut db = coins_ctx.tx_history_db().await?;
+            db.upsert_txs(&ticker, &my_address, txs).await
+        };
+        Box::new(fut.boxed().compat())
+    }
+
+    /// Loads the page of the tx history without loading the rest of it if the storage supports that.
+    fn load_history_page(&self, ctx: &MmArc, from: PagingFrom, limit: Option<usize>) -> TxHistoryFut<TxHistoryPage> {
+        let coins_ctx = CoinsContext::from_ctx(&ctx).unwrap();
+        let ticker = self.ticker().to_owned();
+        let my_address = self.my_address().unwrap_or_default();
+
+        let fut = async move {
+            let mut db = coins_ctx.tx_history_db().await?;
+            db.load_history_page(&ticker, &my_address, from, limit).await
+        };
+        Box::new(fut.boxed().compat())
+    }
+
     /// Transaction history background sync status
     fn history_sync_status(&self) -> HistorySyncState;
 
@@ -904,6 +933,10 @@ struct CoinsContext {
     /// The database has to be initialized only once!
     /// It's better to use something like [`Constructible`], but it doesn't provide a method to get the inner value by the mutable reference.
     tx_history_db: AsyncMutex<Option<TxHistoryDb>>,
+    /// The Electrum clients shared by the coins of the same chain, see `UtxoCoinBuilder::electrum_client`.
+    shared_electrum_clients: Mutex<HashMap<String, Arc<AsyncMutex<Weak<ElectrumClientImpl>>>>>,
+    /// The platform transactions shared by the QRC20 tokens of the same platform and address.
+    qrc20_platform_tx_caches: Mutex<HashMap<String, Weak<PlatformTxCache>>>,
 }
 impl CoinsContext {
     /// Obtains a reference to this crate context, creating it if necessary.
@@ -915,10 +948,38 @@ impl CoinsContext {
                 balance_update_handlers: AsyncMutex::new(vec![]),
                 tx_history_path,
                 tx_history_db: AsyncMutex::new(None),
+                shared_electrum_clients: Mutex::new(HashMap::new()),
+                qrc20_platform_tx_caches: Mutex::new(HashMap::new()),
             })
         })))
     }
 
+    /// Returns the slot of the Electrum client shared by the coins having the same `key`.
+    fn shared_electrum_client(&self, key: &str) -> Arc<AsyncMutex<Weak<ElectrumClientImpl>>> {
+        let mut clients = self.shared_electrum_clients.lock().unwrap();
+        // forget the clients of the disabled coins unless the slot is being awaited by an activation
+        clients.retain(|_, slot| {
+            Arc::strong_count(slot) > 1 || slot.try_lock().map_or(true, |client| client.strong_count() > 0)
+        });
+        clients
+            .entry(key.to_owned())
+            .or_insert_with(|| Arc::new(AsyncMutex::new(Weak::new())))
+            .clone()
+    }
+
+    /// Returns the platform transactions cache shared by the QRC20 tokens having the same `key`.
+    fn qrc20_platform_tx_cache(&self, key: &str) -> Arc<PlatformTxCache> {
+        let mut caches = self.qrc20_platform_tx_caches.lock().unwrap();
+        // forget the caches of the disabled tokens
+        caches.retain(|_, cache| cache.strong_count() > 0);
+        if let Some(cache) = caches.get(key).and_then(Weak::upgrade) {
+            return cache;
+        }
+        let cache = Arc::new(PlatformTxCache::default());
+        caches.insert(key.to_owned(), Arc::downgrade(&cache));
+        cache
+    }
+
     async fn tx_history_db(&self) -> TxHistoryResult<TxHistoryDbLocked<'_>> {
         /// # Panics
         ///
@@ -970,6 +1031,9 @@ pub trait RpcTransportEventHandler {
 
     fn on_incoming_response(&self, data: &[u8]);
 
+    /// Called on a successful response from the remote `address` received within `latency` after the request.
+    fn on_response_latency(&self, address: &str, latency: Duration);
+
     fn on_connected(&self, address: String) -> Result<(), String>;
 }
 
@@ -984,6 +1048,10 @@ impl RpcTransportEventHandler for RpcTransportEventHandlerShared {
 
     fn on_incoming_response(&self, data: &[u8]) { self.as_ref().on_incoming_response(data) }
 
+    fn on_response_latency(&self, address: &str, latency: Duration) {
+        self.as_ref().on_response_latency(address, latency)
+    }
+
     fn on_connected(&self, address: String) -> Result<(), String> { self.as_ref().on_connected(address) }
 }
 
@@ -1005,6 +1073,12 @@ impl<T: RpcTransportEventHandler> RpcTransportEventHandler for Vec<T> {
         }
     }
 
+    fn on_response_latency(&self, address: &str, latency: Duration) {
+        for handler in self {
+            handler.on_response_latency(address, latency)
+        }
+    }
+
     fn on_connected(&self, address: String) -> Result<(), String> {
         for handler in self {
             try_s!(handler.on_connected(address.clone()))
@@ -1068,6 +1142,11 @@ impl RpcTransportEventHandler for CoinTransportMetrics {
             "coin" => self.ticker.clone(), "client" => self.client.clone());
     }
 
+    fn on_response_latency(&self, address: &str, latency: Duration) {
+        mm_timing!(self.metrics, "rpc_client.response.latency", 0, latency.as_nanos() as u64,
+            "coin" => self.ticker.clone(), "client" => self.client.clone(), "server" => address.to_owned());
+    }
+
     fn on_connected(&self, _address: String) -> Result<(), String> {
         // Handle a new connected endpoint if necessary.
         // Now just return the Ok
@@ -1110,6 +1189,14 @@ pub fn is_wallet_only_ticker(ctx: &MmArc, ticker: &str) -> bool {
 ///
 /// * `req` - Payload of the corresponding "enable" or "electrum" RPC request.
 pub async fn lp_coininit(ctx: &MmArc, ticker: &str, req: &Json) -> Result<MmCoinEnum, String> {
+    let coin = try_s!(lp_coin_activate(ctx, ticker, req).await);
+    try_s!(lp_coin_spawn_loops(ctx, &coin, req));
+    Ok(coin)
+}
+
+/// Initializes the coin and adds it to the enabled coins.
+/// The background loops of the coin are not started, cf. `lp_coin_spawn_loops`.
+pub async fn lp_coin_activate(ctx: &MmArc, ticker: &str, req: &Json) -> Result<MmCoinEnum, String> {
     let cctx = try_s!(CoinsContext::from_ctx(ctx));
     {
         let coins = cctx.coins.lock().await;
@@ -1179,14 +1266,19 @@ pub async fn lp_coininit(ctx: &MmArc, ticker: &str, req: &Json) -> Result<MmCoin
         RawEntryMut::Occupied(_oe) => return ERR!("Coin {} already initialized", ticker),
         RawEntryMut::Vacant(ve) => ve.insert(ticker.to_string(), coin.clone()),
     };
+    Ok(coin)
+}
+
+/// Starts the tx history loop (if it's requested) and the balance update loop of the activated coin.
+pub fn lp_coin_spawn_loops(ctx: &MmArc, coin: &MmCoinEnum, req: &Json) -> Result<(), String> {
     let history = req["tx_history"].as_bool().unwrap_or(false);
     if history {
         try_s!(lp_spawn_tx_history(ctx.clone(), coin.clone()));
     }
-    let ticker = ticker.to_owned();
+    let ticker = coin.ticker().to_owned();
     let ctx_weak = ctx.weak();
     spawn(async move { check_balance_update_loop(ctx_weak, ticker).await });
-    Ok(coin)
+    Ok(())
 }
 
 #[cfg(not(target_arch = "wasm32"))]
@@ -1346,26 +1438,28 @@ pub async fn my_tx_history(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, S
         Err(err) => return ERR!("!lp_coinfind({}): {}", request.coin, err),
     };
 
-    let history = try_s!(coin.load_history_from_file(&ctx).compat().await);
-    let total_records = history.len();
-    let limit = if request.max { total_records } else { request.limit };
-
-    let block_number = try_s!(coin.current_block().compat().await);
-    let skip = match &request.from_id {
-        Some(id) => {
-            try_s!(history
-                .iter()
-                .position(|item| item.internal_id == *id)
-                .ok_or(format!("from_id {:02x} is not found", id)))
-                + 1
-        },
+    let from = match &request.from_id {
+        Some(id) => PagingFrom::FromId(id.clone()),
         None => match request.page_number {
-            Some(page_n) => (page_n.get() - 1) * request.limit,
-            None => 0,
+            Some(page_n) => PagingFrom::Skip((page_n.get() - 1) * request.limit),
+            None => PagingFrom::Skip(0),
         },
     };
+    let limit = if request.max { None } else { Some(request.limit) };
+    // only the requested page is loaded from the storage
+    let page = match coin.load_history_page(&ctx, from, limit).compat().await {
+        Ok(page) => page,
+        Err(e) => match e.get_inner() {
+            TxHistoryError::FromIdNotFound(error) => return ERR!("{}", error),
+            _ => return ERR!("{}", e),
+        },
+    };
+    let total_records = page.total;
+    let limit = limit.unwrap_or(total_records);
+    let skip = page.skipped;
 
-    let history = history.into_iter().skip(skip).take(limit);
+    let block_number = try_s!(coin.current_block().compat().await);
+    let history = page.transactions.into_iter();
     let history: Vec<Json> = history
         .map(|item| {
             let tx_block = item.block_height;
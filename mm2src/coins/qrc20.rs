@@ -8,10 +8,11 @@ use crate::utxo::utxo_common::{self, big_decimal_from_sat, check_all_inputs_sign
 use crate::utxo::{qtum, sign_tx, ActualTxFee, AdditionalTxData, FeePolicy, GenerateTxError, GenerateTxResult,
                   RecentlySpentOutPoints, UtxoCoinBuilder, UtxoCoinFields, UtxoCommonOps, UtxoTx,
                   VerboseTransactionFrom, UTXO_LOCK};
-use crate::{BalanceError, BalanceFut, CoinBalance, FeeApproxStage, FoundSwapTxSpend, HistorySyncState, MarketCoinOps,
-            MmCoin, NegotiateSwapContractAddrErr, SwapOps, TradeFee, TradePreimageError, TradePreimageFut,
-            TradePreimageResult, TradePreimageValue, TransactionDetails, TransactionEnum, TransactionFut,
-            ValidateAddressResult, WithdrawError, WithdrawFee, WithdrawFut, WithdrawRequest, WithdrawResult};
+use crate::{BalanceError, BalanceFut, CoinBalance, CoinsContext, FeeApproxStage, FoundSwapTxSpend, HistorySyncState,
+            MarketCoinOps, MmCoin, NegotiateSwapContractAddrErr, SwapOps, TradeFee, TradePreimageError,
+            TradePreimageFut, TradePreimageResult, TradePreimageValue, TransactionDetails, TransactionEnum,
+            TransactionFut, ValidateAddressResult, WithdrawError, WithdrawFee, WithdrawFut, WithdrawRequest,
+            WithdrawResult};
 use async_trait::async_trait;
 use bigdecimal::BigDecimal;
 use bitcrypto::{dhash160, sha256};
@@ -39,12 +40,14 @@ use script::{Builder as ScriptBuilder, Opcode, Script, TransactionInputSigner};
 use script_pubkey::generate_contract_call_script_pubkey;
 use serde_json::{self as json, Value as Json};
 use serialization::{deserialize, serialize, CoinVariant};
+use std::collections::{HashMap, HashSet};
 use std::ops::{Deref, Neg};
 #[cfg(not(target_arch = "wasm32"))] use std::path::PathBuf;
 use std::str::FromStr;
 use std::sync::Arc;
 
 mod history;
+pub use history::PlatformTxCache;
 #[cfg(test)] mod qrc20_tests;
 pub mod rpc_clients;
 mod script_pubkey;
@@ -122,12 +125,15 @@ impl UtxoCoinBuilder for Qrc20CoinBuilder<'_> {
         let swap_contract_address = try_s!(self.swap_contract_address());
         let fallback_swap_contract = try_s!(self.fallback_swap_contract());
         let utxo = try_s!(self.build_utxo_fields().await);
+        let coins_ctx = try_s!(CoinsContext::from_ctx(self.ctx));
+        let platform_tx_cache = coins_ctx.qrc20_platform_tx_cache(&format!("{} {}", self.platform, utxo.my_address));
         let inner = Qrc20CoinFields {
             utxo,
             platform: self.platform,
             contract_address: self.contract_address,
             swap_contract_address,
             fallback_swap_contract,
+            platform_tx_cache,
         };
         Ok(Qrc20Coin(Arc::new(inner)))
     }
@@ -211,6 +217,8 @@ pub struct Qrc20CoinFields {
     pub contract_address: H160,
     pub swap_contract_address: H160,
     pub fallback_swap_contract: Option<H160>,
+    /// The platform transactions shared with the other tokens of the `platform` to load the history.
+    pub platform_tx_cache: Arc<PlatformTxCache>,
 }
 
 #[derive(Clone, Debug)]
@@ -372,6 +380,12 @@ impl Qrc20Coin {
             .mm_err(|e| WithdrawError::from_generate_tx_error(e, platform, decimals))
             .map_err(|e| ERRL!("{}", e))?;
         let _tx = try_s!(self.utxo.rpc_client.send_transaction(&signed).compat().await);
+        // the token sends don't update the RecentlySpentOutPoints, the reservation keeps the next send off the spent outputs
+        self.utxo
+            .utxo_index
+            .lock()
+            .unwrap()
+            .reserve(signed.inputs.iter().map(|input| input.previous_output.clone()));
         Ok(signed.into())
     }
 
@@ -534,12 +548,12 @@ impl UtxoCommonOps for Qrc20Coin {
         utxo_common::ordered_mature_unspents(self, address).await
     }
 
-    fn get_verbose_transaction_from_cache_or_rpc(
+    fn get_verbose_transactions_from_cache_or_rpc(
         &self,
-        txid: H256Json,
-    ) -> Box<dyn Future<Item = VerboseTransactionFrom, Error = String> + Send> {
+        txids: HashSet<H256Json>,
+    ) -> Box<dyn Future<Item = HashMap<H256Json, VerboseTransactionFrom>, Error = String> + Send> {
         let selfi = self.clone();
-        let fut = async move { utxo_common::get_verbose_transaction_from_cache_or_rpc(&selfi.utxo, txid).await };
+        let fut = async move { utxo_common::get_verbose_transactions_from_cache_or_rpc(&selfi.utxo, txids).await };
         Box::new(fut.boxed().compat())
     }
 
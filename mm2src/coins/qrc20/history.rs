@@ -5,18 +5,93 @@ use crate::CoinsContext;
 use crate::TxFeeDetails;
 use byteorder::{BigEndian, ReadBytesExt, WriteBytesExt};
 use common::jsonrpc_client::JsonRpcErrorType;
+use common::lru_cache::LruCache;
 use common::mm_metrics::MetricsArc;
+use futures::lock::Mutex as AsyncMutex;
 use itertools::Itertools;
 use script_pubkey::{extract_contract_call_from_script, extract_gas_from_script, ExtractGasEnum};
 use std::cmp::Ordering;
 use std::collections::HashMap;
 use std::io::Cursor;
-use utxo_common::{HISTORY_TOO_LARGE_ERROR, HISTORY_TOO_LARGE_ERR_CODE};
+use std::sync::Mutex;
+use utxo_common::{InputTransactions, HISTORY_TOO_LARGE_ERROR, HISTORY_TOO_LARGE_ERR_CODE};
 
 type TxTransferMap = HashMap<TxInternalId, TransactionDetails>;
 type HistoryMapByHash = HashMap<H256Json, TxTransferMap>;
 type TxIds = Vec<(H256Json, u64)>;
 
+/// The number of the platform transactions cached by the `PlatformTxCache`.
+const MAX_CACHED_PLATFORM_TXS: usize = 2000;
+
+/// The receipts, the transaction and its input transactions of a confirmed transaction.
+/// They don't depend on the token, so the details are built of them by every token with its own ticker and decimals.
+#[derive(Debug)]
+pub struct PlatformTx {
+    receipts: Vec<TxReceipt>,
+    verbose_tx: RpcTransaction,
+    input_transactions: InputTransactions,
+}
+
+impl PlatformTx {
+    /// Returns the Qtum details of the transaction, the amounts and the fee are scaled by the `coin` decimals.
+    fn details(&self, coin: &Qrc20Coin) -> Result<TransactionDetails, String> {
+        utxo_common::tx_details_from_input_transactions(coin, &self.verbose_tx, &self.input_transactions)
+    }
+}
+
+/// The confirmed transactions shared by the history loops of the tokens of the same platform and address,
+/// so the receipts and the transactions are requested once however many tokens it transfers
+/// and however many tokens are enabled. The transfers of every token are still extracted by its own loop.
+#[derive(Debug)]
+pub struct PlatformTxCache {
+    txs: Mutex<LruCache<H256Json, Arc<PlatformTx>>>,
+    /// The locks of the transactions being requested, so the loops requesting the same transaction
+    /// concurrently wait for the first request instead of repeating it.
+    requests: Mutex<HashMap<H256Json, Arc<AsyncMutex<()>>>>,
+}
+
+impl Default for PlatformTxCache {
+    fn default() -> Self {
+        PlatformTxCache {
+            txs: Mutex::new(LruCache::new(MAX_CACHED_PLATFORM_TXS)),
+            requests: Mutex::new(HashMap::new()),
+        }
+    }
+}
+
+impl PlatformTxCache {
+    fn get(&self, tx_hash: &H256Json) -> Option<Arc<PlatformTx>> { self.txs.lock().unwrap().get(tx_hash).cloned() }
+
+    fn request_lock(&self, tx_hash: &H256Json) -> Arc<AsyncMutex<()>> {
+        let mut requests = self.requests.lock().unwrap();
+        requests.entry(tx_hash.clone()).or_default().clone()
+    }
+
+    /// Removes the lock of the finished request unless it's replaced already.
+    fn release_request_lock(&self, tx_hash: &H256Json, request_lock: &Arc<AsyncMutex<()>>) {
+        let mut requests = self.requests.lock().unwrap();
+        if requests
+            .get(tx_hash)
+            .map_or(false, |lock| Arc::ptr_eq(lock, request_lock))
+        {
+            requests.remove(tx_hash);
+        }
+    }
+
+    /// Caches the transaction if it's confirmed, the receipts and the transaction of the unconfirmed one will change.
+    fn insert(&self, tx_hash: H256Json, tx: PlatformTx) -> Arc<PlatformTx> {
+        let is_confirmed = tx.verbose_tx.height.unwrap_or(0) > 0
+            && tx.verbose_tx.time > 0
+            && !tx.receipts.is_empty()
+            && tx.receipts.iter().all(|receipt| receipt.block_number > 0);
+        let tx = Arc::new(tx);
+        if is_confirmed {
+            self.txs.lock().unwrap().insert(tx_hash, tx.clone());
+        }
+        tx
+    }
+}
+
 #[derive(Clone, Debug, Eq, Hash, Ord, PartialEq, PartialOrd)]
 pub struct TxInternalId {
     tx_hash: H256Json,
@@ -199,10 +274,51 @@ impl Qrc20Coin {
         }
     }
 
+    /// Returns the receipts and the Qtum transaction, they're requested once for all the tokens.
+    /// The concurrent requests of the same transaction wait for the first one.
+    /// The unconfirmed transaction is not cached, so it's requested again by every waiting request.
+    async fn platform_tx(&self, tx_hash: &H256Json) -> Result<Arc<PlatformTx>, String> {
+        if let Some(tx) = self.platform_tx_cache.get(tx_hash) {
+            return Ok(tx);
+        }
+
+        let request_lock = self.platform_tx_cache.request_lock(tx_hash);
+        let request_guard = request_lock.lock().await;
+        // the transaction could be cached by another token while waiting
+        let result = match self.platform_tx_cache.get(tx_hash) {
+            Some(tx) => Ok(tx),
+            None => self.request_platform_tx(tx_hash).await,
+        };
+        drop(request_guard);
+        self.platform_tx_cache.release_request_lock(tx_hash, &request_lock);
+        result
+    }
+
+    async fn request_platform_tx(&self, tx_hash: &H256Json) -> Result<Arc<PlatformTx>, String> {
+        let receipts = try_s!(self.utxo.rpc_client.get_transaction_receipts(tx_hash).compat().await);
+        // request Qtum transaction and its inputs to get a tx_hex, timestamp, block_height and calculate a miner_fee
+        let verbose_tx = try_s!(
+            self.utxo
+                .rpc_client
+                .get_verbose_transaction(tx_hash.clone())
+                .compat()
+                .await
+        );
+        let mut qtum_tx: UtxoTx = try_s!(deserialize(verbose_tx.hex.as_slice()).map_err(|e| ERRL!("{:?}", e)));
+        qtum_tx.tx_hash_algo = self.utxo.tx_hash_algo;
+        let input_transactions = try_s!(utxo_common::input_transactions(self, &qtum_tx).await);
+        let tx = PlatformTx {
+            receipts,
+            verbose_tx,
+            input_transactions,
+        };
+        Ok(self.platform_tx_cache.insert(tx_hash.clone(), tx))
+    }
+
     pub async fn transfer_details_by_hash(&self, tx_hash: H256Json) -> Result<TxTransferMap, String> {
-        let receipts = try_s!(self.utxo.rpc_client.get_transaction_receipts(&tx_hash).compat().await);
-        // request Qtum transaction details to get a tx_hex, timestamp, block_height and calculate a miner_fee
-        let qtum_details = try_s!(utxo_common::tx_details_by_hash(self, &tx_hash.0).await);
+        let platform_tx = try_s!(self.platform_tx(&tx_hash).await);
+        let receipts = &platform_tx.receipts;
+        let qtum_details = try_s!(platform_tx.details(self));
         // Deserialize the UtxoTx to get a script pubkey
         let qtum_tx: UtxoTx = try_s!(deserialize(qtum_details.tx_hex.as_slice()).map_err(|e| ERRL!("{:?}", e)));
 
@@ -231,7 +347,7 @@ impl Qrc20Coin {
         &self,
         qtum_tx: &UtxoTx,
         qtum_details: &TransactionDetails,
-        receipt: TxReceipt,
+        receipt: &TxReceipt,
         miner_fee: BigDecimal,
     ) -> Result<TxTransferMap, String> {
         let tx_hash: H256Json = qtum_details.tx_hash.as_slice().into();
@@ -262,7 +378,7 @@ impl Qrc20Coin {
         };
 
         let mut details = TxTransferMap::new();
-        for (log_index, log_entry) in receipt.log.into_iter().enumerate() {
+        for (log_index, log_entry) in receipt.log.iter().enumerate() {
             if log_entry.topics.len() != 3 {
                 continue;
             }
@@ -276,7 +392,7 @@ impl Qrc20Coin {
             }
 
             let (total_amount, from, to) = {
-                let event = try_s!(transfer_event_from_log(&log_entry));
+                let event = try_s!(transfer_event_from_log(log_entry));
                 // https://github.com/qtumproject/qtum-electrum/blob/v4.0.2/electrum/wallet.py#L2093
                 if event.contract_address != self.contract_address {
                     // contract address mismatch
@@ -411,6 +527,9 @@ impl Qrc20Coin {
         transfer_map: &mut TxTransferMap,
     ) -> ProcessCachedTransferMapResult {
         async fn tx_details_by_hash(coin: &Qrc20Coin, ctx: &MmArc, tx_hash: &H256Json) -> Option<TransactionDetails> {
+            if let Some(platform_tx) = coin.platform_tx_cache.get(tx_hash) {
+                return platform_tx.details(coin).ok();
+            }
             mm_counter!(ctx.metrics, "tx.history.request.count", 1, "coin" => coin.utxo.conf.ticker.clone(), "method" => "tx_detail_by_hash");
             match utxo_common::tx_details_by_hash(coin, &tx_hash.0).await {
                 Ok(d) => {
@@ -821,6 +940,149 @@ mod tests {
         assert_eq!(actual_id, expected_id);
     }
 
+    #[test]
+    fn test_platform_tx_cache() {
+        fn platform_tx(block_height: u64) -> PlatformTx {
+            let receipt = json::from_value(json!({
+                "blockHash": "d1e1a9a1f4ae3e73e5ad7ac7e8262cf2ba54fed0fc105a2444e3ea5cf08d1b20",
+                "blockNumber": block_height,
+                "transactionHash": "85ede12ccc12fb1709c4d9e403e96c0c394b0916f2f6098d41d8dfa00013fcdb",
+                "transactionIndex": 7,
+                "outputIndex": 0,
+                "from": "1549128bbfb33b997949b4105b6a6371c998e212",
+                "cumulativeGasUsed": 39429,
+                "gasUsed": 39429,
+                "log": [],
+                "excepted": "None",
+                "exceptedMessage": ""
+            }))
+            .unwrap();
+            let verbose_tx = json::from_value(json!({
+                "hex": "00",
+                "txid": "85ede12ccc12fb1709c4d9e403e96c0c394b0916f2f6098d41d8dfa00013fcdb",
+                "version": 2,
+                "locktime": 0,
+                "vin": [],
+                "vout": [],
+                "time": 1602997840,
+                "height": block_height,
+            }))
+            .unwrap();
+            PlatformTx {
+                receipts: vec![receipt],
+                verbose_tx,
+                input_transactions: InputTransactions::new(),
+            }
+        }
+
+        let cache = PlatformTxCache::default();
+        // the unconfirmed transaction is not cached
+        cache.insert(H256Json::from([0; 32]), platform_tx(0));
+        assert!(cache.get(&H256Json::from([0; 32])).is_none());
+
+        for i in 0..=MAX_CACHED_PLATFORM_TXS {
+            let mut tx_hash = [0; 32];
+            tx_hash[..8].copy_from_slice(&(i as u64).to_le_bytes());
+            cache.insert(tx_hash.into(), platform_tx(699545));
+        }
+        assert_eq!(cache.txs.lock().unwrap().len(), MAX_CACHED_PLATFORM_TXS);
+        // the least recently used transaction is evicted
+        assert!(cache.get(&H256Json::from([0; 32])).is_none());
+        let mut last_tx_hash = [0; 32];
+        last_tx_hash[..8].copy_from_slice(&(MAX_CACHED_PLATFORM_TXS as u64).to_le_bytes());
+        let cached = cache.get(&last_tx_hash.into()).unwrap();
+        assert_eq!(cached.verbose_tx.height, Some(699545));
+        assert_eq!(cached.receipts[0].block_number, 699545);
+    }
+
+    #[test]
+    fn test_platform_tx_request_lock() {
+        let cache = PlatformTxCache::default();
+        let tx_hash = H256Json::from([1; 32]);
+        let request_lock = cache.request_lock(&tx_hash);
+        let guard = block_on(request_lock.lock());
+        // the concurrent request of the same transaction waits for the first one
+        let waiting_lock = cache.request_lock(&tx_hash);
+        assert!(Arc::ptr_eq(&request_lock, &waiting_lock));
+        assert!(waiting_lock.try_lock().is_none());
+        assert!(cache.request_lock(&H256Json::from([2; 32])).try_lock().is_some());
+
+        drop(guard);
+        cache.release_request_lock(&tx_hash, &request_lock);
+        assert!(!cache.requests.lock().unwrap().contains_key(&tx_hash));
+        // the lock is not removed by the request holding the replaced one
+        let new_lock = cache.request_lock(&tx_hash);
+        cache.release_request_lock(&tx_hash, &waiting_lock);
+        assert!(Arc::ptr_eq(&cache.requests.lock().unwrap()[&tx_hash], &new_lock));
+    }
+
+    #[test]
+    fn test_platform_tx_shared_by_tokens_with_different_decimals() {
+        // priv_key of qXxsj5RtciAby9T7m98AgAATL4zTi4UwDG
+        let priv_key = [
+            3, 98, 177, 3, 108, 39, 234, 144, 131, 178, 103, 103, 127, 80, 230, 166, 53, 68, 147, 215, 42, 216, 144,
+            72, 172, 110, 180, 13, 123, 179, 10, 49,
+        ];
+        let (ctx, coin) = qrc20_coin_for_test(&priv_key, None);
+        let conf = json!({
+            "coin":"QRC20_6",
+            "decimals": 6,
+            "required_confirmations":0,
+            "pubtype":120,
+            "p2shtype":110,
+            "wiftype":128,
+            "segwit":true,
+            "mm2":1,
+            "mature_confirmations":2000,
+            "dust":72800,
+        });
+        let req = json!({
+            "method": "electrum",
+            "servers": [{"url":"95.217.83.126:10001"}],
+            "swap_contract_address": "0xba8b71f3544b93e2f681f996da519a98ace0107a",
+        });
+        let contract_address = "0xd362e096e873eb7907e205fadc6175c6fec7bc44".into();
+        let coin_6 = block_on(qrc20_coin_from_conf_and_request(
+            &ctx,
+            "QRC20_6",
+            "QTUM",
+            &conf,
+            &req,
+            &priv_key,
+            contract_address,
+        ))
+        .unwrap();
+        assert!(Arc::ptr_eq(&coin.platform_tx_cache, &coin_6.platform_tx_cache));
+
+        let tx_hash: H256Json = hex::decode("85ede12ccc12fb1709c4d9e403e96c0c394b0916f2f6098d41d8dfa00013fcdb")
+            .unwrap()
+            .as_slice()
+            .into();
+        let transfer_map = block_on(coin.transfer_details_by_hash(tx_hash.clone())).unwrap();
+        assert!(coin.platform_tx_cache.get(&tx_hash).is_some());
+        // the details are built of the cached transaction by the token with its own ticker and decimals
+        let transfer_map_6 = block_on(coin_6.transfer_details_by_hash(tx_hash)).unwrap();
+        assert!(!transfer_map.is_empty());
+        assert_eq!(transfer_map.len(), transfer_map_6.len());
+
+        let scale = BigDecimal::from(100);
+        for (id, details) in transfer_map {
+            let details_6 = transfer_map_6.get(&id).unwrap();
+            assert_eq!(details.coin, "QRC20");
+            assert_eq!(details_6.coin, "QRC20_6");
+            assert_eq!(details_6.total_amount, &details.total_amount * &scale);
+            assert_eq!(details_6.tx_hex, details.tx_hex);
+            assert_eq!(details_6.timestamp, details.timestamp);
+
+            let (fee, fee_6) = match (details.fee_details, details_6.fee_details.clone()) {
+                (Some(TxFeeDetails::Qrc20(fee)), Some(TxFeeDetails::Qrc20(fee_6))) => (fee, fee_6),
+                fees => panic!("Unexpected fee details {:?}", fees),
+            };
+            assert_eq!(fee_6.miner_fee, &fee.miner_fee * &scale);
+            assert_eq!(fee_6.total_gas_fee, &fee.total_gas_fee * &scale);
+        }
+    }
+
     #[test]
     fn test_process_cached_tx_transfer_map_update_is_not_needed() {
         // priv_key of qXxsj5RtciAby9T7m98AgAATL4zTi4UwDG
@@ -343,9 +343,15 @@ impl Qrc20Coin {
     ) -> Result<(), String> {
         try_s!(
             self.utxo
-                .rpc_client
-                .wait_for_confirmations(&qtum_tx, confirmations as u32, requires_nota, wait_until, check_every)
-                .compat()
+                .chain_watcher
+                .wait_for_confirmations(
+                    &self.utxo.rpc_client,
+                    qtum_tx.clone(),
+                    confirmations as u32,
+                    requires_nota,
+                    wait_until,
+                    check_every
+                )
                 .await
         );
         let tx_hash = qtum_tx.hash().reversed().into();
@@ -2,6 +2,9 @@ use crate::TransactionDetails;
 use async_trait::async_trait;
 use common::mm_error::prelude::*;
 use derive_more::Display;
+use rpc::v1::types::Bytes as BytesJson;
+use std::cmp::Reverse;
+use std::collections::HashMap;
 use std::path::PathBuf;
 
 #[cfg(not(target_arch = "wasm32"))]
@@ -17,10 +20,86 @@ pub enum TxHistoryError {
     ErrorSaving(String),
     ErrorLoading(String),
     ErrorClearing(String),
+    FromIdNotFound(String),
     NotSupported(String),
     InternalError(String),
 }
 
+/// The position the history page starts from.
+#[derive(Debug)]
+pub enum PagingFrom {
+    /// Skip the transactions up to the one with the given `internal_id` (skipping it too).
+    FromId(BytesJson),
+    /// Skip the given number of transactions.
+    Skip(usize),
+}
+
+#[derive(Debug)]
+pub struct TxHistoryPage {
+    pub transactions: Vec<TransactionDetails>,
+    /// The number of skipped transactions.
+    pub skipped: usize,
+    /// The total number of transactions in the history.
+    pub total: usize,
+}
+
+/// The key the history is ordered by: from the newest to the oldest transactions, the unconfirmed ones go first.
+/// The transactions of the same block are ordered by `internal_id`, e.g. the QRC20 transfers of one transaction.
+type HistoryOrderKey = (Reverse<u64>, Vec<u8>);
+
+fn history_order_key(block_height: u64, internal_id: &[u8]) -> HistoryOrderKey {
+    let height = if block_height == 0 { u64::MAX } else { block_height };
+    (Reverse(height), internal_id.to_vec())
+}
+
+fn tx_order_key(tx: &TransactionDetails) -> HistoryOrderKey { history_order_key(tx.block_height, &tx.internal_id) }
+
+/// Replaces the transactions of the `history` with the same `internal_id` and adds the rest of the `txs`.
+fn upsert_into_history(history: &mut Vec<TransactionDetails>, txs: Vec<TransactionDetails>) {
+    let mut positions: HashMap<BytesJson, usize> = history
+        .iter()
+        .enumerate()
+        .map(|(i, tx)| (tx.internal_id.clone(), i))
+        .collect();
+    for tx in txs {
+        match positions.get(&tx.internal_id) {
+            Some(i) => history[*i] = tx,
+            None => {
+                positions.insert(tx.internal_id.clone(), history.len());
+                history.push(tx);
+            },
+        }
+    }
+    history.sort_by_cached_key(tx_order_key);
+}
+
+/// Returns the page of the `history` sorted by `tx_order_key`.
+fn history_page(
+    history: Vec<TransactionDetails>,
+    from: PagingFrom,
+    limit: Option<usize>,
+) -> TxHistoryResult<TxHistoryPage> {
+    let total = history.len();
+    let skipped = match from {
+        PagingFrom::FromId(id) => match history.iter().position(|tx| tx.internal_id == id) {
+            Some(position) => position + 1,
+            None => {
+                return MmError::err(TxHistoryError::FromIdNotFound(format!(
+                    "from_id {:02x} is not found",
+                    id
+                )))
+            },
+        },
+        PagingFrom::Skip(skip) => skip,
+    };
+    let transactions = history.into_iter().skip(skipped).take(limit.unwrap_or(total)).collect();
+    Ok(TxHistoryPage {
+        transactions,
+        skipped,
+        total,
+    })
+}
+
 #[async_trait]
 pub trait TxHistoryOps {
     async fn init_with_fs_path(db_dir: PathBuf) -> TxHistoryResult<TxHistoryDb>;
@@ -34,19 +113,70 @@ pub trait TxHistoryOps {
         txs: Vec<TransactionDetails>,
     ) -> TxHistoryResult<()>;
 
+    /// Adds the new transactions to the history and replaces the ones with the same `internal_id`.
+    async fn upsert_txs(
+        &mut self,
+        ticker: &str,
+        wallet_address: &str,
+        txs: Vec<TransactionDetails>,
+    ) -> TxHistoryResult<()> {
+        let mut history = self.load_history(ticker, wallet_address).await?;
+        upsert_into_history(&mut history, txs);
+        self.save_history(ticker, wallet_address, history).await
+    }
+
+    /// Loads no more than `limit` transactions (all if `None`) starting from the `from` position.
+    async fn load_history_page(
+        &mut self,
+        ticker: &str,
+        wallet_address: &str,
+        from: PagingFrom,
+        limit: Option<usize>,
+    ) -> TxHistoryResult<TxHistoryPage> {
+        let history = self.load_history(ticker, wallet_address).await?;
+        history_page(history, from, limit)
+    }
+
     async fn clear(&mut self, ticker: &str, wallet_address: &str) -> TxHistoryResult<()>;
 }
 
+/// The history of every coin address is stored in an append-only file `<TICKER>_<ADDRESS>.txhistory`.
+///
+/// The record layout is
+/// `[payload len: u32 LE][block height: u64 LE][internal_id len: u16 LE][CRC32: u32 LE][internal_id][payload]`,
+/// where the payload is the binary-encoded `TransactionDetails` and the CRC32 is of the block height,
+/// the internal_id and the payload. The index by `internal_id` and the order of the history are built
+/// on the first access, so the page of the history is loaded without decoding the rest of it.
+/// The file is truncated at the first torn or corrupted record. The appended records are synced to the disk.
+/// A record of an already stored `internal_id` supersedes the previous one,
+/// the file is compacted on the open if the superseded records outweigh the actual ones.
+///
+/// The file I/O runs on the blocking thread pool, so it doesn't stall the executor.
+/// The legacy JSON history `<TICKER>_<ADDRESS>.json` is moved to the file on the first access.
 #[cfg(not(target_arch = "wasm32"))]
 mod native_db {
     use super::*;
-    use async_std::fs;
-    use futures::AsyncWriteExt;
+    use bigdecimal::BigDecimal;
+    use common::executor::spawn_blocking;
     use serde_json as json;
-    use std::io;
+    use std::collections::{BTreeSet, HashMap};
+    use std::convert::TryInto;
+    use std::fs::{self, File, OpenOptions};
+    use std::io::{self, BufReader, Read, Seek, SeekFrom, Write};
+    use std::ops::Bound;
+    use std::path::Path;
+    use std::str::FromStr;
+
+    const RECORD_HEADER_LEN: u64 = 4 + 8 + 2 + 4;
+    /// Don't compact the file until the superseded records occupy at least this number of bytes.
+    const MIN_COMPACTION_BYTES: u64 = 1024 * 1024;
+    /// The version of the `TransactionDetails` binary encoding, the first byte of every payload.
+    const ENCODING_VERSION: u8 = 1;
 
     pub struct TxHistoryDb {
         tx_history_path: PathBuf,
+        /// The opened histories by their file paths.
+        stores: HashMap<PathBuf, HistoryStore>,
     }
 
     #[async_trait]
@@ -54,6 +184,7 @@ mod native_db {
         async fn init_with_fs_path(db_dir: PathBuf) -> TxHistoryResult<TxHistoryDb> {
             Ok(TxHistoryDb {
                 tx_history_path: db_dir,
+                stores: HashMap::new(),
             })
         }
 
@@ -62,49 +193,66 @@ mod native_db {
             ticker: &str,
             wallet_address: &str,
         ) -> TxHistoryResult<Vec<TransactionDetails>> {
-            let path = self.ticker_history_path(ticker, wallet_address);
-            let content = match fs::read(&path).await {
-                Ok(content) => content,
-                Err(err) if err.kind() == io::ErrorKind::NotFound => {
-                    return Ok(Vec::new());
-                },
-                Err(err) => {
-                    let error = format!("Error '{}' reading from the history file {}", err, path.display());
-                    return MmError::err(TxHistoryError::ErrorLoading(error));
-                },
-            };
-            json::from_slice(&content).map_to_mm(|e| TxHistoryError::ErrorDeserializing(e.to_string()))
+            let page = self
+                .load_history_page(ticker, wallet_address, PagingFrom::Skip(0), None)
+                .await?;
+            Ok(page.transactions)
         }
 
+        /// Replaces the whole history with the `txs`.
         async fn save_history(
             &mut self,
             ticker: &str,
             wallet_address: &str,
             txs: Vec<TransactionDetails>,
         ) -> TxHistoryResult<()> {
-            let content = json::to_vec(&txs).map_to_mm(|e| TxHistoryError::ErrorSerializing(e.to_string()))?;
             let path = self.ticker_history_path(ticker, wallet_address);
-
-            let tmp_file = format!("{}.tmp", path.display());
-            let fut = async {
-                let mut file = fs::File::create(&tmp_file).await?;
-                file.write_all(&content).await?;
-                file.flush().await?;
-                fs::rename(&tmp_file, &path).await?;
-                Ok(())
-            };
-            let res: io::Result<_> = fut.await;
-            if let Err(e) = res {
-                let error = format!("Error '{}' creating/writing/renaming the tmp file {}", e, tmp_file);
-                return MmError::err(TxHistoryError::ErrorSaving(error));
-            }
+            self.stores.remove(&path);
+            let (path, store) = spawn_blocking(move || -> TxHistoryResult<_> {
+                write_history_file(&path, &txs).map_to_mm(TxHistoryError::ErrorSaving)?;
+                let store = HistoryStore::open(&path).map_to_mm(TxHistoryError::ErrorLoading)?;
+                Ok((path, store))
+            })
+            .await?;
+            self.stores.insert(path, store);
             Ok(())
         }
 
-        async fn clear(&mut self, ticker: &str, wallet_address: &str) -> TxHistoryResult<()> {
-            fs::remove_file(&self.ticker_history_path(ticker, wallet_address))
+        async fn upsert_txs(
+            &mut self,
+            ticker: &str,
+            wallet_address: &str,
+            txs: Vec<TransactionDetails>,
+        ) -> TxHistoryResult<()> {
+            self.with_store(ticker, wallet_address, move |store| store.append(&txs))
+                .await
+        }
+
+        async fn load_history_page(
+            &mut self,
+            ticker: &str,
+            wallet_address: &str,
+            from: PagingFrom,
+            limit: Option<usize>,
+        ) -> TxHistoryResult<TxHistoryPage> {
+            self.with_store(ticker, wallet_address, move |store| store.load_page(from, limit))
                 .await
-                .map_to_mm(|e| TxHistoryError::ErrorClearing(e.to_string()))
+        }
+
+        async fn clear(&mut self, ticker: &str, wallet_address: &str) -> TxHistoryResult<()> {
+            let path = self.ticker_history_path(ticker, wallet_address);
+            self.stores.remove(&path);
+            spawn_blocking(move || {
+                for path in [path.clone(), path.with_extension("json")].iter() {
+                    match fs::remove_file(path) {
+                        Ok(()) => (),
+                        Err(e) if e.kind() == io::ErrorKind::NotFound => (),
+                        Err(e) => return MmError::err(TxHistoryError::ErrorClearing(e.to_string())),
+                    }
+                }
+                Ok(())
+            })
+            .await
         }
     }
 
@@ -113,8 +261,575 @@ mod native_db {
             // BCH cash address format has colon after prefix, e.g. bitcoincash:
             // Colon can't be used in file names on Windows so it should be escaped
             let wallet_address = wallet_address.replace(":", "_");
-            self.tx_history_path.join(format!("{}_{}.json", ticker, wallet_address))
+            self.tx_history_path
+                .join(format!("{}_{}.txhistory", ticker, wallet_address))
+        }
+
+        /// Runs the `f` with the store on the blocking thread pool.
+        /// The history is opened on the first access moving the legacy JSON history to the store.
+        async fn with_store<R, F>(&mut self, ticker: &str, wallet_address: &str, f: F) -> TxHistoryResult<R>
+        where
+            R: Send + 'static,
+            F: FnOnce(&mut HistoryStore) -> TxHistoryResult<R> + Send + 'static,
+        {
+            let path = self.ticker_history_path(ticker, wallet_address);
+            // the store is opened again on the next access if the future is dropped
+            let store = self.stores.remove(&path);
+            let (path, store, result) = spawn_blocking(move || {
+                let mut store = match store {
+                    Some(store) => store,
+                    None => match open_store(&path) {
+                        Ok(store) => store,
+                        Err(e) => return (path, None, Err(e)),
+                    },
+                };
+                let result = f(&mut store);
+                (path, Some(store), result)
+            })
+            .await;
+            if let Some(store) = store {
+                self.stores.insert(path, store);
+            }
+            result
+        }
+    }
+
+    fn open_store(path: &Path) -> TxHistoryResult<HistoryStore> {
+        migrate_legacy_history(path)?;
+        HistoryStore::open(path).map_to_mm(TxHistoryError::ErrorLoading)
+    }
+
+    fn migrate_legacy_history(path: &Path) -> TxHistoryResult<()> {
+        let legacy_path = path.with_extension("json");
+        let content = match fs::read(&legacy_path) {
+            Ok(content) => content,
+            Err(e) if e.kind() == io::ErrorKind::NotFound => return Ok(()),
+            Err(e) => {
+                let error = format!("Error '{}' reading from the history file {}", e, legacy_path.display());
+                return MmError::err(TxHistoryError::ErrorLoading(error));
+            },
+        };
+        let mut txs: Vec<TransactionDetails> =
+            json::from_slice(&content).map_to_mm(|e| TxHistoryError::ErrorDeserializing(e.to_string()))?;
+        txs.sort_by_cached_key(tx_order_key);
+        write_history_file(path, &txs).map_to_mm(TxHistoryError::ErrorSaving)?;
+        fs::remove_file(&legacy_path).map_to_mm(|e| TxHistoryError::ErrorSaving(e.to_string()))
+    }
+
+    /// Writes the records of the `txs` to a temporary file that replaces the history file then.
+    fn write_history_file(path: &Path, txs: &[TransactionDetails]) -> Result<(), String> {
+        let tmp_path = path.with_extension("tmp");
+        let mut content = Vec::new();
+        for tx in txs {
+            content.extend_from_slice(&try_s!(encode_record(tx)));
+        }
+        let mut tmp_file = try_s!(File::create(&tmp_path));
+        try_s!(tmp_file.write_all(&content));
+        try_s!(tmp_file.sync_all());
+        try_s!(fs::rename(tmp_path, path));
+        Ok(())
+    }
+
+    #[derive(Clone, Copy)]
+    struct RecordPosition {
+        payload_offset: u64,
+        payload_len: u32,
+        block_height: u64,
+        checksum: u32,
+    }
+
+    impl RecordPosition {
+        fn record_len(&self, internal_id_len: usize) -> u64 {
+            RECORD_HEADER_LEN + internal_id_len as u64 + self.payload_len as u64
+        }
+    }
+
+    struct HistoryStore {
+        file: File,
+        /// The latest records by `internal_id`.
+        index: HashMap<Vec<u8>, RecordPosition>,
+        /// The history order, see `history_order_key`.
+        order: BTreeSet<HistoryOrderKey>,
+        /// The length of the valid file part, the records are appended there.
+        file_len: u64,
+    }
+
+    impl HistoryStore {
+        fn open(path: &Path) -> Result<HistoryStore, String> {
+            let mut store = try_s!(Self::open_no_compaction(path));
+            let actual_len = store.actual_records_len();
+            let superseded_len = store.file_len - actual_len;
+            if superseded_len >= MIN_COMPACTION_BYTES && superseded_len > actual_len {
+                match store.compact(path) {
+                    Ok(()) => store = try_s!(Self::open_no_compaction(path)),
+                    // the store is still usable
+                    Err(e) => log!("Error " (e) " compacting " [path]),
+                }
+            }
+            Ok(store)
+        }
+
+        fn open_no_compaction(path: &Path) -> Result<HistoryStore, String> {
+            let file = try_s!(OpenOptions::new().read(true).write(true).create(true).open(path));
+            let total_len = try_s!(file.metadata()).len();
+
+            let mut store = HistoryStore {
+                file,
+                index: HashMap::new(),
+                order: BTreeSet::new(),
+                file_len: 0,
+            };
+            {
+                // the records are read sequentially to verify their checksums
+                let mut reader = BufReader::new(try_s!(store.file.try_clone()));
+                let mut header = [0; RECORD_HEADER_LEN as usize];
+                let mut payload = Vec::new();
+                while store.file_len + RECORD_HEADER_LEN <= total_len {
+                    try_s!(reader.read_exact(&mut header));
+                    let payload_len = u32::from_le_bytes(header[..4].try_into().expect("4 bytes"));
+                    let block_height = u64::from_le_bytes(header[4..12].try_into().expect("8 bytes"));
+                    let internal_id_len = u16::from_le_bytes(header[12..14].try_into().expect("2 bytes"));
+                    let checksum = u32::from_le_bytes(header[14..].try_into().expect("4 bytes"));
+                    let payload_offset = store.file_len + RECORD_HEADER_LEN + internal_id_len as u64;
+                    if payload_offset + payload_len as u64 > total_len {
+                        break;
+                    }
+
+                    let mut internal_id = vec![0; internal_id_len as usize];
+                    try_s!(reader.read_exact(&mut internal_id));
+                    payload.resize(payload_len as usize, 0);
+                    try_s!(reader.read_exact(&mut payload));
+                    if record_checksum(block_height, &internal_id, &payload) != checksum {
+                        break;
+                    }
+                    store.insert_position(internal_id, RecordPosition {
+                        payload_offset,
+                        payload_len,
+                        block_height,
+                        checksum,
+                    });
+                    store.file_len = payload_offset + payload_len as u64;
+                }
+            }
+
+            if store.file_len < total_len {
+                // the last record was not written completely or the record is corrupted
+                log!("Truncating " (total_len - store.file_len) " bytes of the torn or corrupted records at " [path]);
+                try_s!(store.file.set_len(store.file_len));
+                try_s!(store.file.sync_data());
+            }
+            Ok(store)
+        }
+
+        fn insert_position(&mut self, internal_id: Vec<u8>, position: RecordPosition) {
+            if let Some(prev) = self.index.get(&internal_id) {
+                self.order.remove(&history_order_key(prev.block_height, &internal_id));
+            }
+            self.order
+                .insert(history_order_key(position.block_height, &internal_id));
+            self.index.insert(internal_id, position);
         }
+
+        fn actual_records_len(&self) -> u64 {
+            self.index.iter().fold(0, |len, (internal_id, position)| {
+                len + position.record_len(internal_id.len())
+            })
+        }
+
+        /// Rewrites the actual records only in the history order.
+        fn compact(&mut self, path: &Path) -> Result<(), String> {
+            let mut txs = Vec::with_capacity(self.order.len());
+            for (_, internal_id) in self.order.clone() {
+                txs.push(try_s!(self.read_tx(&internal_id)));
+            }
+            write_history_file(path, &txs)
+        }
+
+        fn read_tx(&mut self, internal_id: &[u8]) -> Result<TransactionDetails, String> {
+            let position = match self.index.get(internal_id) {
+                Some(position) => *position,
+                None => return ERR!("No record of {}", hex::encode(internal_id)),
+            };
+            let mut payload = vec![0; position.payload_len as usize];
+            try_s!(self.file.seek(SeekFrom::Start(position.payload_offset)));
+            try_s!(self.file.read_exact(&mut payload));
+            if record_checksum(position.block_height, internal_id, &payload) != position.checksum {
+                return ERR!("The record of {} is corrupted", hex::encode(internal_id));
+            }
+            decode_tx(&payload)
+        }
+
+        fn load_page(&mut self, from: PagingFrom, limit: Option<usize>) -> TxHistoryResult<TxHistoryPage> {
+            let total = self.order.len();
+            let limit = limit.unwrap_or(total);
+            let (skipped, keys): (usize, Vec<HistoryOrderKey>) = match from {
+                PagingFrom::FromId(id) => {
+                    let key = match self.index.get(&id.0) {
+                        Some(position) => history_order_key(position.block_height, &id.0),
+                        None => {
+                            let error = format!("from_id {:02x} is not found", id);
+                            return MmError::err(TxHistoryError::FromIdNotFound(error));
+                        },
+                    };
+                    let skipped = self.order.range(..&key).count() + 1;
+                    let keys = self
+                        .order
+                        .range((Bound::Excluded(&key), Bound::Unbounded))
+                        .take(limit)
+                        .cloned()
+                        .collect();
+                    (skipped, keys)
+                },
+                PagingFrom::Skip(skip) => (skip, self.order.iter().skip(skip).take(limit).cloned().collect()),
+            };
+
+            let mut transactions = Vec::with_capacity(keys.len());
+            for (_, internal_id) in keys {
+                let tx = self
+                    .read_tx(&internal_id)
+                    .map_to_mm(TxHistoryError::ErrorDeserializing)?;
+                transactions.push(tx);
+            }
+            Ok(TxHistoryPage {
+                transactions,
+                skipped,
+                total,
+            })
+        }
+
+        /// Appends the records of the `txs` superseding the records with the same `internal_id`.
+        fn append(&mut self, txs: &[TransactionDetails]) -> TxHistoryResult<()> {
+            let mut content = Vec::new();
+            let mut positions = Vec::with_capacity(txs.len());
+            for tx in txs {
+                let record = encode_record(tx).map_to_mm(TxHistoryError::ErrorSerializing)?;
+                let payload_offset =
+                    self.file_len + content.len() as u64 + RECORD_HEADER_LEN + tx.internal_id.len() as u64;
+                positions.push((tx.internal_id.0.clone(), RecordPosition {
+                    payload_offset,
+                    payload_len: (record.len() as u64 - RECORD_HEADER_LEN - tx.internal_id.len() as u64) as u32,
+                    block_height: tx.block_height,
+                    checksum: u32::from_le_bytes(record[14..18].try_into().expect("4 bytes")),
+                }));
+                content.extend_from_slice(&record);
+            }
+
+            let write_res = self
+                .file
+                .seek(SeekFrom::Start(self.file_len))
+                .and_then(|_| self.file.write_all(&content))
+                .and_then(|_| self.file.sync_data());
+            if let Err(e) = write_res {
+                // drop the partially written records
+                self.file.set_len(self.file_len).ok();
+                return MmError::err(TxHistoryError::ErrorSaving(e.to_string()));
+            }
+
+            for (internal_id, position) in positions {
+                self.insert_position(internal_id, position);
+            }
+            self.file_len += content.len() as u64;
+            Ok(())
+        }
+    }
+
+    fn encode_record(tx: &TransactionDetails) -> Result<Vec<u8>, String> {
+        let payload = try_s!(encode_tx(tx));
+        if tx.internal_id.len() > u16::MAX as usize {
+            return ERR!("Too long internal_id {:02x}", tx.internal_id);
+        }
+
+        let checksum = record_checksum(tx.block_height, &tx.internal_id, &payload);
+        let mut record = Vec::with_capacity(RECORD_HEADER_LEN as usize + tx.internal_id.len() + payload.len());
+        record.extend_from_slice(&(payload.len() as u32).to_le_bytes());
+        record.extend_from_slice(&tx.block_height.to_le_bytes());
+        record.extend_from_slice(&(tx.internal_id.len() as u16).to_le_bytes());
+        record.extend_from_slice(&checksum.to_le_bytes());
+        record.extend_from_slice(&tx.internal_id);
+        record.extend_from_slice(&payload);
+        Ok(record)
+    }
+
+    fn record_checksum(block_height: u64, internal_id: &[u8], payload: &[u8]) -> u32 {
+        let mut hasher = crc32fast::Hasher::new();
+        hasher.update(&block_height.to_le_bytes());
+        hasher.update(internal_id);
+        hasher.update(payload);
+        hasher.finalize()
+    }
+
+    /// The binary encoding of the `TransactionDetails`: the raw bytes instead of the hex strings,
+    /// the length-prefixed byte strings and the fixed-size integers.
+    fn encode_tx(tx: &TransactionDetails) -> Result<Vec<u8>, String> {
+        fn put_bytes(buf: &mut Vec<u8>, bytes: &[u8]) {
+            buf.extend_from_slice(&(bytes.len() as u32).to_le_bytes());
+            buf.extend_from_slice(bytes);
+        }
+
+        fn put_strings(buf: &mut Vec<u8>, strings: &[String]) {
+            buf.extend_from_slice(&(strings.len() as u32).to_le_bytes());
+            for s in strings {
+                put_bytes(buf, s.as_bytes());
+            }
+        }
+
+        let fee_details = match &tx.fee_details {
+            Some(fee_details) => try_s!(json::to_vec(fee_details)),
+            None => Vec::new(),
+        };
+
+        let mut buf = Vec::with_capacity(tx.tx_hex.len() + 256);
+        buf.push(ENCODING_VERSION);
+        put_bytes(&mut buf, &tx.tx_hex);
+        put_bytes(&mut buf, &tx.tx_hash);
+        put_strings(&mut buf, &tx.from);
+        put_strings(&mut buf, &tx.to);
+        for amount in [
+            &tx.total_amount,
+            &tx.spent_by_me,
+            &tx.received_by_me,
+            &tx.my_balance_change,
+        ]
+        .iter()
+        {
+            put_bytes(&mut buf, amount.to_string().as_bytes());
+        }
+        buf.extend_from_slice(&tx.block_height.to_le_bytes());
+        buf.extend_from_slice(&tx.timestamp.to_le_bytes());
+        put_bytes(&mut buf, &fee_details);
+        put_bytes(&mut buf, tx.coin.as_bytes());
+        put_bytes(&mut buf, &tx.internal_id);
+        Ok(buf)
+    }
+
+    struct Reader<'a> {
+        data: &'a [u8],
+    }
+
+    impl<'a> Reader<'a> {
+        fn take(&mut self, len: usize) -> Result<&'a [u8], String> {
+            if self.data.len() < len {
+                return ERR!("Unexpected end of data");
+            }
+            let (taken, rest) = self.data.split_at(len);
+            self.data = rest;
+            Ok(taken)
+        }
+
+        fn u32(&mut self) -> Result<u32, String> {
+            Ok(u32::from_le_bytes(try_s!(self.take(4)).try_into().expect("4 bytes")))
+        }
+
+        fn u64(&mut self) -> Result<u64, String> {
+            Ok(u64::from_le_bytes(try_s!(self.take(8)).try_into().expect("8 bytes")))
+        }
+
+        fn bytes(&mut self) -> Result<Vec<u8>, String> {
+            let len = try_s!(self.u32()) as usize;
+            Ok(try_s!(self.take(len)).to_vec())
+        }
+
+        fn string(&mut self) -> Result<String, String> {
+            String::from_utf8(try_s!(self.bytes())).map_err(|e| ERRL!("{}", e))
+        }
+
+        fn strings(&mut self) -> Result<Vec<String>, String> {
+            let len = try_s!(self.u32());
+            (0..len).map(|_| self.string()).collect()
+        }
+
+        fn big_decimal(&mut self) -> Result<BigDecimal, String> {
+            BigDecimal::from_str(&try_s!(self.string())).map_err(|e| ERRL!("{}", e))
+        }
+    }
+
+    fn decode_tx(payload: &[u8]) -> Result<TransactionDetails, String> {
+        let mut reader = Reader { data: payload };
+        let version = try_s!(reader.take(1))[0];
+        if version != ENCODING_VERSION {
+            return ERR!("Unsupported encoding version {}", version);
+        }
+
+        let tx_hex = try_s!(reader.bytes()).into();
+        let tx_hash = try_s!(reader.bytes()).into();
+        let from = try_s!(reader.strings());
+        let to = try_s!(reader.strings());
+        let total_amount = try_s!(reader.big_decimal());
+        let spent_by_me = try_s!(reader.big_decimal());
+        let received_by_me = try_s!(reader.big_decimal());
+        let my_balance_change = try_s!(reader.big_decimal());
+        let block_height = try_s!(reader.u64());
+        let timestamp = try_s!(reader.u64());
+        let fee_details = try_s!(reader.bytes());
+        let fee_details = if fee_details.is_empty() {
+            None
+        } else {
+            Some(try_s!(json::from_slice(&fee_details)))
+        };
+        let coin = try_s!(reader.string());
+        let internal_id = try_s!(reader.bytes()).into();
+        Ok(TransactionDetails {
+            tx_hex,
+            tx_hash,
+            from,
+            to,
+            total_amount,
+            spent_by_me,
+            received_by_me,
+            my_balance_change,
+            block_height,
+            timestamp,
+            fee_details,
+            coin,
+            internal_id,
+        })
+    }
+}
+
+#[cfg(all(test, not(target_arch = "wasm32")))]
+mod native_tests {
+    use super::*;
+    use common::{block_on, now_ms, temp_dir};
+    use serde_json as json;
+    use std::fs::{self, OpenOptions};
+    use std::io::Write;
+
+    const TICKER: &str = "RICK";
+    const ADDRESS: &str = "RRnMcSeKiLrNdbp91qNVQwwXx5azD4S4CD";
+
+    fn tx_for_test(internal_id: u8, block_height: u64) -> TransactionDetails {
+        let internal_id = hex::encode(&[internal_id; 32]);
+        json::from_value(json!({
+            "tx_hex": "0400008085202f89",
+            "tx_hash": internal_id,
+            "from": ["RHvavL8j683JwrN2ygk9Bg495DvPu5QVN3"],
+            "to": ["RHvavL8j683JwrN2ygk9Bg495DvPu5QVN3", "bH6y6RtvbLToqSUNtLA5rQRjSwyNNzUSNc"],
+            "total_amount": "3.51293022",
+            "spent_by_me": "3.51293022",
+            "received_by_me": "3.41292022",
+            "my_balance_change": "-0.10001",
+            "block_height": block_height,
+            "timestamp": 1620235027,
+            "fee_details": {"type": "Utxo", "amount": "0.00001"},
+            "coin": TICKER,
+            "internal_id": internal_id,
+        }))
+        .unwrap()
+    }
+
+    fn tx_history_path_for_test(name: &str) -> PathBuf {
+        let path = temp_dir().join(format!("{}_{}", name, now_ms()));
+        fs::create_dir_all(&path).unwrap();
+        path
+    }
+
+    fn history_file_path(tx_history_path: &PathBuf) -> PathBuf {
+        tx_history_path.join(format!("{}_{}.txhistory", TICKER, ADDRESS))
+    }
+
+    #[test]
+    fn test_upsert_and_load_page() {
+        let tx_history_path = tx_history_path_for_test("test_upsert_and_load_page");
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path.clone())).unwrap();
+
+        let tx1 = tx_for_test(1, 100);
+        let tx2 = tx_for_test(2, 102);
+        let tx3 = tx_for_test(3, 0);
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx1.clone(), tx3.clone()])).unwrap();
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx2.clone()])).unwrap();
+        // the unconfirmed transaction is confirmed
+        let tx3_confirmed = tx_for_test(3, 101);
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx3_confirmed.clone()])).unwrap();
+
+        let expected = vec![tx2.clone(), tx3_confirmed.clone(), tx1.clone()];
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), expected);
+
+        // the history is restored from the file
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path)).unwrap();
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), expected);
+
+        let page = block_on(db.load_history_page(TICKER, ADDRESS, PagingFrom::Skip(1), Some(1))).unwrap();
+        assert_eq!(page.transactions, vec![tx3_confirmed.clone()]);
+        assert_eq!(page.skipped, 1);
+        assert_eq!(page.total, 3);
+
+        let from = PagingFrom::FromId(tx3_confirmed.internal_id.clone());
+        let page = block_on(db.load_history_page(TICKER, ADDRESS, from, Some(10))).unwrap();
+        assert_eq!(page.transactions, vec![tx1]);
+        assert_eq!(page.skipped, 2);
+
+        let from = PagingFrom::FromId(tx_for_test(4, 0).internal_id);
+        match block_on(db.load_history_page(TICKER, ADDRESS, from, None)) {
+            Err(e) => match e.into_inner() {
+                TxHistoryError::FromIdNotFound(_) => (),
+                e => panic!("Unexpected error {}", e),
+            },
+            Ok(page) => panic!("Unexpected page {:?}", page),
+        }
+
+        block_on(db.clear(TICKER, ADDRESS)).unwrap();
+        assert!(block_on(db.load_history(TICKER, ADDRESS)).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_incomplete_record_truncated() {
+        let tx_history_path = tx_history_path_for_test("test_incomplete_record_truncated");
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path.clone())).unwrap();
+        let tx1 = tx_for_test(1, 100);
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx1.clone()])).unwrap();
+        let file_len = fs::metadata(history_file_path(&tx_history_path)).unwrap().len();
+        drop(db);
+
+        // simulate the record that was not written completely
+        let mut file = OpenOptions::new()
+            .append(true)
+            .open(history_file_path(&tx_history_path))
+            .unwrap();
+        file.write_all(&[100, 0, 0, 0, 1, 2]).unwrap();
+        drop(file);
+
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path.clone())).unwrap();
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), vec![tx1.clone()]);
+        let tx2 = tx_for_test(2, 101);
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx2.clone()])).unwrap();
+        assert!(fs::metadata(history_file_path(&tx_history_path)).unwrap().len() > file_len);
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), vec![tx2, tx1]);
+    }
+
+    #[test]
+    fn test_corrupted_record_truncated() {
+        let tx_history_path = tx_history_path_for_test("test_corrupted_record_truncated");
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path.clone())).unwrap();
+        let tx1 = tx_for_test(1, 100);
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx1.clone()])).unwrap();
+        let file_len = fs::metadata(history_file_path(&tx_history_path)).unwrap().len();
+        block_on(db.upsert_txs(TICKER, ADDRESS, vec![tx_for_test(2, 101), tx_for_test(3, 102)])).unwrap();
+        drop(db);
+
+        // corrupt the internal_id of the second record, so it and the record after it are dropped
+        let mut content = fs::read(history_file_path(&tx_history_path)).unwrap();
+        content[file_len as usize + 30] ^= 0xff;
+        fs::write(history_file_path(&tx_history_path), &content).unwrap();
+
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path.clone())).unwrap();
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), vec![tx1]);
+        assert_eq!(
+            fs::metadata(history_file_path(&tx_history_path)).unwrap().len(),
+            file_len
+        );
+    }
+
+    #[test]
+    fn test_legacy_json_history_migrated() {
+        let tx_history_path = tx_history_path_for_test("test_legacy_json_history_migrated");
+        let legacy_path = tx_history_path.join(format!("{}_{}.json", TICKER, ADDRESS));
+        let history = vec![tx_for_test(1, 100), tx_for_test(2, 0)];
+        fs::write(&legacy_path, json::to_vec(&history).unwrap()).unwrap();
+
+        let mut db = block_on(TxHistoryDb::init_with_fs_path(tx_history_path)).unwrap();
+        let expected = vec![history[1].clone(), history[0].clone()];
+        assert_eq!(block_on(db.load_history(TICKER, ADDRESS)).unwrap(), expected);
+        assert!(!legacy_path.exists());
     }
 }
 
@@ -19,10 +19,14 @@
 //  Copyright © 2017-2019 SuperNET. All rights reserved.
 //
 
+pub mod block_headers_storage;
+pub mod chain_watcher;
+pub mod coin_selection;
 pub mod qtum;
 pub mod rpc_clients;
 pub mod slp;
 pub mod utxo_common;
+pub mod utxo_index;
 pub mod utxo_standard;
 
 #[cfg(not(target_arch = "wasm32"))] pub mod tx_cache;
@@ -53,9 +57,9 @@ use num_traits::ToPrimitive;
 use primitives::hash::{H256, H264, H512};
 use rand::seq::SliceRandom;
 use rpc::v1::types::{Bytes as BytesJson, Transaction as RpcTransaction, H256 as H256Json};
-use script::{Builder, Script, SignatureVersion, TransactionInputSigner};
+use script::{Builder, Script, SighashCache, SignatureVersion, TransactionInputSigner};
 use serde_json::{self as json, Value as Json};
-use serialization::serialize;
+use serialization::{serialize, CoinVariant};
 use std::collections::{HashMap, HashSet};
 use std::convert::TryInto;
 use std::num::NonZeroU64;
@@ -65,14 +69,18 @@ use std::path::PathBuf;
 use std::str::FromStr;
 use std::sync::atomic::{AtomicBool, AtomicU64};
 use std::sync::{Arc, Mutex, Weak};
+use std::time::Duration;
 use utxo_common::{big_decimal_from_sat, display_address};
 
 pub use chain::Transaction as UtxoTx;
 
+use self::block_headers_storage::{sync_block_headers, BlockHeadersStorage, SpvConf};
+use self::chain_watcher::ChainWatcher;
 #[cfg(not(target_arch = "wasm32"))]
 use self::rpc_clients::{ConcurrentRequestMap, NativeClient, NativeClientImpl};
 use self::rpc_clients::{ElectrumClient, ElectrumClientImpl, ElectrumRpcRequest, EstimateFeeMethod, EstimateFeeMode,
                         UnspentInfo, UtxoRpcClientEnum, UtxoRpcError, UtxoRpcResult};
+use self::utxo_index::UtxoIndex;
 use super::{BalanceError, BalanceFut, BalanceResult, CoinTransportMetrics, CoinsContext, FeeApproxStage,
             FoundSwapTxSpend, HistorySyncState, MarketCoinOps, MmCoin, NumConversError, NumConversResult,
             RpcClientType, RpcTransportEventHandler, RpcTransportEventHandlerShared, TradeFee, TradePreimageError,
@@ -88,6 +96,8 @@ const KILO_BYTE: u64 = 1000;
 const MAX_DER_SIGNATURE_LEN: usize = 72;
 const COMPRESSED_PUBKEY_LEN: usize = 33;
 const P2PKH_OUTPUT_LEN: u64 = 34;
+/// The outpoint, the script length, the signature and pubkey with their lengths and the sequence.
+const P2PKH_INPUT_LEN: u64 = 32 + 4 + 1 + 2 + MAX_DER_SIGNATURE_LEN as u64 + COMPRESSED_PUBKEY_LEN as u64 + 4;
 const MATURE_CONFIRMATIONS_DEFAULT: u32 = 100;
 const UTXO_DUST_AMOUNT: u64 = 1000;
 /// Block count for KMD median time past calculation
@@ -96,6 +106,8 @@ const UTXO_DUST_AMOUNT: u64 = 1000;
 /// 11 > 0
 const KMD_MTP_BLOCK_COUNT: NonZeroU64 = unsafe { NonZeroU64::new_unchecked(11u64) };
 const DEFAULT_DYNAMIC_FEE_VOLATILITY_PERCENT: f64 = 0.5;
+/// The interval in seconds the block headers of the coin with `spv_conf` are synced with.
+const BLOCK_HEADERS_SYNC_INTERVAL: f64 = 10.;
 
 #[cfg(windows)]
 #[cfg(not(target_arch = "wasm32"))]
@@ -460,7 +472,12 @@ pub struct UtxoCoinFields {
     /// The daemon needs some time to update the listunspent list for address which makes it return already spent UTXOs
     /// This cache helps to prevent UTXO reuse in such cases
     pub recently_spent_outpoints: AsyncMutex<RecentlySpentOutPoints>,
+    /// The unspents of my address ordered by value with their maturity, and the outputs reserved by the sent transactions
+    /// Lock the `recently_spent_outpoints` mutex before
+    pub utxo_index: Mutex<UtxoIndex>,
     pub tx_hash_algo: TxHashAlgo,
+    /// Wakes the swaps waiting for the transaction confirmations and spends
+    pub chain_watcher: ChainWatcher,
 }
 
 #[async_trait]
@@ -527,11 +544,12 @@ pub trait UtxoCommonOps {
         address: &Address,
     ) -> UtxoRpcResult<(Vec<UnspentInfo>, AsyncMutexGuard<'a, RecentlySpentOutPoints>)>;
 
-    /// Try load verbose transaction from cache or try to request it from Rpc client.
-    fn get_verbose_transaction_from_cache_or_rpc(
+    /// Try load verbose transactions from cache or try to request them from Rpc client.
+    /// The transactions failed to load are logged and not included into the result.
+    fn get_verbose_transactions_from_cache_or_rpc(
         &self,
-        txid: H256Json,
-    ) -> Box<dyn Future<Item = VerboseTransactionFrom, Error = String> + Send>;
+        txids: HashSet<H256Json>,
+    ) -> Box<dyn Future<Item = HashMap<H256Json, VerboseTransactionFrom>, Error = String> + Send>;
 
     /// Cache transaction if the coin supports `TX_CACHE` and tx height is set and not zero.
     async fn cache_transaction_if_possible(&self, tx: &RpcTransaction) -> Result<(), String>;
@@ -813,6 +831,8 @@ impl RpcTransportEventHandler for ElectrumProtoVerifier {
 
     fn on_incoming_response(&self, _data: &[u8]) {}
 
+    fn on_response_latency(&self, _address: &str, _latency: Duration) {}
+
     fn on_connected(&self, address: String) -> Result<(), String> {
         try_s!(self.on_connect_tx.unbounded_send(address));
         Ok(())
@@ -1106,8 +1126,10 @@ pub trait UtxoCoinBuilder {
             history_sync_state: Mutex::new(initial_history_state),
             tx_cache_directory,
             recently_spent_outpoints: AsyncMutex::new(RecentlySpentOutPoints::new(my_script_pubkey)),
+            utxo_index: Mutex::new(UtxoIndex::default()),
             tx_fee,
             tx_hash_algo,
+            chain_watcher: ChainWatcher::default(),
         };
         Ok(coin)
     }
@@ -1176,7 +1198,44 @@ pub trait UtxoCoinBuilder {
         }
     }
 
+    /// Returns the Electrum client shared by the coins of the same chain requesting the same servers
+    /// (e.g. the QRC20 tokens and their QTUM platform), so the connections are set up and checked once.
     async fn electrum_client(&self) -> Result<ElectrumClient, String> {
+        let key = match self.shared_electrum_client_key() {
+            Some(key) => key,
+            None => return self.new_electrum_client().await,
+        };
+        let coins_ctx = try_s!(CoinsContext::from_ctx(self.ctx()));
+        let shared = coins_ctx.shared_electrum_client(&key);
+        // the coins activated concurrently wait for the first one to connect
+        let mut shared = shared.lock().await;
+        if let Some(client) = shared.upgrade() {
+            log!("Coin " (self.ticker()) " reuses the Electrum connections of the same chain coin");
+            return Ok(ElectrumClient(client));
+        }
+        let client = try_s!(self.new_electrum_client().await);
+        *shared = Arc::downgrade(&client.0);
+        Ok(client)
+    }
+
+    /// The coins having the same key can share the Electrum client.
+    /// Returns None if the client is specific to the coin.
+    fn shared_electrum_client_key(&self) -> Option<String> {
+        // the client stores the block headers of the coin
+        if !self.conf()["spv_conf"].is_null() {
+            return None;
+        }
+        let servers: Vec<ElectrumRpcRequest> = json::from_value(self.req()["servers"].clone()).ok()?;
+        let mut servers: Vec<_> = servers.iter().map(|server| format!("{:?}", server)).collect();
+        servers.sort_unstable();
+        let chain = self.conf()["protocol"]["protocol_data"]["platform"]
+            .as_str()
+            .unwrap_or_else(|| self.ticker());
+        let hedge_requests = self.req()["hedge_requests"].as_bool().unwrap_or(false);
+        Some(format!("{} {} {}", chain, hedge_requests, servers.join(",")))
+    }
+
+    async fn new_electrum_client(&self) -> Result<ElectrumClient, String> {
         let (on_connect_tx, on_connect_rx) = mpsc::unbounded();
         let ticker = self.ticker().to_owned();
         let ctx = self.ctx();
@@ -1188,7 +1247,22 @@ pub trait UtxoCoinBuilder {
         let mut servers: Vec<ElectrumRpcRequest> = try_s!(json::from_value(self.req()["servers"].clone()));
         let mut rng = small_rng();
         servers.as_mut_slice().shuffle(&mut rng);
-        let client = ElectrumClientImpl::new(ticker, event_handlers);
+        let mut client = ElectrumClientImpl::new(ticker, event_handlers);
+        client.set_hedge_requests(self.req()["hedge_requests"].as_bool().unwrap_or(false));
+        let spv_conf: Option<SpvConf> = try_s!(json::from_value(self.conf()["spv_conf"].clone()));
+        if let Some(spv_conf) = spv_conf {
+            let coin_variant = match self.conf()["protocol"]["type"].as_str() {
+                Some("QTUM") | Some("QRC20") => CoinVariant::Qtum,
+                _ => CoinVariant::Standard,
+            };
+            #[cfg(not(target_arch = "wasm32"))]
+            let block_headers_dir = Some(ctx.dbdir().join("BLOCK_HEADERS"));
+            #[cfg(target_arch = "wasm32")]
+            let block_headers_dir: Option<PathBuf> = None;
+            let storage =
+                BlockHeadersStorage::open(self.ticker(), coin_variant, &spv_conf, block_headers_dir.as_deref());
+            client.set_block_headers_storage(Arc::new(storage));
+        }
         for server in servers.iter() {
             match client.add_server(server).await {
                 Ok(_) => (),
@@ -1217,6 +1291,10 @@ pub trait UtxoCoinBuilder {
         let weak_client = Arc::downgrade(&client);
         spawn_electrum_ping_loop(weak_client, servers);
 
+        if client.block_headers_storage().is_some() {
+            spawn_block_headers_sync_loop(Arc::downgrade(&client));
+        }
+
         Ok(ElectrumClient(client))
     }
 
@@ -1322,6 +1400,25 @@ fn spawn_electrum_ping_loop(weak_client: Weak<ElectrumClientImpl>, servers: Vec<
     });
 }
 
+/// Syncs the block headers of the Electrum client while the client is alive.
+fn spawn_block_headers_sync_loop(weak_client: Weak<ElectrumClientImpl>) {
+    spawn(async move {
+        loop {
+            let client = match weak_client.upgrade() {
+                Some(client) => ElectrumClient(client),
+                None => break,
+            };
+            if let Some(storage) = client.block_headers_storage() {
+                if let Err(e) = sync_block_headers(&client, storage).await {
+                    log!("Error " (e) " syncing the " (storage.ticker()) " block headers");
+                }
+            }
+            drop(client);
+            Timer::sleep(BLOCK_HEADERS_SYNC_INTERVAL).await
+        }
+    });
+}
+
 /// Follow the `on_connect_rx` stream and verify the protocol version of each connected electrum server.
 /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html?highlight=keep#server-version
 /// Weak reference will allow to stop the thread if client is dropped.
@@ -1604,10 +1701,13 @@ pub(crate) fn sign_tx(
     signature_version: SignatureVersion,
     fork_id: u32,
 ) -> Result<UtxoTx, String> {
-    let mut signed_inputs = vec![];
+    // the sighash components are shared by all inputs
+    let mut sighash_cache = SighashCache::default();
+    let mut signed_inputs = Vec::with_capacity(unsigned.inputs.len());
     for (i, _) in unsigned.inputs.iter().enumerate() {
         signed_inputs.push(try_s!(p2pkh_spend(
             &unsigned,
+            &mut sighash_cache,
             i,
             key_pair,
             &prev_script,
@@ -1689,6 +1789,11 @@ where
             .await
     );
 
+    coin.as_ref()
+        .utxo_index
+        .lock()
+        .unwrap()
+        .reserve(signed.inputs.iter().map(|input| input.previous_output.clone()));
     recently_spent.add_spent(spent_unspents, signed.hash(), signed.outputs.clone());
 
     Ok(signed)
@@ -1697,6 +1802,7 @@ where
 /// Creates signed input spending p2pkh output
 fn p2pkh_spend(
     signer: &TransactionInputSigner,
+    sighash_cache: &mut SighashCache,
     input_index: usize,
     key_pair: &KeyPair,
     prev_script: &Script,
@@ -1712,7 +1818,8 @@ fn p2pkh_spend(
         );
     }
     let sighash_type = 1 | fork_id;
-    let sighash = signer.signature_hash(
+    let sighash = signer.signature_hash_cached(
+        sighash_cache,
         input_index,
         signer.inputs[input_index].amount,
         &script,
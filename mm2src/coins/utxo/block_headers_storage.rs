@@ -0,0 +1,662 @@
+//! The block headers of an Electrum coin synced from the servers and verified locally (SPV).
+//!
+//! The chain starts from the header `SPV_INITIAL_HEADERS` blocks below the tip at the first sync, the start header
+//! is trusted. Every next header must refer to the previous one, its time must be greater than the median time past
+//! and, if the `pow_check` of the coin `spv_conf` is set, its hash must meet the target its bits encode.
+//! The chain tip, the median time past and the merkle roots the transaction proofs are checked against
+//! are then answered locally instead of asking the servers every time.
+//!
+//! The headers are stored to the `BLOCK_HEADERS/<TICKER>.headers` file: the `[start height: u64 LE]` followed by
+//! the fixed-size `[block hash: 32 bytes][merkle root: 32 bytes][time: u32 LE]` records, so the record of a height
+//! is found by its offset and the reorganized headers are just truncated.
+
+use super::rpc_clients::ElectrumClient;
+use chain::{merkle_node_hash, BlockHeaderRef};
+use common::log::{info, warn};
+use common::{median, now_ms};
+use futures::compat::Future01CompatExt;
+use primitives::hash::H256;
+use serialization::CoinVariant;
+use std::convert::TryInto;
+#[cfg(not(target_arch = "wasm32"))]
+use std::fs::{File, OpenOptions};
+#[cfg(not(target_arch = "wasm32"))]
+use std::io::{Read, Seek, SeekFrom, Write};
+use std::num::NonZeroU64;
+use std::path::Path;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::Mutex;
+
+/// The number of headers below the tip the chain starts from at the first sync.
+pub const SPV_INITIAL_HEADERS: u64 = 2016;
+/// The maximum number of headers the Electrum returns by one `blockchain.block.headers` request.
+const MAX_HEADERS_CHUNK: u64 = 2016;
+/// The oldest headers are dropped on the open once the chain exceeds the limit, the half of the headers is kept.
+const MAX_STORED_HEADERS: usize = 100_000;
+/// The number of headers the header time must be greater than the median time of.
+const MTP_BLOCK_COUNT: u64 = 11;
+/// The number of headers dropped at once if the synced headers don't refer to the stored ones.
+const REORG_REWIND_STEP: usize = 10;
+/// The maximum number of the `blockchain.block.headers` requests per sync.
+const MAX_SYNC_REQUESTS: usize = 100;
+/// The chain is considered synced with the servers for this time since the last sync.
+const SYNCED_TIMEOUT_MS: u64 = 60_000;
+
+#[cfg(not(target_arch = "wasm32"))]
+const FILE_HEADER_LEN: u64 = 8;
+const RECORD_LEN: usize = 32 + 32 + 4;
+
+#[derive(Clone, Debug, Deserialize)]
+pub struct SpvConf {
+    /// Whether to check the header hashes meet their targets.
+    /// Should not be set for the proof-of-stake coins and the coins which PoW hash isn't the double sha256.
+    #[serde(default)]
+    pub pow_check: bool,
+}
+
+#[derive(Clone, Debug, PartialEq)]
+struct StoredHeader {
+    hash: H256,
+    merkle_root: H256,
+    time: u32,
+}
+
+impl StoredHeader {
+    fn from_header(header: &BlockHeaderRef) -> StoredHeader {
+        StoredHeader {
+            hash: header.block_hash(),
+            merkle_root: header.merkle_root_hash(),
+            time: header.time(),
+        }
+    }
+
+    fn encode(&self) -> [u8; RECORD_LEN] {
+        let mut record = [0; RECORD_LEN];
+        record[..32].copy_from_slice(&*self.hash);
+        record[32..64].copy_from_slice(&*self.merkle_root);
+        record[64..].copy_from_slice(&self.time.to_le_bytes());
+        record
+    }
+
+    fn decode(record: &[u8]) -> StoredHeader {
+        StoredHeader {
+            hash: H256::from(&record[..32]),
+            merkle_root: H256::from(&record[32..64]),
+            time: u32::from_le_bytes(record[64..RECORD_LEN].try_into().expect("4 bytes")),
+        }
+    }
+}
+
+#[derive(Debug, PartialEq)]
+enum ValidationError {
+    /// The header at the height doesn't refer to the stored previous one, the chain was reorganized deeper.
+    Disconnected {
+        height: u64,
+    },
+    Invalid(String),
+}
+
+#[derive(Default)]
+struct HeadersChain {
+    /// The height of the first header, the one trusted without validation.
+    start_height: u64,
+    headers: Vec<StoredHeader>,
+    /// The index of the first header changed since the chain was stored last time.
+    dirty_from: Option<usize>,
+}
+
+impl HeadersChain {
+    fn tip_height(&self) -> Option<u64> {
+        (self.headers.len() as u64)
+            .checked_sub(1)
+            .map(|last| self.start_height + last)
+    }
+
+    fn get(&self, height: u64) -> Option<&StoredHeader> {
+        let idx = height.checked_sub(self.start_height)?;
+        self.headers.get(idx as usize)
+    }
+
+    /// Returns the median time of the `count` headers ending at the `height` or None if some of them aren't stored.
+    fn median_time_past(&self, height: u64, count: u64) -> Option<u32> {
+        let from = (height + 1).checked_sub(count)?;
+        let mut times = Vec::with_capacity(count as usize);
+        for height in from..=height {
+            times.push(self.get(height)?.time);
+        }
+        median(&mut times)
+    }
+
+    fn height_of(&self, hash: &H256) -> Option<u64> {
+        self.headers
+            .iter()
+            .rposition(|header| header.hash == *hash)
+            .map(|idx| self.start_height + idx as u64)
+    }
+
+    fn mark_dirty(&mut self, idx: usize) { self.dirty_from = Some(self.dirty_from.map_or(idx, |from| from.min(idx))); }
+
+    fn truncate(&mut self, len: usize) {
+        if len < self.headers.len() {
+            self.headers.truncate(len);
+            self.mark_dirty(len);
+        }
+    }
+
+    /// Drops the `count` last headers, the whole chain is dropped if the start header is reached.
+    fn rewind(&mut self, count: usize) {
+        if self.headers.len() > count {
+            self.truncate(self.headers.len() - count);
+        } else {
+            self.truncate(0);
+        }
+    }
+
+    fn validate(&self, header: &BlockHeaderRef, height: u64, pow_check: bool) -> Result<(), ValidationError> {
+        let prev = self.get(height - 1).ok_or(ValidationError::Disconnected { height })?;
+        if header.previous_header_hash() != prev.hash {
+            return Err(ValidationError::Disconnected { height });
+        }
+        if let Some(mtp) = self.median_time_past(height - 1, MTP_BLOCK_COUNT) {
+            if header.time() <= mtp {
+                return Err(ValidationError::Invalid(ERRL!(
+                    "The header {} time {} is not greater than the median time past {}",
+                    height,
+                    header.time(),
+                    mtp
+                )));
+            }
+        }
+        if pow_check && !header.is_aux_pow() && !header.is_pow_valid() {
+            return Err(ValidationError::Invalid(ERRL!(
+                "The header {} hash doesn't meet its target",
+                height
+            )));
+        }
+        Ok(())
+    }
+
+    /// Validates the `headers` starting at the `from` height and stores them.
+    /// The stored headers differing from the `headers` are replaced as reorganized.
+    fn apply(&mut self, from: u64, headers: &[BlockHeaderRef], pow_check: bool) -> Result<(), ValidationError> {
+        if let Some(header) = headers.iter().find(|header| header.is_verus()) {
+            return Err(ValidationError::Invalid(ERRL!(
+                "The Verus header {:?} is not supported",
+                header.block_hash()
+            )));
+        }
+
+        let mut headers = headers.iter();
+        let mut height = from;
+        if self.headers.is_empty() {
+            let first = match headers.next() {
+                Some(first) => first,
+                None => return Ok(()),
+            };
+            self.start_height = from;
+            self.headers.push(StoredHeader::from_header(first));
+            self.mark_dirty(0);
+            height += 1;
+        }
+
+        if height < self.start_height || height > self.start_height + self.headers.len() as u64 {
+            return Err(ValidationError::Invalid(ERRL!(
+                "The headers from {} are not adjacent to the stored {}..{}",
+                from,
+                self.start_height,
+                self.start_height + self.headers.len() as u64
+            )));
+        }
+
+        for header in headers {
+            let idx = (height - self.start_height) as usize;
+            let stored = StoredHeader::from_header(header);
+            if idx < self.headers.len() {
+                if self.headers[idx] == stored {
+                    height += 1;
+                    continue;
+                }
+                if idx == 0 {
+                    return Err(ValidationError::Disconnected { height });
+                }
+                self.truncate(idx);
+            }
+            self.validate(header, height, pow_check)?;
+            self.headers.push(stored);
+            self.mark_dirty(idx);
+            height += 1;
+        }
+        Ok(())
+    }
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+struct HeadersFile {
+    file: File,
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+impl HeadersFile {
+    /// Opens the file and loads the chain from it.
+    fn open(path: &Path) -> Result<(HeadersFile, HeadersChain), String> {
+        let mut file = try_s!(OpenOptions::new().read(true).write(true).create(true).open(path));
+        let mut content = Vec::new();
+        try_s!(file.read_to_end(&mut content));
+
+        let mut chain = HeadersChain::default();
+        if content.len() < FILE_HEADER_LEN as usize {
+            let mut headers_file = HeadersFile { file };
+            // the file is new or its header was not written completely
+            chain.mark_dirty(0);
+            try_s!(headers_file.store(&mut chain));
+            return Ok((headers_file, chain));
+        }
+
+        chain.start_height = u64::from_le_bytes(content[..8].try_into().expect("8 bytes"));
+        let records = &content[FILE_HEADER_LEN as usize..];
+        chain.headers = records.chunks_exact(RECORD_LEN).map(StoredHeader::decode).collect();
+        let incomplete_len = records.len() % RECORD_LEN;
+        if incomplete_len > 0 {
+            // the last record was not written completely
+            log!("Truncating " (incomplete_len) " bytes of the incomplete record at " [path]);
+            try_s!(file.set_len(content.len() as u64 - incomplete_len as u64));
+        }
+
+        let mut headers_file = HeadersFile { file };
+        if chain.headers.len() > MAX_STORED_HEADERS {
+            let dropped = chain.headers.len() - MAX_STORED_HEADERS / 2;
+            chain.headers.drain(..dropped);
+            chain.start_height += dropped as u64;
+            chain.mark_dirty(0);
+            try_s!(headers_file.store(&mut chain));
+        }
+        Ok((headers_file, chain))
+    }
+
+    /// Stores the headers changed since the last time.
+    fn store(&mut self, chain: &mut HeadersChain) -> Result<(), String> {
+        let dirty_from = match chain.dirty_from.take() {
+            Some(dirty_from) => dirty_from,
+            None => return Ok(()),
+        };
+        let offset = FILE_HEADER_LEN + (dirty_from * RECORD_LEN) as u64;
+        let mut content = Vec::with_capacity((chain.headers.len() - dirty_from + 1) * RECORD_LEN);
+        if dirty_from == 0 {
+            content.extend_from_slice(&chain.start_height.to_le_bytes());
+        }
+        for header in chain.headers[dirty_from..].iter() {
+            content.extend_from_slice(&header.encode());
+        }
+
+        let write_from = if dirty_from == 0 { 0 } else { offset };
+        let result = self
+            .file
+            .set_len(write_from)
+            .and_then(|_| self.file.seek(SeekFrom::Start(write_from)))
+            .and_then(|_| self.file.write_all(&content));
+        if let Err(e) = result {
+            // the headers will be rewritten the next time
+            chain.mark_dirty(dirty_from);
+            return ERR!("{}", e);
+        }
+        Ok(())
+    }
+}
+
+struct StorageInner {
+    chain: HeadersChain,
+    #[cfg(not(target_arch = "wasm32"))]
+    file: Option<HeadersFile>,
+}
+
+impl StorageInner {
+    #[cfg(not(target_arch = "wasm32"))]
+    fn store(&mut self, ticker: &str) {
+        if let Some(file) = self.file.as_mut() {
+            if let Err(e) = file.store(&mut self.chain) {
+                log!("Error " (e) " storing the " (ticker) " block headers");
+            }
+        }
+    }
+
+    #[cfg(target_arch = "wasm32")]
+    fn store(&mut self, _ticker: &str) { self.chain.dirty_from = None; }
+}
+
+pub struct BlockHeadersStorage {
+    ticker: String,
+    is_qtum: bool,
+    pow_check: bool,
+    inner: Mutex<StorageInner>,
+    /// The time the chain was synced with the servers tip last time.
+    synced_at: AtomicU64,
+}
+
+impl std::fmt::Debug for BlockHeadersStorage {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("BlockHeadersStorage")
+            .field("ticker", &self.ticker)
+            .finish()
+    }
+}
+
+impl BlockHeadersStorage {
+    /// Loads the chain stored in the `block_headers_dir`.
+    /// The headers are kept in memory only if the directory is not set or the file can't be opened.
+    pub fn open(
+        ticker: &str,
+        coin_variant: CoinVariant,
+        spv_conf: &SpvConf,
+        block_headers_dir: Option<&Path>,
+    ) -> BlockHeadersStorage {
+        let inner = match block_headers_dir {
+            #[cfg(not(target_arch = "wasm32"))]
+            Some(dir) => {
+                let opened = std::fs::create_dir_all(dir)
+                    .map_err(|e| ERRL!("{}", e))
+                    .and_then(|_| HeadersFile::open(&dir.join(format!("{}.headers", ticker))));
+                match opened {
+                    Ok((file, chain)) => StorageInner {
+                        chain,
+                        file: Some(file),
+                    },
+                    Err(e) => {
+                        log!("Error " (e) " opening the " (ticker) " block headers, they won't be stored");
+                        StorageInner {
+                            chain: HeadersChain::default(),
+                            file: None,
+                        }
+                    },
+                }
+            },
+            _ => StorageInner {
+                chain: HeadersChain::default(),
+                #[cfg(not(target_arch = "wasm32"))]
+                file: None,
+            },
+        };
+        BlockHeadersStorage {
+            ticker: ticker.to_owned(),
+            is_qtum: coin_variant.is_qtum(),
+            pow_check: spv_conf.pow_check,
+            inner: Mutex::new(inner),
+            synced_at: AtomicU64::new(0),
+        }
+    }
+
+    pub fn ticker(&self) -> &str { &self.ticker }
+
+    fn set_synced(&self) { self.synced_at.store(now_ms(), Ordering::Relaxed); }
+
+    fn coin_variant(&self) -> CoinVariant {
+        if self.is_qtum {
+            CoinVariant::Qtum
+        } else {
+            CoinVariant::Standard
+        }
+    }
+
+    /// Returns the stored tip height if the chain was synced with the servers recently.
+    pub fn synced_tip_height(&self) -> Option<u64> {
+        if now_ms().saturating_sub(self.synced_at.load(Ordering::Relaxed)) > SYNCED_TIMEOUT_MS {
+            return None;
+        }
+        self.inner.lock().unwrap().chain.tip_height()
+    }
+
+    /// Returns the median time of the `count` headers ending at the `height` or None if some of them aren't stored.
+    pub fn median_time_past(&self, height: u64, count: u64) -> Option<u32> {
+        self.inner.lock().unwrap().chain.median_time_past(height, count)
+    }
+
+    pub fn merkle_root(&self, height: u64) -> Option<H256> {
+        self.inner
+            .lock()
+            .unwrap()
+            .chain
+            .get(height)
+            .map(|header| header.merkle_root.clone())
+    }
+
+    /// Returns the height of the stored block, if it's not reorganized.
+    pub fn block_height(&self, block_hash: &H256) -> Option<u64> {
+        self.inner.lock().unwrap().chain.height_of(block_hash)
+    }
+
+    fn apply(&self, from: u64, headers: &[BlockHeaderRef]) -> Result<(), ValidationError> {
+        let mut inner = self.inner.lock().unwrap();
+        let result = inner.chain.apply(from, headers, self.pow_check);
+        inner.store(&self.ticker);
+        result
+    }
+
+    fn rewind(&self, count: usize) {
+        let mut inner = self.inner.lock().unwrap();
+        inner.chain.rewind(count);
+        inner.store(&self.ticker);
+    }
+
+    /// Returns the height the sync starts from: the stored tip, so the reorganized tip is replaced,
+    /// or `SPV_INITIAL_HEADERS` below the servers `tip` if nothing is stored.
+    fn sync_from(&self, tip: u64) -> u64 {
+        let inner = self.inner.lock().unwrap();
+        match inner.chain.tip_height() {
+            Some(stored_tip) => stored_tip,
+            None => (tip + 1).saturating_sub(SPV_INITIAL_HEADERS),
+        }
+    }
+}
+
+/// Computes the merkle root the transaction `branch` leads to.
+/// The `pos` is the transaction index in the block, the hashes are in the internal byte order.
+pub fn merkle_root_from_branch(tx_hash: &H256, branch: &[H256], mut pos: usize) -> H256 {
+    let mut hash = tx_hash.clone();
+    for node in branch {
+        hash = if pos & 1 == 1 {
+            merkle_node_hash(node, &hash)
+        } else {
+            merkle_node_hash(&hash, node)
+        };
+        pos >>= 1;
+    }
+    hash
+}
+
+/// Syncs the headers up to the servers tip, validating them.
+pub async fn sync_block_headers(client: &ElectrumClient, storage: &BlockHeadersStorage) -> Result<(), String> {
+    let tip = try_s!(client.blockchain_headers_subscribe().compat().await).block_height();
+    let coin_variant = storage.coin_variant();
+    for _ in 0..MAX_SYNC_REQUESTS {
+        let from = storage.sync_from(tip);
+        if from > tip {
+            // the servers are behind the stored tip
+            storage.set_synced();
+            return Ok(());
+        }
+        let count = NonZeroU64::new((tip + 1 - from).min(MAX_HEADERS_CHUNK)).expect("from <= tip");
+        let res = try_s!(client.blockchain_block_headers(from, count).compat().await);
+        let headers = BlockHeaderRef::parse_list(&res.hex.0, &coin_variant).map_err(|e| ERRL!("{:?}", e))?;
+        if headers.is_empty() {
+            break;
+        }
+
+        match storage.apply(from, &headers) {
+            Ok(()) => {
+                if from + headers.len() as u64 > tip {
+                    storage.set_synced();
+                    return Ok(());
+                }
+            },
+            Err(ValidationError::Disconnected { height }) => {
+                info!(
+                    "{} chain is reorganized below the header {}, rewinding",
+                    storage.ticker, height
+                );
+                storage.rewind(REORG_REWIND_STEP);
+            },
+            Err(ValidationError::Invalid(e)) => return ERR!("{}", e),
+        }
+    }
+    warn!("{} block headers are not synced up to {} yet", storage.ticker, tip);
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use common::{now_ms, temp_dir};
+
+    /// Mines the 80-byte headers chained to each other.
+    fn chained_headers(prev_hash: H256, times: &[u32]) -> Vec<Vec<u8>> {
+        let mut prev_hash = prev_hash;
+        times
+            .iter()
+            .enumerate()
+            .map(|(i, time)| {
+                let mut raw = Vec::with_capacity(80);
+                raw.extend_from_slice(&1u32.to_le_bytes());
+                raw.extend_from_slice(&*prev_hash);
+                raw.extend_from_slice(&[i as u8; 32]);
+                raw.extend_from_slice(&time.to_le_bytes());
+                // the regtest target
+                raw.extend_from_slice(&0x207fffffu32.to_le_bytes());
+                raw.extend_from_slice(&0u32.to_le_bytes());
+                for nonce in 0u32.. {
+                    raw[76..].copy_from_slice(&nonce.to_le_bytes());
+                    let header = BlockHeaderRef::parse(&raw, &CoinVariant::Standard).unwrap();
+                    if header.is_pow_valid() {
+                        prev_hash = header.block_hash();
+                        break;
+                    }
+                }
+                raw
+            })
+            .collect()
+    }
+
+    fn parse_headers<'a>(raw: &'a [Vec<u8>]) -> Vec<BlockHeaderRef<'a>> {
+        raw.iter()
+            .map(|raw| BlockHeaderRef::parse(raw, &CoinVariant::Standard).unwrap())
+            .collect()
+    }
+
+    fn times_from(start: u32, count: u32) -> Vec<u32> { (0..count).map(|i| start + i * 60).collect() }
+
+    #[test]
+    fn test_headers_chain_apply() {
+        let raw = chained_headers(H256::default(), &times_from(1000, 20));
+        let headers = parse_headers(&raw);
+        let mut chain = HeadersChain::default();
+        chain.apply(100, &headers[..12], true).unwrap();
+        assert_eq!(chain.tip_height(), Some(111));
+        // the overlapping headers are skipped
+        chain.apply(111, &headers[11..], true).unwrap();
+        assert_eq!(chain.tip_height(), Some(119));
+        assert_eq!(chain.get(119).unwrap().hash, headers[19].block_hash());
+        assert_eq!(chain.height_of(&headers[5].block_hash()), Some(105));
+        // the median of the 1000 + 60 * (i - 100) times of the 109..=119 headers
+        assert_eq!(chain.median_time_past(119, 11), Some(1000 + 60 * 14));
+        assert_eq!(chain.median_time_past(105, 11), None);
+
+        // not adjacent
+        match chain.apply(121, &headers[..1], true) {
+            Err(ValidationError::Invalid(_)) => (),
+            r => panic!("Unexpected {:?}", r),
+        }
+
+        // the fork from the 115 header replaces the stored 116..=119
+        let fork_raw = chained_headers(headers[15].block_hash(), &times_from(5000, 6));
+        let fork = parse_headers(&fork_raw);
+        chain.apply(115, &[headers[15]], true).unwrap();
+        chain.apply(116, &fork, true).unwrap();
+        assert_eq!(chain.tip_height(), Some(121));
+        assert_eq!(chain.get(116).unwrap().hash, fork[0].block_hash());
+        assert_eq!(chain.height_of(&headers[19].block_hash()), None);
+
+        // the fork doesn't refer to the stored headers
+        let fork_raw = chained_headers(H256::from([1; 32]), &times_from(9000, 2));
+        let fork = parse_headers(&fork_raw);
+        assert_eq!(
+            chain.apply(121, &fork, true),
+            Err(ValidationError::Disconnected { height: 121 })
+        );
+        // the 121 header is replaced already
+        assert_eq!(chain.tip_height(), Some(120));
+        chain.rewind(REORG_REWIND_STEP);
+        assert_eq!(chain.tip_height(), Some(110));
+        chain.rewind(100);
+        assert_eq!(chain.tip_height(), None);
+    }
+
+    #[test]
+    fn test_headers_chain_validation() {
+        // the time of the last header is equal to the median time past of the previous 11 headers
+        let mut times = times_from(1000, 11);
+        times.push(1000 + 60 * 5);
+        let raw = chained_headers(H256::default(), &times);
+        let headers = parse_headers(&raw);
+        let mut chain = HeadersChain::default();
+        match chain.apply(0, &headers, false) {
+            Err(ValidationError::Invalid(e)) => assert!(e.contains("median time past")),
+            r => panic!("Unexpected {:?}", r),
+        }
+        assert_eq!(chain.tip_height(), Some(10));
+
+        // the hash doesn't meet the hardest target
+        let mut raw = chained_headers(chain.get(10).unwrap().hash.clone(), &times_from(2000, 1));
+        raw[0][72..76].copy_from_slice(&0x03000001u32.to_le_bytes());
+        let headers = parse_headers(&raw);
+        match chain.apply(11, &headers, true) {
+            Err(ValidationError::Invalid(e)) => assert!(e.contains("target")),
+            r => panic!("Unexpected {:?}", r),
+        }
+        chain.apply(11, &headers, false).unwrap();
+        assert_eq!(chain.tip_height(), Some(11));
+    }
+
+    #[test]
+    fn test_headers_file_reopen() {
+        let dir = temp_dir().join(format!("test_headers_file_reopen_{}", now_ms()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("RICK.headers");
+        let raw = chained_headers(H256::default(), &times_from(1000, 20));
+        let headers = parse_headers(&raw);
+
+        let (mut file, mut chain) = HeadersFile::open(&path).unwrap();
+        chain.apply(500, &headers, false).unwrap();
+        file.store(&mut chain).unwrap();
+        chain.truncate(15);
+        file.store(&mut chain).unwrap();
+        drop(file);
+
+        // simulate the record that was not written completely
+        let mut f = OpenOptions::new().append(true).open(&path).unwrap();
+        f.write_all(&StoredHeader::from_header(&headers[15]).encode()[..40])
+            .unwrap();
+        drop(f);
+
+        let (_, reopened) = HeadersFile::open(&path).unwrap();
+        assert_eq!(reopened.start_height, 500);
+        assert_eq!(reopened.headers, chain.headers);
+        assert_eq!(
+            std::fs::metadata(&path).unwrap().len(),
+            FILE_HEADER_LEN + 15 * RECORD_LEN as u64
+        );
+    }
+
+    #[test]
+    fn test_merkle_root_from_branch() {
+        let txs: Vec<H256> = (0..5u8).map(|i| H256::from([i; 32])).collect();
+        let root = chain::merkle_root(&txs);
+        // the last row node is hashed with itself
+        let h01 = merkle_node_hash(&txs[0], &txs[1]);
+        let h23 = merkle_node_hash(&txs[2], &txs[3]);
+        let h44 = merkle_node_hash(&txs[4], &txs[4]);
+        let h4444 = merkle_node_hash(&h44, &h44);
+        let branch = vec![txs[2].clone(), h01.clone(), h4444];
+        assert_eq!(merkle_root_from_branch(&txs[3], &branch, 3), root);
+        assert_ne!(merkle_root_from_branch(&txs[3], &branch, 2), root);
+        let branch = vec![txs[4].clone(), h44.clone(), merkle_node_hash(&h01, &h23)];
+        assert_eq!(merkle_root_from_branch(&txs[4], &branch, 4), root);
+    }
+}
@@ -0,0 +1,511 @@
+//! The chain events the swaps of a coin wait for, watched by one loop per coin.
+//!
+//! The swaps register the transaction confirmations and the output spends they wait for and are woken
+//! once those happen, so the concurrent swaps don't poll the same server each on its own.
+//! The confirmations can change with a new block only, so they are checked once a new block is found
+//! (or the waiter is just registered) by one batch request for all the watched transactions.
+//! The Electrum loop waits for the new block headers notified over `blockchain.headers.subscribe`,
+//! the native RPC loop polls the block count every `check_every` seconds.
+//! The spends are looked for every `SPEND_CHECK_INTERVAL` seconds once per output however many swaps wait for it.
+//! The loop is spawned on the first registration and stops once nobody waits.
+
+use super::rpc_clients::{rpc_tx_confirmations, UtxoRpcClientEnum};
+use super::UtxoTx;
+use common::custom_futures::FutureTimerExt;
+use common::executor::{spawn, Timer};
+use common::log::{error, info};
+use common::now_ms;
+use futures::channel::oneshot;
+use futures::compat::Future01CompatExt;
+use futures::future::{select, Either};
+use primitives::hash::H256;
+use rpc::v1::types::H256 as H256Json;
+use std::collections::HashMap;
+use std::fmt;
+use std::sync::{Arc, Mutex};
+
+/// The interval in seconds the spends are looked for with.
+const SPEND_CHECK_INTERVAL: u64 = 10;
+/// The Electrum block count is requested if no header is notified within this number of seconds,
+/// e.g. once the subscribed connection is dropped.
+const HEADER_NOTIFICATION_TIMEOUT: u64 = 60;
+
+struct ConfirmationWaiter {
+    tx: UtxoTx,
+    txid: H256Json,
+    confirmations: u32,
+    requires_notarization: bool,
+    check_every: u64,
+    /// Whether the confirmations were checked since the waiter is registered.
+    checked: bool,
+    /// The block height and the merkle root the transaction was verified at by the block headers.
+    spv_verified: Option<(u64, H256)>,
+    result_tx: oneshot::Sender<()>,
+}
+
+struct SpendWaiter {
+    tx: UtxoTx,
+    vout: usize,
+    from_block: u64,
+    result_tx: oneshot::Sender<UtxoTx>,
+}
+
+#[derive(Default)]
+struct WatcherState {
+    confirmation_waiters: Vec<ConfirmationWaiter>,
+    spend_waiters: Vec<SpendWaiter>,
+    is_running: bool,
+    /// Wakes the loop up to check the just registered waiter.
+    wakeup_tx: Option<oneshot::Sender<()>>,
+}
+
+impl WatcherState {
+    /// Drops the waiters nobody waits for anymore, returns false if there are no waiters left.
+    fn retain_waited(&mut self) -> bool {
+        self.confirmation_waiters
+            .retain(|waiter| !waiter.result_tx.is_canceled());
+        self.spend_waiters.retain(|waiter| !waiter.result_tx.is_canceled());
+        !self.confirmation_waiters.is_empty() || !self.spend_waiters.is_empty()
+    }
+
+    fn check_interval(&self) -> u64 {
+        let confirmations_interval = self.confirmation_waiters.iter().map(|waiter| waiter.check_every).min();
+        let spends_interval = if self.spend_waiters.is_empty() {
+            None
+        } else {
+            Some(SPEND_CHECK_INTERVAL)
+        };
+        confirmations_interval
+            .into_iter()
+            .chain(spends_interval)
+            .min()
+            .unwrap_or(SPEND_CHECK_INTERVAL)
+            .max(1)
+    }
+}
+
+#[derive(Clone, Default)]
+pub struct ChainWatcher {
+    state: Arc<Mutex<WatcherState>>,
+}
+
+impl fmt::Debug for ChainWatcher {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let state = self.state.lock().unwrap();
+        f.debug_struct("ChainWatcher")
+            .field("confirmation_waiters", &state.confirmation_waiters.len())
+            .field("spend_waiters", &state.spend_waiters.len())
+            .finish()
+    }
+}
+
+impl ChainWatcher {
+    /// Waits until the `tx` is confirmed `confirmations` times or the `wait_until` timestamp is reached.
+    pub async fn wait_for_confirmations(
+        &self,
+        client: &UtxoRpcClientEnum,
+        tx: UtxoTx,
+        confirmations: u32,
+        requires_notarization: bool,
+        wait_until: u64,
+        check_every: u64,
+    ) -> Result<(), String> {
+        let txid: H256Json = tx.hash().reversed().into();
+        let (result_tx, result_rx) = oneshot::channel();
+        self.register(client, |state| {
+            state.confirmation_waiters.push(ConfirmationWaiter {
+                tx,
+                txid: txid.clone(),
+                confirmations,
+                requires_notarization,
+                check_every,
+                checked: false,
+                spv_verified: None,
+                result_tx,
+            })
+        });
+
+        let timeout = wait_until.saturating_sub(now_ms() / 1000);
+        match result_rx.timeout_secs(timeout as f64).await {
+            Ok(Ok(())) => Ok(()),
+            Ok(Err(_)) => ERR!("The chain watcher is stopped"),
+            Err(_) => ERR!(
+                "Waited too long until {} for transaction {:?} to be confirmed {} times",
+                wait_until,
+                txid,
+                confirmations
+            ),
+        }
+    }
+
+    /// Waits until the `vout` output of the `tx` is spent or the `wait_until` timestamp is reached.
+    /// Returns the spending transaction.
+    pub async fn wait_for_spend(
+        &self,
+        client: &UtxoRpcClientEnum,
+        tx: UtxoTx,
+        vout: usize,
+        from_block: u64,
+        wait_until: u64,
+    ) -> Result<UtxoTx, String> {
+        let txid: H256Json = tx.hash().reversed().into();
+        let (result_tx, result_rx) = oneshot::channel();
+        self.register(client, |state| {
+            state.spend_waiters.push(SpendWaiter {
+                tx,
+                vout,
+                from_block,
+                result_tx,
+            })
+        });
+
+        let timeout = wait_until.saturating_sub(now_ms() / 1000);
+        match result_rx.timeout_secs(timeout as f64).await {
+            Ok(Ok(spend_tx)) => Ok(spend_tx),
+            Ok(Err(_)) => ERR!("The chain watcher is stopped"),
+            Err(_) => ERR!(
+                "Waited too long until {} for transaction {:?} {} to be spent ",
+                wait_until,
+                txid,
+                vout
+            ),
+        }
+    }
+
+    /// Adds the waiter spawning the watching loop if it's not running.
+    fn register(&self, client: &UtxoRpcClientEnum, add_waiter: impl FnOnce(&mut WatcherState)) {
+        let mut state = self.state.lock().unwrap();
+        add_waiter(&mut state);
+        if !state.is_running {
+            state.is_running = true;
+            spawn(watch(self.clone(), client.clone()));
+        } else if let Some(wakeup_tx) = state.wakeup_tx.take() {
+            // the loop might be waiting for the next block
+            wakeup_tx.send(()).ok();
+        }
+    }
+
+    async fn check_confirmations(&self, client: &UtxoRpcClientEnum, new_block: bool) {
+        let mut waiters = std::mem::take(&mut self.state.lock().unwrap().confirmation_waiters);
+        let mut confirmations = HashMap::new();
+        let mut rpc_txids = Vec::new();
+
+        // the notarization can't be checked by the block headers
+        let spv_client = match client {
+            UtxoRpcClientEnum::Electrum(electrum) if electrum.block_headers_storage().is_some() => Some(electrum),
+            _ => None,
+        };
+        for (idx, waiter) in waiters.iter_mut().enumerate() {
+            if waiter.checked && !new_block {
+                continue;
+            }
+            let spv_confirmations = match spv_client {
+                Some(electrum) if !waiter.requires_notarization => {
+                    electrum
+                        .spv_tx_confirmations(&waiter.tx, &mut waiter.spv_verified)
+                        .await
+                },
+                _ => None,
+            };
+            match spv_confirmations {
+                Some(tx_confirmations) => {
+                    confirmations.insert(idx, tx_confirmations);
+                },
+                None => {
+                    if !rpc_txids.contains(&waiter.txid) {
+                        rpc_txids.push(waiter.txid.clone());
+                    }
+                },
+            }
+        }
+
+        if !rpc_txids.is_empty() {
+            let results = client.get_verbose_transactions(&rpc_txids).await;
+            let mut rpc_txs = HashMap::with_capacity(rpc_txids.len());
+            for (txid, result) in rpc_txids.iter().zip(results) {
+                match result {
+                    Ok(rpc_tx) => {
+                        rpc_txs.insert(txid, rpc_tx);
+                    },
+                    Err(e) => error!("Error {:?} getting the transaction {:?}", e, txid),
+                }
+            }
+            for (idx, waiter) in waiters.iter().enumerate() {
+                if confirmations.contains_key(&idx) {
+                    continue;
+                }
+                if let Some(rpc_tx) = rpc_txs.get(&waiter.txid) {
+                    confirmations.insert(idx, rpc_tx_confirmations(rpc_tx, waiter.requires_notarization));
+                }
+            }
+        }
+
+        let mut pending = Vec::with_capacity(waiters.len());
+        for (idx, mut waiter) in waiters.into_iter().enumerate() {
+            match confirmations.get(&idx) {
+                Some(tx_confirmations) if *tx_confirmations >= waiter.confirmations => {
+                    // the receiver might be dropped already
+                    waiter.result_tx.send(()).ok();
+                    continue;
+                },
+                Some(tx_confirmations) => {
+                    waiter.checked = true;
+                    info!(
+                        "Waiting for tx {:?} confirmations, now {}, required {}, requires_notarization {}",
+                        waiter.txid, tx_confirmations, waiter.confirmations, waiter.requires_notarization
+                    );
+                },
+                // checked again the next time
+                None => (),
+            }
+            pending.push(waiter);
+        }
+        self.state.lock().unwrap().confirmation_waiters.extend(pending);
+    }
+
+    async fn check_spends(&self, client: &UtxoRpcClientEnum) {
+        let waiters = std::mem::take(&mut self.state.lock().unwrap().spend_waiters);
+        // the spending transactions by the spent outputs
+        let mut spends: HashMap<(H256, usize), Option<UtxoTx>> = HashMap::new();
+        for waiter in waiters.iter() {
+            let output = (waiter.tx.hash(), waiter.vout);
+            if spends.contains_key(&output) {
+                continue;
+            }
+            let from_block = waiters
+                .iter()
+                .filter(|other| other.vout == waiter.vout && other.tx.hash() == output.0)
+                .map(|other| other.from_block)
+                .min()
+                .unwrap_or(waiter.from_block);
+            let spend = match client
+                .find_output_spend(&waiter.tx, waiter.vout, from_block)
+                .compat()
+                .await
+            {
+                Ok(spend) => spend,
+                Err(e) => {
+                    log!("Error " (e) " on find_output_spend of tx " [output.0.reversed()]);
+                    None
+                },
+            };
+            spends.insert(output, spend);
+        }
+
+        let mut pending = Vec::with_capacity(waiters.len());
+        for waiter in waiters {
+            match spends.get(&(waiter.tx.hash(), waiter.vout)) {
+                Some(Some(spend_tx)) => {
+                    // the receiver might be dropped already
+                    waiter.result_tx.send(spend_tx.clone()).ok();
+                },
+                _ => pending.push(waiter),
+            }
+        }
+        self.state.lock().unwrap().spend_waiters.extend(pending);
+    }
+}
+
+/// Checks the waited events until nobody waits.
+async fn watch(watcher: ChainWatcher, client: UtxoRpcClientEnum) {
+    let mut checked_block = None;
+    let mut notified_block = None;
+    loop {
+        let (wakeup_tx, wakeup_rx) = oneshot::channel();
+        let (check_interval, has_spend_waiters) = {
+            let mut state = watcher.state.lock().unwrap();
+            if !state.retain_waited() {
+                state.is_running = false;
+                state.wakeup_tx = None;
+                return;
+            }
+            // the waiters registered during the checks wake the loop up right away
+            state.wakeup_tx = Some(wakeup_tx);
+            (state.check_interval(), !state.spend_waiters.is_empty())
+        };
+
+        let block_count = match notified_block.take() {
+            Some(height) => Some(height),
+            None => match client.get_block_count().compat().await {
+                Ok(block_count) => Some(block_count),
+                Err(e) => {
+                    error!("Error {} getting the block count", e);
+                    None
+                },
+            },
+        };
+        // the confirmations are checked on every iteration if the block count is unknown
+        let new_block = block_count.is_none() || block_count != checked_block;
+        watcher.check_confirmations(&client, new_block).await;
+        checked_block = block_count;
+        watcher.check_spends(&client).await;
+
+        notified_block = wait_for_next_check(&client, wakeup_rx, check_interval, has_spend_waiters).await;
+    }
+}
+
+/// Waits until the next check is due. Returns the height of the notified block header if any.
+async fn wait_for_next_check(
+    client: &UtxoRpcClientEnum,
+    wakeup_rx: oneshot::Receiver<()>,
+    check_interval: u64,
+    has_spend_waiters: bool,
+) -> Option<u64> {
+    match client {
+        UtxoRpcClientEnum::Electrum(electrum) => {
+            // the new block is notified, so the interval matters for the spends only
+            let timeout = if has_spend_waiters {
+                SPEND_CHECK_INTERVAL
+            } else {
+                HEADER_NOTIFICATION_TIMEOUT
+            };
+            let new_header = electrum.headers_subscription().wait_for_new_header();
+            match select(new_header, wakeup_rx).timeout_secs(timeout as f64).await {
+                Ok(Either::Left((Ok(height), _))) => Some(height),
+                _ => None,
+            }
+        },
+        UtxoRpcClientEnum::Native(_) => {
+            let sleep = Timer::sleep(check_interval as f64);
+            select(sleep, wakeup_rx).await;
+            None
+        },
+    }
+}
+
+#[cfg(all(test, not(target_arch = "wasm32")))]
+mod tests {
+    use super::*;
+    use crate::utxo::rpc_clients::{ElectrumClient, ElectrumClientImpl, NativeClient, NativeClientImpl,
+                                   UtxoRpcClientOps};
+    use common::block_on;
+    use mocktopus::mocking::*;
+    use serialization::deserialize;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    const TX_HEX: &str = "0400008085202f890124443d81192dd9b5d0f89c2efd01f125fecdbbde254ff193455d5ba1cc1e88ba00000000d74730440220519d3eed69815a16357ff07bf453b227654dc85b27ffc22a77abe077302833ec02205c27f439ddc542d332504112871ecac310ea710b99e1922f48eb179c045e44ee01200000000000000000000000000000000000000000000000000000000000000000004c6b6304a9e5e25eb1752102031d4256c4bc9f99ac88bf3dba21773132281f65f9bf23a59928bce08961e2f3ac6782012088a914b8bcb07f6344b42ab04250c86a6e8b75d3fdbbc6882102031d4256c4bc9f99ac88bf3dba21773132281f65f9bf23a59928bce08961e2f3ac68ffffffff0118ddf505000000001976a91405aab5342166f8594baf17a7d9bef5d56744332788acbffee25e000000000000000000000000000000";
+
+    fn test_tx() -> UtxoTx { deserialize(hex::decode(TX_HEX).unwrap().as_slice()).unwrap() }
+
+    fn native_client() -> UtxoRpcClientEnum { NativeClient(Arc::new(NativeClientImpl::default())).into() }
+
+    fn confirmation_waiter(confirmations: u32) -> (ConfirmationWaiter, oneshot::Receiver<()>) {
+        let tx = test_tx();
+        let (result_tx, result_rx) = oneshot::channel();
+        let waiter = ConfirmationWaiter {
+            txid: tx.hash().reversed().into(),
+            tx,
+            confirmations,
+            requires_notarization: false,
+            check_every: 1,
+            checked: false,
+            spv_verified: None,
+            result_tx,
+        };
+        (waiter, result_rx)
+    }
+
+    #[test]
+    fn test_check_confirmations() {
+        static BATCHES_REQUESTED: AtomicUsize = AtomicUsize::new(0);
+        NativeClient::get_verbose_transactions.mock_safe(|_, txids| {
+            // the swaps waiting for the same transaction are checked by one request
+            assert_eq!(txids.len(), 1);
+            BATCHES_REQUESTED.fetch_add(1, Ordering::Relaxed);
+            let tx = RpcTransaction {
+                hex: Default::default(),
+                txid: txids[0].clone(),
+                hash: None,
+                size: Default::default(),
+                vsize: Default::default(),
+                version: 4,
+                locktime: 0,
+                vin: vec![],
+                vout: vec![],
+                blockhash: Default::default(),
+                confirmations: 1,
+                rawconfirmations: Some(2),
+                time: 0,
+                blocktime: 0,
+                height: None,
+            };
+            MockResult::Return(Box::pin(futures::future::ready(vec![Ok(tx)])))
+        });
+
+        let client = native_client();
+        let watcher = ChainWatcher::default();
+        let (confirmed, mut confirmed_rx) = confirmation_waiter(2);
+        let (pending, mut pending_rx) = confirmation_waiter(3);
+        watcher.state.lock().unwrap().confirmation_waiters = vec![confirmed, pending];
+
+        block_on(watcher.check_confirmations(&client, true));
+        assert_eq!(BATCHES_REQUESTED.load(Ordering::Relaxed), 1);
+        assert_eq!(confirmed_rx.try_recv(), Ok(Some(())));
+        assert_eq!(pending_rx.try_recv(), Ok(None));
+        {
+            let state = watcher.state.lock().unwrap();
+            assert_eq!(state.confirmation_waiters.len(), 1);
+            assert!(state.confirmation_waiters[0].checked);
+        }
+
+        // the confirmations can't change until the next block
+        block_on(watcher.check_confirmations(&client, false));
+        assert_eq!(BATCHES_REQUESTED.load(Ordering::Relaxed), 1);
+
+        // the dropped receivers aren't waited anymore
+        drop(pending_rx);
+        assert!(!watcher.state.lock().unwrap().retain_waited());
+    }
+
+    #[test]
+    fn test_check_spends() {
+        static SPENDS_REQUESTED: AtomicUsize = AtomicUsize::new(0);
+        NativeClient::find_output_spend.mock_safe(|_, _, _, from_block| {
+            // the earliest block of the waiters is looked from
+            assert_eq!(from_block, 100);
+            SPENDS_REQUESTED.fetch_add(1, Ordering::Relaxed);
+            MockResult::Return(Box::new(futures01::future::ok(Some(test_tx()))))
+        });
+
+        let client = native_client();
+        let watcher = ChainWatcher::default();
+        let mut receivers = Vec::new();
+        for from_block in &[200, 100] {
+            let (result_tx, result_rx) = oneshot::channel();
+            watcher.state.lock().unwrap().spend_waiters.push(SpendWaiter {
+                tx: test_tx(),
+                vout: 0,
+                from_block: *from_block,
+                result_tx,
+            });
+            receivers.push(result_rx);
+        }
+
+        block_on(watcher.check_spends(&client));
+        assert_eq!(SPENDS_REQUESTED.load(Ordering::Relaxed), 1);
+        for mut result_rx in receivers {
+            assert_eq!(result_rx.try_recv(), Ok(Some(test_tx())));
+        }
+        assert!(watcher.state.lock().unwrap().spend_waiters.is_empty());
+    }
+
+    #[test]
+    fn test_wait_for_next_check() {
+        let electrum = ElectrumClient(Arc::new(ElectrumClientImpl::new("RICK".into(), Vec::new())));
+        let client = UtxoRpcClientEnum::Electrum(electrum.clone());
+
+        // the waiter of the header is added on the first poll, so the header is notified after it
+        let (_wakeup_tx, wakeup_rx) = oneshot::channel();
+        let notify = async { electrum.headers_subscription().on_header_notification(100) };
+        let (notified, _) = block_on(futures::future::join(
+            wait_for_next_check(&client, wakeup_rx, 1, false),
+            notify,
+        ));
+        assert_eq!(notified, Some(100));
+
+        // the just registered waiter wakes the loop up
+        let (wakeup_tx, wakeup_rx) = oneshot::channel();
+        wakeup_tx.send(()).unwrap();
+        assert_eq!(block_on(wait_for_next_check(&client, wakeup_rx, 1, false)), None);
+    }
+}
@@ -0,0 +1,209 @@
+//! The selection of the unspents spent by a transaction.
+//!
+//! The Branch and Bound search looks for the unspents covering the target exactly, so the transaction
+//! doesn't need a change output. The effective values of the unspents (the value minus the fee the input costs)
+//! are used, so every selected unspent pays for itself. If there is no such selection, the smallest unspent
+//! covering the target with a change is taken, or the largest unspents otherwise, to keep the transaction small.
+//!
+//! https://github.com/bitcoin/bitcoin/blob/master/src/wallet/coinselection.cpp
+
+use super::rpc_clients::UnspentInfo;
+use std::cmp::Reverse;
+
+/// The maximum number of the search tree nodes visited by the Branch and Bound search.
+const BNB_TOTAL_TRIES: usize = 100_000;
+
+pub struct SelectionTarget {
+    /// The sum of the outputs plus the fee of the transaction without inputs.
+    pub value: u64,
+    /// The fee the one input costs.
+    pub input_fee: u64,
+    /// The excess that can be given to the miners instead of the change output, the dust amount.
+    pub max_excess: u64,
+    /// The fee of the change output plus the dust amount, the minimal excess the change output can be created for.
+    pub min_change: u64,
+}
+
+/// Reorders the `unspents` so the selected ones go first.
+/// The rest of the unspents follows from the largest to the smallest, so the caller can add them
+/// if the actual transaction fee is larger than estimated.
+pub fn order_unspents_by_selection(mut unspents: Vec<UnspentInfo>, target: &SelectionTarget) -> Vec<UnspentInfo> {
+    unspents.sort_by_key(|unspent| Reverse(unspent.value));
+    let effective_values: Vec<u64> = unspents
+        .iter()
+        .map(|unspent| unspent.value.saturating_sub(target.input_fee))
+        .collect();
+
+    let selected = match select_exact_match(&effective_values, target.value, target.max_excess) {
+        Some(selected) => selected,
+        None => {
+            // the values are sorted in the descending order
+            let smallest_covering = effective_values
+                .iter()
+                .rposition(|value| *value >= target.value + target.min_change);
+            match smallest_covering {
+                Some(idx) => vec![idx],
+                None => return unspents,
+            }
+        },
+    };
+
+    let mut is_selected = vec![false; unspents.len()];
+    for idx in selected.iter() {
+        is_selected[*idx] = true;
+    }
+    let (mut ordered, rest): (Vec<_>, Vec<_>) = unspents
+        .into_iter()
+        .zip(is_selected)
+        .partition(|(_, is_selected)| *is_selected);
+    ordered.extend(rest);
+    ordered.into_iter().map(|(unspent, _)| unspent).collect()
+}
+
+/// Returns the indexes of the `values` which sum is in the `[target, target + max_excess]` range
+/// with the least excess, if any is found within the `BNB_TOTAL_TRIES`.
+/// The `values` must be sorted in the descending order.
+fn select_exact_match(values: &[u64], target: u64, max_excess: u64) -> Option<Vec<usize>> {
+    let mut curr_available: u64 = values.iter().sum();
+    if curr_available < target {
+        return None;
+    }
+
+    // the inclusion flags of the values[..curr_selection.len()]
+    let mut curr_selection: Vec<bool> = Vec::with_capacity(values.len());
+    let mut curr_value = 0;
+    let mut best: Option<(u64, Vec<bool>)> = None;
+
+    for _ in 0..BNB_TOTAL_TRIES {
+        let mut backtrack = false;
+        if curr_value + curr_available < target || curr_value > target + max_excess {
+            // the target can't be reached or is exceeded already
+            backtrack = true;
+        } else if curr_value >= target {
+            let excess = curr_value - target;
+            if best.as_ref().map_or(true, |(best_excess, _)| excess < *best_excess) {
+                best = Some((excess, curr_selection.clone()));
+                if excess == 0 {
+                    break;
+                }
+            }
+            backtrack = true;
+        }
+
+        if backtrack {
+            // walk back to the last included value to try the branch omitting it
+            while let Some(false) = curr_selection.last() {
+                curr_selection.pop();
+                curr_available += values[curr_selection.len()];
+            }
+            match curr_selection.last_mut() {
+                Some(included) => *included = false,
+                // the whole tree is searched
+                None => break,
+            }
+            curr_value -= values[curr_selection.len() - 1];
+        } else {
+            let idx = curr_selection.len();
+            curr_available -= values[idx];
+            // the branch including the value equal to the previous omitted one is searched already
+            let same_as_omitted = idx > 0 && !curr_selection[idx - 1] && values[idx] == values[idx - 1];
+            if same_as_omitted || values[idx] == 0 {
+                curr_selection.push(false);
+            } else {
+                curr_selection.push(true);
+                curr_value += values[idx];
+            }
+        }
+    }
+
+    best.map(|(_, selection)| {
+        selection
+            .into_iter()
+            .enumerate()
+            .filter_map(|(idx, included)| if included { Some(idx) } else { None })
+            .collect()
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use chain::OutPoint;
+
+    fn unspents_for_test(values: &[u64]) -> Vec<UnspentInfo> {
+        values
+            .iter()
+            .enumerate()
+            .map(|(i, value)| UnspentInfo {
+                outpoint: OutPoint {
+                    hash: Default::default(),
+                    index: i as u32,
+                },
+                value: *value,
+                height: None,
+            })
+            .collect()
+    }
+
+    #[test]
+    fn test_select_exact_match() {
+        let values = [10, 9, 7, 5, 3, 1];
+        let selected = select_exact_match(&values, 12, 0).unwrap();
+        let sum: u64 = selected.iter().map(|idx| values[*idx]).sum();
+        assert_eq!(sum, 12);
+
+        // 10 + 9 + 7 + 5 + 3 + 1 = 35
+        assert_eq!(select_exact_match(&values, 35, 0), Some(vec![0, 1, 2, 3, 4, 5]));
+        assert_eq!(select_exact_match(&values, 36, 10), None);
+        // the least excess is chosen
+        assert_eq!(select_exact_match(&[10, 6], 5, 5), Some(vec![1]));
+
+        let values = [8, 8, 8, 8];
+        assert_eq!(select_exact_match(&values, 2, 1), None);
+        assert_eq!(select_exact_match(&values, 15, 1), Some(vec![0, 1]));
+    }
+
+    #[test]
+    fn test_select_exact_match_tries_limit() {
+        // the sum of any selection is even, so the target can't be reached
+        let values: Vec<u64> = (0..100).map(|i| 2 * (i + 1000)).rev().collect();
+        assert_eq!(select_exact_match(&values, 5001, 0), None);
+    }
+
+    #[test]
+    fn test_order_unspents_by_selection() {
+        let unspents = unspents_for_test(&[1000, 6000, 2100, 3000, 20000]);
+        let target = SelectionTarget {
+            value: 4850,
+            input_fee: 100,
+            max_excess: 100,
+            min_change: 200,
+        };
+        // (3000 - 100) + (2100 - 100) = 4850 + 50 of the excess
+        let ordered = order_unspents_by_selection(unspents.clone(), &target);
+        let values: Vec<u64> = ordered.iter().map(|unspent| unspent.value).collect();
+        assert_eq!(values, vec![3000, 2100, 20000, 6000, 1000]);
+
+        // no exact match, the smallest unspent covering the target with the change goes first
+        let target = SelectionTarget {
+            value: 4500,
+            input_fee: 100,
+            max_excess: 0,
+            min_change: 200,
+        };
+        let ordered = order_unspents_by_selection(unspents.clone(), &target);
+        assert_eq!(ordered[0].value, 6000);
+        assert_eq!(ordered.len(), unspents.len());
+
+        // neither the exact match nor the single unspent, the largest unspents go first
+        let target = SelectionTarget {
+            value: 26000,
+            input_fee: 100,
+            max_excess: 0,
+            min_change: 200,
+        };
+        let ordered = order_unspents_by_selection(unspents, &target);
+        let values: Vec<u64> = ordered.iter().map(|unspent| unspent.value).collect();
+        assert_eq!(values, vec![20000, 6000, 3000, 2100, 1000]);
+    }
+}
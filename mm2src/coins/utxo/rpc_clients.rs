@@ -1,14 +1,16 @@
 #![cfg_attr(target_arch = "wasm32", allow(unused_macros))]
 #![cfg_attr(target_arch = "wasm32", allow(dead_code))]
 
+use crate::utxo::block_headers_storage::{merkle_root_from_branch, BlockHeadersStorage};
 use crate::utxo::{sat_from_big_decimal, UtxoAddressFormat};
 use crate::{NumConversError, RpcTransportEventHandler, RpcTransportEventHandlerShared};
 use bigdecimal::BigDecimal;
-use chain::{BlockHeader, OutPoint, Transaction as UtxoTx};
+use chain::{BlockHeaderRef, OutPoint, Transaction as UtxoTx, TransactionRef};
 use common::custom_futures::{select_ok_sequential, FutureTimerExt};
 use common::executor::{spawn, Timer};
-use common::jsonrpc_client::{JsonRpcClient, JsonRpcError, JsonRpcErrorType, JsonRpcMultiClient, JsonRpcRemoteAddr,
-                             JsonRpcRequest, JsonRpcResponse, JsonRpcResponseFut, RpcRes};
+use common::jsonrpc_client::{JsonRpcBatchClient, JsonRpcBatchResponseFut, JsonRpcClient, JsonRpcError,
+                             JsonRpcErrorType, JsonRpcMultiClient, JsonRpcRemoteAddr, JsonRpcRequest, JsonRpcResponse,
+                             JsonRpcResponseFut, RpcBatchRes, RpcRes};
 use common::log::{error, info, warn};
 use common::mm_error::prelude::*;
 use common::mm_number::MmNumber;
@@ -17,9 +19,10 @@ use common::{median, now_float, now_ms, OrdRange};
 use derive_more::Display;
 use futures::channel::oneshot as async_oneshot;
 use futures::compat::{Future01CompatExt, Stream01CompatExt};
-use futures::future::{select as select_func, FutureExt, TryFutureExt};
+use futures::future::{join_all, pending, select as select_func, try_join_all, FutureExt, TryFutureExt};
 use futures::lock::Mutex as AsyncMutex;
-use futures::{select, StreamExt};
+use futures::stream::FuturesUnordered;
+use futures::{pin_mut, select, StreamExt};
 use futures01::future::select_ok;
 use futures01::sync::{mpsc, oneshot};
 use futures01::{Future, Sink, Stream};
@@ -28,19 +31,24 @@ use http::Uri;
 use http::{Request, StatusCode};
 use keys::Address;
 #[cfg(test)] use mocktopus::macros::*;
+use primitives::hash::H256;
 use rpc::v1::types::{Bytes as BytesJson, Transaction as RpcTransaction, H256 as H256Json};
 use script::Builder;
+use serde::de::DeserializeOwned;
+use serde::Serialize;
 use serde_json::{self as json, Value as Json};
-use serialization::{deserialize, serialize, CoinVariant, CompactInteger, Reader};
+use serialization::{deserialize, serialize, CoinVariant};
 use sha2::{Digest, Sha256};
+use std::cmp::Ordering as CmpOrdering;
 use std::collections::hash_map::{Entry, HashMap};
+use std::collections::VecDeque;
 use std::fmt;
 use std::io;
 use std::net::{SocketAddr, ToSocketAddrs};
 use std::num::NonZeroU64;
 use std::ops::Deref;
 use std::sync::atomic::{AtomicU64, Ordering as AtomicOrdering};
-use std::sync::Arc;
+use std::sync::{Arc, Mutex};
 use std::time::Duration;
 
 cfg_native! {
@@ -112,6 +120,14 @@ impl Clone for UtxoRpcClientEnum {
 }
 
 impl UtxoRpcClientEnum {
+    /// The synced block headers if the SPV verification is enabled.
+    pub fn block_headers_storage(&self) -> Option<&BlockHeadersStorage> {
+        match self {
+            UtxoRpcClientEnum::Native(_) => None,
+            UtxoRpcClientEnum::Electrum(electrum) => electrum.block_headers_storage(),
+        }
+    }
+
     pub fn wait_for_confirmations(
         &self,
         tx: &UtxoTx,
@@ -123,6 +139,12 @@ impl UtxoRpcClientEnum {
         let tx = tx.clone();
         let selfi = self.clone();
         let fut = async move {
+            // the notarization can't be checked by the block headers
+            let spv_client = match &selfi {
+                UtxoRpcClientEnum::Electrum(electrum) if !requires_notarization => Some(electrum.clone()),
+                _ => None,
+            };
+            let mut spv_verified = None;
             loop {
                 if now_ms() / 1000 > wait_until {
                     return ERR!(
@@ -133,17 +155,20 @@ impl UtxoRpcClientEnum {
                     );
                 }
 
-                match selfi
-                    .get_verbose_transaction(tx.hash().reversed().into())
-                    .compat()
-                    .await
-                {
-                    Ok(t) => {
-                        let tx_confirmations = if requires_notarization {
-                            t.confirmations
-                        } else {
-                            t.rawconfirmations.unwrap_or(t.confirmations)
-                        };
+                let spv_confirmations = match &spv_client {
+                    Some(electrum) => electrum.spv_tx_confirmations(&tx, &mut spv_verified).await,
+                    None => None,
+                };
+                let tx_confirmations = match spv_confirmations {
+                    Some(tx_confirmations) => Ok(tx_confirmations),
+                    None => selfi
+                        .get_verbose_transaction(tx.hash().reversed().into())
+                        .compat()
+                        .await
+                        .map(|t| rpc_tx_confirmations(&t, requires_notarization)),
+                };
+                match tx_confirmations {
+                    Ok(tx_confirmations) => {
                         if tx_confirmations >= confirmations {
                             return Ok(());
                         } else {
@@ -170,6 +195,15 @@ impl UtxoRpcClientEnum {
     }
 }
 
+/// The confirmations of the verbose transaction, the notarized ones if the `requires_notarization` is set.
+pub fn rpc_tx_confirmations(tx: &RpcTransaction, requires_notarization: bool) -> u32 {
+    if requires_notarization {
+        tx.confirmations
+    } else {
+        tx.rawconfirmations.unwrap_or(tx.confirmations)
+    }
+}
+
 /// Generic unspent info required to build transactions, we need this separate type because native
 /// and Electrum provide different list_unspent format.
 #[derive(Clone, Debug, Eq, Hash, PartialEq)]
@@ -221,6 +255,12 @@ pub trait UtxoRpcClientOps: fmt::Debug + Send + Sync + 'static {
 
     fn get_verbose_transaction(&self, txid: H256Json) -> RpcRes<RpcTransaction>;
 
+    /// Requests the verbose transactions using the batch requests, the results are in the order of `txids`.
+    fn get_verbose_transactions(&self, txids: &[H256Json]) -> RpcBatchRes<RpcTransaction>;
+
+    /// Requests the transactions bytes using the batch requests, the results are in the order of `txids`.
+    fn get_transactions_bytes(&self, txids: &[H256Json]) -> RpcBatchRes<BytesJson>;
+
     fn get_block_count(&self) -> UtxoRpcFut<u64>;
 
     fn display_balance(&self, address: Address, address_format: &UtxoAddressFormat, decimals: u8)
@@ -253,6 +293,40 @@ pub trait UtxoRpcClientOps: fmt::Debug + Send + Sync + 'static {
     ) -> UtxoRpcFut<u32>;
 }
 
+/// Limits the number of the requests sent in one batch.
+/// ElectrumX limits the size of the response to 1MB by default, the batch of verbose transactions should fit it.
+const BATCH_REQUEST_MAX_LEN: usize = 20;
+
+/// Sends the `requests` concurrently in the batches of at most `BATCH_REQUEST_MAX_LEN` requests.
+/// The results are in the order of the requests.
+fn send_batch_request_in_chunks<C, T>(client: &C, requests: Vec<JsonRpcRequest>) -> RpcBatchRes<T>
+where
+    C: JsonRpcBatchClient,
+    T: DeserializeOwned + Send + 'static,
+{
+    let batches: Vec<_> = requests
+        .chunks(BATCH_REQUEST_MAX_LEN)
+        .map(|chunk| client.send_batch_request(chunk.to_vec()))
+        .collect();
+    join_all(batches)
+        .map(|results| results.into_iter().flatten().collect())
+        .boxed()
+}
+
+/// Returns the transaction if it spends the `vout` output of the `tx_hash` transaction.
+/// The inputs are checked on the borrowed view, so only the spending transaction is deserialized.
+fn spending_tx_from_bytes(tx_bytes: &[u8], tx_hash: &H256, vout: usize) -> Result<Option<UtxoTx>, String> {
+    let maybe_spend_tx = try_s!(TransactionRef::parse(tx_bytes).map_err(|e| ERRL!("{:?}", e)));
+    let is_spend = maybe_spend_tx
+        .inputs()
+        .any(|input| input.previous_output.hash == *tx_hash && input.previous_output.index == vout as u32);
+    if !is_spend {
+        return Ok(None);
+    }
+    let spend_tx: UtxoTx = try_s!(deserialize(tx_bytes).map_err(|e| ERRL!("{:?}", e)));
+    Ok(Some(spend_tx))
+}
+
 #[derive(Clone, Deserialize, Debug)]
 pub struct NativeUnspent {
     pub txid: H256Json,
@@ -506,7 +580,23 @@ impl JsonRpcClient for NativeClientImpl {
 
     fn client_info(&self) -> String { UtxoJsonRpcClientInfo::client_info(self) }
 
-    fn transport(&self, request: JsonRpcRequest) -> JsonRpcResponseFut {
+    fn transport(&self, request: JsonRpcRequest) -> JsonRpcResponseFut { self.post_json(request) }
+}
+
+impl JsonRpcBatchClient for NativeClientImpl {
+    fn transport_batch(&self, requests: Vec<JsonRpcRequest>) -> JsonRpcBatchResponseFut { self.post_json(requests) }
+}
+
+impl NativeClientImpl {
+    /// Sends the single or the batch `request` and parses the response body.
+    fn post_json<Req, Res>(
+        &self,
+        request: Req,
+    ) -> Box<dyn Future<Item = (JsonRpcRemoteAddr, Res), Error = String> + Send + 'static>
+    where
+        Req: Serialize + fmt::Debug + Send + 'static,
+        Res: DeserializeOwned + Send + 'static,
+    {
         let request_body = try_fus!(json::to_string(&request));
         // measure now only body length, because the `hyper` crate doesn't allow to get total HTTP packet length
         self.event_handlers.on_outgoing_request(request_body.as_bytes());
@@ -521,7 +611,7 @@ impl JsonRpcClient for NativeClientImpl {
 
         let event_handles = self.event_handlers.clone();
         Box::new(slurp_req(http_request).boxed().compat().then(
-            move |result| -> Result<(JsonRpcRemoteAddr, JsonRpcResponse), String> {
+            move |result| -> Result<(JsonRpcRemoteAddr, Res), String> {
                 let res = try_s!(result);
                 // measure now only body length, because the `hyper` crate doesn't allow to get total HTTP packet length
                 event_handles.on_incoming_response(&res.2);
@@ -587,6 +677,24 @@ impl UtxoRpcClientOps for NativeClient {
         self.get_raw_transaction_verbose(txid)
     }
 
+    fn get_verbose_transactions(&self, txids: &[H256Json]) -> RpcBatchRes<RpcTransaction> {
+        let verbose = 1;
+        let requests = txids
+            .iter()
+            .map(|txid| rpc_req!(self, "getrawtransaction", txid, verbose))
+            .collect();
+        send_batch_request_in_chunks(&**self, requests)
+    }
+
+    fn get_transactions_bytes(&self, txids: &[H256Json]) -> RpcBatchRes<BytesJson> {
+        let verbose = 0;
+        let requests = txids
+            .iter()
+            .map(|txid| rpc_req!(self, "getrawtransaction", txid, verbose))
+            .collect();
+        send_batch_request_in_chunks(&**self, requests)
+    }
+
     fn get_block_count(&self) -> UtxoRpcFut<u64> {
         Box::new(self.0.get_block_count().map_to_mm_fut(UtxoRpcError::from))
     }
@@ -641,7 +749,7 @@ impl UtxoRpcClientOps for NativeClient {
         from_block: u64,
     ) -> Box<dyn Future<Item = Option<UtxoTx>, Error = String> + Send> {
         let selfi = self.clone();
-        let tx = tx.clone();
+        let tx_hash = tx.hash();
         let fut = async move {
             let from_block_hash = try_s!(selfi.get_block_hash(from_block).compat().await);
             let list_since_block: ListSinceBlockRes = try_s!(selfi.list_since_block(from_block_hash).compat().await);
@@ -651,13 +759,8 @@ impl UtxoRpcClientOps for NativeClient {
                 .filter(|tx| !tx.is_conflicting())
             {
                 let maybe_spend_tx_bytes = try_s!(selfi.get_raw_transaction_bytes(transaction.txid).compat().await);
-                let maybe_spend_tx: UtxoTx =
-                    try_s!(deserialize(maybe_spend_tx_bytes.as_slice()).map_err(|e| ERRL!("{:?}", e)));
-
-                for input in maybe_spend_tx.inputs.iter() {
-                    if input.previous_output.hash == tx.hash() && input.previous_output.index == vout as u32 {
-                        return Ok(Some(maybe_spend_tx));
-                    }
+                if let Some(spend_tx) = try_s!(spending_tx_from_bytes(&maybe_spend_tx_bytes, &tx_hash, vout)) {
+                    return Ok(Some(spend_tx));
                 }
             }
             Ok(None)
@@ -890,7 +993,7 @@ impl NativeClientImpl {
 }
 
 #[derive(Clone, Debug, Deserialize)]
-struct ElectrumUnspent {
+pub struct ElectrumUnspent {
     height: Option<u64>,
     tx_hash: H256Json,
     tx_pos: u32,
@@ -945,7 +1048,7 @@ pub enum EstimateFeeMode {
 }
 
 impl ElectrumBlockHeader {
-    fn block_height(&self) -> u64 {
+    pub fn block_height(&self) -> u64 {
         match self {
             ElectrumBlockHeader::V12(h) => h.block_height,
             ElectrumBlockHeader::V14(h) => h.height,
@@ -953,6 +1056,14 @@ impl ElectrumBlockHeader {
     }
 }
 
+/// The merkle branch of the transaction in the block.
+#[derive(Debug, Deserialize)]
+pub struct ElectrumTxMerkle {
+    pub block_height: u64,
+    pub merkle: Vec<H256Json>,
+    pub pos: usize,
+}
+
 #[derive(Debug, Deserialize)]
 pub struct ElectrumTxHistoryItem {
     pub height: i64,
@@ -961,7 +1072,7 @@ pub struct ElectrumTxHistoryItem {
 }
 
 #[derive(Clone, Debug, Deserialize)]
-struct ElectrumBalance {
+pub struct ElectrumBalance {
     confirmed: i64,
     unconfirmed: i64,
 }
@@ -1051,6 +1162,8 @@ fn addr_to_socket_addr(input: &str) -> Result<SocketAddr, String> {
 pub fn spawn_electrum(
     req: &ElectrumRpcRequest,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
 ) -> Result<ElectrumConnection, String> {
     let config = match req.protocol {
         ElectrumProtocol::TCP => ElectrumConfig::TCP,
@@ -1073,7 +1186,13 @@ pub fn spawn_electrum(
         },
     };
 
-    Ok(electrum_connect(req.url.clone(), config, event_handlers))
+    Ok(electrum_connect(
+        req.url.clone(),
+        config,
+        event_handlers,
+        scripthash_subscriptions,
+        headers_subscription,
+    ))
 }
 
 /// Attempts to process the request (parse url, etc), build up the config and create new electrum connection
@@ -1081,6 +1200,8 @@ pub fn spawn_electrum(
 pub fn spawn_electrum(
     req: &ElectrumRpcRequest,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
 ) -> Result<ElectrumConnection, String> {
     let mut url = req.url.clone();
     let uri: Uri = try_s!(req.url.parse());
@@ -1108,7 +1229,66 @@ pub fn spawn_electrum(
         },
     };
 
-    Ok(electrum_connect(url, config, event_handlers))
+    Ok(electrum_connect(
+        url,
+        config,
+        event_handlers,
+        scripthash_subscriptions,
+        headers_subscription,
+    ))
+}
+
+/// The number of the latest response latencies used to estimate the latency percentiles of a connection.
+const LATENCY_SAMPLES_LEN: usize = 64;
+/// Don't hedge the requests until the connection has responded this number of times.
+const MIN_HEDGE_LATENCY_SAMPLES: usize = 8;
+/// The weight of a new sample in the moving latency and error rate averages.
+const STATS_EWMA_WEIGHT: f64 = 0.2;
+/// The time in milliseconds a failed request is assumed to take on calculating the score of a connection.
+const ERROR_PENALTY_MS: f64 = (ELECTRUM_TIMEOUT * 1000) as f64;
+
+/// The latency and error rate estimates of an Electrum connection updated on the responses to the requests,
+/// including the `server.ping` ones.
+#[derive(Debug, Default)]
+pub struct ElectrumConnectionStats {
+    /// The exponential moving average of the response latency in milliseconds.
+    /// None if the server hasn't responded yet.
+    latency_ms: Option<f64>,
+    /// The exponential moving average of the request error rate in the range [0, 1].
+    error_rate: f64,
+    /// The latest response latencies in milliseconds.
+    latest_latencies: VecDeque<u64>,
+}
+
+impl ElectrumConnectionStats {
+    pub fn on_response(&mut self, latency_ms: u64) {
+        self.latency_ms = Some(match self.latency_ms {
+            Some(avg) => avg + STATS_EWMA_WEIGHT * (latency_ms as f64 - avg),
+            None => latency_ms as f64,
+        });
+        self.error_rate -= STATS_EWMA_WEIGHT * self.error_rate;
+        if self.latest_latencies.len() == LATENCY_SAMPLES_LEN {
+            self.latest_latencies.pop_front();
+        }
+        self.latest_latencies.push_back(latency_ms);
+    }
+
+    pub fn on_error(&mut self) { self.error_rate += STATS_EWMA_WEIGHT * (1. - self.error_rate); }
+
+    /// The expected time to get a response, the lower the better.
+    /// The servers that haven't been requested yet are scored the best to measure them.
+    pub fn score(&self) -> f64 { self.latency_ms.unwrap_or_default() + self.error_rate * ERROR_PENALTY_MS }
+
+    /// Returns the 95th percentile of the latest latencies if there are enough samples.
+    pub fn hedge_delay_ms(&self) -> Option<u64> {
+        if self.latest_latencies.len() < MIN_HEDGE_LATENCY_SAMPLES {
+            return None;
+        }
+        let mut latencies: Vec<_> = self.latest_latencies.iter().copied().collect();
+        latencies.sort_unstable();
+        let p95_index = (latencies.len() * 95 + 99) / 100 - 1;
+        Some(latencies[p95_index])
+    }
 }
 
 #[derive(Debug)]
@@ -1126,6 +1306,8 @@ pub struct ElectrumConnection {
     responses: Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
     /// Selected protocol version. The value is initialized after the server.version RPC call.
     protocol_version: AsyncMutex<Option<f32>>,
+    /// The latency and error rate estimates used to select the connection.
+    stats: Arc<Mutex<ElectrumConnectionStats>>,
 }
 
 impl ElectrumConnection {
@@ -1161,13 +1343,38 @@ impl<V> ConcurrentRequestState<V> {
 
 #[derive(Debug)]
 pub struct ConcurrentRequestMap<K, V> {
-    inner: AsyncMutex<HashMap<K, ConcurrentRequestState<V>>>,
+    /// The lock is never held across an await, so the state is reset synchronously when the request is dropped.
+    inner: Mutex<HashMap<K, ConcurrentRequestState<V>>>,
 }
 
 impl<K, V> Default for ConcurrentRequestMap<K, V> {
     fn default() -> Self {
         ConcurrentRequestMap {
-            inner: AsyncMutex::new(HashMap::new()),
+            inner: Mutex::new(HashMap::new()),
+        }
+    }
+}
+
+/// Removes the state of the running request and notifies its subscribers once the request is finished or dropped.
+/// The subscribers of the dropped request get no result and send their own requests instead.
+struct RunningRequestGuard<'a, K: Clone + Eq + std::hash::Hash, V: Clone> {
+    map: &'a ConcurrentRequestMap<K, V>,
+    request_arg: K,
+    request_res: Option<Result<V, JsonRpcError>>,
+}
+
+impl<'a, K: Clone + Eq + std::hash::Hash, V: Clone> Drop for RunningRequestGuard<'a, K, V> {
+    fn drop(&mut self) {
+        let state = self.map.inner.lock().unwrap().remove(&self.request_arg);
+        let (state, request_res) = match (state, self.request_res.take()) {
+            (Some(state), Some(request_res)) => (state, request_res),
+            // the subscribers are notified by dropping their senders
+            _ => return,
+        };
+        for sub in state.subscribers {
+            if sub.send(request_res.clone()).is_err() {
+                warn!("subscriber is dropped");
+            }
         }
     }
 }
@@ -1175,31 +1382,213 @@ impl<K, V> Default for ConcurrentRequestMap<K, V> {
 impl<K: Clone + Eq + std::hash::Hash, V: Clone> ConcurrentRequestMap<K, V> {
     pub fn new() -> ConcurrentRequestMap<K, V> { ConcurrentRequestMap::default() }
 
-    async fn wrap_request(&self, request_arg: K, request_fut: RpcRes<V>) -> Result<V, JsonRpcError> {
-        let mut map = self.inner.lock().await;
-        let state = map
-            .entry(request_arg.clone())
-            .or_insert_with(ConcurrentRequestState::new);
-        if state.is_running {
-            let (tx, rx) = async_oneshot::channel();
-            state.subscribers.push(tx);
-            // drop here to avoid holding the lock during await
-            drop(map);
-            rx.await.unwrap()
-        } else {
-            // drop here to avoid holding the lock during await
-            drop(map);
-            let request_res = request_fut.compat().await;
-            let mut map = self.inner.lock().await;
-            let state = map.get_mut(&request_arg).unwrap();
-            for sub in state.subscribers.drain(..) {
-                if sub.send(request_res.clone()).is_err() {
-                    warn!("subscriber is dropped");
+    pub async fn wrap_request(&self, request_arg: K, request_fut: RpcRes<V>) -> Result<V, JsonRpcError> {
+        loop {
+            let rx = {
+                let mut map = self.inner.lock().unwrap();
+                let state = map
+                    .entry(request_arg.clone())
+                    .or_insert_with(ConcurrentRequestState::new);
+                if !state.is_running {
+                    state.is_running = true;
+                    break;
                 }
+                let (tx, rx) = async_oneshot::channel();
+                state.subscribers.push(tx);
+                rx
+            };
+            match rx.await {
+                Ok(request_res) => return request_res,
+                // the running request is dropped, send this one
+                Err(_) => continue,
+            }
+        }
+
+        let mut guard = RunningRequestGuard {
+            map: self,
+            request_arg,
+            request_res: None,
+        };
+        let request_res = request_fut.compat().await;
+        guard.request_res = Some(request_res.clone());
+        request_res
+    }
+}
+
+/// The `blockchain.scripthash.subscribe` subscription and the data cached until the status of the scripthash changes.
+#[derive(Debug)]
+struct ScripthashSubscription {
+    /// The status notifications come from this server only.
+    server_addr: String,
+    /// The status hash of the scripthash history, None if the history is empty.
+    status: Option<String>,
+    /// Incremented on every invalidation to discard the responses to the requests sent before it.
+    generation: u64,
+    balance: Option<ElectrumBalance>,
+    unspents: Option<Vec<ElectrumUnspent>>,
+}
+
+impl ScripthashSubscription {
+    fn invalidate(&mut self) {
+        self.generation += 1;
+        self.balance = None;
+        self.unspents = None;
+    }
+}
+
+/// The cached data of a scripthash.
+#[derive(Debug)]
+pub enum ScripthashCached<T> {
+    Hit(T),
+    /// The data should be requested from the `server_addr` and stored with the `generation`.
+    Miss {
+        server_addr: String,
+        generation: u64,
+    },
+    NotSubscribed,
+}
+
+/// The scripthashes subscribed to the status notifications.
+/// Their balances and unspents are requested once and then served from the cache
+/// until the server notifies that the status has changed.
+#[derive(Debug, Default)]
+pub struct ScripthashSubscriptions {
+    subscriptions: Mutex<HashMap<String, ScripthashSubscription>>,
+    /// The waiters of the next status change of any scripthash.
+    status_waiters: Mutex<Vec<async_oneshot::Sender<()>>>,
+}
+
+impl ScripthashSubscriptions {
+    pub fn on_subscribed(&self, hash: &str, server_addr: String, status: Option<String>) {
+        let mut subscriptions = self.subscriptions.lock().unwrap();
+        let generation = subscriptions.get(hash).map_or(0, |sub| sub.generation + 1);
+        subscriptions.insert(hash.to_owned(), ScripthashSubscription {
+            server_addr,
+            status,
+            generation,
+            balance: None,
+            unspents: None,
+        });
+    }
+
+    /// Invalidates the cached data of the `hash` if its status has changed.
+    /// Returns whether the status has changed.
+    pub fn on_status_notification(&self, server_addr: &str, hash: &str, status: Option<String>) -> bool {
+        {
+            let mut subscriptions = self.subscriptions.lock().unwrap();
+            match subscriptions.get_mut(hash) {
+                Some(sub) if sub.server_addr == server_addr && sub.status != status => {
+                    sub.status = status;
+                    sub.invalidate();
+                },
+                _ => return false,
             }
-            state.is_running = false;
-            request_res
         }
+        self.notify_status_waiters();
+        true
+    }
+
+    /// The subscriptions are lost on disconnection, so the status might change unnoticed.
+    pub fn on_disconnected(&self, server_addr: &str) {
+        let removed = {
+            let mut subscriptions = self.subscriptions.lock().unwrap();
+            let len = subscriptions.len();
+            subscriptions.retain(|_, sub| sub.server_addr != server_addr);
+            len != subscriptions.len()
+        };
+        if removed {
+            self.notify_status_waiters();
+        }
+    }
+
+    /// Invalidates the cached data of every scripthash without waiting for the notifications,
+    /// e.g. once a transaction is broadcasted.
+    pub fn invalidate_all(&self) {
+        for sub in self.subscriptions.lock().unwrap().values_mut() {
+            sub.invalidate();
+        }
+    }
+
+    pub fn balance(&self, hash: &str) -> ScripthashCached<ElectrumBalance> { self.cached(hash, |sub| &sub.balance) }
+
+    pub fn unspents(&self, hash: &str) -> ScripthashCached<Vec<ElectrumUnspent>> {
+        self.cached(hash, |sub| &sub.unspents)
+    }
+
+    pub fn store_balance(&self, hash: &str, generation: u64, balance: ElectrumBalance) {
+        self.store(hash, generation, |sub| sub.balance = Some(balance));
+    }
+
+    pub fn store_unspents(&self, hash: &str, generation: u64, unspents: Vec<ElectrumUnspent>) {
+        self.store(hash, generation, |sub| sub.unspents = Some(unspents));
+    }
+
+    /// Returns the receiver that is notified on the next status change of any scripthash.
+    pub fn wait_for_status_change(&self) -> async_oneshot::Receiver<()> {
+        let (tx, rx) = async_oneshot::channel();
+        let mut status_waiters = self.status_waiters.lock().unwrap();
+        // the receivers might be dropped on timeout
+        status_waiters.retain(|waiter| !waiter.is_canceled());
+        status_waiters.push(tx);
+        rx
+    }
+
+    fn cached<T: Clone>(
+        &self,
+        hash: &str,
+        get_data: impl Fn(&ScripthashSubscription) -> &Option<T>,
+    ) -> ScripthashCached<T> {
+        match self.subscriptions.lock().unwrap().get(hash) {
+            Some(sub) => match get_data(sub) {
+                Some(data) => ScripthashCached::Hit(data.clone()),
+                None => ScripthashCached::Miss {
+                    server_addr: sub.server_addr.clone(),
+                    generation: sub.generation,
+                },
+            },
+            None => ScripthashCached::NotSubscribed,
+        }
+    }
+
+    fn store(&self, hash: &str, generation: u64, set_data: impl FnOnce(&mut ScripthashSubscription)) {
+        match self.subscriptions.lock().unwrap().get_mut(hash) {
+            // the data is outdated if the scripthash was invalidated after the request
+            Some(sub) if sub.generation == generation => set_data(sub),
+            _ => (),
+        }
+    }
+
+    fn notify_status_waiters(&self) {
+        for waiter in self.status_waiters.lock().unwrap().drain(..) {
+            // the receiver might be dropped already
+            waiter.send(()).ok();
+        }
+    }
+}
+
+/// The waiters of the new block headers notified by the servers.
+/// A connection is subscribed to the notifications by every `blockchain.headers.subscribe` request sent over it.
+#[derive(Debug, Default)]
+pub struct HeadersSubscription {
+    waiters: Mutex<Vec<async_oneshot::Sender<u64>>>,
+}
+
+impl HeadersSubscription {
+    pub fn on_header_notification(&self, height: u64) {
+        for waiter in self.waiters.lock().unwrap().drain(..) {
+            // the receiver might be dropped already
+            waiter.send(height).ok();
+        }
+    }
+
+    /// Returns the receiver of the height of the next notified block header.
+    pub fn wait_for_new_header(&self) -> async_oneshot::Receiver<u64> {
+        let (tx, rx) = async_oneshot::channel();
+        let mut waiters = self.waiters.lock().unwrap();
+        // the receivers might be dropped on timeout
+        waiters.retain(|waiter| !waiter.is_canceled());
+        waiters.push(tx);
+        rx
     }
 }
 
@@ -1212,51 +1601,192 @@ pub struct ElectrumClientImpl {
     protocol_version: OrdRange<f32>,
     get_balance_concurrent_map: ConcurrentRequestMap<String, ElectrumBalance>,
     list_unspent_concurrent_map: ConcurrentRequestMap<String, Vec<ElectrumUnspent>>,
+    /// Whether to send the request to the next best connection too
+    /// if the best one doesn't respond within its 95th latency percentile.
+    hedge_requests: bool,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
+    /// The headers the transaction confirmations and the median time past are checked against locally.
+    block_headers_storage: Option<Arc<BlockHeadersStorage>>,
 }
 
-async fn electrum_request_multi(
-    client: ElectrumClient,
-    request: JsonRpcRequest,
-) -> Result<(JsonRpcRemoteAddr, JsonRpcResponse), String> {
-    let mut futures = vec![];
+/// The connection the request can be sent to.
+struct ElectrumRequestTarget {
+    addr: String,
+    tx: mpsc::Sender<Vec<u8>>,
+    responses: Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
+    stats: Arc<Mutex<ElectrumConnectionStats>>,
+}
+
+impl ElectrumRequestTarget {
+    /// Returns None if the connection is not established yet.
+    async fn from_connection(connection: &ElectrumConnection) -> Option<ElectrumRequestTarget> {
+        let tx = connection.tx.lock().await.clone()?;
+        Some(ElectrumRequestTarget {
+            addr: connection.addr.clone(),
+            tx,
+            responses: connection.responses.clone(),
+            stats: connection.stats.clone(),
+        })
+    }
+
+    fn score(&self) -> f64 { self.stats.lock().unwrap().score() }
+
+    fn request(
+        self,
+        request: JsonRpcRequest,
+        event_handlers: Vec<RpcTransportEventHandlerShared>,
+        timeout: u64,
+    ) -> JsonRpcResponseFut {
+        let fut = electrum_request(request, self.tx.clone(), self.responses.clone(), timeout);
+        self.track_response(fut, event_handlers)
+    }
+
+    fn batch_request(
+        self,
+        requests: Vec<JsonRpcRequest>,
+        event_handlers: Vec<RpcTransportEventHandlerShared>,
+        timeout: u64,
+    ) -> JsonRpcBatchResponseFut {
+        let fut = electrum_batch_request(requests, self.tx.clone(), self.responses.clone(), timeout);
+        self.track_response(fut, event_handlers)
+    }
+
+    /// Updates the connection stats and reports the response latency to the `event_handlers`.
+    fn track_response<T: Send + 'static>(
+        self,
+        fut: Box<dyn Future<Item = T, Error = String> + Send + 'static>,
+        event_handlers: Vec<RpcTransportEventHandlerShared>,
+    ) -> Box<dyn Future<Item = (JsonRpcRemoteAddr, T), Error = String> + Send + 'static> {
+        let ElectrumRequestTarget { addr, stats, .. } = self;
+        let started_at = now_ms();
+        Box::new(fut.then(move |result| {
+            match result {
+                Ok(_) => {
+                    let latency_ms = now_ms().saturating_sub(started_at);
+                    stats.lock().unwrap().on_response(latency_ms);
+                    event_handlers.on_response_latency(&addr, Duration::from_millis(latency_ms));
+                },
+                Err(_) => stats.lock().unwrap().on_error(),
+            }
+            result.map(|response| (JsonRpcRemoteAddr(addr), response))
+        }))
+    }
+}
+
+/// Returns the established connections ordered by their score, the best first,
+/// and the timeout of a request to one connection.
+async fn electrum_request_targets(client: &ElectrumClient) -> Result<(Vec<ElectrumRequestTarget>, u64), String> {
+    let mut targets = vec![];
     let connections = client.connections.lock().await;
     for connection in connections.iter() {
-        let connection_addr = connection.addr.clone();
-        match &*connection.tx.lock().await {
-            Some(tx) => {
-                let fut = electrum_request(
-                    request.clone(),
-                    tx.clone(),
-                    connection.responses.clone(),
-                    ELECTRUM_TIMEOUT / connections.len() as u64,
-                )
-                .map(|response| (JsonRpcRemoteAddr(connection_addr), response));
-                futures.push(fut)
-            },
-            None => (),
+        if let Some(target) = ElectrumRequestTarget::from_connection(connection).await {
+            targets.push((target.score(), target));
         }
     }
+    let connections_len = connections.len();
     drop(connections);
-    if futures.is_empty() {
+    if targets.is_empty() {
         return ERR!("All electrums are currently disconnected");
     }
-    if request.method != "server.ping" {
-        Ok(try_s!(
-            select_ok_sequential(futures)
-                .map_err(|e| ERRL!("{:?}", e))
-                .compat()
-                .await
-        ))
-    } else {
+    let timeout = ELECTRUM_TIMEOUT / connections_len as u64;
+
+    targets.sort_by(|(score_a, _), (score_b, _)| score_a.partial_cmp(score_b).unwrap_or(CmpOrdering::Equal));
+    Ok((targets.into_iter().map(|(_, target)| target).collect(), timeout))
+}
+
+async fn electrum_request_multi(
+    client: ElectrumClient,
+    request: JsonRpcRequest,
+) -> Result<(JsonRpcRemoteAddr, JsonRpcResponse), String> {
+    let _span = trace_span!("electrum", "{}", request.method);
+    let (targets, timeout) = try_s!(electrum_request_targets(&client).await);
+    let event_handlers = client.event_handlers.clone();
+    if request.method == "server.ping" {
         // server.ping must be sent to all servers to keep all connections alive
-        Ok(try_s!(
+        let futures = targets
+            .into_iter()
+            .map(|target| target.request(request.clone(), event_handlers.clone(), timeout));
+        return Ok(try_s!(
             select_ok(futures)
                 .map(|(result, _)| result)
                 .map_err(|e| ERRL!("{:?}", e))
                 .compat()
                 .await
-        ))
+        ));
+    }
+
+    if client.hedge_requests {
+        return electrum_request_hedged(targets, request, event_handlers, timeout).await;
     }
+    let futures = targets
+        .into_iter()
+        .map(|target| target.request(request.clone(), event_handlers.clone(), timeout));
+    Ok(try_s!(
+        select_ok_sequential(futures)
+            .map_err(|e| ERRL!("{:?}", e))
+            .compat()
+            .await
+    ))
+}
+
+/// Sends the request to the connections one by one until a successful response.
+/// The request is sent to the next connection either on an error of the previous one
+/// or if the previous one doesn't respond within its 95th latency percentile, the first response is taken then.
+async fn electrum_request_hedged(
+    targets: Vec<ElectrumRequestTarget>,
+    request: JsonRpcRequest,
+    event_handlers: Vec<RpcTransportEventHandlerShared>,
+    timeout: u64,
+) -> Result<(JsonRpcRemoteAddr, JsonRpcResponse), String> {
+    let mut targets = targets.into_iter().peekable();
+    let mut in_flight = FuturesUnordered::new();
+    let mut errors = vec![];
+    loop {
+        let mut hedge_delay_ms = None;
+        if let Some(target) = targets.next() {
+            hedge_delay_ms = target.stats.lock().unwrap().hedge_delay_ms();
+            in_flight.push(
+                target
+                    .request(request.clone(), event_handlers.clone(), timeout)
+                    .compat(),
+            );
+        }
+        if in_flight.is_empty() {
+            return ERR!("{:?}", errors);
+        }
+
+        let hedge_timer = match hedge_delay_ms {
+            Some(delay_ms) if targets.peek().is_some() => Timer::sleep(delay_ms as f64 / 1000.).left_future(),
+            _ => pending().right_future(),
+        }
+        .fuse();
+        pin_mut!(hedge_timer);
+        select! {
+            result = in_flight.select_next_some() => match result {
+                Ok(response) => return Ok(response),
+                Err(e) => errors.push(e),
+            },
+            _ = hedge_timer => (),
+        }
+    }
+}
+
+async fn electrum_batch_request_multi(
+    client: ElectrumClient,
+    requests: Vec<JsonRpcRequest>,
+) -> Result<(JsonRpcRemoteAddr, Vec<JsonRpcResponse>), String> {
+    let _span = trace_span!("electrum", "batch of {}", requests.len());
+    let (targets, timeout) = try_s!(electrum_request_targets(&client).await);
+    let futures = targets
+        .into_iter()
+        .map(|target| target.batch_request(requests.clone(), client.event_handlers.clone(), timeout));
+    Ok(try_s!(
+        select_ok_sequential(futures)
+            .map_err(|e| ERRL!("{:?}", e))
+            .compat()
+            .await
+    ))
 }
 
 async fn electrum_request_to(
@@ -1264,34 +1794,45 @@ async fn electrum_request_to(
     request: JsonRpcRequest,
     to_addr: String,
 ) -> Result<(JsonRpcRemoteAddr, JsonRpcResponse), String> {
-    let (tx, responses) = {
+    let _span = trace_span!("electrum", "{} to {}", request.method, to_addr);
+    let target = {
         let connections = client.connections.lock().await;
         let connection = connections
             .iter()
             .find(|c| c.addr == to_addr)
             .ok_or(ERRL!("Unknown destination address {}", to_addr))?;
-        let responses = connection.responses.clone();
-        let tx = {
-            match &*connection.tx.lock().await {
-                Some(tx) => tx.clone(),
-                None => return ERR!("Connection {} is not established yet", to_addr),
-            }
-        };
-        (tx, responses)
+        match ElectrumRequestTarget::from_connection(connection).await {
+            Some(target) => target,
+            None => return ERR!("Connection {} is not established yet", to_addr),
+        }
     };
 
-    let response = try_s!(
-        electrum_request(request.clone(), tx, responses, ELECTRUM_TIMEOUT)
+    Ok(try_s!(
+        target
+            .request(request, client.event_handlers.clone(), ELECTRUM_TIMEOUT)
             .compat()
             .await
-    );
-    Ok((JsonRpcRemoteAddr(to_addr.to_owned()), response))
+    ))
 }
 
 impl ElectrumClientImpl {
+    /// Enable or disable sending the request to the next best connection
+    /// if the best one doesn't respond within its 95th latency percentile.
+    pub fn set_hedge_requests(&mut self, hedge_requests: bool) { self.hedge_requests = hedge_requests; }
+
+    /// Enables the SPV verification against the block headers synced to the `storage`.
+    pub fn set_block_headers_storage(&mut self, storage: Arc<BlockHeadersStorage>) {
+        self.block_headers_storage = Some(storage);
+    }
+
     /// Create an Electrum connection and spawn a green thread actor to handle it.
     pub async fn add_server(&self, req: &ElectrumRpcRequest) -> Result<(), String> {
-        let connection = try_s!(spawn_electrum(req, self.event_handlers.clone()));
+        let connection = try_s!(spawn_electrum(
+            req,
+            self.event_handlers.clone(),
+            self.scripthash_subscriptions.clone(),
+            self.headers_subscription.clone()
+        ));
         self.connections.lock().await.push(connection);
         Ok(())
     }
@@ -1344,6 +1885,12 @@ impl ElectrumClientImpl {
 
     /// Get available protocol versions.
     pub fn protocol_version(&self) -> &OrdRange<f32> { &self.protocol_version }
+
+    pub fn scripthash_subscriptions(&self) -> &ScripthashSubscriptions { &self.scripthash_subscriptions }
+
+    pub fn headers_subscription(&self) -> &HeadersSubscription { &self.headers_subscription }
+
+    pub fn block_headers_storage(&self) -> Option<&BlockHeadersStorage> { self.block_headers_storage.as_deref() }
 }
 
 #[derive(Clone, Debug)]
@@ -1354,6 +1901,7 @@ impl Deref for ElectrumClient {
 }
 
 const BLOCKCHAIN_HEADERS_SUB_ID: &str = "blockchain.headers.subscribe";
+const BLOCKCHAIN_SCRIPTHASH_SUB_ID: &str = "blockchain.scripthash.subscribe";
 
 impl UtxoJsonRpcClientInfo for ElectrumClient {
     fn coin_name(&self) -> &str { self.coin_ticker.as_str() }
@@ -1377,6 +1925,12 @@ impl JsonRpcMultiClient for ElectrumClient {
     }
 }
 
+impl JsonRpcBatchClient for ElectrumClient {
+    fn transport_batch(&self, requests: Vec<JsonRpcRequest>) -> JsonRpcBatchResponseFut {
+        Box::new(electrum_batch_request_multi(self.clone(), requests).boxed().compat())
+    }
+}
+
 impl ElectrumClient {
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#server-ping
     pub fn server_ping(&self) -> RpcRes<()> { rpc_func!(self, "server.ping") }
@@ -1395,53 +1949,141 @@ impl ElectrumClient {
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-scripthash-listunspent
     /// It can return duplicates sometimes: https://github.com/artemii235/SuperNET/issues/269
     /// We should remove them to build valid transactions
+    /// The unspents of a subscribed scripthash are cached until its status changes.
     fn scripthash_list_unspent(&self, hash: &str) -> RpcRes<Vec<ElectrumUnspent>> {
-        let request_fut = Box::new(rpc_func!(self, "blockchain.scripthash.listunspent", hash).and_then(
-            move |unspents: Vec<ElectrumUnspent>| {
-                let mut map: HashMap<(H256Json, u32), bool> = HashMap::new();
-                let unspents = unspents
-                    .into_iter()
-                    .filter(|unspent| match map.entry((unspent.tx_hash.clone(), unspent.tx_pos)) {
-                        Entry::Occupied(_) => false,
-                        Entry::Vacant(e) => {
-                            e.insert(true);
-                            true
-                        },
-                    })
-                    .collect();
-                Ok(unspents)
-            },
-        ));
         let arc = self.clone();
         let hash = hash.to_owned();
-        let fut = async move { arc.list_unspent_concurrent_map.wrap_request(hash, request_fut).await };
+        let fut = async move {
+            match arc.scripthash_cached(&hash, ScripthashSubscriptions::unspents).await {
+                ScripthashCached::Hit(unspents) => Ok(unspents),
+                ScripthashCached::Miss {
+                    server_addr,
+                    generation,
+                } => {
+                    let request = rpc_func_from!(arc, &server_addr, "blockchain.scripthash.listunspent", &hash);
+                    let unspents = arc.unspents_request(hash.clone(), request).await?;
+                    arc.scripthash_subscriptions
+                        .store_unspents(&hash, generation, unspents.clone());
+                    Ok(unspents)
+                },
+                ScripthashCached::NotSubscribed => {
+                    let request = rpc_func!(arc, "blockchain.scripthash.listunspent", &hash);
+                    arc.unspents_request(hash, request).await
+                },
+            }
+        };
         Box::new(fut.boxed().compat())
     }
 
+    /// Removes the duplicates from the `listunspent` response and de-duplicates the concurrent requests.
+    async fn unspents_request(
+        &self,
+        hash: String,
+        request: RpcRes<Vec<ElectrumUnspent>>,
+    ) -> Result<Vec<ElectrumUnspent>, JsonRpcError> {
+        let request_fut = Box::new(request.and_then(move |unspents: Vec<ElectrumUnspent>| {
+            let mut map: HashMap<(H256Json, u32), bool> = HashMap::new();
+            let unspents = unspents
+                .into_iter()
+                .filter(|unspent| match map.entry((unspent.tx_hash.clone(), unspent.tx_pos)) {
+                    Entry::Occupied(_) => false,
+                    Entry::Vacant(e) => {
+                        e.insert(true);
+                        true
+                    },
+                })
+                .collect();
+            Ok(unspents)
+        }));
+        self.list_unspent_concurrent_map.wrap_request(hash, request_fut).await
+    }
+
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-scripthash-get-history
     pub fn scripthash_get_history(&self, hash: &str) -> RpcRes<Vec<ElectrumTxHistoryItem>> {
         rpc_func!(self, "blockchain.scripthash.get_history", hash)
     }
 
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-scripthash-gethistory
+    /// The balance of a subscribed scripthash is cached until its status changes.
     fn scripthash_get_balance(&self, hash: &str) -> RpcRes<ElectrumBalance> {
         let arc = self.clone();
         let hash = hash.to_owned();
         let fut = async move {
-            let request = rpc_func!(arc, "blockchain.scripthash.get_balance", &hash);
-            arc.get_balance_concurrent_map.wrap_request(hash, request).await
+            match arc.scripthash_cached(&hash, ScripthashSubscriptions::balance).await {
+                ScripthashCached::Hit(balance) => Ok(balance),
+                ScripthashCached::Miss {
+                    server_addr,
+                    generation,
+                } => {
+                    let request = rpc_func_from!(arc, &server_addr, "blockchain.scripthash.get_balance", &hash);
+                    let balance = arc
+                        .get_balance_concurrent_map
+                        .wrap_request(hash.clone(), request)
+                        .await?;
+                    arc.scripthash_subscriptions
+                        .store_balance(&hash, generation, balance.clone());
+                    Ok(balance)
+                },
+                ScripthashCached::NotSubscribed => {
+                    let request = rpc_func!(arc, "blockchain.scripthash.get_balance", &hash);
+                    arc.get_balance_concurrent_map.wrap_request(hash, request).await
+                },
+            }
         };
         Box::new(fut.boxed().compat())
     }
 
+    /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-scripthash-subscribe
+    /// Subscribes to the status changes of the scripthash on the best scored server.
+    async fn scripthash_subscribe(&self, hash: &str) -> Result<(), String> {
+        let (targets, _) = try_s!(electrum_request_targets(self).await);
+        // the targets are not empty
+        let server_addr = targets[0].addr.clone();
+        let status: Option<String> = try_s!(
+            rpc_func_from!(self, &server_addr, BLOCKCHAIN_SCRIPTHASH_SUB_ID, hash)
+                .compat()
+                .await
+        );
+        self.scripthash_subscriptions.on_subscribed(hash, server_addr, status);
+        Ok(())
+    }
+
+    /// Returns the cached data of the scripthash subscribing to it if it's not subscribed yet.
+    /// Returns `ScripthashCached::NotSubscribed` if the subscription fails, so the data is requested as usual.
+    async fn scripthash_cached<T>(
+        &self,
+        hash: &str,
+        get_cached: fn(&ScripthashSubscriptions, &str) -> ScripthashCached<T>,
+    ) -> ScripthashCached<T> {
+        match get_cached(&self.scripthash_subscriptions, hash) {
+            ScripthashCached::NotSubscribed => (),
+            cached => return cached,
+        }
+        match self.scripthash_subscribe(hash).await {
+            Ok(()) => get_cached(&self.scripthash_subscriptions, hash),
+            Err(e) => {
+                warn!("Error {} subscribing to {}", e, hash);
+                ScripthashCached::NotSubscribed
+            },
+        }
+    }
+
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-headers-subscribe
     pub fn blockchain_headers_subscribe(&self) -> RpcRes<ElectrumBlockHeader> {
         rpc_func!(self, "blockchain.headers.subscribe")
     }
 
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-transaction-broadcast
+    /// The cached balances and unspents are invalidated once the transaction is broadcasted
+    /// not to wait for the status notifications.
     fn blockchain_transaction_broadcast(&self, tx: BytesJson) -> RpcRes<H256Json> {
-        rpc_func!(self, "blockchain.transaction.broadcast", tx)
+        let arc = self.clone();
+        Box::new(
+            rpc_func!(self, "blockchain.transaction.broadcast", tx).map(move |tx_hash| {
+                arc.scripthash_subscriptions.invalidate_all();
+                tx_hash
+            }),
+        )
     }
 
     /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-estimatefee
@@ -1459,6 +2101,72 @@ impl ElectrumClient {
     pub fn blockchain_block_headers(&self, start_height: u64, count: NonZeroU64) -> RpcRes<ElectrumBlockHeadersRes> {
         rpc_func!(self, "blockchain.block.headers", start_height, count)
     }
+
+    /// https://electrumx.readthedocs.io/en/latest/protocol-methods.html#blockchain-transaction-get-merkle
+    pub fn blockchain_transaction_get_merkle(&self, txid: H256Json, height: u64) -> RpcRes<ElectrumTxMerkle> {
+        rpc_func!(self, "blockchain.transaction.get_merkle", txid, height)
+    }
+
+    /// Returns the transaction confirmations counted by the synced block headers
+    /// once the transaction merkle proof is checked against the header it's mined in.
+    /// The `verified` is the block height and the merkle root the transaction was verified at before,
+    /// the proof isn't requested again unless the block is reorganized.
+    /// Returns None if the confirmations can't be counted locally, so they should be requested as usual.
+    pub async fn spv_tx_confirmations(&self, tx: &UtxoTx, verified: &mut Option<(u64, H256)>) -> Option<u32> {
+        let storage = self.block_headers_storage()?;
+        let tip = storage.synced_tip_height()?;
+        if let Some((height, merkle_root)) = verified.as_ref() {
+            if storage.merkle_root(*height).as_ref() == Some(merkle_root) {
+                return Some((tip + 1).saturating_sub(*height) as u32);
+            }
+            *verified = None;
+        }
+
+        let tx_hash = tx.hash();
+        let txid: H256Json = tx_hash.reversed().into();
+        let script_hash = hex::encode(electrum_script_hash(&tx.outputs.first()?.script_pubkey));
+        let history = match self.scripthash_get_history(&script_hash).compat().await {
+            Ok(history) => history,
+            Err(e) => {
+                error!("Error {} getting the history of {:?}", e, txid);
+                return None;
+            },
+        };
+        let height = match history.iter().find(|item| item.tx_hash == txid) {
+            Some(item) if item.height > 0 => item.height as u64,
+            // the mempool transaction is not mined yet
+            Some(_) => return Some(0),
+            // the transaction is not in the history of its first output, the confirmations are requested as usual
+            None => return None,
+        };
+        if height > tip {
+            // the header is not synced yet
+            return Some(0);
+        }
+        let merkle_root = storage.merkle_root(height)?;
+
+        let proof = match self
+            .blockchain_transaction_get_merkle(txid.clone(), height)
+            .compat()
+            .await
+        {
+            Ok(proof) => proof,
+            Err(e) => {
+                error!("Error {} getting the merkle proof of {:?}", e, txid);
+                return None;
+            },
+        };
+        let branch: Vec<H256> = proof.merkle.iter().map(|hash| hash.reversed().into()).collect();
+        if merkle_root_from_branch(&tx_hash, &branch, proof.pos) != merkle_root {
+            error!(
+                "The merkle proof of {:?} doesn't match the block {} header",
+                txid, height
+            );
+            return Some(0);
+        }
+        *verified = Some((height, merkle_root));
+        Some((tip + 1 - height) as u32)
+    }
 }
 
 #[cfg_attr(test, mockable)]
@@ -1511,7 +2219,31 @@ impl UtxoRpcClientOps for ElectrumClient {
         rpc_func!(self, "blockchain.transaction.get", txid, verbose)
     }
 
+    fn get_verbose_transactions(&self, txids: &[H256Json]) -> RpcBatchRes<RpcTransaction> {
+        let verbose = true;
+        let requests = txids
+            .iter()
+            .map(|txid| rpc_req!(self, "blockchain.transaction.get", txid, verbose))
+            .collect();
+        send_batch_request_in_chunks(self, requests)
+    }
+
+    fn get_transactions_bytes(&self, txids: &[H256Json]) -> RpcBatchRes<BytesJson> {
+        let verbose = false;
+        let requests = txids
+            .iter()
+            .map(|txid| rpc_req!(self, "blockchain.transaction.get", txid, verbose))
+            .collect();
+        send_batch_request_in_chunks(self, requests)
+    }
+
     fn get_block_count(&self) -> UtxoRpcFut<u64> {
+        if let Some(height) = self
+            .block_headers_storage()
+            .and_then(BlockHeadersStorage::synced_tip_height)
+        {
+            return Box::new(futures01::future::ok(height));
+        }
         Box::new(
             self.blockchain_headers_subscribe()
                 .map(|r| r.block_height())
@@ -1561,7 +2293,7 @@ impl UtxoRpcClientOps for ElectrumClient {
     ) -> Box<dyn Future<Item = Option<UtxoTx>, Error = String> + Send> {
         let selfi = self.clone();
         let script_hash = hex::encode(electrum_script_hash(&tx.outputs[vout].script_pubkey));
-        let tx = tx.clone();
+        let tx_hash = tx.hash();
         let fut = async move {
             let history = try_s!(selfi.scripthash_get_history(&script_hash).compat().await);
 
@@ -1571,13 +2303,8 @@ impl UtxoRpcClientOps for ElectrumClient {
 
             for item in history.iter() {
                 let transaction = try_s!(selfi.get_transaction_bytes(item.tx_hash.clone()).compat().await);
-
-                let maybe_spend_tx: UtxoTx = try_s!(deserialize(transaction.as_slice()).map_err(|e| ERRL!("{:?}", e)));
-
-                for input in maybe_spend_tx.inputs.iter() {
-                    if input.previous_output.hash == tx.hash() && input.previous_output.index == vout as u32 {
-                        return Ok(Some(maybe_spend_tx));
-                    }
+                if let Some(spend_tx) = try_s!(spending_tx_from_bytes(&transaction, &tx_hash, vout)) {
+                    return Ok(Some(spend_tx));
                 }
             }
             Ok(None)
@@ -1596,6 +2323,12 @@ impl UtxoRpcClientOps for ElectrumClient {
         } else {
             starting_block - count.get() + 1
         };
+        let stored_mtp = self
+            .block_headers_storage()
+            .and_then(|storage| storage.median_time_past(starting_block, starting_block + 1 - from));
+        if let Some(mtp) = stored_mtp {
+            return Box::new(futures01::future::ok(mtp));
+        }
         Box::new(
             self.blockchain_block_headers(from, count)
                 .map_to_mm_fut(UtxoRpcError::from)
@@ -1603,12 +2336,8 @@ impl UtxoRpcClientOps for ElectrumClient {
                     if res.count == 0 {
                         return MmError::err(UtxoRpcError::InvalidResponse("Server returned zero count".to_owned()));
                     }
-                    let len = CompactInteger::from(res.count);
-                    let mut serialized = serialize(&len).take();
-                    serialized.extend(res.hex.0.into_iter());
-                    let mut reader = Reader::new_with_coin_variant(serialized.as_slice(), coin_variant);
-                    let headers = reader.read_list::<BlockHeader>()?;
-                    let mut timestamps: Vec<_> = headers.into_iter().map(|block| block.time).collect();
+                    let headers = BlockHeaderRef::parse_list(&res.hex.0, &coin_variant)?;
+                    let mut timestamps: Vec<_> = headers.iter().map(|header| header.time()).collect();
                     // can unwrap because count is non zero
                     Ok(median(timestamps.as_mut_slice()).unwrap())
                 }),
@@ -1628,6 +2357,10 @@ impl ElectrumClientImpl {
             protocol_version,
             get_balance_concurrent_map: ConcurrentRequestMap::new(),
             list_unspent_concurrent_map: ConcurrentRequestMap::new(),
+            hedge_requests: false,
+            scripthash_subscriptions: Arc::new(ScripthashSubscriptions::default()),
+            headers_subscription: Arc::new(HeadersSubscription::default()),
+            block_headers_storage: None,
         }
     }
 
@@ -1651,7 +2384,30 @@ fn rx_to_stream(rx: mpsc::Receiver<Vec<u8>>) -> impl Stream<Item = Vec<u8>, Erro
 
 async fn electrum_process_json(
     raw_json: Json,
+    addr: &str,
     arc: &Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
+    scripthash_subscriptions: &ScripthashSubscriptions,
+    headers_subscription: &HeadersSubscription,
+) {
+    match raw_json {
+        // the batch response is an array of the responses to the batch requests
+        Json::Array(responses) => {
+            for response in responses {
+                electrum_process_single_json(response, addr, arc, scripthash_subscriptions, headers_subscription).await
+            }
+        },
+        raw_json => {
+            electrum_process_single_json(raw_json, addr, arc, scripthash_subscriptions, headers_subscription).await
+        },
+    }
+}
+
+async fn electrum_process_single_json(
+    raw_json: Json,
+    addr: &str,
+    arc: &Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
+    scripthash_subscriptions: &ScripthashSubscriptions,
+    headers_subscription: &HeadersSubscription,
 ) {
     // detect if we got standard JSONRPC response or subscription response as JSONRPC request
     if raw_json["method"].is_null() && raw_json["params"].is_null() {
@@ -1677,8 +2433,32 @@ async fn electrum_process_json(
                 return;
             },
         };
+        if request.method == BLOCKCHAIN_SCRIPTHASH_SUB_ID {
+            // the notification params are [scripthash, status]
+            match json::from_value::<(String, Option<String>)>(Json::Array(request.params)) {
+                Ok((hash, status)) => {
+                    scripthash_subscriptions.on_status_notification(addr, &hash, status);
+                },
+                Err(e) => error!("Error {} parsing the scripthash notification from {}", e, addr),
+            }
+            return;
+        }
+
         let id = match request.method.as_ref() {
-            BLOCKCHAIN_HEADERS_SUB_ID => BLOCKCHAIN_HEADERS_SUB_ID,
+            BLOCKCHAIN_HEADERS_SUB_ID => {
+                // the notification params are [header]
+                match request
+                    .params
+                    .get(0)
+                    .cloned()
+                    .map(json::from_value::<ElectrumBlockHeader>)
+                {
+                    Some(Ok(header)) => headers_subscription.on_header_notification(header.block_height()),
+                    Some(Err(e)) => error!("Error {} parsing the header notification from {}", e, addr),
+                    None => error!("Empty header notification from {}", addr),
+                }
+                BLOCKCHAIN_HEADERS_SUB_ID
+            },
             _ => {
                 error!("Couldn't get id of request {:?}", request);
                 return;
@@ -1703,7 +2483,10 @@ async fn electrum_process_json(
 
 async fn electrum_process_chunk(
     chunk: &[u8],
+    addr: &str,
     arc: &Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
+    scripthash_subscriptions: &ScripthashSubscriptions,
+    headers_subscription: &HeadersSubscription,
 ) {
     // we should split the received chunk because we can get several responses in 1 chunk.
     let split = chunk.split(|item| *item == b'\n');
@@ -1717,7 +2500,7 @@ async fn electrum_process_chunk(
                     return;
                 },
             };
-            electrum_process_json(raw_json, arc).await
+            electrum_process_json(raw_json, addr, arc, scripthash_subscriptions, headers_subscription).await
         }
     }
 }
@@ -1812,6 +2595,8 @@ async fn connect_loop(
     responses: Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
     connection_tx: Arc<AsyncMutex<Option<mpsc::Sender<Vec<u8>>>>>,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
 ) -> Result<(), ()> {
     let mut delay: u64 = 0;
 
@@ -1868,6 +2653,8 @@ async fn connect_loop(
             let addr = addr.clone();
             let responses = responses.clone();
             let event_handlers = event_handlers.clone();
+            let scripthash_subscriptions = scripthash_subscriptions.clone();
+            let headers_subscription = headers_subscription.clone();
             async move {
                 let mut buffer = String::with_capacity(1024);
                 let mut buf_reader = BufReader::new(read);
@@ -1888,7 +2675,14 @@ async fn connect_loop(
                     event_handlers.on_incoming_response(buffer.as_bytes());
                     last_chunk.store(now_ms(), AtomicOrdering::Relaxed);
 
-                    electrum_process_chunk(buffer.as_bytes(), &responses).await;
+                    electrum_process_chunk(
+                        buffer.as_bytes(),
+                        &addr,
+                        &responses,
+                        &scripthash_subscriptions,
+                        &headers_subscription,
+                    )
+                    .await;
                     buffer.clear();
                 }
             }
@@ -1911,6 +2705,7 @@ async fn connect_loop(
             () => {
                 info!("{} connection dropped", addr);
                 *connection_tx.lock().await = None;
+                scripthash_subscriptions.on_disconnected(&addr);
                 continue;
             };
         }
@@ -1930,6 +2725,8 @@ async fn connect_loop(
     responses: Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
     connection_tx: Arc<AsyncMutex<Option<mpsc::Sender<Vec<u8>>>>>,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
 ) -> Result<(), ()> {
     use std::sync::atomic::AtomicUsize;
 
@@ -1963,6 +2760,8 @@ async fn connect_loop(
             let addr = addr.clone();
             let responses = responses.clone();
             let event_handlers = event_handlers.clone();
+            let scripthash_subscriptions = scripthash_subscriptions.clone();
+            let headers_subscription = headers_subscription.clone();
             async move {
                 while let Some(incoming_res) = transport_rx.next().await {
                     last_chunk.store(now_ms(), AtomicOrdering::Relaxed);
@@ -1972,7 +2771,14 @@ async fn connect_loop(
                             let incoming_str = incoming_json.to_string();
                             event_handlers.on_incoming_response(incoming_str.as_bytes());
 
-                            electrum_process_json(incoming_json, &responses).await;
+                            electrum_process_json(
+                                incoming_json,
+                                &addr,
+                                &responses,
+                                &scripthash_subscriptions,
+                                &headers_subscription,
+                            )
+                            .await;
                         },
                         Err(e) => {
                             error!("{} error: {:?}", addr, e);
@@ -2011,6 +2817,7 @@ async fn connect_loop(
             () => {
                 info!("{} connection dropped", addr);
                 *connection_tx.lock().await = None;
+                scripthash_subscriptions.on_disconnected(&addr);
                 continue;
             };
         }
@@ -2029,6 +2836,8 @@ fn electrum_connect(
     addr: String,
     config: ElectrumConfig,
     event_handlers: Vec<RpcTransportEventHandlerShared>,
+    scripthash_subscriptions: Arc<ScripthashSubscriptions>,
+    headers_subscription: Arc<HeadersSubscription>,
 ) -> ElectrumConnection {
     let (shutdown_tx, shutdown_rx) = oneshot::channel::<()>();
     let responses = Arc::new(AsyncMutex::new(HashMap::new()));
@@ -2040,6 +2849,8 @@ fn electrum_connect(
         responses.clone(),
         tx.clone(),
         event_handlers,
+        scripthash_subscriptions,
+        headers_subscription,
     );
 
     let connect_loop = select_func(connect_loop.boxed(), shutdown_rx.compat());
@@ -2051,6 +2862,7 @@ fn electrum_connect(
         shutdown_tx: Some(shutdown_tx),
         responses,
         protocol_version: AsyncMutex::new(None),
+        stats: Arc::new(Mutex::new(ElectrumConnectionStats::default())),
     }
 }
 
@@ -2087,3 +2899,44 @@ fn electrum_request(
         .map_err(|e| ERRL!("{}", e));
     Box::new(send_fut)
 }
+
+/// Sends the `requests` as one batch and returns the responses in the order of the requests.
+fn electrum_batch_request(
+    requests: Vec<JsonRpcRequest>,
+    tx: mpsc::Sender<Vec<u8>>,
+    responses: Arc<AsyncMutex<HashMap<String, async_oneshot::Sender<JsonRpcResponse>>>>,
+    timeout: u64,
+) -> Box<dyn Future<Item = Vec<JsonRpcResponse>, Error = String> + Send + 'static> {
+    let send_fut = async move {
+        let mut json = try_s!(json::to_string(&requests));
+        #[cfg(not(target_arch = "wasm"))]
+        {
+            // Electrum request and responses must end with \n
+            // https://electrumx.readthedocs.io/en/latest/protocol-basics.html#message-stream
+            json.push('\n');
+        }
+
+        let mut resp_rxs = Vec::with_capacity(requests.len());
+        {
+            let mut responses = responses.lock().await;
+            for request in requests.iter() {
+                let (req_tx, resp_rx) = async_oneshot::channel();
+                responses.insert(request.get_id().to_string(), req_tx);
+                resp_rxs.push(resp_rx);
+            }
+        }
+        try_s!(tx.send(json.into_bytes()).compat().await);
+        let responses = try_s!(try_join_all(resp_rxs).await);
+        Ok(responses)
+    };
+    let send_fut = send_fut
+        .boxed()
+        .timeout(Duration::from_secs(timeout))
+        .compat()
+        .then(|res| match res {
+            Ok(responses) => responses,
+            Err(timeout_error) => ERR!("{}", timeout_error),
+        })
+        .map_err(|e| ERRL!("{}", e));
+    Box::new(send_fut)
+}
@@ -1,44 +1,403 @@
+//! The verbose transactions cache of a coin stored in a single append-only file `TX_CACHE/<TICKER>.txcache`.
+//!
+//! The record layout is `[payload len: u32 LE][txid: 32 bytes][CRC32: u32 LE][payload]`, where the payload is
+//! the JSON-encoded verbose transaction and the CRC32 is of the txid and the payload. The index from txid
+//! to the latest record is built on the first access of the coin cache. The file is truncated at the first
+//! torn or corrupted record. The appended records are synced to the disk.
+//! A record of an already cached txid supersedes the previous one, the file is compacted on the open
+//! if the superseded records outweigh the actual ones.
+//!
+//! Every coin cache is locked independently, the file I/O runs on the blocking thread pool. The legacy one-file-per-txid `TX_CACHE/<txid>` cache
+//! is used as a fallback, the transactions found there are moved to the coin cache.
+
+use common::executor::spawn_blocking;
 use common::safe_slurp;
 use futures::lock::Mutex as AsyncMutex;
 use rpc::v1::types::{Transaction as RpcTransaction, H256 as H256Json};
-use std::path::PathBuf;
+use std::collections::HashMap;
+use std::convert::TryInto;
+use std::fs::{File, OpenOptions};
+use std::io::{BufReader, Read, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+
+const RECORD_HEADER_LEN: u64 = 4 + 32 + 4;
+/// Don't compact the file until the superseded records occupy at least this number of bytes.
+const MIN_COMPACTION_BYTES: u64 = 1024 * 1024;
+
+type SharedStore = Arc<AsyncMutex<Option<TxCacheStore>>>;
 
 lazy_static! {
-    static ref TX_CACHE_LOCK: AsyncMutex<()> = AsyncMutex::new(());
+    /// The coin caches by their file paths. The global lock is held only to find the coin cache.
+    static ref TX_CACHE_STORES: Mutex<HashMap<PathBuf, SharedStore>> = Mutex::new(HashMap::new());
 }
 
-/// Try load transaction from cache.
-/// Note: tx.confirmations can be out-of-date.
-pub async fn load_transaction_from_cache(
-    tx_cache_path: &PathBuf,
-    txid: &H256Json,
-) -> Result<Option<RpcTransaction>, String> {
-    let _lock = TX_CACHE_LOCK.lock().await;
+#[derive(Clone, Copy)]
+struct RecordPosition {
+    payload_offset: u64,
+    payload_len: u32,
+    checksum: u32,
+}
+
+struct TxCacheStore {
+    file: File,
+    index: HashMap<H256Json, RecordPosition>,
+    /// The length of the valid file part, the records are appended there.
+    file_len: u64,
+}
+
+impl TxCacheStore {
+    fn open(path: &Path) -> Result<TxCacheStore, String> {
+        let mut store = try_s!(Self::open_no_compaction(path));
+        let actual_len = store.actual_records_len();
+        let superseded_len = store.file_len - actual_len;
+        if superseded_len >= MIN_COMPACTION_BYTES && superseded_len > actual_len {
+            match store.compact(path) {
+                Ok(()) => store = try_s!(Self::open_no_compaction(path)),
+                // the store is still usable
+                Err(e) => log!("Error " (e) " compacting " [path]),
+            }
+        }
+        Ok(store)
+    }
+
+    fn open_no_compaction(path: &Path) -> Result<TxCacheStore, String> {
+        let file = try_s!(OpenOptions::new().read(true).write(true).create(true).open(path));
+        let total_len = try_s!(file.metadata()).len();
+
+        let mut index = HashMap::new();
+        let mut file_len = 0;
+        {
+            // the records are read sequentially to verify their checksums
+            let mut reader = BufReader::new(try_s!(file.try_clone()));
+            let mut header = [0; RECORD_HEADER_LEN as usize];
+            let mut payload = Vec::new();
+            while file_len + RECORD_HEADER_LEN <= total_len {
+                try_s!(reader.read_exact(&mut header));
+                let payload_len = u32::from_le_bytes(header[..4].try_into().expect("4 bytes"));
+                let checksum = u32::from_le_bytes(header[36..].try_into().expect("4 bytes"));
+                let payload_offset = file_len + RECORD_HEADER_LEN;
+                if payload_offset + payload_len as u64 > total_len {
+                    break;
+                }
+
+                let mut txid = [0; 32];
+                txid.copy_from_slice(&header[4..36]);
+                payload.resize(payload_len as usize, 0);
+                try_s!(reader.read_exact(&mut payload));
+                if record_checksum(&txid, &payload) != checksum {
+                    break;
+                }
+                index.insert(H256Json(txid), RecordPosition {
+                    payload_offset,
+                    payload_len,
+                    checksum,
+                });
+                file_len = payload_offset + payload_len as u64;
+            }
+        }
+
+        if file_len < total_len {
+            // the last record was not written completely or the record is corrupted
+            log!("Truncating " (total_len - file_len) " bytes of the torn or corrupted records at " [path]);
+            try_s!(file.set_len(file_len));
+            try_s!(file.sync_data());
+        }
+
+        Ok(TxCacheStore { file, index, file_len })
+    }
+
+    fn actual_records_len(&self) -> u64 {
+        self.index
+            .values()
+            .fold(0, |len, position| len + RECORD_HEADER_LEN + position.payload_len as u64)
+    }
+
+    /// Rewrites the actual records only to a temporary file that replaces the store file then.
+    fn compact(&mut self, path: &Path) -> Result<(), String> {
+        let tmp_path = path.with_extension("tmp");
+        let mut tmp_file = try_s!(File::create(&tmp_path));
+        let mut positions: Vec<_> = self
+            .index
+            .iter()
+            .map(|(txid, position)| (txid.clone(), *position))
+            .collect();
+        positions.sort_unstable_by_key(|(_, position)| position.payload_offset);
+        for (txid, position) in positions {
+            let payload = try_s!(self.read_payload(&txid, position));
+            try_s!(tmp_file.write_all(&encode_record(&txid, &payload)));
+        }
+        try_s!(tmp_file.sync_all());
+        try_s!(std::fs::rename(tmp_path, path));
+        Ok(())
+    }
+
+    fn read_payload(&mut self, txid: &H256Json, position: RecordPosition) -> Result<Vec<u8>, String> {
+        let mut payload = vec![0; position.payload_len as usize];
+        try_s!(self.file.seek(SeekFrom::Start(position.payload_offset)));
+        try_s!(self.file.read_exact(&mut payload));
+        if record_checksum(&txid.0, &payload) != position.checksum {
+            return ERR!("The record of {:?} is corrupted", txid);
+        }
+        Ok(payload)
+    }
+
+    fn load(&mut self, txid: &H256Json) -> Result<Option<RpcTransaction>, String> {
+        let position = match self.index.get(txid) {
+            Some(position) => *position,
+            None => return Ok(None),
+        };
+        let payload = try_s!(self.read_payload(txid, position));
+        serde_json::from_slice(&payload).map(Some).map_err(|e| ERRL!("{}", e))
+    }
+
+    fn append(&mut self, tx: &RpcTransaction) -> Result<(), String> {
+        let payload = try_s!(serde_json::to_vec(tx));
+        let record = encode_record(&tx.txid, &payload);
+        let write_res = self
+            .file
+            .seek(SeekFrom::Start(self.file_len))
+            .and_then(|_| self.file.write_all(&record))
+            .and_then(|_| self.file.sync_data());
+        if let Err(e) = write_res {
+            // drop the partially written record
+            self.file.set_len(self.file_len).ok();
+            return ERR!("{}", e);
+        }
+
+        self.index.insert(tx.txid.clone(), RecordPosition {
+            payload_offset: self.file_len + RECORD_HEADER_LEN,
+            payload_len: payload.len() as u32,
+            checksum: record_checksum(&tx.txid.0, &payload),
+        });
+        self.file_len += record.len() as u64;
+        Ok(())
+    }
+}
+
+fn encode_record(txid: &H256Json, payload: &[u8]) -> Vec<u8> {
+    let mut record = Vec::with_capacity(RECORD_HEADER_LEN as usize + payload.len());
+    record.extend_from_slice(&(payload.len() as u32).to_le_bytes());
+    record.extend_from_slice(&txid.0);
+    record.extend_from_slice(&record_checksum(&txid.0, payload).to_le_bytes());
+    record.extend_from_slice(payload);
+    record
+}
+
+fn record_checksum(txid: &[u8; 32], payload: &[u8]) -> u32 {
+    let mut hasher = crc32fast::Hasher::new();
+    hasher.update(txid);
+    hasher.update(payload);
+    hasher.finalize()
+}
+
+fn coin_store_path(tx_cache_path: &Path, ticker: &str) -> PathBuf { tx_cache_path.join(format!("{}.txcache", ticker)) }
 
-    let path = cached_transaction_path(tx_cache_path, &txid);
+fn coin_store(tx_cache_path: &Path, ticker: &str) -> SharedStore {
+    let path = coin_store_path(tx_cache_path, ticker);
+    let mut stores = TX_CACHE_STORES.lock().unwrap();
+    stores
+        .entry(path)
+        .or_insert_with(|| Arc::new(AsyncMutex::new(None)))
+        .clone()
+}
+
+/// Runs the `f` with the coin cache on the blocking thread pool.
+/// The coin cache is opened on the first access, it stays locked until the `f` is done.
+async fn with_store<R, F>(tx_cache_path: &Path, ticker: &str, f: F) -> Result<R, String>
+where
+    R: Send + 'static,
+    F: FnOnce(&mut TxCacheStore) -> Result<R, String> + Send + 'static,
+{
+    let path = coin_store_path(tx_cache_path, ticker);
+    let shared_store = coin_store(tx_cache_path, ticker);
+    let mut store_guard = shared_store.lock().await;
+    // the store is opened again on the next access if the future is dropped
+    let store = store_guard.take();
+    let (store, result) = spawn_blocking(move || {
+        let mut store = match store {
+            Some(store) => store,
+            None => match TxCacheStore::open(&path) {
+                Ok(store) => store,
+                Err(e) => return (None, Err(e)),
+            },
+        };
+        let result = f(&mut store);
+        (Some(store), result)
+    })
+    .await;
+    *store_guard = store;
+    result
+}
+
+/// Loads the transaction from the legacy one-file-per-txid cache.
+fn load_legacy_transaction(tx_cache_path: &Path, txid: &H256Json) -> Result<Option<RpcTransaction>, String> {
+    let path = tx_cache_path.join(format!("{:?}", txid));
     let data = try_s!(safe_slurp(&path));
     if data.is_empty() {
         // couldn't find corresponding file
         return Ok(None);
     }
+    serde_json::from_slice(&data).map(Some).map_err(|e| ERRL!("{}", e))
+}
 
-    let data = try_s!(String::from_utf8(data));
-    serde_json::from_str(&data).map(Some).map_err(|e| ERRL!("{}", e))
+/// Try load transactions from cache.
+/// Returns the found transactions only, the transactions failed to load are logged.
+/// Note: tx.confirmations can be out-of-date.
+pub async fn load_transactions_from_cache<'a>(
+    tx_cache_path: &Path,
+    ticker: &str,
+    txids: impl IntoIterator<Item = &'a H256Json>,
+) -> Result<HashMap<H256Json, RpcTransaction>, String> {
+    let legacy_path = tx_cache_path.to_owned();
+    let txids: Vec<_> = txids.into_iter().cloned().collect();
+    with_store(tx_cache_path, ticker, move |store| {
+        let mut found = HashMap::new();
+        for txid in txids {
+            let loaded = match store.load(&txid) {
+                Ok(None) => load_legacy_transaction(&legacy_path, &txid).map(|tx| tx.map(|tx| (tx, true))),
+                loaded => loaded.map(|tx| tx.map(|tx| (tx, false))),
+            };
+            match loaded {
+                Ok(Some((tx, from_legacy))) => {
+                    if from_legacy {
+                        if let Err(e) = store.append(&tx) {
+                            log!("Error " (e) " moving the " [txid] " transaction to the coin cache");
+                        }
+                    }
+                    found.insert(txid, tx);
+                },
+                Ok(None) => (),
+                Err(e) => log!("Error " (e) " loading the " [txid] " transaction from cache"),
+            }
+        }
+        Ok(found)
+    })
+    .await
+}
+
+/// Try load transaction from cache.
+/// Note: tx.confirmations can be out-of-date.
+pub async fn load_transaction_from_cache(
+    tx_cache_path: &Path,
+    ticker: &str,
+    txid: &H256Json,
+) -> Result<Option<RpcTransaction>, String> {
+    let mut found = try_s!(load_transactions_from_cache(tx_cache_path, ticker, std::iter::once(txid)).await);
+    Ok(found.remove(txid))
 }
 
 /// Upload transaction to cache.
-pub async fn cache_transaction(tx_cache_path: &PathBuf, tx: &RpcTransaction) -> Result<(), String> {
-    let _lock = TX_CACHE_LOCK.lock().await;
-    let path = cached_transaction_path(tx_cache_path, &tx.txid);
-    let tmp_path = format!("{}.tmp", path.display());
+pub async fn cache_transaction(tx_cache_path: &Path, ticker: &str, tx: &RpcTransaction) -> Result<(), String> {
+    let tx = tx.clone();
+    with_store(tx_cache_path, ticker, move |store| store.append(&tx)).await
+}
 
-    let content = try_s!(serde_json::to_string(tx));
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use common::{block_on, now_ms, temp_dir};
 
-    try_s!(std::fs::write(&tmp_path, content));
-    try_s!(std::fs::rename(tmp_path, path));
-    Ok(())
-}
+    fn tx_for_test(txid: u8, locktime: u32) -> RpcTransaction {
+        let txid = H256Json([txid; 32]);
+        serde_json::from_value(json!({
+            "hex": "0400008085202f89",
+            "txid": txid,
+            "vin": [],
+            "vout": [],
+            "version": 4,
+            "locktime": locktime,
+            "height": 100,
+        }))
+        .unwrap()
+    }
+
+    fn tx_cache_path_for_test(name: &str) -> PathBuf {
+        let path = temp_dir().join(format!("{}_{}", name, now_ms()));
+        std::fs::create_dir_all(&path).unwrap();
+        path
+    }
+
+    #[test]
+    fn test_tx_cache_store_reopen() {
+        let tx_cache_path = tx_cache_path_for_test("test_tx_cache_store_reopen");
+        let path = coin_store_path(&tx_cache_path, "RICK");
+        let tx1 = tx_for_test(1, 0);
+        let tx2 = tx_for_test(2, 0);
+        let tx1_updated = tx_for_test(1, 1);
+
+        let mut store = TxCacheStore::open(&path).unwrap();
+        store.append(&tx1).unwrap();
+        store.append(&tx2).unwrap();
+        store.append(&tx1_updated).unwrap();
+        let file_len = store.file_len;
+        assert_eq!(store.load(&tx1.txid).unwrap(), Some(tx1_updated.clone()));
+        drop(store);
+
+        // simulate the record that was not written completely
+        let mut file = OpenOptions::new().append(true).open(&path).unwrap();
+        file.write_all(&encode_record(&H256Json([3; 32]), b"{\"hex\":")[..44])
+            .unwrap();
+        drop(file);
+
+        let mut store = TxCacheStore::open(&path).unwrap();
+        assert_eq!(store.file_len, file_len);
+        assert_eq!(store.index.len(), 2);
+        assert_eq!(store.load(&tx1.txid).unwrap(), Some(tx1_updated));
+        assert_eq!(store.load(&tx2.txid).unwrap(), Some(tx2.clone()));
+        assert_eq!(store.load(&H256Json([3; 32])).unwrap(), None);
+
+        store.compact(&path).unwrap();
+        let store = TxCacheStore::open(&path).unwrap();
+        assert_eq!(store.file_len, store.actual_records_len());
+        assert!(store.file_len < file_len);
+    }
 
-fn cached_transaction_path(tx_cache_path: &PathBuf, txid: &H256Json) -> PathBuf {
-    tx_cache_path.join(format!("{:?}", txid))
+    #[test]
+    fn test_corrupted_record_truncated() {
+        let tx_cache_path = tx_cache_path_for_test("test_corrupted_record_truncated");
+        let path = coin_store_path(&tx_cache_path, "RICK");
+        let tx1 = tx_for_test(1, 0);
+
+        let mut store = TxCacheStore::open(&path).unwrap();
+        store.append(&tx1).unwrap();
+        let file_len = store.file_len;
+        store.append(&tx_for_test(2, 0)).unwrap();
+        store.append(&tx_for_test(3, 0)).unwrap();
+        drop(store);
+
+        // corrupt the payload of the second record, so it and the record after it are dropped
+        let mut content = std::fs::read(&path).unwrap();
+        content[file_len as usize + RECORD_HEADER_LEN as usize + 2] ^= 0xff;
+        std::fs::write(&path, &content).unwrap();
+
+        let mut store = TxCacheStore::open(&path).unwrap();
+        assert_eq!(store.file_len, file_len);
+        assert_eq!(store.index.len(), 1);
+        assert_eq!(store.load(&tx1.txid).unwrap(), Some(tx1));
+        assert_eq!(store.load(&H256Json([2; 32])).unwrap(), None);
+        assert_eq!(std::fs::metadata(&path).unwrap().len(), file_len);
+    }
+
+    #[test]
+    fn test_load_transactions_from_legacy_cache() {
+        let tx_cache_path = tx_cache_path_for_test("test_load_transactions_from_legacy_cache");
+        let legacy_tx = tx_for_test(1, 0);
+        let tx = tx_for_test(2, 0);
+        let legacy_path = tx_cache_path.join(format!("{:?}", legacy_tx.txid));
+        std::fs::write(&legacy_path, serde_json::to_vec(&legacy_tx).unwrap()).unwrap();
+        block_on(cache_transaction(&tx_cache_path, "RICK", &tx)).unwrap();
+
+        let unknown_txid = H256Json([3; 32]);
+        let txids = vec![legacy_tx.txid.clone(), tx.txid.clone(), unknown_txid];
+        let found = block_on(load_transactions_from_cache(&tx_cache_path, "RICK", txids.iter())).unwrap();
+        assert_eq!(found.len(), 2);
+        assert_eq!(found[&legacy_tx.txid], legacy_tx);
+        assert_eq!(found[&tx.txid], tx);
+
+        // the legacy transaction is moved to the coin cache
+        std::fs::remove_file(&legacy_path).unwrap();
+        let loaded = block_on(load_transaction_from_cache(&tx_cache_path, "RICK", &legacy_tx.txid)).unwrap();
+        assert_eq!(loaded, Some(legacy_tx));
+    }
 }
@@ -12,7 +12,7 @@ use common::mm_metrics::MetricsArc;
 use common::mm_number::MmNumber;
 use common::{block_on, now_ms};
 use futures::compat::Future01CompatExt;
-use futures::future::{FutureExt, TryFutureExt};
+use futures::future::{select, FutureExt, TryFutureExt};
 use futures01::future::Either;
 use keys::bytes::Bytes;
 use keys::{Address, AddressHash, KeyPair, Public, SegwitAddress, Type};
@@ -25,12 +25,15 @@ use serde_json::{self as json};
 use serialization::{deserialize, serialize, CoinVariant};
 use std::cmp::Ordering;
 use std::collections::hash_map::{Entry, HashMap};
+use std::collections::HashSet;
 use std::str::FromStr;
 use std::sync::atomic::Ordering as AtomicOrderding;
 
 pub use chain::Transaction as UtxoTx;
 
+use self::coin_selection::{order_unspents_by_selection, SelectionTarget};
 use self::rpc_clients::{electrum_script_hash, UnspentInfo, UtxoRpcClientEnum, UtxoRpcClientOps, UtxoRpcResult};
+use self::utxo_index::UnspentMaturity;
 use crate::{CanRefundHtlc, CoinBalance, TradePreimageValue, ValidateAddressResult, WithdrawResult};
 
 const MIN_BTC_TRADING_VOL: &str = "0.00777";
@@ -51,6 +54,8 @@ lazy_static! {
 }
 
 pub const HISTORY_TOO_LARGE_ERR_CODE: i64 = -1;
+/// The number of the history transactions requested at once.
+const HISTORY_BATCH_LEN: usize = 100;
 
 pub struct UtxoArcBuilder<'a> {
     ctx: &'a MmArc,
@@ -360,6 +365,8 @@ where
     } else {
         None
     };
+    let target = coin_selection_target(&tx, &fee_policy, &coin_tx_fee, sum_outputs_value, dust, min_relay_fee);
+    let utxos = order_unspents_by_selection(utxos, &target);
     for utxo in utxos.iter() {
         sum_inputs += utxo.value;
         tx.inputs.push(UnsignedTransactionInput {
@@ -483,6 +490,43 @@ where
     Ok(coin.calc_interest_if_required(tx, data, change_script_pubkey).await?)
 }
 
+/// Estimates the selection target of the transaction without inputs, see [`order_unspents_by_selection`].
+fn coin_selection_target(
+    tx: &TransactionInputSigner,
+    fee_policy: &FeePolicy,
+    coin_tx_fee: &ActualTxFee,
+    sum_outputs_value: u64,
+    dust: u64,
+    min_relay_fee: Option<u64>,
+) -> SelectionTarget {
+    let (fee_per_kb, base_fee) = match coin_tx_fee {
+        ActualTxFee::Fixed(f) => (0, *f),
+        // the per kbyte fee is rounded up to the next kbyte, the estimation ignores that
+        ActualTxFee::Dynamic(f) | ActualTxFee::FixedPerKb(f) => {
+            let base_size = serialize(&UtxoTx::from(tx.clone())).len() as u64;
+            (*f, (f * base_size) / KILO_BYTE)
+        },
+    };
+    let base_fee = std::cmp::max(base_fee, min_relay_fee.unwrap_or_default());
+    let min_change = (fee_per_kb * P2PKH_OUTPUT_LEN) / KILO_BYTE + dust;
+    match fee_policy {
+        FeePolicy::SendExact => SelectionTarget {
+            value: sum_outputs_value + base_fee,
+            input_fee: (fee_per_kb * P2PKH_INPUT_LEN) / KILO_BYTE,
+            max_excess: dust,
+            min_change,
+        },
+        // the fee is deducted from the output, so the inputs have to cover the outputs only
+        // the output is the sum of all unspents usually (max withdraw, merge), they all are selected then
+        FeePolicy::DeductFromOutput(_) => SelectionTarget {
+            value: sum_outputs_value,
+            input_fee: 0,
+            max_excess: dust,
+            min_change,
+        },
+    }
+}
+
 /// Calculates interest if the coin is KMD
 /// Adds the value to existing output to my_script_pub or creates additional interest output
 /// returns transaction and data as is if the coin is not KMD
@@ -923,8 +967,18 @@ where
 {
     match tx.height {
         Some(confirmed_at) => Ok(confirmed_at <= block_number),
-        // fallback to a number of confirmations
         None => {
+            let block_hash = tx.blockhash.reversed().into();
+            let stored_height = coin
+                .as_ref()
+                .rpc_client
+                .block_headers_storage()
+                .and_then(|storage| storage.block_height(&block_hash));
+            if let Some(confirmed_at) = stored_height {
+                return Ok(confirmed_at <= block_number);
+            }
+
+            // fallback to a number of confirmations
             if tx.confirmations > 0 {
                 let current_block = try_s!(coin.as_ref().rpc_client.get_block_count().compat().await);
                 let confirmed_at = current_block + 1 - tx.confirmations as u64;
@@ -1251,8 +1305,21 @@ pub fn wait_for_confirmations(
 ) -> Box<dyn Future<Item = (), Error = String> + Send> {
     let mut tx: UtxoTx = try_fus!(deserialize(tx).map_err(|e| ERRL!("{:?}", e)));
     tx.tx_hash_algo = coin.tx_hash_algo;
-    coin.rpc_client
-        .wait_for_confirmations(&tx, confirmations as u32, requires_nota, wait_until, check_every)
+    let client = coin.rpc_client.clone();
+    let chain_watcher = coin.chain_watcher.clone();
+    let fut = async move {
+        chain_watcher
+            .wait_for_confirmations(
+                &client,
+                tx,
+                confirmations as u32,
+                requires_nota,
+                wait_until,
+                check_every,
+            )
+            .await
+    };
+    Box::new(fut.boxed().compat())
 }
 
 pub fn wait_for_tx_spend(coin: &UtxoCoinFields, tx_bytes: &[u8], wait_until: u64, from_block: u64) -> TransactionFut {
@@ -1260,30 +1327,36 @@ pub fn wait_for_tx_spend(coin: &UtxoCoinFields, tx_bytes: &[u8], wait_until: u64
     tx.tx_hash_algo = coin.tx_hash_algo;
     let vout = 0;
     let client = coin.rpc_client.clone();
+    let chain_watcher = coin.chain_watcher.clone();
     let tx_hash_algo = coin.tx_hash_algo;
     let fut = async move {
-        loop {
-            match client.find_output_spend(&tx, vout, from_block).compat().await {
-                Ok(Some(mut tx)) => {
-                    tx.tx_hash_algo = tx_hash_algo;
-                    return Ok(tx.into());
-                },
-                Ok(None) => (),
-                Err(e) => {
-                    log!("Error " (e) " on find_output_spend of tx " [e]);
-                },
-            };
-
-            if now_ms() / 1000 > wait_until {
+        // the output might be spent already, then there is no need to wait for the watcher
+        let mut spend = match client.find_output_spend(&tx, vout, from_block).compat().await {
+            Ok(Some(spend)) => spend,
+            Ok(None) if now_ms() / 1000 > wait_until => {
                 return ERR!(
                     "Waited too long until {} for transaction {:?} {} to be spent ",
                     wait_until,
                     tx,
                     vout
                 );
-            }
-            Timer::sleep(10.).await;
-        }
+            },
+            Ok(None) => try_s!(
+                chain_watcher
+                    .wait_for_spend(&client, tx, vout, from_block, wait_until)
+                    .await
+            ),
+            Err(e) => {
+                log!("Error " (e) " on find_output_spend of tx " [tx.hash().reversed()]);
+                try_s!(
+                    chain_watcher
+                        .wait_for_spend(&client, tx, vout, from_block, wait_until)
+                        .await
+                )
+            },
+        };
+        spend.tx_hash_algo = tx_hash_algo;
+        Ok(spend.into())
     };
     Box::new(fut.boxed().compat())
 }
@@ -1495,6 +1568,18 @@ where
     }
 }
 
+/// Waits for a status change notification of the subscribed Electrum scripthashes but no longer than `timeout` seconds.
+/// The native client doesn't notify of the balance changes, so it just sleeps for `timeout` seconds.
+async fn wait_for_balance_change(rpc_client: &UtxoRpcClientEnum, timeout: f64) {
+    match rpc_client {
+        UtxoRpcClientEnum::Electrum(client) => {
+            let status_changed = client.scripthash_subscriptions().wait_for_status_change();
+            select(status_changed, Timer::sleep(timeout).boxed()).await;
+        },
+        UtxoRpcClientEnum::Native(_) => Timer::sleep(timeout).await,
+    }
+}
+
 #[allow(clippy::cognitive_complexity)]
 pub async fn process_history_loop<T>(coin: T, ctx: MmArc)
 where
@@ -1550,7 +1635,7 @@ where
         match (&my_balance, &actual_balance) {
             (Some(prev_balance), Some(actual_balance)) if prev_balance == actual_balance && !need_update => {
                 // my balance hasn't been changed, there is no need to reload tx_history
-                Timer::sleep(30.).await;
+                wait_for_balance_change(&coin.as_ref().rpc_client, 30.).await;
                 continue;
             },
             _ => (),
@@ -1601,71 +1686,83 @@ where
             0
         };
 
-        for (txid, height) in tx_ids {
-            let mut updated = false;
-            match history_map.entry(txid.clone()) {
-                Entry::Vacant(e) => {
-                    mm_counter!(ctx.metrics, "tx.history.request.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
-
-                    match coin.tx_details_by_hash(&txid.0).await {
-                        Ok(mut tx_details) => {
-                            mm_counter!(ctx.metrics, "tx.history.response.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
-
-                            if tx_details.block_height == 0 && height > 0 {
-                                tx_details.block_height = height;
-                            }
+        for batch in tx_ids.chunks(HISTORY_BATCH_LEN) {
+            // request the new transactions and the transactions which timestamp should be updated at once
+            let to_request: Vec<H256Json> = batch
+                .iter()
+                .filter(|(txid, _)| match history_map.get(txid) {
+                    Some(tx) => tx.should_update_timestamp(),
+                    None => true,
+                })
+                .map(|(txid, _)| txid.clone())
+                .collect();
+            let verbose_results = coin.as_ref().rpc_client.get_verbose_transactions(&to_request).await;
+            let mut verbose_txs: HashMap<_, _> = to_request.into_iter().zip(verbose_results).collect();
+
+            let mut updated_txs = Vec::new();
+            for (txid, height) in batch {
+                let height = *height;
+                let mut updated = false;
+                match history_map.entry(txid.clone()) {
+                    Entry::Vacant(e) => {
+                        mm_counter!(ctx.metrics, "tx.history.request.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
 
-                            e.insert(tx_details);
-                            if transactions_left > 0 {
-                                transactions_left -= 1;
-                                *coin.as_ref().history_sync_state.lock().unwrap() =
-                                    HistorySyncState::InProgress(json!({ "transactions_left": transactions_left }));
-                            }
+                        match tx_details_from_verbose_result(&coin, verbose_txs.remove(txid)).await {
+                            Ok(mut tx_details) => {
+                                mm_counter!(ctx.metrics, "tx.history.response.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
+
+                                if tx_details.block_height == 0 && height > 0 {
+                                    tx_details.block_height = height;
+                                }
+
+                                e.insert(tx_details);
+                                if transactions_left > 0 {
+                                    transactions_left -= 1;
+                                    *coin.as_ref().history_sync_state.lock().unwrap() =
+                                        HistorySyncState::InProgress(json!({ "transactions_left": transactions_left }));
+                                }
+                                updated = true;
+                            },
+                            Err(e) => ctx.log.log(
+                                "",
+                                &[&"tx_history", &coin.as_ref().conf.ticker],
+                                &ERRL!("Error {:?} on getting the details of {:?}, skipping the tx", e, txid),
+                            ),
+                        }
+                    },
+                    Entry::Occupied(mut e) => {
+                        // update block height for previously unconfirmed transaction
+                        if e.get().should_update_block_height() && height > 0 {
+                            e.get_mut().block_height = height;
                             updated = true;
-                        },
-                        Err(e) => ctx.log.log(
-                            "",
-                            &[&"tx_history", &coin.as_ref().conf.ticker],
-                            &ERRL!("Error {:?} on getting the details of {:?}, skipping the tx", e, txid),
-                        ),
-                    }
-                },
-                Entry::Occupied(mut e) => {
-                    // update block height for previously unconfirmed transaction
-                    if e.get().should_update_block_height() && height > 0 {
-                        e.get_mut().block_height = height;
-                        updated = true;
-                    }
-                    if e.get().should_update_timestamp() {
-                        mm_counter!(ctx.metrics, "tx.history.request.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
+                        }
+                        if e.get().should_update_timestamp() {
+                            mm_counter!(ctx.metrics, "tx.history.request.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
 
-                        if let Ok(tx_details) = coin.tx_details_by_hash(&txid.0).await {
-                            mm_counter!(ctx.metrics, "tx.history.response.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
+                            if let Ok(tx_details) =
+                                tx_details_from_verbose_result(&coin, verbose_txs.remove(txid)).await
+                            {
+                                mm_counter!(ctx.metrics, "tx.history.response.count", 1, "coin" => coin.as_ref().conf.ticker.clone(), "method" => "tx_detail_by_hash");
 
-                            e.get_mut().timestamp = tx_details.timestamp;
-                            updated = true;
+                                e.get_mut().timestamp = tx_details.timestamp;
+                                updated = true;
+                            }
                         }
+                    },
+                }
+                if updated {
+                    if let Some(tx) = history_map.get(txid) {
+                        updated_txs.push(tx.clone());
                     }
-                },
+                }
             }
-            if updated {
-                let mut to_write: Vec<TransactionDetails> =
-                    history_map.iter().map(|(_, value)| value.clone()).collect();
-                // the transactions with block_height == 0 are the most recent so we need to separately handle them while sorting
-                to_write.sort_unstable_by(|a, b| {
-                    if a.block_height == 0 {
-                        Ordering::Less
-                    } else if b.block_height == 0 {
-                        Ordering::Greater
-                    } else {
-                        b.block_height.cmp(&a.block_height)
-                    }
-                });
-                if let Err(e) = coin.save_history_to_file(&ctx, to_write).compat().await {
+            // only the updated transactions are written, the rest of the history is not rewritten
+            if !updated_txs.is_empty() {
+                if let Err(e) = coin.upsert_history_txs(&ctx, updated_txs).compat().await {
                     ctx.log.log(
                         "",
                         &[&"tx_history", &coin.as_ref().conf.ticker],
-                        &ERRL!("Error {} on 'save_history_to_file', stop the history loop", e),
+                        &ERRL!("Error {} on 'upsert_history_txs', stop the history loop", e),
                     );
                     return;
                 };
@@ -1792,9 +1889,77 @@ where
 {
     let hash = H256Json::from(hash);
     let verbose_tx = try_s!(coin.as_ref().rpc_client.get_verbose_transaction(hash).compat().await);
+    tx_details_from_verbose_tx(coin, verbose_tx).await
+}
+
+async fn tx_details_from_verbose_result<T>(
+    coin: &T,
+    verbose_tx: Option<Result<RpcTransaction, JsonRpcError>>,
+) -> Result<TransactionDetails, String>
+where
+    T: AsRef<UtxoCoinFields> + UtxoCommonOps + Send + Sync + 'static,
+{
+    match verbose_tx {
+        Some(Ok(verbose_tx)) => tx_details_from_verbose_tx(coin, verbose_tx).await,
+        Some(Err(e)) => ERR!("{}", e),
+        None => ERR!("The transaction is not requested"),
+    }
+}
+
+/// The transactions spent by the inputs of a transaction by their hashes.
+pub type InputTransactions = HashMap<H256, UtxoTx>;
+
+/// Gets tx details of the given verbose transaction requesting its input transactions in batches.
+pub async fn tx_details_from_verbose_tx<T>(coin: &T, verbose_tx: RpcTransaction) -> Result<TransactionDetails, String>
+where
+    T: AsRef<UtxoCoinFields> + UtxoCommonOps + Send + Sync + 'static,
+{
+    let mut tx: UtxoTx = try_s!(deserialize(verbose_tx.hex.as_slice()).map_err(|e| ERRL!("{:?}", e)));
+    tx.tx_hash_algo = coin.as_ref().tx_hash_algo;
+    let input_transactions = try_s!(input_transactions(coin, &tx).await);
+    tx_details_from_input_transactions(coin, &verbose_tx, &input_transactions)
+}
+
+/// Requests the transactions spent by the `tx` inputs in batches, the coinbase input has no input transaction.
+pub async fn input_transactions<T>(coin: &T, tx: &UtxoTx) -> Result<InputTransactions, String>
+where
+    T: AsRef<UtxoCoinFields>,
+{
+    // input transaction is zero if the tx is the coinbase transaction
+    let prev_hashes: HashSet<H256> = tx
+        .inputs
+        .iter()
+        .map(|input| input.previous_output.hash.clone())
+        .filter(|prev_hash| !prev_hash.is_zero())
+        .collect();
+    let prev_hashes: Vec<H256> = prev_hashes.into_iter().collect();
+    let prev_txids: Vec<H256Json> = prev_hashes.iter().map(|hash| hash.reversed().into()).collect();
+    let prev_txs = coin.as_ref().rpc_client.get_transactions_bytes(&prev_txids).await;
+
+    let mut input_transactions = InputTransactions::with_capacity(prev_hashes.len());
+    for ((prev_hash, prev_txid), prev) in prev_hashes.into_iter().zip(prev_txids).zip(prev_txs) {
+        let prev = try_s!(prev);
+        let mut prev_tx: UtxoTx =
+            try_s!(deserialize(prev.as_slice()).map_err(|e| ERRL!("{:?}, tx: {:?}", e, prev_txid)));
+        prev_tx.tx_hash_algo = coin.as_ref().tx_hash_algo;
+        input_transactions.insert(prev_hash, prev_tx);
+    }
+    Ok(input_transactions)
+}
+
+/// Gets tx details of the given verbose transaction from the transactions spent by its inputs,
+/// the amounts are scaled by the `coin` decimals.
+pub fn tx_details_from_input_transactions<T>(
+    coin: &T,
+    verbose_tx: &RpcTransaction,
+    input_transactions: &InputTransactions,
+) -> Result<TransactionDetails, String>
+where
+    T: AsRef<UtxoCoinFields> + UtxoCommonOps,
+{
     let mut tx: UtxoTx = try_s!(deserialize(verbose_tx.hex.as_slice()).map_err(|e| ERRL!("{:?}", e)));
     tx.tx_hash_algo = coin.as_ref().tx_hash_algo;
-    let mut input_transactions: HashMap<&H256, UtxoTx> = HashMap::new();
+
     let mut input_amount = 0;
     let mut output_amount = 0;
     let mut from_addresses = vec![];
@@ -1802,27 +1967,10 @@ where
     let mut spent_by_me = 0;
     let mut received_by_me = 0;
     for input in tx.inputs.iter() {
-        // input transaction is zero if the tx is the coinbase transaction
-        if input.previous_output.hash.is_zero() {
-            continue;
-        }
-
-        let input_tx = match input_transactions.entry(&input.previous_output.hash) {
-            Entry::Vacant(e) => {
-                let prev_hash = input.previous_output.hash.reversed();
-                let prev: BytesJson = try_s!(
-                    coin.as_ref()
-                        .rpc_client
-                        .get_transaction_bytes(prev_hash.clone().into())
-                        .compat()
-                        .await
-                );
-                let mut prev_tx: UtxoTx =
-                    try_s!(deserialize(prev.as_slice()).map_err(|e| ERRL!("{:?}, tx: {:?}", e, prev_hash)));
-                prev_tx.tx_hash_algo = coin.as_ref().tx_hash_algo;
-                e.insert(prev_tx)
-            },
-            Entry::Occupied(e) => e.into_mut(),
+        let input_tx = match input_transactions.get(&input.previous_output.hash) {
+            Some(input_tx) => input_tx,
+            // the coinbase input
+            None => continue,
         };
         input_amount += input_tx.outputs[input.previous_output.index as usize].value;
         let from: Vec<Address> = try_s!(coin.addresses_from_script(
@@ -1871,7 +2019,7 @@ where
         my_balance_change: big_decimal_from_sat(received_by_me as i64 - spent_by_me as i64, coin.as_ref().decimals),
         total_amount: big_decimal_from_sat(input_amount as i64, coin.as_ref().decimals),
         tx_hash: tx.hash().reversed().to_vec().into(),
-        tx_hex: verbose_tx.hex,
+        tx_hex: verbose_tx.hex.clone(),
         fee_details: Some(UtxoFeeDetails { amount: fee }.into()),
         block_height: verbose_tx.height.unwrap_or(0),
         coin: coin.as_ref().conf.ticker.clone(),
@@ -2125,23 +2273,50 @@ where
     let (unspents, recently_spent) = list_unspent_ordered(coin, address).await?;
     let block_count = coin.as_ref().rpc_client.get_block_count().compat().await?;
 
-    let mut result = Vec::with_capacity(unspents.len());
-    for unspent in unspents {
-        let tx_hash: H256Json = unspent.outpoint.hash.reversed().into();
-        let tx_info = match coin
-            .get_verbose_transaction_from_cache_or_rpc(tx_hash.clone())
+    // the maturity of the indexed unspents is known already, the transactions of the rest are requested
+    let is_indexed = *address == coin.as_ref().my_address;
+    let known_maturity: Vec<Option<bool>> = if is_indexed {
+        let utxo_index = coin.as_ref().utxo_index.lock().unwrap();
+        unspents
+            .iter()
+            .map(|unspent| utxo_index.maturity(&unspent.outpoint).is_mature(block_count))
+            .collect()
+    } else {
+        vec![None; unspents.len()]
+    };
+
+    let txids: HashSet<H256Json> = unspents
+        .iter()
+        .zip(known_maturity.iter())
+        .filter(|(_, is_mature)| is_mature.is_none())
+        .map(|(unspent, _)| unspent.outpoint.hash.reversed().into())
+        .collect();
+    let verbose_txs = if txids.is_empty() {
+        HashMap::new()
+    } else {
+        coin.get_verbose_transactions_from_cache_or_rpc(txids)
             .compat()
             .await
-        {
-            Ok(x) => x,
-            Err(err) => {
-                log!("Error " [err] " getting the transaction " [tx_hash] ", skip the unspent output");
-                continue;
-            },
-        };
+            .map_to_mm(UtxoRpcError::Internal)?
+    };
+
+    let mature_confirmations = coin.as_ref().conf.mature_confirmations;
+    let mut result = Vec::with_capacity(unspents.len());
+    let mut found_maturity = Vec::new();
+    let mut cached_txids = HashSet::new();
+    for (unspent, is_mature) in unspents.into_iter().zip(known_maturity) {
+        if let Some(is_mature) = is_mature {
+            if is_mature {
+                result.push(unspent);
+            }
+            continue;
+        }
 
-        let tx_info = match tx_info {
-            VerboseTransactionFrom::Cache(mut tx) => {
+        let tx_hash: H256Json = unspent.outpoint.hash.reversed().into();
+        // several unspents can belong to the same transaction, so the transaction is cloned
+        let tx_info = match verbose_txs.get(&tx_hash) {
+            Some(VerboseTransactionFrom::Cache(tx)) => {
+                let mut tx = tx.clone();
                 if unspent.height.is_some() {
                     tx.height = unspent.height;
                 }
@@ -2153,62 +2328,116 @@ where
                 }
                 tx
             },
-            VerboseTransactionFrom::Rpc(mut tx) => {
+            Some(VerboseTransactionFrom::Rpc(tx)) => {
+                let mut tx = tx.clone();
                 if tx.height.is_none() {
                     tx.height = unspent.height;
                 }
-                if let Err(e) = coin.cache_transaction_if_possible(&tx).await {
-                    log!((e));
+                // don't cache the transaction again if it has several unspent outputs
+                if cached_txids.insert(tx_hash.clone()) {
+                    if let Err(e) = coin.cache_transaction_if_possible(&tx).await {
+                        log!((e));
+                    }
                 }
                 tx
             },
+            None => {
+                log!("Error getting the transaction " [tx_hash] ", skip the unspent output");
+                continue;
+            },
         };
 
-        if coin.is_unspent_mature(&tx_info) {
+        let is_mature = coin.is_unspent_mature(&tx_info);
+        found_maturity.push((
+            unspent.outpoint.clone(),
+            unspent_maturity(is_mature, &tx_info, mature_confirmations),
+        ));
+        if is_mature {
             result.push(unspent);
         }
     }
 
+    if is_indexed {
+        let mut utxo_index = coin.as_ref().utxo_index.lock().unwrap();
+        for (outpoint, maturity) in found_maturity {
+            utxo_index.set_maturity(&outpoint, maturity);
+        }
+    }
     Ok((result, recently_spent))
 }
 
+/// The mature unspent stays mature until it's spent, the immature coinbase output matures at the known block count.
+fn unspent_maturity(is_mature: bool, tx: &RpcTransaction, mature_confirmations: u32) -> UnspentMaturity {
+    if is_mature {
+        return UnspentMaturity::Mature;
+    }
+    match tx.height {
+        // the confirmations are `block_count - height + 1`
+        Some(height) if height > 0 => UnspentMaturity::MatureAt(height + mature_confirmations as u64 - 1),
+        _ => UnspentMaturity::Unknown,
+    }
+}
+
 pub fn is_unspent_mature(mature_confirmations: u32, output: &RpcTransaction) -> bool {
     // don't skip outputs with confirmations == 0, because we can spend them
     !output.is_coinbase() || output.confirmations >= mature_confirmations
 }
 
+/// Requests the verbose transactions in batches, the transactions failed to request are logged and skipped.
+async fn request_verbose_transactions(
+    coin: &UtxoCoinFields,
+    txids: Vec<H256Json>,
+) -> HashMap<H256Json, VerboseTransactionFrom> {
+    let results = coin.rpc_client.get_verbose_transactions(&txids).await;
+
+    let mut verbose_txs = HashMap::with_capacity(txids.len());
+    for (txid, res) in txids.into_iter().zip(results) {
+        match res {
+            Ok(tx) => {
+                verbose_txs.insert(txid, VerboseTransactionFrom::Rpc(tx));
+            },
+            Err(e) => log!("Error " [e] " requesting the " [txid] " transaction"),
+        }
+    }
+    verbose_txs
+}
+
 #[cfg(not(target_arch = "wasm32"))]
-pub async fn get_verbose_transaction_from_cache_or_rpc(
+pub async fn get_verbose_transactions_from_cache_or_rpc(
     coin: &UtxoCoinFields,
-    txid: H256Json,
-) -> Result<VerboseTransactionFrom, String> {
+    txids: HashSet<H256Json>,
+) -> Result<HashMap<H256Json, VerboseTransactionFrom>, String> {
     let tx_cache_path = match &coin.tx_cache_directory {
         Some(p) => p.clone(),
         _ => {
             // the coin doesn't support TX local cache, don't try to load from cache and don't cache it
-            let tx = try_s!(coin.rpc_client.get_verbose_transaction(txid.clone()).compat().await);
-            return Ok(VerboseTransactionFrom::Rpc(tx));
+            return Ok(request_verbose_transactions(coin, txids.into_iter().collect()).await);
         },
     };
 
-    match tx_cache::load_transaction_from_cache(&tx_cache_path, &txid).await {
-        Ok(Some(tx)) => return Ok(VerboseTransactionFrom::Cache(tx)),
-        Err(err) => log!("Error " [err] " loading the " [txid] " transaction. Try request tx using Rpc client"),
-        // txid just not found
-        _ => (),
-    }
+    let mut result: HashMap<_, _> =
+        match tx_cache::load_transactions_from_cache(&tx_cache_path, &coin.conf.ticker, txids.iter()).await {
+            Ok(found) => found
+                .into_iter()
+                .map(|(txid, tx)| (txid, VerboseTransactionFrom::Cache(tx)))
+                .collect(),
+            Err(err) => {
+                log!("Error " [err] " loading the transactions. Try request them using Rpc client");
+                HashMap::new()
+            },
+        };
 
-    let tx = try_s!(coin.rpc_client.get_verbose_transaction(txid).compat().await);
-    Ok(VerboseTransactionFrom::Rpc(tx))
+    let to_request: Vec<_> = txids.into_iter().filter(|txid| !result.contains_key(txid)).collect();
+    result.extend(request_verbose_transactions(coin, to_request).await);
+    Ok(result)
 }
 
 #[cfg(target_arch = "wasm32")]
-pub async fn get_verbose_transaction_from_cache_or_rpc(
+pub async fn get_verbose_transactions_from_cache_or_rpc(
     coin: &UtxoCoinFields,
-    txid: H256Json,
-) -> Result<VerboseTransactionFrom, String> {
-    let tx = try_s!(coin.rpc_client.get_verbose_transaction(txid.clone()).compat().await);
-    Ok(VerboseTransactionFrom::Rpc(tx))
+    txids: HashSet<H256Json>,
+) -> Result<HashMap<H256Json, VerboseTransactionFrom>, String> {
+    Ok(request_verbose_transactions(coin, txids.into_iter().collect()).await)
 }
 
 #[cfg(not(target_arch = "wasm32"))]
@@ -2226,7 +2455,7 @@ pub async fn cache_transaction_if_possible(coin: &UtxoCoinFields, tx: &RpcTransa
         None => return Ok(()),
     }
 
-    tx_cache::cache_transaction(&tx_cache_path, &tx)
+    tx_cache::cache_transaction(&tx_cache_path, &coin.conf.ticker, &tx)
         .await
         .map_err(|e| ERRL!("Error {:?} on caching transaction {:?}", e, tx.txid))
 }
@@ -2591,20 +2820,32 @@ where
         .compat()
         .await?;
     let recently_spent = coin.as_ref().recently_spent_outpoints.lock().await;
-    unspents = recently_spent
-        .replace_spent_outputs_with_cache(unspents.into_iter().collect())
-        .into_iter()
-        .collect();
-    unspents.sort_unstable_by(|a, b| {
-        if a.value < b.value {
-            Ordering::Less
-        } else {
-            Ordering::Greater
-        }
-    });
-    // dedup just in case we add duplicates of same unspent out
-    // all duplicates will be removed because vector in sorted before dedup
-    unspents.dedup_by(|one, another| one.outpoint == another.outpoint);
+    if *address != coin.as_ref().my_address {
+        // the index keeps the unspents of my address only
+        unspents = recently_spent
+            .replace_spent_outputs_with_cache(unspents.into_iter().collect())
+            .into_iter()
+            .collect();
+        unspents.sort_unstable_by(|a, b| {
+            if a.value < b.value {
+                Ordering::Less
+            } else {
+                Ordering::Greater
+            }
+        });
+        // dedup just in case we add duplicates of same unspent out
+        // all duplicates will be removed because vector in sorted before dedup
+        unspents.dedup_by(|one, another| one.outpoint == another.outpoint);
+        return Ok((unspents, recently_spent));
+    }
+
+    let mut utxo_index = coin.as_ref().utxo_index.lock().unwrap();
+    // the reservations are checked against the RPC listing, the outputs replaced by the cache are not listed yet
+    let unspents = utxo_index.filter_reserved(unspents);
+    let unspents = recently_spent.replace_spent_outputs_with_cache(unspents.into_iter().collect());
+    // the index is ordered by value and has no duplicates of the same unspent out
+    let unspents = utxo_index.update(unspents);
+    drop(utxo_index);
     Ok((unspents, recently_spent))
 }
 
@@ -0,0 +1,203 @@
+//! The in-memory index of the coin unspents.
+//!
+//! The unspents are kept ordered by value and the index is updated with the difference of the RPC listings,
+//! so thousands of unspents are not sorted again for every transaction. The maturity of an unspent is kept
+//! until it's spent, so only the transactions of the new unspents are requested to check their maturity.
+//!
+//! The outputs spent by the transactions sent by this node are reserved until the RPC stops listing them.
+//! The concurrent swaps don't select them again while the RPC server is catching up with the mempool.
+
+use super::rpc_clients::UnspentInfo;
+use chain::OutPoint;
+use common::now_ms;
+use std::collections::{BTreeMap, HashMap, HashSet};
+
+/// The reservation is released after this time even if the RPC still lists the output,
+/// so the outputs of the transactions dropped from the mempool become spendable again.
+const RESERVATION_TIMEOUT_MS: u64 = 60 * 60 * 1000;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum UnspentMaturity {
+    /// The transaction of the unspent is not checked yet.
+    Unknown,
+    Mature,
+    /// The coinbase output matures when the block count reaches the given one.
+    MatureAt(u64),
+}
+
+/// The value of the unspent, its txid and output index.
+type ValueKey = (u64, [u8; 32], u32);
+
+fn value_key(outpoint: &OutPoint, value: u64) -> ValueKey { (value, *outpoint.hash, outpoint.index) }
+
+#[derive(Debug)]
+struct IndexedUnspent {
+    value: u64,
+    maturity: UnspentMaturity,
+}
+
+#[derive(Debug, Default)]
+pub struct UtxoIndex {
+    unspents: HashMap<OutPoint, IndexedUnspent>,
+    by_value: BTreeMap<ValueKey, UnspentInfo>,
+    /// The outputs spent by the sent transactions and the time they were reserved at.
+    reserved: HashMap<OutPoint, u64>,
+}
+
+impl UtxoIndex {
+    /// Removes the reserved outputs from the unspents listed by the RPC.
+    /// The reservations of the outputs that are not listed anymore or reserved too long ago are released.
+    pub fn filter_reserved(&mut self, listed: Vec<UnspentInfo>) -> Vec<UnspentInfo> {
+        if self.reserved.is_empty() {
+            return listed;
+        }
+
+        let now = now_ms();
+        let listed_outpoints: HashSet<&OutPoint> = listed.iter().map(|unspent| &unspent.outpoint).collect();
+        self.reserved.retain(|outpoint, reserved_at| {
+            listed_outpoints.contains(outpoint) && now < *reserved_at + RESERVATION_TIMEOUT_MS
+        });
+        listed
+            .into_iter()
+            .filter(|unspent| !self.reserved.contains_key(&unspent.outpoint))
+            .collect()
+    }
+
+    /// Reserves the outputs spent by the sent transaction and removes them from the index.
+    pub fn reserve(&mut self, outpoints: impl IntoIterator<Item = OutPoint>) {
+        let now = now_ms();
+        for outpoint in outpoints {
+            if let Some(indexed) = self.unspents.remove(&outpoint) {
+                self.by_value.remove(&value_key(&outpoint, indexed.value));
+            }
+            self.reserved.insert(outpoint, now);
+        }
+    }
+
+    /// Updates the index to the actual unspents and returns them ordered by value in the ascending order.
+    /// The maturity of the unspents indexed already is kept.
+    pub fn update(&mut self, unspents: impl IntoIterator<Item = UnspentInfo>) -> Vec<UnspentInfo> {
+        let mut actual: HashMap<OutPoint, UnspentInfo> = unspents
+            .into_iter()
+            .map(|unspent| (unspent.outpoint.clone(), unspent))
+            .collect();
+
+        let by_value = &mut self.by_value;
+        self.unspents.retain(|outpoint, indexed| {
+            let key = value_key(outpoint, indexed.value);
+            match actual.remove(outpoint) {
+                // the unspent height is set once its transaction is mined
+                Some(unspent) if unspent.value == indexed.value => {
+                    by_value.insert(key, unspent);
+                    true
+                },
+                Some(unspent) => {
+                    // the RPC reported another value, the unspent is indexed again
+                    actual.insert(outpoint.clone(), unspent);
+                    by_value.remove(&key);
+                    false
+                },
+                None => {
+                    by_value.remove(&key);
+                    false
+                },
+            }
+        });
+
+        for (outpoint, unspent) in actual {
+            self.by_value
+                .insert(value_key(&outpoint, unspent.value), unspent.clone());
+            self.unspents.insert(outpoint, IndexedUnspent {
+                value: unspent.value,
+                maturity: UnspentMaturity::Unknown,
+            });
+        }
+        self.by_value.values().cloned().collect()
+    }
+
+    pub fn maturity(&self, outpoint: &OutPoint) -> UnspentMaturity {
+        self.unspents
+            .get(outpoint)
+            .map_or(UnspentMaturity::Unknown, |indexed| indexed.maturity)
+    }
+
+    pub fn set_maturity(&mut self, outpoint: &OutPoint, maturity: UnspentMaturity) {
+        if let Some(indexed) = self.unspents.get_mut(outpoint) {
+            indexed.maturity = maturity;
+        }
+    }
+}
+
+impl UnspentMaturity {
+    /// Returns None if the maturity is not known.
+    pub fn is_mature(&self, block_count: u64) -> Option<bool> {
+        match self {
+            UnspentMaturity::Unknown => None,
+            UnspentMaturity::Mature => Some(true),
+            UnspentMaturity::MatureAt(mature_block_count) => Some(block_count >= *mature_block_count),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use primitives::hash::H256;
+
+    fn unspent_for_test(hash: u8, value: u64) -> UnspentInfo {
+        UnspentInfo {
+            outpoint: OutPoint {
+                hash: H256::from([hash; 32]),
+                index: 0,
+            },
+            value,
+            height: None,
+        }
+    }
+
+    fn values(unspents: &[UnspentInfo]) -> Vec<u64> { unspents.iter().map(|unspent| unspent.value).collect() }
+
+    #[test]
+    fn test_utxo_index_update() {
+        let mut index = UtxoIndex::default();
+        let unspents = vec![
+            unspent_for_test(1, 3000),
+            unspent_for_test(2, 1000),
+            unspent_for_test(3, 2000),
+        ];
+        assert_eq!(values(&index.update(unspents.clone())), vec![1000, 2000, 3000]);
+
+        let outpoint = unspents[0].outpoint.clone();
+        index.set_maturity(&outpoint, UnspentMaturity::MatureAt(100));
+        let mut mined = unspents[0].clone();
+        mined.height = Some(90);
+        let updated = index.update(vec![mined.clone(), unspent_for_test(4, 1500), unspents[1].clone()]);
+        assert_eq!(values(&updated), vec![1000, 1500, 3000]);
+        assert_eq!(updated[2], mined);
+        // the maturity is kept until the unspent is spent
+        assert_eq!(index.maturity(&outpoint), UnspentMaturity::MatureAt(100));
+        assert_eq!(index.maturity(&outpoint).is_mature(99), Some(false));
+        assert_eq!(index.maturity(&unspents[1].outpoint), UnspentMaturity::Unknown);
+
+        assert!(index.update(vec![]).is_empty());
+        assert_eq!(index.maturity(&outpoint), UnspentMaturity::Unknown);
+    }
+
+    #[test]
+    fn test_utxo_index_reserve() {
+        let mut index = UtxoIndex::default();
+        let unspents = vec![unspent_for_test(1, 1000), unspent_for_test(2, 2000)];
+        index.update(unspents.clone());
+        index.reserve(vec![unspents[0].outpoint.clone()]);
+
+        // the RPC still lists the spent output
+        let listed = index.filter_reserved(unspents.clone());
+        assert_eq!(values(&index.update(listed)), vec![2000]);
+
+        // the reservation is released once the output is not listed
+        let listed = index.filter_reserved(vec![unspents[1].clone()]);
+        assert_eq!(values(&listed), vec![2000]);
+        assert!(index.reserved.is_empty());
+        assert_eq!(values(&index.filter_reserved(unspents)), vec![1000, 2000]);
+    }
+}
@@ -115,12 +115,12 @@ impl UtxoCommonOps for UtxoStandardCoin {
         utxo_common::ordered_mature_unspents(self, address).await
     }
 
-    fn get_verbose_transaction_from_cache_or_rpc(
+    fn get_verbose_transactions_from_cache_or_rpc(
         &self,
-        txid: H256Json,
-    ) -> Box<dyn Future<Item = VerboseTransactionFrom, Error = String> + Send> {
+        txids: HashSet<H256Json>,
+    ) -> Box<dyn Future<Item = HashMap<H256Json, VerboseTransactionFrom>, Error = String> + Send> {
         let selfi = self.clone();
-        let fut = async move { utxo_common::get_verbose_transaction_from_cache_or_rpc(&selfi.utxo_arc, txid).await };
+        let fut = async move { utxo_common::get_verbose_transactions_from_cache_or_rpc(&selfi.utxo_arc, txids).await };
         Box::new(fut.boxed().compat())
     }
 
@@ -1,4 +1,5 @@
-use super::rpc_clients::{ElectrumProtocol, ListSinceBlockRes, NetworkInfo};
+use super::rpc_clients::{ElectrumBalance, ElectrumConnectionStats, ElectrumProtocol, ListSinceBlockRes, NetworkInfo,
+                         ScripthashCached, ScripthashSubscriptions};
 use super::*;
 use crate::utxo::qtum::{qtum_coin_from_conf_and_request, QtumCoin};
 use crate::utxo::rpc_clients::{GetAddressInfoRes, UtxoRpcClientOps, ValidateAddressRes, VerboseBlock};
@@ -9,6 +10,7 @@ use crate::{CoinBalance, SwapOps, TradePreimageValue};
 use bigdecimal::BigDecimal;
 use chain::constants::SEQUENCE_FINAL;
 use chain::OutPoint;
+use common::jsonrpc_client::JsonRpcErrorType;
 use common::mm_ctx::MmCtxBuilder;
 use common::privkey::key_pair_from_seed;
 use common::{block_on, now_ms, OrdRange, DEX_FEE_ADDR_RAW_PUBKEY};
@@ -114,7 +116,9 @@ fn utxo_coin_fields_for_test(rpc_client: UtxoRpcClientEnum, force_seed: Option<&
         history_sync_state: Mutex::new(HistorySyncState::NotEnabled),
         tx_cache_directory: None,
         recently_spent_outpoints: AsyncMutex::new(RecentlySpentOutPoints::new(my_script_pubkey)),
+        utxo_index: Mutex::new(UtxoIndex::default()),
         tx_hash_algo: TxHashAlgo::DSHA256,
+        chain_watcher: ChainWatcher::default(),
     }
 }
 
@@ -831,6 +835,96 @@ fn test_electrum_rpc_client_error() {
     assert_eq!(expected, actual);
 }
 
+#[test]
+fn test_electrum_connection_stats() {
+    let mut unknown = ElectrumConnectionStats::default();
+    let mut fast = ElectrumConnectionStats::default();
+    let mut slow = ElectrumConnectionStats::default();
+    for i in 0..20 {
+        fast.on_response(10 + i);
+        slow.on_response(100);
+    }
+    // the servers that haven't responded yet are tried first
+    assert!(unknown.score() < fast.score());
+    assert!(fast.score() < slow.score());
+
+    // the fast server becomes worse than the slow one if it keeps failing
+    for _ in 0..20 {
+        fast.on_error();
+    }
+    assert!(slow.score() < fast.score());
+
+    assert_eq!(unknown.hedge_delay_ms(), None);
+    // the 95th percentile of 10..=29
+    assert_eq!(fast.hedge_delay_ms(), Some(28));
+    assert_eq!(slow.hedge_delay_ms(), Some(100));
+
+    unknown.on_response(50);
+    assert_eq!(unknown.score(), 50.);
+    assert_eq!(unknown.hedge_delay_ms(), None);
+}
+
+#[test]
+fn test_scripthash_subscriptions_cache() {
+    let subscriptions = ScripthashSubscriptions::default();
+    let balance: ElectrumBalance = json::from_value(json!({"confirmed": 1, "unconfirmed": 0})).unwrap();
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::NotSubscribed));
+
+    subscriptions.on_subscribed("hash", "electrum1".into(), None);
+    let generation = match subscriptions.balance("hash") {
+        ScripthashCached::Miss {
+            server_addr,
+            generation,
+        } => {
+            assert_eq!(server_addr, "electrum1");
+            generation
+        },
+        cached => panic!("Unexpected {:?}", cached),
+    };
+    subscriptions.store_balance("hash", generation, balance.clone());
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::Hit(_)));
+    // the unspents are cached separately
+    assert!(matches!(subscriptions.unspents("hash"), ScripthashCached::Miss { .. }));
+
+    // the notifications from the other servers and the notifications without the status change are ignored
+    assert!(!subscriptions.on_status_notification("electrum2", "hash", Some("status".into())));
+    assert!(!subscriptions.on_status_notification("electrum1", "hash", None));
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::Hit(_)));
+
+    let mut status_changed = subscriptions.wait_for_status_change();
+    assert!(subscriptions.on_status_notification("electrum1", "hash", Some("status".into())));
+    assert_eq!(status_changed.try_recv(), Ok(Some(())));
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::Miss { .. }));
+
+    // the response to the request sent before the status change is discarded
+    subscriptions.store_balance("hash", generation, balance.clone());
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::Miss { .. }));
+
+    subscriptions.on_disconnected("electrum1");
+    assert!(matches!(subscriptions.balance("hash"), ScripthashCached::NotSubscribed));
+}
+
+#[test]
+fn test_electrum_get_verbose_transactions_batch() {
+    let client = electrum_client_for_test(&["electrum1.cipig.net:10017", "electrum2.cipig.net:10017"]);
+
+    let tx_hash: H256Json = hex::decode("0a0fda88364b960000f445351fe7678317a1e0c80584de0413377ede00ba696f")
+        .unwrap()
+        .as_slice()
+        .into();
+    let empty_hash = H256Json::default();
+    let results = block_on(client.get_verbose_transactions(&[tx_hash.clone(), empty_hash, tx_hash.clone()]));
+    assert_eq!(results.len(), 3);
+
+    let expected = client.get_verbose_transaction(tx_hash).wait().unwrap();
+    assert_eq!(results[0].as_ref().unwrap(), &expected);
+    match &results[1].as_ref().unwrap_err().error {
+        JsonRpcErrorType::Response(_, _) => (),
+        e => panic!("Unexpected error {:?}", e),
+    }
+    assert_eq!(results[2].as_ref().unwrap(), &expected);
+}
+
 #[test]
 fn test_network_info_deserialization() {
     let network_info_kmd = r#"{
@@ -1542,11 +1636,12 @@ fn test_ordered_mature_unspents_from_cache_impl(
     });
     ElectrumClient::get_block_count
         .mock_safe(move |_| MockResult::Return(Box::new(futures01::future::ok(block_count))));
-    UtxoStandardCoin::get_verbose_transaction_from_cache_or_rpc.mock_safe(move |_, txid| {
-        assert_eq!(txid, tx_hash);
-        MockResult::Return(Box::new(futures01::future::ok(VerboseTransactionFrom::Cache(
-            verbose.clone(),
-        ))))
+    UtxoStandardCoin::get_verbose_transactions_from_cache_or_rpc.mock_safe(move |_, txids| {
+        assert_eq!(txids.len(), 1);
+        assert!(txids.contains(&tx_hash));
+        let mut result = HashMap::new();
+        result.insert(tx_hash.clone(), VerboseTransactionFrom::Cache(verbose.clone()));
+        MockResult::Return(Box::new(futures01::future::ok(result)))
     });
     static mut IS_UNSPENT_MATURE_CALLED: bool = false;
     UtxoStandardCoin::is_unspent_mature.mock_safe(move |_, tx: &RpcTransaction| {
@@ -1566,6 +1661,63 @@ fn test_ordered_mature_unspents_from_cache_impl(
     assert!(unsafe { IS_UNSPENT_MATURE_CALLED == true });
 }
 
+#[test]
+#[cfg(not(target_arch = "wasm32"))]
+fn test_ordered_mature_unspents_maturity_indexed() {
+    const TX_HASH: &str = "0a0fda88364b960000f445351fe7678317a1e0c80584de0413377ede00ba696f";
+    static mut BLOCK_COUNT: u64 = 1000;
+    static mut VERBOSE_REQUESTS: usize = 0;
+
+    NativeClient::list_unspent.mock_safe(|_, _, _| {
+        let unspents = vec![UnspentInfo {
+            outpoint: OutPoint {
+                hash: H256::from_reversed_str(TX_HASH),
+                index: 0,
+            },
+            value: 1000000000,
+            height: Some(990),
+        }];
+        MockResult::Return(Box::new(futures01::future::ok(unspents)))
+    });
+    NativeClient::get_block_count
+        .mock_safe(|_| MockResult::Return(Box::new(futures01::future::ok(unsafe { BLOCK_COUNT }))));
+    UtxoStandardCoin::get_verbose_transactions_from_cache_or_rpc.mock_safe(|_, txids| {
+        unsafe { VERBOSE_REQUESTS += 1 }
+        let tx_hash: H256Json = hex::decode(TX_HASH).unwrap().as_slice().into();
+        assert!(txids.contains(&tx_hash));
+        let tx: RpcTransaction = json::from_value(json!({
+            "hex": "0400008085202f89",
+            "txid": tx_hash,
+            "vin": [],
+            "vout": [],
+            "version": 4,
+            "locktime": 0,
+            "height": 990,
+        }))
+        .unwrap();
+        let mut result = HashMap::new();
+        result.insert(tx_hash, VerboseTransactionFrom::Rpc(tx));
+        MockResult::Return(Box::new(futures01::future::ok(result)))
+    });
+    // the immature coinbase output
+    UtxoStandardCoin::is_unspent_mature.mock_safe(|_, _| MockResult::Return(false));
+
+    let coin = utxo_coin_for_test(UtxoRpcClientEnum::Native(native_client_for_test()), None);
+    let my_address = coin.as_ref().my_address.clone();
+    let (unspents, _) = block_on(coin.ordered_mature_unspents(&my_address)).unwrap();
+    assert!(unspents.is_empty());
+    assert_eq!(unsafe { VERBOSE_REQUESTS }, 1);
+
+    // the output matures at 990 + MATURE_CONFIRMATIONS_DEFAULT - 1, the transaction is not requested again
+    unsafe { BLOCK_COUNT = 1088 }
+    let (unspents, _) = block_on(coin.ordered_mature_unspents(&my_address)).unwrap();
+    assert!(unspents.is_empty());
+    unsafe { BLOCK_COUNT = 1089 }
+    let (unspents, _) = block_on(coin.ordered_mature_unspents(&my_address)).unwrap();
+    assert_eq!(unspents.len(), 1);
+    assert_eq!(unsafe { VERBOSE_REQUESTS }, 1);
+}
+
 #[test]
 fn test_ordered_mature_unspents_from_cache() {
     let unspent_height = None;
@@ -2699,3 +2851,59 @@ fn test_parse_tx_with_huge_locktime() {
     let verbose_tx: RpcTransaction = json::from_str(verbose).expect("!json::from_str");
     let _: UtxoTx = deserialize(verbose_tx.hex.as_slice()).unwrap();
 }
+
+#[test]
+fn test_shared_electrum_client_key() {
+    let ctx = MmCtxBuilder::new().into_mm_arc();
+    let qtum_conf = json!({"coin": "QTUM", "protocol": {"type": "QTUM"}});
+    let token_conf = json!({
+        "coin": "QRC20",
+        "protocol": {"type": "QRC20", "protocol_data": {"platform": "QTUM", "contract_address": "0x"}},
+    });
+    let req = json!({
+        "method": "electrum",
+        "servers": [{"url": "electrum1.cipig.net:10071"}, {"url": "electrum2.cipig.net:10071"}],
+    });
+    let reordered_req = json!({
+        "method": "electrum",
+        "servers": [{"url": "electrum2.cipig.net:10071"}, {"url": "electrum1.cipig.net:10071"}],
+    });
+    let key = |ticker: &str, conf: &Json, req: &Json| {
+        UtxoArcBuilder::new(&ctx, ticker, conf, req, &[1; 32]).shared_electrum_client_key()
+    };
+
+    // the token shares the client of its platform regardless of the servers order
+    let qtum_key = key("QTUM", &qtum_conf, &req);
+    assert!(qtum_key.is_some());
+    assert_eq!(key("QRC20", &token_conf, &reordered_req), qtum_key);
+
+    // the other chain doesn't share the client even if the servers are the same
+    let other_conf = json!({"coin": "OTHER", "protocol": {"type": "UTXO"}});
+    assert_ne!(key("OTHER", &other_conf, &req), qtum_key);
+
+    // the client storing the block headers is specific to the coin
+    let spv_conf = json!({"coin": "QTUM", "protocol": {"type": "QTUM"}, "spv_conf": {}});
+    assert_eq!(key("QTUM", &spv_conf, &req), None);
+}
+
+#[test]
+fn test_concurrent_request_map_running_request_dropped() {
+    use super::rpc_clients::ConcurrentRequestMap;
+    use futures::FutureExt;
+
+    let map = ConcurrentRequestMap::<String, u64>::new();
+    let never = futures01::future::empty::<u64, JsonRpcError>();
+    let mut running = Box::pin(map.wrap_request("hash".into(), Box::new(never)));
+    assert!(running.as_mut().now_or_never().is_none());
+    let request = futures01::future::ok::<u64, JsonRpcError>(1);
+    let mut subscriber = Box::pin(map.wrap_request("hash".into(), Box::new(request)));
+    assert!(subscriber.as_mut().now_or_never().is_none());
+
+    // the subscriber sends its own request once the running one is dropped
+    drop(running);
+    assert_eq!(block_on(subscriber).unwrap(), 1);
+
+    // the request is not running anymore
+    let request = futures01::future::ok::<u64, JsonRpcError>(2);
+    assert_eq!(block_on(map.wrap_request("hash".into(), Box::new(request))).unwrap(), 2);
+}
@@ -18,6 +18,7 @@
 #![feature(optin_builtin_traits)]
 #![feature(drain_filter)]
 #![feature(const_fn)]
+#![cfg_attr(test, feature(test))]
 
 #[macro_use] extern crate arrayref;
 #[macro_use] extern crate fomat_macros;
@@ -28,6 +29,7 @@
 #[cfg(test)]
 #[macro_use]
 extern crate ser_error_derive;
+#[cfg(test)] extern crate test;
 
 /// Fills a C character array with a zero-terminated C string,
 /// returning an error if the string is too large.
@@ -87,6 +89,8 @@ pub mod jsonrpc_client;
 pub mod log;
 #[macro_use]
 pub mod mm_metrics;
+#[macro_use]
+pub mod mm_trace;
 
 pub mod big_int_str;
 pub mod crash_reports;
@@ -95,6 +99,7 @@ pub mod duplex_mutex;
 pub mod file_lock;
 #[cfg(not(target_arch = "wasm32"))] pub mod for_c;
 pub mod iguana_utils;
+pub mod lru_cache;
 pub mod mm_ctx;
 #[path = "mm_error/mm_error.rs"] pub mod mm_error;
 pub mod mm_number;
@@ -692,6 +697,10 @@ pub mod wio {
             .pool_size(8)
             .name_prefix("POOL")
             .create().expect("!ThreadPool"));
+        /// Shared CPU pool sized to the number of cores to verify and decode the incoming P2P messages.
+        pub static ref P2P_VERIFY_POOL: ThreadPool = ThreadPool::builder()
+            .name_prefix("P2P_VERIFY")
+            .create().expect("!ThreadPool");
     }
 
     impl<Fut: std::future::Future<Output = ()> + Send + 'static> hyper::rt::Executor<Fut> for &MM2Runtime {
@@ -1048,6 +1057,16 @@ pub mod executor {
 
     pub fn spawn_boxed(future: Box<dyn Future03<Output = ()> + Send + Unpin + 'static>) { spawn(future); }
 
+    /// Runs the blocking `f` (such as the file writes followed by fsync) on the blocking thread pool,
+    /// so it doesn't stall the executor threads.
+    pub async fn spawn_blocking<F, R>(f: F) -> R
+    where
+        F: FnOnce() -> R + Send + 'static,
+        R: Send + 'static,
+    {
+        async_std::task::spawn_blocking(f).await
+    }
+
     /// Schedule the given `future` to be executed shortly after the given `utc` time is reached.
     pub fn spawn_after(utc: f64, future: impl Future03<Output = ()> + Send + 'static) {
         use crossbeam::channel;
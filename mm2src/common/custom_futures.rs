@@ -11,6 +11,7 @@ use futures01::stream::{Fuse, Stream};
 use futures01::{Async, AsyncSink, Future, Poll, Sink};
 
 use std::fmt;
+use std::ops::{Deref, DerefMut};
 use std::pin::Pin;
 use std::task::Context;
 use std::time::Duration;
@@ -199,6 +200,15 @@ where
 pub struct TimedMutexGuard<'a, T>(futures::lock::MutexGuard<'a, T>);
 //impl<'a, T> Drop for TimedMutexGuard<'a, T> {fn drop (&mut self) {}}
 
+impl<'a, T> Deref for TimedMutexGuard<'a, T> {
+    type Target = T;
+    fn deref(&self) -> &T { &self.0 }
+}
+
+impl<'a, T> DerefMut for TimedMutexGuard<'a, T> {
+    fn deref_mut(&mut self) -> &mut T { &mut self.0 }
+}
+
 /// Like `AsyncMutex` but periodically invokes a callback,
 /// allowing the application to implement timeouts, status updates and shutdowns.
 pub struct TimedAsyncMutex<T>(AsyncMutex<T>);
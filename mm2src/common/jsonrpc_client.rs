@@ -1,6 +1,9 @@
+use futures::compat::Future01CompatExt;
+use futures::future::{BoxFuture, FutureExt};
 use futures01::Future;
 use serde::de::DeserializeOwned;
 use serde_json::{self as json, Value as Json};
+use std::collections::HashMap;
 use std::fmt;
 
 /// Macro generating functions for RPC requests.
@@ -29,7 +32,7 @@ macro_rules! rpc_func {
 /// Generates params vector from input args, builds the request and sends it.
 #[macro_export]
 macro_rules! rpc_func_from {
-    ($selff:ident, $address:expr, $method:expr $(, $arg_name:ident)*) => {{
+    ($selff:ident, $address:expr, $method:expr $(, $arg_name:expr)*) => {{
         let mut params = vec![];
         $(
             params.push(json::value::to_value($arg_name).unwrap());
@@ -44,6 +47,24 @@ macro_rules! rpc_func_from {
     }}
 }
 
+/// Macro generating the RPC request without sending it, e.g. to send it as a part of the batch request.
+/// Args must implement/derive Serialize trait.
+#[macro_export]
+macro_rules! rpc_req {
+    ($selff:ident, $method:expr $(, $arg_name:expr)*) => {{
+        let mut params = vec![];
+        $(
+            params.push(json::value::to_value($arg_name).unwrap());
+        )*
+        JsonRpcRequest {
+            jsonrpc: $selff.version().into(),
+            id: $selff.next_id(),
+            method: $method.into(),
+            params
+        }
+    }}
+}
+
 /// Address of server from which an Rpc response was received
 #[derive(Clone, Default)]
 pub struct JsonRpcRemoteAddr(pub String);
@@ -114,6 +135,11 @@ impl fmt::Display for JsonRpcError {
 pub type JsonRpcResponseFut =
     Box<dyn Future<Item = (JsonRpcRemoteAddr, JsonRpcResponse), Error = String> + Send + 'static>;
 pub type RpcRes<T> = Box<dyn Future<Item = T, Error = JsonRpcError> + Send + 'static>;
+pub type JsonRpcBatchResponseFut =
+    Box<dyn Future<Item = (JsonRpcRemoteAddr, Vec<JsonRpcResponse>), Error = String> + Send + 'static>;
+/// The results of the batch request items in the order of the items.
+/// A transport error is reported as the error of every item.
+pub type RpcBatchRes<T> = BoxFuture<'static, Vec<Result<T, JsonRpcError>>>;
 
 pub trait JsonRpcClient {
     fn version(&self) -> &'static str;
@@ -151,6 +177,56 @@ pub trait JsonRpcMultiClient: JsonRpcClient {
     }
 }
 
+/// The trait is used when the rpc client supports the JSON-RPC batch requests:
+/// the requests are sent as an array in one message, the responses are matched with the requests by id.
+/// https://www.jsonrpc.org/specification#batch
+pub trait JsonRpcBatchClient: JsonRpcClient {
+    fn transport_batch(&self, requests: Vec<JsonRpcRequest>) -> JsonRpcBatchResponseFut;
+
+    fn send_batch_request<T: DeserializeOwned + Send + 'static>(
+        &self,
+        requests: Vec<JsonRpcRequest>,
+    ) -> RpcBatchRes<T> {
+        let client_info = self.client_info();
+        self.transport_batch(requests.clone())
+            .compat()
+            .map(move |result| process_batch_transport_result(result, client_info, requests))
+            .boxed()
+    }
+}
+
+fn process_batch_transport_result<T: DeserializeOwned + Send + 'static>(
+    result: Result<(JsonRpcRemoteAddr, Vec<JsonRpcResponse>), String>,
+    client_info: String,
+    requests: Vec<JsonRpcRequest>,
+) -> Vec<Result<T, JsonRpcError>> {
+    let (remote_addr, responses) = match result {
+        Ok(r) => r,
+        Err(e) => {
+            return requests
+                .into_iter()
+                .map(|request| process_transport_result(Err(e.clone()), client_info.clone(), request))
+                .collect()
+        },
+    };
+
+    // the responses can be sent in any order
+    let mut responses: HashMap<_, _> = responses
+        .into_iter()
+        .map(|response| (response.id.clone(), response))
+        .collect();
+    requests
+        .into_iter()
+        .map(|request| {
+            let result = match responses.remove(request.get_id()) {
+                Some(response) => Ok((remote_addr.clone(), response)),
+                None => ERR!("No response to the request with id {}", request.get_id()),
+            };
+            process_transport_result(result, client_info.clone(), request)
+        })
+        .collect()
+}
+
 fn process_transport_result<T: DeserializeOwned + Send + 'static>(
     result: Result<(JsonRpcRemoteAddr, JsonRpcResponse), String>,
     client_info: String,
@@ -184,3 +260,62 @@ fn process_transport_result<T: DeserializeOwned + Send + 'static>(
         ),
     })
 }
+
+#[cfg(test)]
+mod jsonrpc_client_tests {
+    use super::*;
+
+    fn request(id: &str) -> JsonRpcRequest {
+        JsonRpcRequest {
+            jsonrpc: "2.0".into(),
+            id: id.into(),
+            method: "blockchain.transaction.get".into(),
+            params: vec![],
+        }
+    }
+
+    fn response(id: &str, result: Json, error: Json) -> JsonRpcResponse {
+        JsonRpcResponse {
+            jsonrpc: "2.0".into(),
+            id: id.into(),
+            result,
+            error,
+        }
+    }
+
+    #[test]
+    fn test_process_batch_transport_result() {
+        let requests = vec![request("1"), request("2"), request("3"), request("4")];
+        // the responses are not in the order of the requests, the response to the "4" request is missing
+        let responses = vec![
+            response("3", Json::Null, json!({"code": 1, "message": "error"})),
+            response("1", json!(1), Json::Null),
+            response("2", json!(2), Json::Null),
+        ];
+        let result = Ok((JsonRpcRemoteAddr("electrum".into()), responses));
+        let results: Vec<Result<u32, JsonRpcError>> =
+            process_batch_transport_result(result, "client".into(), requests.clone());
+        assert_eq!(results.len(), 4);
+        assert_eq!(results[0].as_ref().unwrap(), &1);
+        assert_eq!(results[1].as_ref().unwrap(), &2);
+        match &results[2].as_ref().unwrap_err().error {
+            JsonRpcErrorType::Response(_, error) => assert_eq!(error["code"], 1),
+            e => panic!("Unexpected error {:?}", e),
+        }
+        match &results[3].as_ref().unwrap_err().error {
+            JsonRpcErrorType::Transport(_) => (),
+            e => panic!("Unexpected error {:?}", e),
+        }
+
+        let results: Vec<Result<u32, JsonRpcError>> =
+            process_batch_transport_result(Err("Disconnected".into()), "client".into(), requests);
+        assert_eq!(results.len(), 4);
+        assert!(results.iter().all(|result| match result {
+            Err(JsonRpcError {
+                error: JsonRpcErrorType::Transport(_),
+                ..
+            }) => true,
+            _ => false,
+        }));
+    }
+}
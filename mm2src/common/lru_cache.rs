@@ -0,0 +1,130 @@
+//! The bounded map evicting the least recently used entry, for the caches of the responses and the fetched data
+//! on the request paths, so the entries requested often are kept however many others are requested once.
+
+use std::borrow::Borrow;
+use std::collections::{BTreeMap, HashMap};
+use std::hash::Hash;
+
+#[derive(Debug)]
+pub struct LruCache<K, V> {
+    capacity: usize,
+    /// The values and the ticks they were used at last time.
+    entries: HashMap<K, (V, u64)>,
+    /// The keys by the ticks they were used at, the least recent first.
+    recency: BTreeMap<u64, K>,
+    tick: u64,
+}
+
+impl<K: Clone + Eq + Hash, V> LruCache<K, V> {
+    /// The `capacity` is the number of the entries kept, it's at least 1.
+    pub fn new(capacity: usize) -> LruCache<K, V> {
+        LruCache {
+            capacity: capacity.max(1),
+            entries: HashMap::new(),
+            recency: BTreeMap::new(),
+            tick: 0,
+        }
+    }
+
+    pub fn len(&self) -> usize { self.entries.len() }
+
+    pub fn is_empty(&self) -> bool { self.entries.is_empty() }
+
+    pub fn contains_key<Q>(&self, key: &Q) -> bool
+    where
+        K: Borrow<Q>,
+        Q: Eq + Hash + ?Sized,
+    {
+        self.entries.contains_key(key)
+    }
+
+    /// Returns the value without marking it as used.
+    pub fn peek<Q>(&self, key: &Q) -> Option<&V>
+    where
+        K: Borrow<Q>,
+        Q: Eq + Hash + ?Sized,
+    {
+        self.entries.get(key).map(|(value, _)| value)
+    }
+
+    /// Returns the value marking it as the most recently used.
+    pub fn get<Q>(&mut self, key: &Q) -> Option<&V>
+    where
+        K: Borrow<Q>,
+        Q: Eq + Hash + ?Sized,
+    {
+        self.tick += 1;
+        let tick = self.tick;
+        let (value, used_at) = self.entries.get_mut(key)?;
+        if let Some(key) = self.recency.remove(used_at) {
+            self.recency.insert(tick, key);
+        }
+        *used_at = tick;
+        Some(value)
+    }
+
+    /// Inserts the value as the most recently used, the least recently used entry is evicted if the cache is full.
+    /// Returns the previous value of the `key`.
+    pub fn insert(&mut self, key: K, value: V) -> Option<V> {
+        self.tick += 1;
+        let previous = self.remove(&key);
+        if self.entries.len() >= self.capacity {
+            let least_recent = self.recency.keys().next().copied();
+            if let Some(least_recent) = least_recent {
+                if let Some(evicted) = self.recency.remove(&least_recent) {
+                    self.entries.remove(&evicted);
+                }
+            }
+        }
+        self.recency.insert(self.tick, key.clone());
+        self.entries.insert(key, (value, self.tick));
+        previous
+    }
+
+    pub fn remove<Q>(&mut self, key: &Q) -> Option<V>
+    where
+        K: Borrow<Q>,
+        Q: Eq + Hash + ?Sized,
+    {
+        let (value, used_at) = self.entries.remove(key)?;
+        self.recency.remove(&used_at);
+        Some(value)
+    }
+
+    pub fn clear(&mut self) {
+        self.entries.clear();
+        self.recency.clear();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lru_cache() {
+        let mut cache = LruCache::new(2);
+        assert_eq!(cache.insert("first", 1), None);
+        assert_eq!(cache.insert("second", 2), None);
+        // the first is used, the second is the least recent one
+        assert_eq!(cache.get("first"), Some(&1));
+        // the peeked entry is not marked as used
+        assert_eq!(cache.peek("second"), Some(&2));
+        cache.insert("third", 3);
+        assert_eq!(cache.len(), 2);
+        assert!(!cache.contains_key("second"));
+        assert_eq!(cache.get("first"), Some(&1));
+
+        // the replaced value is the most recent one
+        assert_eq!(cache.insert("third", 4), Some(3));
+        cache.insert("fourth", 5);
+        assert!(!cache.contains_key("first"));
+        assert_eq!(cache.get("third"), Some(&4));
+
+        assert_eq!(cache.remove("third"), Some(4));
+        assert_eq!(cache.get("third"), None);
+        assert_eq!(cache.recency.len(), cache.len());
+        cache.clear();
+        assert!(cache.is_empty());
+    }
+}
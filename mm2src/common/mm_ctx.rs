@@ -1,5 +1,6 @@
 use crate::log::{self, LogState};
 use crate::mm_metrics::{MetricsArc, MetricsOps};
+use crate::mm_trace::RequestTracer;
 use crate::{bits256, small_rng};
 use gstuff::Constructible;
 use keys::KeyPair;
@@ -58,6 +59,8 @@ pub struct MmCtx {
     pub log: log::LogArc,
     /// Tools and methods and to collect and export the MM metrics.
     pub metrics: MetricsArc,
+    /// The traces of the recent RPC requests and swaps.
+    pub tracer: RequestTracer,
     /// Set to true after `lp_passphrase_init`, indicating that we have a usable state.
     ///
     /// Should be refactored away in the future. State should always be valid.
@@ -102,6 +105,7 @@ impl MmCtx {
             conf: Json::Object(json::Map::new()),
             log: log::LogArc::new(log),
             metrics: MetricsArc::new(),
+            tracer: RequestTracer::default(),
             initialized: Constructible::default(),
             rpc_started: Constructible::default(),
             stop: Constructible::default(),
@@ -490,6 +494,8 @@ impl MmCtxBuilder {
         if let Some(conf) = self.conf {
             ctx.conf = conf
         }
+        ctx.tracer
+            .set_enabled(ctx.conf["request_tracing"].as_bool().unwrap_or(false));
 
         if let Some(key_pair) = self.key_pair {
             ctx.rmd160.pin(key_pair.public().address_hash()).unwrap();
@@ -4,6 +4,7 @@ use std::collections::HashMap;
 use std::sync::{Arc, Weak};
 
 #[cfg(not(target_arch = "wasm32"))] mod native;
+#[cfg(not(target_arch = "wasm32"))] mod recorder;
 #[cfg(not(target_arch = "wasm32"))]
 pub use native::{prometheus, Clock, Metrics, TrySink};
 
@@ -11,7 +12,7 @@ pub use native::{prometheus, Clock, Metrics, TrySink};
 #[cfg(target_arch = "wasm32")] pub use wasm::{Clock, Metrics};
 
 pub trait MetricsOps {
-    /// If the instance was not initialized yet, create the `receiver` else return an error.
+    /// If the instance was not initialized yet, create the `recorder` else return an error.
     fn init(&self) -> Result<(), String>;
 
     /// Create new Metrics instance and spawn the metrics recording into the log, else return an error.
@@ -1,18 +1,19 @@
+use super::recorder::{now_nanos, MetricsObserver, Recorder, TimingSnapshot};
 use super::*;
 use crate::executor::{spawn, Timer};
 use gstuff::Constructible;
 use hdrhistogram::Histogram;
 use itertools::Itertools;
-use metrics_core::{Builder, Drain, Key, Label, Observe, Observer, ScopedString};
-use metrics_runtime::{observers::PrometheusBuilder, Receiver};
+use metrics_core::{Key, Label, ScopedString};
 use metrics_util::{parse_quantiles, Quantile};
+use parking_lot::Mutex;
 use serde_json as json;
-use std::collections::HashMap;
+use std::collections::{BTreeMap, HashMap};
 use std::fmt::Write as WriteFmt;
 use std::slice::Iter;
 
+pub use super::recorder::Sink;
 use crate::log::{LogArc, Tag};
-pub use metrics_runtime::Sink;
 
 /// Increment counter if an MmArc is not dropped yet and metrics system is initialized already.
 #[macro_export]
@@ -67,6 +68,25 @@ macro_rules! mm_timing {
     }};
 }
 
+/// Same as [`mm_timing`] but records only one of `$sample_rate` timings, for the very hot paths.
+/// The count and the sum of the timings are scaled by the rate.
+#[macro_export]
+macro_rules! mm_timing_sampled {
+    ($metrics:expr, $sample_rate:expr, $name:expr, $start:expr, $end:expr) => {{
+        if let Some(mut sink) = $crate::mm_metrics::TrySink::try_sink(&$metrics) {
+            sink.record_sampled_timing($name, $sample_rate, $start, $end);
+        }
+    }};
+
+    ($metrics:expr, $sample_rate:expr, $name:expr, $start:expr, $end:expr, $($label_key:expr => $label_val:expr),+) => {{
+        use metrics::labels;
+        if let Some(mut sink) = $crate::mm_metrics::TrySink::try_sink(&$metrics) {
+            let labels = labels!( $($label_key => $label_val),+ );
+            sink.record_sampled_timing_with_labels($name, $sample_rate, $start, $end, labels);
+        }
+    }};
+}
+
 /// Default quantiles are "min" and "max"
 const QUANTILES: &[f64] = &[0.0, 1.0];
 
@@ -85,33 +105,29 @@ impl TrySink for MetricsWeak {
     }
 }
 
-pub struct Clock {
-    sink: Sink,
-}
-
-impl From<Sink> for Clock {
-    fn from(sink: Sink) -> Self { Clock { sink } }
-}
+/// Measures the timings in nanoseconds.
+pub struct Clock {}
 
 impl ClockOps for Clock {
-    fn now(&self) -> u64 { self.sink.now() }
+    fn now(&self) -> u64 { now_nanos() }
 }
 
 #[derive(Default)]
 pub struct Metrics {
-    /// `Receiver` receives and collect all the metrics sent through the `sink`.
-    /// The `receiver` can be initialized only once time.
-    receiver: Constructible<Receiver>,
+    /// `Recorder` collects all the metrics sent through the `sink`.
+    /// The `recorder` can be initialized only once time.
+    recorder: Constructible<Arc<Recorder>>,
+    /// The Prometheus exposition is rendered again only for the metrics changed since the previous scrape.
+    prometheus: Mutex<PrometheusExposition>,
 }
 
 impl MetricsOps for Metrics {
     fn init(&self) -> Result<(), String> {
-        if self.receiver.is_some() {
+        if self.recorder.is_some() {
             return ERR!("metrics system is initialized already");
         }
 
-        let receiver = try_s!(Receiver::builder().build());
-        let _ = try_s!(self.receiver.pin(receiver));
+        let _ = try_s!(self.recorder.pin(Arc::new(Recorder::default())));
 
         Ok(())
     }
@@ -119,12 +135,12 @@ impl MetricsOps for Metrics {
     fn init_with_dashboard(&self, log_state: LogWeak, record_interval: f64) -> Result<(), String> {
         self.init()?;
 
-        let controller = self.receiver.as_option().unwrap().controller();
+        let recorder = self.recorder.as_option().unwrap().clone();
 
         let observer = TagObserver::new(QUANTILES);
         let exporter = TagExporter {
             log_state,
-            controller,
+            recorder,
             observer,
         };
 
@@ -133,37 +149,33 @@ impl MetricsOps for Metrics {
         Ok(())
     }
 
-    fn clock(&self) -> Result<Clock, String> { self.sink().map_err(|e| ERRL!("{}", e)).map(Clock::from) }
+    fn clock(&self) -> Result<Clock, String> { self.sink().map(|_| Clock {}) }
 
     fn collect_json(&self) -> Result<Json, String> {
-        let receiver = try_s!(self.try_receiver());
-        let controller = receiver.controller();
+        let recorder = try_s!(self.try_recorder());
 
         let mut observer = JsonObserver::new(QUANTILES);
 
-        controller.observe(&mut observer);
+        recorder.observe(&mut observer);
 
         observer.into_json()
     }
 }
 
 impl Metrics {
-    /// Try get receiver.
-    fn try_receiver(&self) -> Result<&Receiver, String> {
-        self.receiver.ok_or("metrics system is not initialized yet".into())
+    /// Try get recorder.
+    fn try_recorder(&self) -> Result<&Arc<Recorder>, String> {
+        self.recorder.ok_or("metrics system is not initialized yet".into())
     }
 
-    fn sink(&self) -> Result<Sink, String> { Ok(try_s!(self.try_receiver()).sink()) }
+    fn sink(&self) -> Result<Sink, String> { Ok(Sink::new(try_s!(self.try_recorder()).clone())) }
 
     /// Collect the metrics in Prometheus format.
     pub fn collect_prometheus_format(&self) -> Result<String, String> {
-        let receiver = try_s!(self.try_receiver());
-        let controller = receiver.controller();
-
-        let mut observer = PrometheusBuilder::new().set_quantiles(QUANTILES).build();
-        controller.observe(&mut observer);
-
-        Ok(observer.drain())
+        let recorder = try_s!(self.try_recorder());
+        let mut exposition = self.prometheus.lock();
+        recorder.observe(&mut *exposition);
+        Ok(exposition.render())
     }
 }
 
@@ -200,7 +212,7 @@ struct TagObserver {
     /// Metric:Value pair matching an unique set of labels.
     metrics: HashMap<MetricLabels, MetricNameValueMap>,
     /// Histograms present set of time measurements and analysis over the measurements
-    histograms: HashMap<Key, Histogram<u64>>,
+    histograms: HashMap<Key, TimingSnapshot>,
 }
 
 impl TagObserver {
@@ -259,32 +271,12 @@ impl TagObserver {
     }
 }
 
-impl Observer for TagObserver {
+impl MetricsObserver for TagObserver {
     fn observe_counter(&mut self, key: Key, value: u64) { self.insert_metric(key, Integer::Unsigned(value)) }
 
     fn observe_gauge(&mut self, key: Key, value: i64) { self.insert_metric(key, Integer::Signed(value)) }
 
-    fn observe_histogram(&mut self, key: Key, values: &[u64]) {
-        let entry = self.histograms.entry(key).or_insert({
-            // Use default significant figures value.
-            // For more info on `sigfig` see the Historgam::new_with_bounds().
-            let sigfig = 3;
-            match Histogram::new(sigfig) {
-                Ok(x) => x,
-                Err(err) => {
-                    log!("failed to create histogram: "(err));
-                    // do nothing on error
-                    return;
-                },
-            }
-        });
-
-        for value in values {
-            if let Err(err) = entry.record(*value) {
-                log!("failed to observe histogram value: "(err));
-            }
-        }
-    }
+    fn observe_timing(&mut self, key: Key, timing: TimingSnapshot) { self.histograms.insert(key, timing); }
 }
 
 /// Observes metrics and histograms in Tag format.
@@ -295,7 +287,7 @@ struct JsonObserver {
     metrics: MetricsJson,
 }
 
-impl Observer for JsonObserver {
+impl MetricsObserver for JsonObserver {
     fn observe_counter(&mut self, key: Key, value: u64) {
         let (key, labels) = key.into_parts();
 
@@ -320,31 +312,12 @@ impl Observer for JsonObserver {
         self.metrics.metrics.push(metric);
     }
 
-    fn observe_histogram(&mut self, key: Key, values: &[u64]) {
+    fn observe_timing(&mut self, key: Key, timing: TimingSnapshot) {
         let (key, labels) = key.into_parts();
 
-        // Use default significant figures value.
-        // For more info on `sigfig` see the Historgam::new_with_bounds().
-        let sigfig = 3;
-        let mut histogram = match Histogram::new(sigfig) {
-            Ok(x) => x,
-            Err(err) => {
-                log!("failed to create histogram: "(err));
-                // do nothing on error
-                return;
-            },
-        };
-
-        for value in values {
-            if let Err(err) = histogram.record(*value) {
-                log!("failed to observe histogram value: "(err));
-            }
-        }
-
-        let count = histogram.len() as u64;
-        let mut quantiles = hist_at_quantiles(histogram, &self.quantiles);
+        let mut quantiles = hist_at_quantiles(&timing.histogram, &self.quantiles);
         // add total quantiles number
-        quantiles.insert("count".into(), count);
+        quantiles.insert("count".into(), timing.count());
 
         let metric = MetricType::Histogram {
             key: key.to_string(),
@@ -368,19 +341,16 @@ impl JsonObserver {
 }
 
 /// Exports metrics by converting them to a Tag format and log them using log::Status.
-struct TagExporter<C> {
+struct TagExporter {
     /// Using a weak reference by default in order to avoid circular references and leaks.
     log_state: LogWeak,
     /// Handle for acquiring metric snapshots.
-    controller: C,
+    recorder: Arc<Recorder>,
     /// Handle for converting snapshots into log.
     observer: TagObserver,
 }
 
-impl<C> TagExporter<C>
-where
-    C: Observe,
-{
+impl TagExporter {
     /// Run endless async loop
     async fn run(mut self, interval: f64) {
         loop {
@@ -400,7 +370,7 @@ where
         log!(">>>>>>>>>> DEX metrics <<<<<<<<<");
 
         // Observe means fill the observer's metrics and histograms with actual values
-        self.controller.observe(&mut self.observer);
+        self.recorder.observe(&mut self.observer);
 
         for PreparedMetric { tags, message } in self.observer.prepare_metrics() {
             log_state.log_deref_tags("", tags, &message);
@@ -441,7 +411,7 @@ fn name_value_map_to_message(name_value_map: &MetricNameValueMap) -> String {
     }
 }
 
-fn hist_at_quantiles(hist: Histogram<u64>, quantiles: &[Quantile]) -> HashMap<String, u64> {
+fn hist_at_quantiles(hist: &Histogram<u64>, quantiles: &[Quantile]) -> HashMap<String, u64> {
     quantiles
         .iter()
         .map(|quantile| {
@@ -452,16 +422,16 @@ fn hist_at_quantiles(hist: Histogram<u64>, quantiles: &[Quantile]) -> HashMap<St
         .collect()
 }
 
-fn hist_to_message(hist: &Histogram<u64>, quantiles: &[Quantile]) -> String {
+fn hist_to_message(timing: &TimingSnapshot, quantiles: &[Quantile]) -> String {
     let mut message = String::with_capacity(256);
     let fmt_quantiles = quantiles.iter().map(|quantile| {
         let key = quantile.label().to_string();
-        let val = hist.value_at_quantile(quantile.value());
+        let val = timing.histogram.value_at_quantile(quantile.value());
         format!("{}={}", key, val)
     });
 
     match wite!(message,
-                "count=" (hist.len())
+                "count=" (timing.count())
                 if quantiles.is_empty() { "" } else { " " }
                 for q in fmt_quantiles { (q) } separated {' '}
     ) {
@@ -473,6 +443,149 @@ fn hist_to_message(hist: &Histogram<u64>, quantiles: &[Quantile]) -> String {
     }
 }
 
+/// The Prometheus text format lines of a metric and the value they were rendered for.
+struct RenderedMetric {
+    /// The observed value: the counter or gauge value, or the timings count and sum.
+    state: (i128, u64),
+    /// Observed by the latest scrape.
+    is_observed: bool,
+    metric_type: &'static str,
+    lines: String,
+}
+
+/// Renders the metrics in the Prometheus text format.
+/// The lines of the metrics not changed since the previous scrape are reused as is.
+struct PrometheusExposition {
+    quantiles: Vec<Quantile>,
+    /// The metrics keyed by the Prometheus name and the rendered labels.
+    rendered: BTreeMap<(String, String), RenderedMetric>,
+    /// The exposition buffer reused by every scrape.
+    buffer: String,
+}
+
+impl Default for PrometheusExposition {
+    fn default() -> Self {
+        PrometheusExposition {
+            quantiles: parse_quantiles(QUANTILES),
+            rendered: BTreeMap::new(),
+            buffer: String::new(),
+        }
+    }
+}
+
+impl PrometheusExposition {
+    /// Renders the metric lines if the `state` changed since the previous scrape.
+    fn update<F>(&mut self, key: Key, state: (i128, u64), metric_type: &'static str, render: F)
+    where
+        F: FnOnce(&str, &str, &mut String),
+    {
+        let rendered_key = (prometheus_name(&key.name()), prometheus_labels(key.labels()));
+        if let Some(rendered) = self.rendered.get_mut(&rendered_key) {
+            rendered.is_observed = true;
+            if rendered.state == state && rendered.metric_type == metric_type {
+                return;
+            }
+        }
+
+        let mut lines = String::new();
+        render(&rendered_key.0, &rendered_key.1, &mut lines);
+        self.rendered.insert(rendered_key, RenderedMetric {
+            state,
+            is_observed: true,
+            metric_type,
+            lines,
+        });
+    }
+
+    fn render(&mut self) -> String {
+        self.rendered.retain(|_, metric| metric.is_observed);
+
+        self.buffer.clear();
+        let mut prev_name: Option<&str> = None;
+        for ((name, _labels), metric) in self.rendered.iter_mut() {
+            metric.is_observed = false;
+            if prev_name != Some(name.as_str()) {
+                let _ = writeln!(self.buffer, "# TYPE {} {}", name, metric.metric_type);
+                prev_name = Some(name.as_str());
+            }
+            self.buffer.push_str(&metric.lines);
+        }
+        self.buffer.clone()
+    }
+}
+
+impl MetricsObserver for PrometheusExposition {
+    fn observe_counter(&mut self, key: Key, value: u64) {
+        self.update(key, (value as i128, 0), "counter", |name, labels, lines| {
+            let _ = writeln!(lines, "{}{} {}", name, braced(labels), value);
+        })
+    }
+
+    fn observe_gauge(&mut self, key: Key, value: i64) {
+        self.update(key, (value as i128, 0), "gauge", |name, labels, lines| {
+            let _ = writeln!(lines, "{}{} {}", name, braced(labels), value);
+        })
+    }
+
+    fn observe_timing(&mut self, key: Key, timing: TimingSnapshot) {
+        // the quantiles are borrowed by the renderer while the `self` is updated
+        let quantiles = std::mem::take(&mut self.quantiles);
+        let (count, sum) = (timing.count(), timing.sum());
+        self.update(key, (count as i128, sum), "summary", |name, labels, lines| {
+            let separator = if labels.is_empty() { "" } else { "," };
+            for quantile in quantiles.iter() {
+                let value = timing.histogram.value_at_quantile(quantile.value());
+                let _ = writeln!(
+                    lines,
+                    "{}{{{}{}quantile=\"{}\"}} {}",
+                    name,
+                    labels,
+                    separator,
+                    quantile.value(),
+                    value
+                );
+            }
+            let _ = writeln!(lines, "{}_sum{} {}", name, braced(labels), sum);
+            let _ = writeln!(lines, "{}_count{} {}", name, braced(labels), count);
+        });
+        self.quantiles = quantiles;
+    }
+}
+
+/// Replaces the characters not allowed in the Prometheus metric names, e.g. "rpc.traffic.tx" -> "rpc_traffic_tx".
+fn prometheus_name(name: &str) -> String {
+    name.chars()
+        .map(|c| {
+            if c.is_ascii_alphanumeric() || c == '_' || c == ':' {
+                c
+            } else {
+                '_'
+            }
+        })
+        .collect()
+}
+
+fn prometheus_labels(labels: Iter<Label>) -> String {
+    labels
+        .map(|label| {
+            let value = label
+                .value()
+                .replace('\\', "\\\\")
+                .replace('"', "\\\"")
+                .replace('\n', "\\n");
+            format!("{}=\"{}\"", prometheus_name(label.key()), value)
+        })
+        .join(",")
+}
+
+fn braced(labels: &str) -> String {
+    if labels.is_empty() {
+        String::new()
+    } else {
+        format!("{{{}}}", labels)
+    }
+}
+
 pub mod prometheus {
     use super::*;
     use futures::future::{Future, FutureExt};
@@ -761,4 +874,33 @@ mod tests {
             actual
         );
     }
+
+    #[test]
+    fn test_collect_prometheus_format() {
+        let metrics = MetricsArc::new();
+
+        metrics.init().unwrap();
+
+        mm_counter!(metrics, "rpc.traffic.tx", 62, "coin" => "BTC");
+        mm_gauge!(metrics, "rpc.connection.count", 3);
+        mm_timing!(metrics, "rpc.query.spent_time", 0, 100, "coin" => "KMD");
+        mm_timing_sampled!(metrics, 2, "p2p.message.spent_time", 0, 100);
+        mm_timing_sampled!(metrics, 2, "p2p.message.spent_time", 0, 100);
+
+        let exposition = metrics.0.collect_prometheus_format().unwrap();
+        assert!(exposition.contains("# TYPE rpc_traffic_tx counter\nrpc_traffic_tx{coin=\"BTC\"} 62\n"));
+        assert!(exposition.contains("# TYPE rpc_connection_count gauge\nrpc_connection_count 3\n"));
+        assert!(exposition.contains("# TYPE rpc_query_spent_time summary\n"));
+        assert!(exposition.contains("rpc_query_spent_time{coin=\"KMD\",quantile=\"1\"} 100\n"));
+        assert!(exposition.contains("rpc_query_spent_time_sum{coin=\"KMD\"} 100\n"));
+        assert!(exposition.contains("rpc_query_spent_time_count{coin=\"KMD\"} 1\n"));
+        // one of two timings is recorded, the count is scaled
+        assert!(exposition.contains("p2p_message_spent_time_count 2\n"));
+
+        // the changed metrics are rendered again
+        mm_counter!(metrics, "rpc.traffic.tx", 8, "coin" => "BTC");
+        let exposition = metrics.0.collect_prometheus_format().unwrap();
+        assert!(exposition.contains("rpc_traffic_tx{coin=\"BTC\"} 70\n"));
+        assert!(exposition.contains("rpc_connection_count 3\n"));
+    }
 }
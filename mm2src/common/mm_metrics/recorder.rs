@@ -0,0 +1,402 @@
+//! The metrics are recorded to atomics the observers read on demand:
+//! the counters are sharded by threads so the concurrent increments don't contend on the same cache line,
+//! the gauges are stored as is, and the timings are recorded to HDR histograms (O(1) record), optionally sampled.
+//! Every thread caches the handles of the metrics it records to, so the registry is locked only to register
+//! a new metric or to observe all of them.
+
+use crossbeam::utils::CachePadded;
+use hdrhistogram::Histogram;
+use metrics_core::{IntoLabels, Key, ScopedString};
+use parking_lot::{Mutex, RwLock};
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicI64, AtomicU64, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Instant;
+
+/// The number of the shards every counter is split into.
+const COUNTER_SHARDS: usize = 16;
+/// The significant figures of the timings histograms, see `Histogram::new`.
+const HISTOGRAM_SIGFIG: u8 = 3;
+
+static NEXT_RECORDER_ID: AtomicUsize = AtomicUsize::new(0);
+static NEXT_COUNTER_SHARD: AtomicUsize = AtomicUsize::new(0);
+
+lazy_static! {
+    static ref CLOCK_START: Instant = Instant::now();
+}
+
+thread_local! {
+    /// The shard of the counters the thread increments.
+    static COUNTER_SHARD: usize = NEXT_COUNTER_SHARD.fetch_add(1, Ordering::Relaxed) % COUNTER_SHARDS;
+    /// The handles of the metrics the thread recorded to, cached for the last used recorder only.
+    static LOCAL_HANDLES: RefCell<LocalHandles> = RefCell::new(LocalHandles::default());
+}
+
+/// Nanoseconds elapsed since the first call, monotonic.
+pub fn now_nanos() -> u64 { CLOCK_START.elapsed().as_nanos() as u64 }
+
+#[derive(Default)]
+struct LocalHandles {
+    recorder_id: Option<usize>,
+    handles: HashMap<(MetricKind, Key), Handle>,
+}
+
+#[derive(Clone, Copy, Debug, Eq, Hash, PartialEq)]
+enum MetricKind {
+    Counter,
+    Gauge,
+    Timing,
+}
+
+#[derive(Clone)]
+enum Handle {
+    Counter(Arc<Counter>),
+    Gauge(Arc<Gauge>),
+    Timing(Arc<Timing>),
+}
+
+impl Handle {
+    fn new(kind: MetricKind, sample_rate: u64) -> Handle {
+        match kind {
+            MetricKind::Counter => Handle::Counter(Default::default()),
+            MetricKind::Gauge => Handle::Gauge(Default::default()),
+            MetricKind::Timing => Handle::Timing(Arc::new(Timing::new(sample_rate))),
+        }
+    }
+}
+
+#[derive(Default)]
+struct Counter {
+    shards: [CachePadded<AtomicU64>; COUNTER_SHARDS],
+}
+
+impl Counter {
+    fn increment(&self, value: u64) {
+        let shard = COUNTER_SHARD.try_with(|shard| *shard).unwrap_or(0);
+        self.shards[shard].fetch_add(value, Ordering::Relaxed);
+    }
+
+    fn value(&self) -> u64 {
+        self.shards
+            .iter()
+            .fold(0, |total: u64, shard| total.wrapping_add(shard.load(Ordering::Relaxed)))
+    }
+}
+
+#[derive(Default)]
+struct Gauge(AtomicI64);
+
+struct Timing {
+    histogram: Mutex<Histogram<u64>>,
+    /// The sum of the recorded values.
+    sum: AtomicU64,
+    /// Only one of `sample_rate` timings is recorded.
+    sample_rate: u64,
+    /// The number of the timings passed if they're sampled.
+    passed: AtomicU64,
+}
+
+impl Timing {
+    fn new(sample_rate: u64) -> Timing {
+        Timing {
+            histogram: Mutex::new(Histogram::new(HISTOGRAM_SIGFIG).expect("HISTOGRAM_SIGFIG is valid")),
+            sum: AtomicU64::new(0),
+            sample_rate: sample_rate.max(1),
+            passed: AtomicU64::new(0),
+        }
+    }
+
+    fn record(&self, value: u64) {
+        if self.sample_rate > 1 && self.passed.fetch_add(1, Ordering::Relaxed) % self.sample_rate != 0 {
+            return;
+        }
+        self.sum.fetch_add(value, Ordering::Relaxed);
+        // the histogram is resized only while the range of the values grows
+        self.histogram.lock().saturating_record(value);
+    }
+
+    fn snapshot(&self) -> TimingSnapshot {
+        TimingSnapshot {
+            histogram: self.histogram.lock().clone(),
+            sum: self.sum.load(Ordering::Relaxed),
+            sample_rate: self.sample_rate,
+        }
+    }
+}
+
+/// The timings recorded so far.
+pub struct TimingSnapshot {
+    pub histogram: Histogram<u64>,
+    sum: u64,
+    sample_rate: u64,
+}
+
+impl TimingSnapshot {
+    /// The estimated number of the timings including the not sampled ones.
+    pub fn count(&self) -> u64 { self.histogram.len() * self.sample_rate }
+
+    /// The estimated sum of the timings including the not sampled ones.
+    pub fn sum(&self) -> u64 { self.sum.wrapping_mul(self.sample_rate) }
+}
+
+/// Receives the actual values of the metrics, see [`Recorder::observe`].
+pub trait MetricsObserver {
+    fn observe_counter(&mut self, key: Key, value: u64);
+
+    fn observe_gauge(&mut self, key: Key, value: i64);
+
+    fn observe_timing(&mut self, key: Key, timing: TimingSnapshot);
+}
+
+pub struct Recorder {
+    /// Distinguishes the recorders in the `LOCAL_HANDLES`.
+    id: usize,
+    registry: RwLock<HashMap<(MetricKind, Key), Handle>>,
+}
+
+impl Default for Recorder {
+    fn default() -> Recorder {
+        Recorder {
+            id: NEXT_RECORDER_ID.fetch_add(1, Ordering::Relaxed),
+            registry: RwLock::new(HashMap::new()),
+        }
+    }
+}
+
+impl Recorder {
+    /// Calls the `f` with the handle of the `key` metric registering it if it's not recorded yet.
+    /// The `sample_rate` matters for the timings registered by the call only.
+    fn with_handle<F>(&self, kind: MetricKind, key: Key, sample_rate: u64, f: F)
+    where
+        F: FnOnce(&Handle),
+    {
+        let mut f = Some(f);
+        let mut registry_key = Some((kind, key));
+        let cached = LOCAL_HANDLES.try_with(|local| {
+            let mut local = local.borrow_mut();
+            if local.recorder_id != Some(self.id) {
+                local.recorder_id = Some(self.id);
+                local.handles.clear();
+            }
+
+            let registry_key = registry_key.take().expect("registry_key is taken once");
+            let f = f.take().expect("f is taken once");
+            match local.handles.get(&registry_key) {
+                Some(handle) => f(handle),
+                None => {
+                    let handle = self.register(registry_key.clone(), sample_rate);
+                    f(&handle);
+                    local.handles.insert(registry_key, handle);
+                },
+            }
+        });
+
+        // the thread local storage is destroyed already
+        if cached.is_err() {
+            if let (Some(registry_key), Some(f)) = (registry_key, f) {
+                f(&self.register(registry_key, sample_rate))
+            }
+        }
+    }
+
+    fn register(&self, registry_key: (MetricKind, Key), sample_rate: u64) -> Handle {
+        let kind = registry_key.0;
+        self.registry
+            .write()
+            .entry(registry_key)
+            .or_insert_with(|| Handle::new(kind, sample_rate))
+            .clone()
+    }
+
+    pub fn increment_counter(&self, key: Key, value: u64) {
+        self.with_handle(MetricKind::Counter, key, 1, |handle| {
+            if let Handle::Counter(counter) = handle {
+                counter.increment(value)
+            }
+        })
+    }
+
+    pub fn update_gauge(&self, key: Key, value: i64) {
+        self.with_handle(MetricKind::Gauge, key, 1, |handle| {
+            if let Handle::Gauge(gauge) = handle {
+                gauge.0.store(value, Ordering::Relaxed)
+            }
+        })
+    }
+
+    pub fn record_timing(&self, key: Key, sample_rate: u64, value: u64) {
+        self.with_handle(MetricKind::Timing, key, sample_rate, |handle| {
+            if let Handle::Timing(timing) = handle {
+                timing.record(value)
+            }
+        })
+    }
+
+    /// Passes the actual values of all the recorded metrics to the `observer`.
+    pub fn observe<O: MetricsObserver>(&self, observer: &mut O) {
+        // the recording threads aren't blocked while the observer processes the values
+        let handles: Vec<_> = self
+            .registry
+            .read()
+            .iter()
+            .map(|((_kind, key), handle)| (key.clone(), handle.clone()))
+            .collect();
+        for (key, handle) in handles {
+            match handle {
+                Handle::Counter(counter) => observer.observe_counter(key, counter.value()),
+                Handle::Gauge(gauge) => observer.observe_gauge(key, gauge.0.load(Ordering::Relaxed)),
+                Handle::Timing(timing) => observer.observe_timing(key, timing.snapshot()),
+            }
+        }
+    }
+}
+
+/// The handle for recording the metrics, see the `mm_counter`, `mm_gauge` and `mm_timing` macros.
+pub struct Sink {
+    recorder: Arc<Recorder>,
+}
+
+impl Sink {
+    pub fn new(recorder: Arc<Recorder>) -> Sink { Sink { recorder } }
+
+    pub fn increment_counter<N: Into<ScopedString>>(&mut self, name: N, value: u64) {
+        self.recorder.increment_counter(Key::from_name(name), value)
+    }
+
+    pub fn increment_counter_with_labels<N, L>(&mut self, name: N, value: u64, labels: L)
+    where
+        N: Into<ScopedString>,
+        L: IntoLabels,
+    {
+        self.recorder
+            .increment_counter(Key::from_name_and_labels(name, labels), value)
+    }
+
+    pub fn update_gauge<N: Into<ScopedString>>(&mut self, name: N, value: i64) {
+        self.recorder.update_gauge(Key::from_name(name), value)
+    }
+
+    pub fn update_gauge_with_labels<N, L>(&mut self, name: N, value: i64, labels: L)
+    where
+        N: Into<ScopedString>,
+        L: IntoLabels,
+    {
+        self.recorder
+            .update_gauge(Key::from_name_and_labels(name, labels), value)
+    }
+
+    pub fn record_timing<N: Into<ScopedString>>(&mut self, name: N, start: u64, end: u64) {
+        self.record_sampled_timing(name, 1, start, end)
+    }
+
+    pub fn record_timing_with_labels<N, L>(&mut self, name: N, start: u64, end: u64, labels: L)
+    where
+        N: Into<ScopedString>,
+        L: IntoLabels,
+    {
+        self.record_sampled_timing_with_labels(name, 1, start, end, labels)
+    }
+
+    /// Records only one of `sample_rate` timings, the rate is fixed by the first record of the metric.
+    pub fn record_sampled_timing<N: Into<ScopedString>>(&mut self, name: N, sample_rate: u64, start: u64, end: u64) {
+        self.recorder
+            .record_timing(Key::from_name(name), sample_rate, end.saturating_sub(start))
+    }
+
+    pub fn record_sampled_timing_with_labels<N, L>(
+        &mut self,
+        name: N,
+        sample_rate: u64,
+        start: u64,
+        end: u64,
+        labels: L,
+    ) where
+        N: Into<ScopedString>,
+        L: IntoLabels,
+    {
+        self.recorder.record_timing(
+            Key::from_name_and_labels(name, labels),
+            sample_rate,
+            end.saturating_sub(start),
+        )
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use metrics_core::Label;
+    use std::thread;
+
+    #[derive(Default)]
+    struct CollectingObserver {
+        counters: HashMap<Key, u64>,
+        gauges: HashMap<Key, i64>,
+        timings: HashMap<Key, TimingSnapshot>,
+    }
+
+    impl MetricsObserver for CollectingObserver {
+        fn observe_counter(&mut self, key: Key, value: u64) { self.counters.insert(key, value); }
+
+        fn observe_gauge(&mut self, key: Key, value: i64) { self.gauges.insert(key, value); }
+
+        fn observe_timing(&mut self, key: Key, timing: TimingSnapshot) { self.timings.insert(key, timing); }
+    }
+
+    #[test]
+    fn test_recorder_concurrent() {
+        let recorder = Arc::new(Recorder::default());
+        let threads: Vec<_> = (0..8)
+            .map(|i| {
+                let mut sink = Sink::new(recorder.clone());
+                thread::spawn(move || {
+                    for _ in 0..1000 {
+                        sink.increment_counter("counter", 1);
+                        sink.increment_counter_with_labels("counter", 2, vec![Label::new("coin", "KMD")]);
+                        sink.record_timing("timing", 0, 100);
+                        sink.record_sampled_timing("sampled", 10, 0, 100);
+                    }
+                    sink.update_gauge("gauge", i);
+                })
+            })
+            .collect();
+        for thread in threads {
+            thread.join().unwrap();
+        }
+
+        let mut observer = CollectingObserver::default();
+        recorder.observe(&mut observer);
+        assert_eq!(observer.counters[&Key::from_name("counter")], 8000);
+        let labeled = Key::from_name_and_labels("counter", vec![Label::new("coin", "KMD")]);
+        assert_eq!(observer.counters[&labeled], 16000);
+        assert!((0..8).contains(&observer.gauges[&Key::from_name("gauge")]));
+
+        let timing = &observer.timings[&Key::from_name("timing")];
+        assert_eq!(timing.count(), 8000);
+        assert_eq!(timing.sum(), 800_000);
+        assert_eq!(timing.histogram.max(), 100);
+
+        let sampled = &observer.timings[&Key::from_name("sampled")];
+        assert_eq!(sampled.histogram.len(), 800);
+        assert_eq!(sampled.count(), 8000);
+        assert_eq!(sampled.sum(), 800_000);
+    }
+
+    #[test]
+    fn test_recorders_separated() {
+        let recorder1 = Arc::new(Recorder::default());
+        let recorder2 = Arc::new(Recorder::default());
+        Sink::new(recorder1.clone()).increment_counter("counter", 1);
+        Sink::new(recorder2.clone()).increment_counter("counter", 2);
+        Sink::new(recorder1.clone()).increment_counter("counter", 3);
+
+        let mut observer = CollectingObserver::default();
+        recorder1.observe(&mut observer);
+        assert_eq!(observer.counters[&Key::from_name("counter")], 4);
+
+        let mut observer = CollectingObserver::default();
+        recorder2.observe(&mut observer);
+        assert_eq!(observer.counters[&Key::from_name("counter")], 2);
+    }
+}
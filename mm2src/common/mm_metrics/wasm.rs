@@ -3,7 +3,7 @@ use crate::now_ms;
 
 /// The dummy macro that imitates [`crate::mm_metrics::native::mm_counter`].
 /// These macros borrow the `$metrics`, `$name`, `$value` and takes ownership of the `$label_key`, `$label_val` to prevent the `unused_variable` warning.
-/// The labels have to be moved because [`metrics_runtime::Sink::increment_counter_with_labels`] also takes ownership of the labels.
+/// The labels have to be moved because [`crate::mm_metrics::native::Sink::increment_counter_with_labels`] also takes ownership of the labels.
 #[macro_export]
 macro_rules! mm_counter {
     ($metrics:expr, $name:expr, $value:expr) => {{
@@ -17,7 +17,7 @@ macro_rules! mm_counter {
 
 /// The dummy macro that imitates [`crate::mm_metrics::native::mm_gauge`].
 /// These macros borrow the `$metrics`, `$name`, `$value` and takes ownership of the `$label_key`, `$label_val` to prevent the `unused_variable` warning.
-/// The labels have to be moved because [`metrics_runtime::Sink::update_gauge_with_labels`] also takes ownership of the labels.
+/// The labels have to be moved because [`crate::mm_metrics::native::Sink::update_gauge_with_labels`] also takes ownership of the labels.
 #[macro_export]
 macro_rules! mm_gauge {
     ($metrics:expr, $name:expr, $value:expr) => {{
@@ -31,7 +31,7 @@ macro_rules! mm_gauge {
 
 /// The dummy macro that imitates [`crate::mm_metrics::native::mm_timing`].
 /// These macros borrow the `$metrics`, `$name`, `$start`, `$end` and takes ownership of the `$label_key`, `$label_val` to prevent the `unused_variable` warning.
-/// The labels have to be moved because [`metrics_runtime::Sink::record_timing_with_labels`] also takes ownership of the labels.
+/// The labels have to be moved because [`crate::mm_metrics::native::Sink::record_timing_with_labels`] also takes ownership of the labels.
 #[macro_export]
 macro_rules! mm_timing {
     ($metrics:expr, $name:expr, $start:expr, $end:expr) => {{
@@ -43,6 +43,20 @@ macro_rules! mm_timing {
     }};
 }
 
+/// The dummy macro that imitates [`crate::mm_metrics::native::mm_timing_sampled`].
+/// These macros borrow the `$metrics`, `$sample_rate`, `$name`, `$start`, `$end` and takes ownership of the `$label_key`, `$label_val` to prevent the `unused_variable` warning.
+/// The labels have to be moved because [`crate::mm_metrics::native::Sink::record_sampled_timing_with_labels`] also takes ownership of the labels.
+#[macro_export]
+macro_rules! mm_timing_sampled {
+    ($metrics:expr, $sample_rate:expr, $name:expr, $start:expr, $end:expr) => {{
+        let _ = (&$metrics, &$sample_rate, &$name, &$start, &$end); // borrow
+    }};
+    ($metrics:expr, $sample_rate:expr, $name:expr, $start:expr, $end:expr, $($label_key:expr => $label_val:expr),+) => {{
+        let _ = (&$metrics, &$sample_rate, &$name, &$start, &$end); // borrow
+        let _ = ($($label_key, $label_val),+); // move
+    }};
+}
+
 #[derive(Default)]
 pub struct Clock {}
 
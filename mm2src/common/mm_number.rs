@@ -1,8 +1,11 @@
 use crate::big_int_str::BigIntStr;
 use core::ops::{Add, AddAssign, Div, Mul, Sub};
-use num_traits::{Pow, Zero};
-use serde::{de, Deserialize, Deserializer, Serialize};
+use num_traits::{Pow, ToPrimitive, Zero};
+use serde::{de, Deserialize, Deserializer, Serialize, Serializer};
 use serde_json::value::RawValue;
+use std::borrow::Cow;
+use std::cmp::Ordering;
+use std::convert::TryFrom;
 use std::str::FromStr;
 
 pub use bigdecimal::BigDecimal;
@@ -57,8 +60,119 @@ macro_rules! construct_detailed {
     };
 }
 
-#[derive(Clone, Debug, Eq, PartialEq, PartialOrd, Ord, Serialize)]
-pub struct MmNumber(BigRational);
+/// The rational number kept inline while the numerator and the denominator fit the `i128`.
+/// The `BigRational` is allocated only once the arithmetic overflows, so the usual amounts and prices
+/// are matched and the fees are computed without allocating and normalizing the big integers.
+#[derive(Clone, Eq, PartialEq)]
+pub struct MmNumber(Repr);
+
+#[derive(Clone, Eq, PartialEq)]
+enum Repr {
+    Small(SmallRatio),
+    /// Only the numbers not fitting the `SmallRatio` are kept as the `BigRational`,
+    /// so the equal numbers are always represented the same way.
+    Big(BigRational),
+}
+
+/// The normalized rational: the denominator is positive and coprime with the numerator,
+/// the numerator is never `i128::MIN` so it can be negated.
+#[derive(Clone, Copy, Debug, Eq, PartialEq)]
+struct SmallRatio {
+    numer: i128,
+    denom: i128,
+}
+
+/// The greatest common divisor by the Euclidean algorithm.
+fn gcd(mut a: u128, mut b: u128) -> u128 {
+    while b != 0 {
+        let rem = a % b;
+        a = b;
+        b = rem;
+    }
+    a
+}
+
+/// The operations return None if the result doesn't fit, the callers fall back to the `BigRational` then.
+impl SmallRatio {
+    const ZERO: SmallRatio = SmallRatio { numer: 0, denom: 1 };
+
+    fn new(numer: i128, denom: i128) -> Option<SmallRatio> {
+        if denom == 0 {
+            return None;
+        }
+        let (numer, denom) = if denom < 0 {
+            (numer.checked_neg()?, denom.checked_neg()?)
+        } else {
+            (numer, denom)
+        };
+        let divisor = gcd(numer.checked_abs()? as u128, denom as u128) as i128;
+        Some(SmallRatio {
+            numer: numer / divisor,
+            denom: denom / divisor,
+        })
+    }
+
+    fn from_big(ratio: &BigRational) -> Option<SmallRatio> {
+        SmallRatio::new(ratio.numer().to_i128()?, ratio.denom().to_i128()?)
+    }
+
+    fn from_dec(dec: &BigDecimal) -> Option<SmallRatio> {
+        let (num, scale) = dec.as_bigint_and_exponent();
+        let num = num.to_i128()?;
+        let pow = 10i128.checked_pow(u32::try_from(scale.checked_abs()?).ok()?)?;
+        if scale >= 0 {
+            SmallRatio::new(num, pow)
+        } else {
+            SmallRatio::new(num.checked_mul(pow)?, 1)
+        }
+    }
+
+    fn to_big(self) -> BigRational { BigRational::new_raw(self.numer.into(), self.denom.into()) }
+
+    fn checked_add(self, rhs: SmallRatio) -> Option<SmallRatio> {
+        if self.denom == rhs.denom {
+            return SmallRatio::new(self.numer.checked_add(rhs.numer)?, self.denom);
+        }
+        let divisor = gcd(self.denom as u128, rhs.denom as u128) as i128;
+        let lhs_factor = rhs.denom / divisor;
+        let rhs_factor = self.denom / divisor;
+        let numer = self
+            .numer
+            .checked_mul(lhs_factor)?
+            .checked_add(rhs.numer.checked_mul(rhs_factor)?)?;
+        SmallRatio::new(numer, self.denom.checked_mul(lhs_factor)?)
+    }
+
+    fn checked_sub(self, rhs: SmallRatio) -> Option<SmallRatio> {
+        self.checked_add(SmallRatio {
+            numer: -rhs.numer,
+            denom: rhs.denom,
+        })
+    }
+
+    fn checked_mul(self, rhs: SmallRatio) -> Option<SmallRatio> {
+        // the cross reduction keeps the products smaller
+        let lhs_divisor = gcd(self.numer.checked_abs()? as u128, rhs.denom as u128) as i128;
+        let rhs_divisor = gcd(rhs.numer.checked_abs()? as u128, self.denom as u128) as i128;
+        let numer = (self.numer / lhs_divisor).checked_mul(rhs.numer / rhs_divisor)?;
+        let denom = (self.denom / rhs_divisor).checked_mul(rhs.denom / lhs_divisor)?;
+        SmallRatio::new(numer, denom)
+    }
+
+    /// Returns None on the division by zero too, so it panics the same way as the `BigRational` does.
+    fn checked_div(self, rhs: SmallRatio) -> Option<SmallRatio> {
+        self.checked_mul(SmallRatio::new(rhs.denom, rhs.numer)?)
+    }
+
+    fn checked_cmp(&self, rhs: &SmallRatio) -> Option<Ordering> {
+        if self.denom == rhs.denom {
+            return Some(self.numer.cmp(&rhs.numer));
+        }
+        let lhs = self.numer.checked_mul(rhs.denom)?;
+        let rhs = rhs.numer.checked_mul(self.denom)?;
+        Some(lhs.cmp(&rhs))
+    }
+}
 
 /// Rational number representation de/serializable in human readable form
 /// Should simplify the visual perception and parsing in code
@@ -147,15 +261,19 @@ impl<'de> Deserialize<'de> for MmNumber {
         let raw: Box<RawValue> = Deserialize::deserialize(deserializer)?;
 
         if let Ok(dec) = BigDecimal::from_str(&raw.get().trim_matches('"')) {
-            return Ok(MmNumber(from_dec_to_ratio(&dec)));
+            return Ok(MmNumber::from_dec(&dec));
         };
 
         if let Ok(rat) = serde_json::from_str::<BigRational>(raw.get()) {
-            return Ok(MmNumber(rat));
+            // the deserialized ratio isn't normalized
+            if rat.denom().is_zero() {
+                return Ok(MmNumber(Repr::Big(rat)));
+            }
+            return Ok(rat.reduced().into());
         };
 
         if let Ok(fraction) = serde_json::from_str::<Fraction>(raw.get()) {
-            return Ok(MmNumber(fraction.into()));
+            return Ok(fraction.into());
         };
 
         Err(de::Error::custom(format!(
@@ -165,144 +283,232 @@ impl<'de> Deserialize<'de> for MmNumber {
     }
 }
 
+/// Serialized as the `BigRational` newtype regardless of the representation.
+impl Serialize for MmNumber {
+    fn serialize<S>(&self, serializer: S) -> Result<S::Ok, S::Error>
+    where
+        S: Serializer,
+    {
+        serializer.serialize_newtype_struct("MmNumber", &*self.as_big())
+    }
+}
+
+impl std::fmt::Debug for MmNumber {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        f.debug_tuple("MmNumber").field(&*self.as_big()).finish()
+    }
+}
+
 impl std::fmt::Display for MmNumber {
-    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result { write!(f, "{}", from_ratio_to_dec(&self.0)) }
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        write!(f, "{}", from_ratio_to_dec(&self.as_big()))
+    }
 }
 
 impl From<BigDecimal> for MmNumber {
-    fn from(n: BigDecimal) -> MmNumber { from_dec_to_ratio(&n).into() }
+    fn from(n: BigDecimal) -> MmNumber { MmNumber::from_dec(&n) }
 }
 
 impl From<BigRational> for MmNumber {
-    fn from(r: BigRational) -> MmNumber { MmNumber(r) }
+    fn from(r: BigRational) -> MmNumber {
+        match SmallRatio::from_big(&r) {
+            Some(small) => MmNumber(Repr::Small(small)),
+            None => MmNumber(Repr::Big(r)),
+        }
+    }
 }
 
 impl From<Fraction> for MmNumber {
-    fn from(f: Fraction) -> MmNumber { MmNumber(f.into()) }
+    fn from(f: Fraction) -> MmNumber {
+        let ratio: BigRational = f.into();
+        ratio.into()
+    }
 }
 
 impl From<MmNumber> for BigDecimal {
-    fn from(n: MmNumber) -> BigDecimal { from_ratio_to_dec(&n.0) }
+    fn from(n: MmNumber) -> BigDecimal { n.to_decimal() }
 }
 
 impl From<MmNumber> for BigRational {
-    fn from(n: MmNumber) -> BigRational { n.0 }
+    fn from(n: MmNumber) -> BigRational {
+        match n.0 {
+            Repr::Small(small) => small.to_big(),
+            Repr::Big(ratio) => ratio,
+        }
+    }
 }
 
 impl From<u64> for MmNumber {
-    fn from(n: u64) -> MmNumber { BigRational::from_integer(n.into()).into() }
+    fn from(n: u64) -> MmNumber {
+        MmNumber(Repr::Small(SmallRatio {
+            numer: n.into(),
+            denom: 1,
+        }))
+    }
 }
 
 impl From<(u64, u64)> for MmNumber {
-    fn from(tuple: (u64, u64)) -> MmNumber { BigRational::new(tuple.0.into(), tuple.1.into()).into() }
+    fn from(tuple: (u64, u64)) -> MmNumber {
+        match SmallRatio::new(tuple.0.into(), tuple.1.into()) {
+            Some(small) => MmNumber(Repr::Small(small)),
+            // panics on the zero denominator like the `BigRational` does
+            None => BigRational::new(tuple.0.into(), tuple.1.into()).into(),
+        }
+    }
 }
 
 impl Mul for MmNumber {
     type Output = MmNumber;
 
-    fn mul(self, rhs: Self) -> Self::Output { (self.0 * rhs.0).into() }
+    fn mul(self, rhs: Self) -> Self::Output { &self * &rhs }
 }
 
 impl Mul for &MmNumber {
     type Output = MmNumber;
 
-    fn mul(self, rhs: Self) -> Self::Output {
-        let lhs = &self.0;
-        let rhs = &rhs.0;
-        MmNumber(lhs * rhs)
-    }
+    fn mul(self, rhs: Self) -> Self::Output { self.apply(rhs, SmallRatio::checked_mul, |lhs, rhs| lhs * rhs) }
 }
 
 impl Add for MmNumber {
     type Output = MmNumber;
 
-    fn add(self, rhs: Self) -> Self::Output { (self.0 + rhs.0).into() }
+    fn add(self, rhs: Self) -> Self::Output { &self + &rhs }
 }
 
 impl AddAssign for MmNumber {
-    fn add_assign(&mut self, rhs: Self) { self.0 += rhs.0; }
+    fn add_assign(&mut self, rhs: Self) { *self = &*self + &rhs; }
 }
 
 impl AddAssign<&MmNumber> for MmNumber {
-    fn add_assign(&mut self, rhs: &Self) { self.0 += &rhs.0; }
+    fn add_assign(&mut self, rhs: &Self) { *self = &*self + rhs; }
 }
 
 impl Add for &MmNumber {
     type Output = MmNumber;
 
-    fn add(self, rhs: Self) -> Self::Output {
-        let lhs = &self.0;
-        let rhs = &rhs.0;
-        MmNumber(lhs + rhs)
-    }
+    fn add(self, rhs: Self) -> Self::Output { self.apply(rhs, SmallRatio::checked_add, |lhs, rhs| lhs + rhs) }
 }
 
 impl Sub for MmNumber {
     type Output = MmNumber;
 
-    fn sub(self, rhs: Self) -> Self::Output { (self.0 - rhs.0).into() }
+    fn sub(self, rhs: Self) -> Self::Output { &self - &rhs }
 }
 
 impl Sub for &MmNumber {
     type Output = MmNumber;
 
-    fn sub(self, rhs: Self) -> Self::Output { (&self.0 - &rhs.0).into() }
+    fn sub(self, rhs: Self) -> Self::Output { self.apply(rhs, SmallRatio::checked_sub, |lhs, rhs| lhs - rhs) }
 }
 
 impl Div for MmNumber {
     type Output = MmNumber;
 
-    fn div(self, rhs: MmNumber) -> MmNumber { (self.0 / rhs.0).into() }
+    fn div(self, rhs: MmNumber) -> MmNumber { &self / &rhs }
 }
 
 impl Div for &MmNumber {
     type Output = MmNumber;
 
-    fn div(self, rhs: &MmNumber) -> MmNumber {
-        let lhs = &self.0;
-        let rhs = &rhs.0;
-        MmNumber(lhs / rhs)
+    fn div(self, rhs: &MmNumber) -> MmNumber { self.apply(rhs, SmallRatio::checked_div, |lhs, rhs| lhs / rhs) }
+}
+
+impl Ord for MmNumber {
+    fn cmp(&self, other: &Self) -> Ordering {
+        if let (Repr::Small(lhs), Repr::Small(rhs)) = (&self.0, &other.0) {
+            if let Some(ordering) = lhs.checked_cmp(rhs) {
+                return ordering;
+            }
+        }
+        self.as_big().cmp(&other.as_big())
     }
 }
 
+impl PartialOrd for MmNumber {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> { Some(self.cmp(other)) }
+}
+
 impl PartialOrd<BigDecimal> for MmNumber {
-    fn partial_cmp(&self, other: &BigDecimal) -> Option<std::cmp::Ordering> {
-        Some(self.0.cmp(&from_dec_to_ratio(other)))
-    }
+    fn partial_cmp(&self, other: &BigDecimal) -> Option<Ordering> { Some(self.cmp(&MmNumber::from_dec(other))) }
 }
 
 impl PartialEq<BigDecimal> for MmNumber {
-    fn eq(&self, rhs: &BigDecimal) -> bool { self.0 == from_dec_to_ratio(rhs) }
+    fn eq(&self, rhs: &BigDecimal) -> bool { *self == MmNumber::from_dec(rhs) }
 }
 
 impl Default for MmNumber {
-    fn default() -> MmNumber { BigRational::from_integer(0.into()).into() }
+    fn default() -> MmNumber { MmNumber(Repr::Small(SmallRatio::ZERO)) }
 }
 
 impl MmNumber {
-    /// Returns Fraction representation of the number
-    pub fn to_fraction(&self) -> Fraction {
-        Fraction {
-            numer: self.0.numer().clone().into(),
-            denom: self.0.denom().clone().into(),
+    fn from_dec(dec: &BigDecimal) -> MmNumber {
+        match SmallRatio::from_dec(dec) {
+            Some(small) => MmNumber(Repr::Small(small)),
+            None => from_dec_to_ratio(dec).into(),
         }
     }
 
-    /// Clones the internal BigRational
-    pub fn to_ratio(&self) -> BigRational { self.0.clone() }
+    /// Borrows the `BigRational` or converts the small number to it.
+    fn as_big(&self) -> Cow<BigRational> {
+        match &self.0 {
+            Repr::Small(small) => Cow::Owned(small.to_big()),
+            Repr::Big(ratio) => Cow::Borrowed(ratio),
+        }
+    }
+
+    /// Applies the `small_op` if both numbers are small and the result fits, the `big_op` otherwise.
+    fn apply(
+        &self,
+        rhs: &MmNumber,
+        small_op: fn(SmallRatio, SmallRatio) -> Option<SmallRatio>,
+        big_op: fn(&BigRational, &BigRational) -> BigRational,
+    ) -> MmNumber {
+        if let (Repr::Small(lhs), Repr::Small(rhs)) = (&self.0, &rhs.0) {
+            if let Some(res) = small_op(*lhs, *rhs) {
+                return MmNumber(Repr::Small(res));
+            }
+        }
+        big_op(&self.as_big(), &rhs.as_big()).into()
+    }
+
+    /// Returns Fraction representation of the number
+    pub fn to_fraction(&self) -> Fraction { self.to_ratio().into() }
+
+    /// Returns the BigRational representation of the number
+    pub fn to_ratio(&self) -> BigRational { self.as_big().into_owned() }
 
     /// Get BigDecimal representation
-    pub fn to_decimal(&self) -> BigDecimal { from_ratio_to_dec(&self.0) }
+    pub fn to_decimal(&self) -> BigDecimal { from_ratio_to_dec(&self.as_big()) }
 
-    pub fn numer(&self) -> &BigInt { self.0.numer() }
+    pub fn numer(&self) -> BigInt {
+        match &self.0 {
+            Repr::Small(small) => small.numer.into(),
+            Repr::Big(ratio) => ratio.numer().clone(),
+        }
+    }
 
-    pub fn denom(&self) -> &BigInt { self.0.denom() }
+    pub fn denom(&self) -> BigInt {
+        match &self.0 {
+            Repr::Small(small) => small.denom.into(),
+            Repr::Big(ratio) => ratio.denom().clone(),
+        }
+    }
 
-    pub fn is_zero(&self) -> bool { self.0.is_zero() }
+    pub fn is_zero(&self) -> bool {
+        match &self.0 {
+            Repr::Small(small) => small.numer == 0,
+            Repr::Big(ratio) => ratio.is_zero(),
+        }
+    }
 }
 
 impl From<i32> for MmNumber {
-    fn from(num: i32) -> MmNumber { MmNumber(BigRational::from_integer(num.into())) }
+    fn from(num: i32) -> MmNumber {
+        MmNumber(Repr::Small(SmallRatio {
+            numer: num.into(),
+            denom: 1,
+        }))
+    }
 }
 
 /// Useful for tests
@@ -318,6 +524,7 @@ mod tests {
     use super::*;
     use serde_json as json;
     use std::str::FromStr;
+    use test::Bencher;
 
     #[test]
     fn test_from_dec_to_ratio() {
@@ -429,10 +636,10 @@ mod tests {
 
     #[test]
     fn test_mm_number_to_fraction() {
-        let num: MmNumber = MmNumber(BigRational::new(2000.into(), 3.into()));
+        let num: MmNumber = BigRational::new(2000.into(), 3.into()).into();
         let fraction = num.to_fraction();
-        assert_eq!(num.0.numer(), fraction.numer());
-        assert_eq!(num.0.denom(), fraction.denom());
+        assert_eq!(&num.numer(), fraction.numer());
+        assert_eq!(&num.denom(), fraction.denom());
     }
 
     #[test]
@@ -450,4 +657,108 @@ mod tests {
         assert_eq!(actual.number_rat, expected.number_rat);
         // Fraction doesn't implement `PartialEq` trait
     }
+
+    fn is_small(num: &MmNumber) -> bool {
+        match num.0 {
+            Repr::Small(_) => true,
+            Repr::Big(_) => false,
+        }
+    }
+
+    #[test]
+    fn test_small_ratio_arithmetic() {
+        let third = MmNumber::from((1, 3));
+        let sixth = MmNumber::from((1, 6));
+        assert_eq!(&third + &sixth, MmNumber::from((1, 2)));
+        assert_eq!(&sixth - &third, MmNumber::from((1, 6)) * MmNumber::from(-1));
+        assert_eq!(&third * &sixth, MmNumber::from((1, 18)));
+        assert_eq!(&third / &sixth, MmNumber::from(2));
+        assert!(sixth < third);
+        assert!((&sixth - &third) < MmNumber::default());
+        assert!((&third - &third).is_zero());
+
+        // the results are the same as the BigRational ones
+        let big_third = BigRational::new(1.into(), 3.into());
+        let big_sixth = BigRational::new(1.into(), 6.into());
+        assert_eq!((&third + &sixth).to_ratio(), &big_third + &big_sixth);
+        assert_eq!((&third - &sixth).to_ratio(), &big_third - &big_sixth);
+        assert_eq!((&third * &sixth).to_ratio(), &big_third * &big_sixth);
+        assert_eq!((&third / &sixth).to_ratio(), &big_third / &big_sixth);
+    }
+
+    #[test]
+    fn test_small_ratio_overflow() {
+        let max = MmNumber::from(i64::max_value() as u64);
+        let max_rat = BigRational::from_integer(i64::max_value().into());
+        // fits the i128 yet
+        let square = &max * &max;
+        assert!(is_small(&square));
+        // overflows and falls back to the BigRational
+        let cube = &square * &max;
+        assert!(!is_small(&cube));
+        assert_eq!(cube.to_ratio(), &(&max_rat * &max_rat) * &max_rat);
+        assert!(cube > square);
+        assert!(square < cube);
+
+        // the numbers fitting the i128 again are represented inline, so they are equal to the small ones
+        let back = &cube / &max;
+        assert!(is_small(&back));
+        assert_eq!(back, square);
+        assert_eq!(MmNumber::from(cube.to_ratio()), cube);
+        assert_eq!(MmNumber::from(square.to_ratio()), square);
+
+        // the products don't fit, but the comparison is still right
+        let lhs = MmNumber::from((u64::max_value(), u64::max_value() - 1));
+        let rhs = MmNumber::from((u64::max_value() - 1, u64::max_value() - 2));
+        assert_eq!(lhs.cmp(&rhs), lhs.to_ratio().cmp(&rhs.to_ratio()));
+        assert_eq!((&lhs * &lhs).to_ratio(), &lhs.to_ratio() * &lhs.to_ratio());
+    }
+
+    #[test]
+    fn test_mm_number_serialize() {
+        let nums = vec![
+            MmNumber::from((1, 3)),
+            &(&MmNumber::from(u64::max_value()) * &MmNumber::from(u64::max_value())) * &MmNumber::from((3, 7)),
+        ];
+        for num in nums {
+            let expected = json::to_string(&num.to_ratio()).unwrap();
+            assert_eq!(json::to_string(&num).unwrap(), expected);
+            let actual: MmNumber = json::from_str(&expected).unwrap();
+            assert_eq!(actual, num);
+        }
+
+        let num: MmNumber = json::from_str("\"0.00000001\"").unwrap();
+        assert_eq!(num, MmNumber::from((1, 100000000)));
+        assert_eq!(num.to_string(), "0.00000001");
+    }
+
+    #[bench]
+    fn bench_dex_fee_and_volume_checks_small(b: &mut Bencher) {
+        let amounts: Vec<MmNumber> = (1..1000u64)
+            .map(|i| MmNumber::from((i * 123456789, 100000000)))
+            .collect();
+        let rate = MmNumber::from((1, 777));
+        let threshold = MmNumber::from("0.0001");
+        b.iter(|| {
+            amounts
+                .iter()
+                .filter(|amount| &(*amount * &rate) >= &threshold)
+                .fold(MmNumber::default(), |sum, amount| &sum + amount)
+        });
+    }
+
+    #[bench]
+    fn bench_dex_fee_and_volume_checks_big_rational(b: &mut Bencher) {
+        let amounts: Vec<BigRational> = (1..1000u64)
+            .map(|i| BigRational::new((i * 123456789).into(), 100000000.into()))
+            .collect();
+        let rate = BigRational::new(1.into(), 777.into());
+        let threshold = from_dec_to_ratio(&"0.0001".parse().unwrap());
+        b.iter(|| {
+            amounts
+                .iter()
+                .filter(|amount| &(*amount * &rate) >= &threshold)
+                .fold(BigRational::zero(), |sum, amount| &sum + amount)
+        });
+    }
 }
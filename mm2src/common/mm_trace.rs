@@ -0,0 +1,298 @@
+//! The traces of the RPC requests and the swaps: the stages a request spends its time at.
+//!
+//! A request future is wrapped by `RequestTracer::trace` and the trace is made current on the thread
+//! for every poll of the future, so the `trace_span!` guards created by the nested calls
+//! (the Electrum and Web3 requests, the ordermatch locks, etc.) are recorded to the trace of the request
+//! without passing it through the call stack.
+//! The finished traces are kept by the tracer to be listed by the `get_request_traces` RPC.
+//!
+//! The tracing is disabled by default and can be switched at runtime with the `set_request_tracing` RPC.
+//! No trace is started while it's disabled, and a `trace_span!` is an atomic load then.
+
+use crate::{now_float, now_ms};
+use std::cell::RefCell;
+use std::collections::VecDeque;
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll};
+
+/// The number of the finished traces kept by the tracer.
+const MAX_FINISHED_TRACES: usize = 1000;
+/// The stages recorded by a trace after this number are counted only.
+const MAX_TRACE_STAGES: usize = 256;
+
+/// The number of the traces being recorded by all the tracers.
+/// The spans return immediately while it's zero.
+static ACTIVE_TRACES: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    /// The trace of the future being polled on the thread.
+    static CURRENT_TRACE: RefCell<Option<Arc<ActiveTrace>>> = RefCell::new(None);
+}
+
+/// Creates the `TraceSpan` guard recording the stage to the current trace once the guard is dropped.
+/// The optional detail is formatted only if there is a current trace.
+///
+/// ```rust
+/// let _span = trace_span!("electrum", "{}", request.method);
+/// ```
+#[macro_export]
+macro_rules! trace_span {
+    ($stage: expr) => {
+        $crate::mm_trace::TraceSpan::enter($stage, || None)
+    };
+    ($stage: expr, $($detail: tt)+) => {
+        $crate::mm_trace::TraceSpan::enter($stage, || Some(format!($($detail)+)))
+    };
+}
+
+#[derive(Clone, Debug, Serialize)]
+pub struct TraceStage {
+    pub stage: &'static str,
+    #[serde(skip_serializing_if = "Option::is_none")]
+    pub detail: Option<String>,
+    /// Milliseconds since the start of the trace.
+    pub started_ms: f64,
+    pub duration_ms: f64,
+}
+
+#[derive(Clone, Debug, Serialize)]
+pub struct RequestTrace {
+    pub id: u64,
+    /// The RPC method or the swap.
+    pub name: String,
+    /// UTC timestamp in milliseconds.
+    pub started_at: u64,
+    pub duration_ms: f64,
+    /// False if the request future was dropped before it's finished.
+    pub finished: bool,
+    /// The stages in the order they are finished.
+    pub stages: Vec<TraceStage>,
+    /// The number of the stages not recorded due to `MAX_TRACE_STAGES`.
+    pub dropped_stages: usize,
+}
+
+struct ActiveTrace {
+    id: u64,
+    name: String,
+    started_at: u64,
+    started: f64,
+    stages: Mutex<(Vec<TraceStage>, usize)>,
+}
+
+impl ActiveTrace {
+    fn elapsed_ms(&self) -> f64 { (now_float() - self.started) * 1000. }
+
+    fn record_stage(&self, stage: &'static str, detail: Option<String>, started_ms: f64) {
+        let duration_ms = self.elapsed_ms() - started_ms;
+        let mut stages = self.stages.lock().unwrap();
+        if stages.0.len() >= MAX_TRACE_STAGES {
+            stages.1 += 1;
+            return;
+        }
+        stages.0.push(TraceStage {
+            stage,
+            detail,
+            started_ms,
+            duration_ms,
+        });
+    }
+
+    fn finish(&self, finished: bool) -> RequestTrace {
+        let (stages, dropped_stages) = std::mem::take(&mut *self.stages.lock().unwrap());
+        RequestTrace {
+            id: self.id,
+            name: self.name.clone(),
+            started_at: self.started_at,
+            duration_ms: self.elapsed_ms(),
+            finished,
+            stages,
+            dropped_stages,
+        }
+    }
+}
+
+#[derive(Default)]
+pub struct RequestTracer {
+    enabled: AtomicBool,
+    next_id: AtomicU64,
+    finished: Arc<Mutex<VecDeque<RequestTrace>>>,
+}
+
+impl RequestTracer {
+    pub fn is_enabled(&self) -> bool { self.enabled.load(Ordering::Relaxed) }
+
+    pub fn set_enabled(&self, enabled: bool) { self.enabled.store(enabled, Ordering::Relaxed) }
+
+    /// Wraps the `future` to record its trace named by the `name`.
+    /// The `name` is called and the trace is recorded only if the tracing is enabled.
+    pub fn trace<F, N>(&self, name: N, future: F) -> Traced<F>
+    where
+        F: Future,
+        N: FnOnce() -> String,
+    {
+        if !self.is_enabled() {
+            return Traced { future, trace: None };
+        }
+
+        ACTIVE_TRACES.fetch_add(1, Ordering::Relaxed);
+        let trace = ActiveTrace {
+            id: self.next_id.fetch_add(1, Ordering::Relaxed),
+            name: name(),
+            started_at: now_ms(),
+            started: now_float(),
+            stages: Mutex::new((Vec::new(), 0)),
+        };
+        Traced {
+            future,
+            trace: Some((Arc::new(trace), self.finished.clone())),
+        }
+    }
+
+    /// Returns the `limit` slowest of the recent traces, the slowest first.
+    /// The traces are filtered by the `name` if it's specified.
+    pub fn slowest_traces(&self, limit: usize, name: Option<&str>) -> Vec<RequestTrace> {
+        let finished = self.finished.lock().unwrap();
+        let mut traces: Vec<_> = finished
+            .iter()
+            .filter(|trace| name.map_or(true, |name| trace.name.starts_with(name)))
+            .collect();
+        traces.sort_unstable_by(|a, b| b.duration_ms.partial_cmp(&a.duration_ms).unwrap());
+        traces.into_iter().take(limit).cloned().collect()
+    }
+}
+
+/// The future returned by `RequestTracer::trace`.
+#[must_use = "futures do nothing unless polled"]
+pub struct Traced<F> {
+    future: F,
+    trace: Option<(Arc<ActiveTrace>, Arc<Mutex<VecDeque<RequestTrace>>>)>,
+}
+
+impl<F> Traced<F> {
+    fn finish(&mut self, finished: bool) {
+        let (trace, traces) = match self.trace.take() {
+            Some(trace) => trace,
+            None => return,
+        };
+        ACTIVE_TRACES.fetch_sub(1, Ordering::Relaxed);
+        let trace = trace.finish(finished);
+        let mut traces = traces.lock().unwrap();
+        if traces.len() >= MAX_FINISHED_TRACES {
+            traces.pop_front();
+        }
+        traces.push_back(trace);
+    }
+}
+
+impl<F: Future> Future for Traced<F> {
+    type Output = F::Output;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+        // The `future` is never moved out of the pinned `Traced`.
+        let this = unsafe { self.get_unchecked_mut() };
+        let future = unsafe { Pin::new_unchecked(&mut this.future) };
+        let trace = match this.trace {
+            Some((ref trace, _)) => trace.clone(),
+            None => return future.poll(cx),
+        };
+
+        let previous = CURRENT_TRACE.with(|current| current.replace(Some(trace)));
+        let poll = future.poll(cx);
+        CURRENT_TRACE.with(|current| current.replace(previous));
+
+        if poll.is_ready() {
+            this.finish(true);
+        }
+        poll
+    }
+}
+
+impl<F> Drop for Traced<F> {
+    fn drop(&mut self) { self.finish(false) }
+}
+
+/// The guard created by `trace_span!`, records the stage once dropped.
+#[must_use = "the stage is recorded once the span is dropped"]
+pub struct TraceSpan {
+    span: Option<(Arc<ActiveTrace>, &'static str, Option<String>, f64)>,
+}
+
+impl TraceSpan {
+    pub fn enter<D>(stage: &'static str, detail: D) -> TraceSpan
+    where
+        D: FnOnce() -> Option<String>,
+    {
+        if ACTIVE_TRACES.load(Ordering::Relaxed) == 0 {
+            return TraceSpan { span: None };
+        }
+
+        let trace = CURRENT_TRACE
+            .try_with(|current| current.borrow().clone())
+            .ok()
+            .flatten();
+        TraceSpan {
+            span: trace.map(|trace| {
+                let started_ms = trace.elapsed_ms();
+                (trace, stage, detail(), started_ms)
+            }),
+        }
+    }
+}
+
+impl Drop for TraceSpan {
+    fn drop(&mut self) {
+        if let Some((trace, stage, detail, started_ms)) = self.span.take() {
+            trace.record_stage(stage, detail, started_ms);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::block_on;
+    use futures::future::{join, lazy};
+
+    #[test]
+    fn test_request_tracer() {
+        let tracer = RequestTracer::default();
+        // the tracing is disabled
+        block_on(tracer.trace(|| "disabled".into(), lazy(|_| drop(trace_span!("ignored")))));
+        assert!(tracer.slowest_traces(10, None).is_empty());
+
+        tracer.set_enabled(true);
+        let request = async {
+            let _span = trace_span!("request", "{}", 1);
+            let first = async { drop(trace_span!("first")) };
+            let second = async { drop(trace_span!("second", "{}", "detail")) };
+            join(first, second).await;
+        };
+        block_on(tracer.trace(|| "request".into(), request));
+        // the span outside of the traced future is not recorded
+        drop(trace_span!("outside"));
+        // the dropped future is recorded as not finished
+        drop(tracer.trace(|| "dropped".into(), lazy(|_| ())));
+
+        let traces = tracer.slowest_traces(10, Some("request"));
+        assert_eq!(traces.len(), 1);
+        assert!(traces[0].finished);
+        let stages: Vec<_> = traces[0]
+            .stages
+            .iter()
+            .map(|stage| (stage.stage, stage.detail.clone()))
+            .collect();
+        assert_eq!(stages, vec![
+            ("first", None),
+            ("second", Some("detail".to_owned())),
+            ("request", Some("1".to_owned())),
+        ]);
+
+        let traces = tracer.slowest_traces(10, None);
+        assert_eq!(traces.len(), 2);
+        assert!(traces.iter().any(|trace| trace.name == "dropped" && !trace.finished));
+        assert_eq!(tracer.slowest_traces(1, None).len(), 1);
+    }
+}
@@ -5,14 +5,13 @@ pub mod database_common;
 #[path = "database/my_orders.rs"] pub mod my_orders;
 #[path = "database/my_swaps.rs"] pub mod my_swaps;
 #[path = "database/stats_swaps.rs"] pub mod stats_swaps;
+#[path = "database/swaps_indexing.rs"] pub mod swaps_indexing;
 
 use crate::CREATE_MY_SWAPS_TABLE;
 use common::{log::{debug, error, info},
-             mm_ctx::MmArc,
              rusqlite::{Connection, Result as SqlResult, NO_PARAMS}};
 
-use my_swaps::fill_my_swaps_from_json_statements;
-use stats_swaps::create_and_fill_stats_swaps_from_json_statements;
+use swaps_indexing::{schedule_indexing_statements, IndexedDir, CREATE_SWAPS_INDEXING_TABLE};
 
 const SELECT_MIGRATION: &str = "SELECT * FROM migration ORDER BY current_migration DESC LIMIT 1;";
 
@@ -20,7 +19,7 @@ fn get_current_migration(conn: &Connection) -> SqlResult<i64> {
     conn.query_row(SELECT_MIGRATION, NO_PARAMS, |row| row.get(0))
 }
 
-pub fn init_and_migrate_db(ctx: &MmArc, conn: &Connection) -> SqlResult<()> {
+pub fn init_and_migrate_db(conn: &Connection) -> SqlResult<()> {
     info!("Checking the current SQLite migration");
     match get_current_migration(conn) {
         Ok(current_migration) => {
@@ -29,14 +28,15 @@ pub fn init_and_migrate_db(ctx: &MmArc, conn: &Connection) -> SqlResult<()> {
                     "Current migration is {}, skipping the init, trying to migrate",
                     current_migration
                 );
-                migrate_sqlite_database(ctx, conn, current_migration)?;
+                migrate_sqlite_database(conn, current_migration)?;
                 return Ok(());
             }
         },
         Err(e) => {
             debug!("Error {} on getting current migration. The database is either empty or corrupted, trying to clean it first", e);
             if let Err(e) = conn.execute_batch(
-                "DROP TABLE migration;
+                "DROP TABLE IF EXISTS swaps_indexing;
+                    DROP TABLE migration;
                     DROP TABLE my_swaps;",
             ) {
                 error!("Error {} on SQLite database cleanup", e);
@@ -54,15 +54,21 @@ pub fn init_and_migrate_db(ctx: &MmArc, conn: &Connection) -> SqlResult<()> {
         "COMMIT;"
     );
     conn.execute_batch(init_batch)?;
-    migrate_sqlite_database(ctx, conn, 1)?;
+    migrate_sqlite_database(conn, 1)?;
     info!("SQLite database initialization is successful");
     Ok(())
 }
 
-fn migration_1(ctx: &MmArc) -> Vec<(&'static str, Vec<String>)> { fill_my_swaps_from_json_statements(ctx) }
+/// The existing swap files are indexed in background by `swaps_indexing`, the migration only schedules it.
+fn migration_1() -> Vec<(&'static str, Vec<String>)> { schedule_indexing_statements(&[IndexedDir::MySwaps]) }
 
-fn migration_2(ctx: &MmArc) -> Vec<(&'static str, Vec<String>)> {
-    create_and_fill_stats_swaps_from_json_statements(ctx)
+fn migration_2() -> Vec<(&'static str, Vec<String>)> {
+    let mut statements = vec![(stats_swaps::CREATE_STATS_SWAPS_TABLE, vec![])];
+    statements.extend(schedule_indexing_statements(&[
+        IndexedDir::StatsMakerSwaps,
+        IndexedDir::StatsTakerSwaps,
+    ]));
+    statements
 }
 
 fn migration_3() -> Vec<(&'static str, Vec<String>)> { vec![(stats_swaps::ADD_STARTED_AT_INDEX, vec![])] }
@@ -71,21 +77,29 @@ fn migration_4() -> Vec<(&'static str, Vec<String>)> { stats_swaps::add_and_spli
 
 fn migration_5() -> Vec<(&'static str, Vec<String>)> { vec![(my_orders::CREATE_MY_ORDERS_TABLE, vec![])] }
 
-fn statements_for_migration(ctx: &MmArc, current_migration: i64) -> Option<Vec<(&'static str, Vec<String>)>> {
+fn migration_6() -> Vec<(&'static str, Vec<String>)> {
+    vec![
+        (CREATE_SWAPS_INDEXING_TABLE, vec![]),
+        (my_swaps::ADD_IS_FINISHED_COLUMN, vec![]),
+    ]
+}
+
+fn statements_for_migration(current_migration: i64) -> Option<Vec<(&'static str, Vec<String>)>> {
     match current_migration {
-        1 => Some(migration_1(ctx)),
-        2 => Some(migration_2(ctx)),
+        1 => Some(migration_1()),
+        2 => Some(migration_2()),
         3 => Some(migration_3()),
         4 => Some(migration_4()),
         5 => Some(migration_5()),
+        6 => Some(migration_6()),
         _ => None,
     }
 }
 
-pub fn migrate_sqlite_database(ctx: &MmArc, conn: &Connection, mut current_migration: i64) -> SqlResult<()> {
+pub fn migrate_sqlite_database(conn: &Connection, mut current_migration: i64) -> SqlResult<()> {
     info!("migrate_sqlite_database, current migration {}", current_migration);
     let transaction = conn.unchecked_transaction()?;
-    while let Some(statements_with_params) = statements_for_migration(ctx, current_migration) {
+    while let Some(statements_with_params) = statements_for_migration(current_migration) {
         for (statement, params) in statements_with_params {
             debug!("Executing SQL statement {:?} with params {:?}", statement, params);
             transaction.execute(&statement, params)?;
@@ -1,11 +1,10 @@
 /// This module contains code to work with my_swaps table in MM2 SQLite DB
-use crate::mm2::lp_swap::{my_swaps_dir, MySwapsFilter, SavedSwap};
-use common::log::{debug, error};
+use crate::mm2::lp_swap::{MySwapsFilter, SavedSwap};
+use common::log::debug;
 use common::mm_ctx::MmArc;
-use common::rusqlite::{Connection, Error as SqlError, Result as SqlResult, ToSql};
-use common::{read_dir, slurp};
-use serde_json::{self as json};
+use common::rusqlite::{Connection, Error as SqlError, Result as SqlResult, ToSql, NO_PARAMS};
 use sql_builder::SqlBuilder;
+use std::collections::HashSet;
 use std::convert::TryInto;
 use uuid::Uuid;
 
@@ -36,42 +35,47 @@ pub fn insert_new_swap(ctx: &MmArc, my_coin: &str, other_coin: &str, uuid: &str,
     conn.execute(INSERT_MY_SWAP, &params).map(|_| ())
 }
 
-/// Returns SQL statements to initially fill my_swaps table using existing DB with JSON files
-pub fn fill_my_swaps_from_json_statements(ctx: &MmArc) -> Vec<(&'static str, Vec<String>)> {
-    let swap_files = read_dir(&my_swaps_dir(&ctx)).expect("Reading swaps dir should not fail at this point");
-    let mut result = vec![];
-    for (_, file) in swap_files {
-        let content = slurp(&file).expect("slurp should not fail at this point");
-        match json::from_slice::<SavedSwap>(&content) {
-            Ok(swap) => {
-                if let Some(sql_with_params) = insert_saved_swap_sql(swap) {
-                    result.push(sql_with_params);
-                }
-            },
-            Err(e) => error!(
-                "Error {} on file {} content {:?} deserialization to SavedSwap",
-                e,
-                file.display(),
-                content
-            ),
-        }
-    }
-    result
-}
+const INSERT_OR_IGNORE_MY_SWAP: &str =
+    "INSERT OR IGNORE INTO my_swaps (my_coin, other_coin, uuid, started_at, is_finished) VALUES (?1, ?2, ?3, ?4, ?5)";
+
+/// The swaps indexed before this column was added have `is_finished = 0` until they are found finished on kick-start.
+pub const ADD_IS_FINISHED_COLUMN: &str = "ALTER TABLE my_swaps ADD COLUMN is_finished INTEGER NOT NULL DEFAULT 0;";
+
+const MARK_MY_SWAP_FINISHED: &str = "UPDATE my_swaps SET is_finished = 1 WHERE uuid = ?1";
+
+const SELECT_FINISHED_UUIDS: &str = "SELECT uuid FROM my_swaps WHERE is_finished = 1";
 
-fn insert_saved_swap_sql(swap: SavedSwap) -> Option<(&'static str, Vec<String>)> {
+/// Adds the swap loaded from the JSON file to the my_swaps table if it's not there yet.
+pub fn index_my_swap(conn: &Connection, swap: &SavedSwap) -> SqlResult<()> {
     let swap_info = match swap.get_my_info() {
         Some(s) => s,
         // get_my_info returning None means that swap did not even start - so we can keep it away from indexing.
-        None => return None,
+        None => return Ok(()),
     };
-    let params = vec![
+    let params = [
         swap_info.my_coin,
         swap_info.other_coin,
         swap.uuid().to_string(),
         swap_info.started_at.to_string(),
+        (swap.is_finished() as u32).to_string(),
     ];
-    Some((INSERT_MY_SWAP, params))
+    debug!("Executing query {} with params {:?}", INSERT_OR_IGNORE_MY_SWAP, params);
+    conn.execute(INSERT_OR_IGNORE_MY_SWAP, &params).map(|_| ())
+}
+
+pub fn mark_swaps_finished(conn: &Connection, uuids: &[Uuid]) -> SqlResult<()> {
+    let transaction = conn.unchecked_transaction()?;
+    for uuid in uuids {
+        transaction.execute(MARK_MY_SWAP_FINISHED, &[uuid.to_string()])?;
+    }
+    transaction.commit()
+}
+
+/// Returns the uuids of the swaps that are known to be finished, they don't have to be loaded on kick-start.
+pub fn select_finished_uuids(conn: &Connection) -> SqlResult<HashSet<String>> {
+    let mut stmt = conn.prepare(SELECT_FINISHED_UUIDS)?;
+    let uuids = stmt.query_map(NO_PARAMS, |row| row.get(0))?.collect();
+    uuids
 }
 
 #[derive(Debug)]
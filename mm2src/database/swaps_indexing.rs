@@ -0,0 +1,232 @@
+/// This module indexes the swaps saved as JSON files into the my_swaps and stats_swaps tables.
+/// The indexing runs in background after the start, so the node doesn't have to parse every swap file
+/// before the RPC is available. The progress is recorded per directory, an interrupted indexing is resumed
+/// from the last indexed file on the next start.
+use crate::mm2::lp_swap::{my_swaps_dir, stats_maker_swap_dir, stats_taker_swap_dir, MakerSavedSwap, SavedSwap,
+                          TakerSavedSwap};
+use common::log::{error, info};
+use common::mm_ctx::MmArc;
+use common::rusqlite::{Connection, Result as SqlResult, NO_PARAMS};
+use common::{json_dir_entries, slurp};
+use serde_json::{self as json};
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread;
+
+use super::my_swaps::index_my_swap;
+use super::stats_swaps::add_swap_to_index;
+
+pub const CREATE_SWAPS_INDEXING_TABLE: &str = "CREATE TABLE IF NOT EXISTS swaps_indexing (
+    dir VARCHAR(255) NOT NULL UNIQUE,
+    last_indexed VARCHAR(255) NOT NULL
+);";
+
+pub const INSERT_SWAPS_INDEXING: &str = "INSERT OR IGNORE INTO swaps_indexing (dir, last_indexed) VALUES (?1, '')";
+
+const SELECT_SWAPS_INDEXING: &str = "SELECT dir, last_indexed FROM swaps_indexing";
+
+const UPDATE_SWAPS_INDEXING: &str = "UPDATE swaps_indexing SET last_indexed = ?2 WHERE dir = ?1";
+
+const DELETE_SWAPS_INDEXING: &str = "DELETE FROM swaps_indexing WHERE dir = ?1";
+
+/// The number of swap files indexed within one SQL transaction.
+/// The SQLite connection is shared with the RPC so it should not be locked for long.
+const INDEXING_BATCH_SIZE: usize = 256;
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum IndexedDir {
+    MySwaps,
+    StatsMakerSwaps,
+    StatsTakerSwaps,
+}
+
+impl IndexedDir {
+    /// The stats maker swaps are indexed before the taker ones:
+    /// the taker swap is skipped if its maker counterpart is indexed already.
+    const ALL: [IndexedDir; 3] = [
+        IndexedDir::MySwaps,
+        IndexedDir::StatsMakerSwaps,
+        IndexedDir::StatsTakerSwaps,
+    ];
+
+    pub fn name(&self) -> &'static str {
+        match self {
+            IndexedDir::MySwaps => "my_swaps",
+            IndexedDir::StatsMakerSwaps => "stats_maker_swaps",
+            IndexedDir::StatsTakerSwaps => "stats_taker_swaps",
+        }
+    }
+
+    fn path(&self, ctx: &MmArc) -> PathBuf {
+        match self {
+            IndexedDir::MySwaps => my_swaps_dir(ctx),
+            IndexedDir::StatsMakerSwaps => stats_maker_swap_dir(ctx),
+            IndexedDir::StatsTakerSwaps => stats_taker_swap_dir(ctx),
+        }
+    }
+
+    fn parse(&self, content: &[u8]) -> Result<SavedSwap, json::Error> {
+        match self {
+            IndexedDir::MySwaps => json::from_slice(content),
+            IndexedDir::StatsMakerSwaps => json::from_slice::<MakerSavedSwap>(content).map(SavedSwap::Maker),
+            IndexedDir::StatsTakerSwaps => json::from_slice::<TakerSavedSwap>(content).map(SavedSwap::Taker),
+        }
+    }
+
+    fn index(&self, conn: &Connection, swap: &SavedSwap) -> SqlResult<()> {
+        match self {
+            IndexedDir::MySwaps => index_my_swap(conn, swap),
+            IndexedDir::StatsMakerSwaps | IndexedDir::StatsTakerSwaps => {
+                add_swap_to_index(conn, swap);
+                Ok(())
+            },
+        }
+    }
+}
+
+/// Returns the statements scheduling the indexing of the given directories.
+pub fn schedule_indexing_statements(dirs: &[IndexedDir]) -> Vec<(&'static str, Vec<String>)> {
+    let mut result = vec![(CREATE_SWAPS_INDEXING_TABLE, vec![])];
+    result.extend(
+        dirs.iter()
+            .map(|dir| (INSERT_SWAPS_INDEXING, vec![dir.name().to_owned()])),
+    );
+    result
+}
+
+#[derive(Debug, Default)]
+pub struct SwapsIndexingProgress {
+    in_progress: AtomicBool,
+    total: AtomicUsize,
+    indexed: AtomicUsize,
+    /// Whether the my_swaps table misses some of the swap files yet.
+    /// It stays set if the indexing fails, so the history RPCs keep falling back to the swap files.
+    my_swaps_pending: AtomicBool,
+}
+
+impl SwapsIndexingProgress {
+    /// Returns the number of indexed files and the total number of files to index if the indexing is in progress.
+    pub fn get(&self) -> Option<(usize, usize)> {
+        if !self.in_progress.load(Ordering::Acquire) {
+            return None;
+        }
+        Some((self.indexed.load(Ordering::Relaxed), self.total.load(Ordering::Relaxed)))
+    }
+
+    /// Returns true if every swap file of the my_swaps directory is in the my_swaps table.
+    pub fn is_my_swaps_indexed(&self) -> bool { !self.my_swaps_pending.load(Ordering::Acquire) }
+}
+
+struct PendingDir {
+    dir: IndexedDir,
+    /// Sorted by the file name, the order the files are indexed in.
+    files: Vec<PathBuf>,
+}
+
+fn file_name(path: &PathBuf) -> String {
+    path.file_name()
+        .map(|name| name.to_string_lossy().into_owned())
+        .unwrap_or_default()
+}
+
+fn select_pending_dirs(ctx: &MmArc) -> Result<Vec<PendingDir>, String> {
+    let pending: Vec<(String, String)> = {
+        let conn = ctx.sqlite_connection();
+        let mut stmt = try_s!(conn.prepare(SELECT_SWAPS_INDEXING));
+        let rows = try_s!(stmt.query_map(NO_PARAMS, |row| Ok((row.get(0)?, row.get(1)?))));
+        try_s!(rows.collect::<SqlResult<_>>())
+    };
+
+    let mut result = Vec::with_capacity(pending.len());
+    for dir in IndexedDir::ALL.iter() {
+        let last_indexed = match pending.iter().find(|(name, _)| name == dir.name()) {
+            Some((_, last_indexed)) => last_indexed,
+            None => continue,
+        };
+        let mut files: Vec<PathBuf> = try_s!(json_dir_entries(&dir.path(ctx)))
+            .into_iter()
+            .map(|entry| entry.path())
+            .filter(|path| file_name(path).as_str() > last_indexed.as_str())
+            .collect();
+        files.sort();
+        result.push(PendingDir { dir: *dir, files });
+    }
+    Ok(result)
+}
+
+fn index_batch(ctx: &MmArc, dir: IndexedDir, files: &[PathBuf]) -> SqlResult<()> {
+    // parse the files before locking the connection
+    let swaps: Vec<SavedSwap> = files
+        .iter()
+        .filter_map(|path| {
+            let content = match slurp(path) {
+                Ok(content) => content,
+                Err(e) => {
+                    error!("Error {} on file {} reading", e, path.display());
+                    return None;
+                },
+            };
+            match dir.parse(&content) {
+                Ok(swap) => Some(swap),
+                Err(e) => {
+                    error!("Error {} on file {} deserialization", e, path.display());
+                    None
+                },
+            }
+        })
+        .collect();
+
+    let conn = ctx.sqlite_connection();
+    let transaction = conn.unchecked_transaction()?;
+    for swap in swaps.iter() {
+        dir.index(&transaction, swap)?;
+    }
+    if let Some(last) = files.last() {
+        transaction.execute(UPDATE_SWAPS_INDEXING, &[dir.name().to_owned(), file_name(last)])?;
+    }
+    transaction.commit()
+}
+
+fn index_pending_dirs(ctx: &MmArc, pending: Vec<PendingDir>, progress: &SwapsIndexingProgress) -> Result<(), String> {
+    for PendingDir { dir, files } in pending {
+        for batch in files.chunks(INDEXING_BATCH_SIZE) {
+            if ctx.is_stopping() {
+                return Ok(());
+            }
+            try_s!(index_batch(ctx, dir, batch));
+            progress.indexed.fetch_add(batch.len(), Ordering::Relaxed);
+        }
+        try_s!(ctx.sqlite_connection().execute(DELETE_SWAPS_INDEXING, &[dir.name()]));
+        if dir == IndexedDir::MySwaps {
+            progress.my_swaps_pending.store(false, Ordering::Release);
+        }
+    }
+    Ok(())
+}
+
+/// Spawns the indexing of the swap files of the directories scheduled by migrations.
+/// The `progress` is set before the function returns, so the history RPCs started after can report it.
+pub fn spawn_json_swaps_indexing(ctx: MmArc, progress: Arc<SwapsIndexingProgress>) -> Result<(), String> {
+    let pending = try_s!(select_pending_dirs(&ctx));
+    if pending.is_empty() {
+        return Ok(());
+    }
+
+    let total = pending.iter().map(|pending| pending.files.len()).sum();
+    info!("Indexing {} swap files in background", total);
+    progress.total.store(total, Ordering::Relaxed);
+    progress.indexed.store(0, Ordering::Relaxed);
+    let my_swaps_pending = pending.iter().any(|pending| pending.dir == IndexedDir::MySwaps);
+    progress.my_swaps_pending.store(my_swaps_pending, Ordering::Release);
+    progress.in_progress.store(true, Ordering::Release);
+
+    try_s!(thread::Builder::new().name("swaps_indexing".into()).spawn(move || {
+        match index_pending_dirs(&ctx, pending, &progress) {
+            Ok(()) => info!("Indexing of swap files is complete"),
+            Err(e) => error!("Error {} on swap files indexing", e),
+        }
+        progress.in_progress.store(false, Ordering::Release);
+    }));
+    Ok(())
+}
@@ -20,7 +20,7 @@
 
 use crate::config::GossipsubConfig;
 use crate::handler::GossipsubHandler;
-use crate::mcache::MessageCache;
+use crate::mcache::{MessageCache, MessageCacheStats};
 use crate::protocol::{GossipsubControlAction, GossipsubMessage, GossipsubSubscription, GossipsubSubscriptionAction,
                       MessageId};
 use crate::time_cache::{Entry as TimeCacheEntry, TimeCache};
@@ -123,7 +123,8 @@ impl Gossipsub {
                 gs_config.history_gossip,
                 gs_config.history_length,
                 gs_config.message_id_fn,
-            ),
+            )
+            .with_max_bytes(gs_config.max_cache_bytes),
             received: TimeCache::new(gs_config.duplicate_cache_time),
             heartbeat: Interval::new_at(
                 Instant::now() + gs_config.heartbeat_initial_delay,
@@ -827,6 +828,7 @@ impl Gossipsub {
 
         // shift the memcache
         self.mcache.shift();
+        debug!("Message cache: {:?}", self.mcache.stats());
         debug!("Completed Heartbeat");
     }
 
@@ -1108,6 +1110,8 @@ impl Gossipsub {
 
     pub fn get_config(&self) -> &GossipsubConfig { &self.config }
 
+    pub fn message_cache_stats(&self) -> MessageCacheStats { self.mcache.stats() }
+
     /// Adds peers to relays mesh and notifies them they are added
     fn add_peers_to_relays_mesh(&mut self, peers: Vec<PeerId>) {
         for peer in &peers {
@@ -18,6 +18,7 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 // DEALINGS IN THE SOFTWARE.
 
+use crate::mcache::DEFAULT_MAX_CACHE_BYTES;
 use crate::protocol::{GossipsubMessage, MessageId};
 use std::borrow::Cow;
 use std::time::Duration;
@@ -64,6 +65,10 @@ pub struct GossipsubConfig {
     /// The maximum byte size for each gossip (default is 2048 bytes).
     pub max_transmit_size: usize,
 
+    /// The limit of the approximate size of the messages kept in the `memcache`, the oldest messages are
+    /// evicted before leaving the history once it's exceeded (default is 64 MiB).
+    pub max_cache_bytes: usize,
+
     /// Duplicates are prevented by storing message id's of known messages in an LRU time cache.
     /// This settings sets the time period that messages are stored in the cache. Duplicates can be
     /// received if duplicate messages are sent at a time greater than this setting apart. The
@@ -109,6 +114,7 @@ impl Default for GossipsubConfig {
             heartbeat_interval: Duration::from_secs(1),
             fanout_ttl: Duration::from_secs(60),
             max_transmit_size: 2048,
+            max_cache_bytes: DEFAULT_MAX_CACHE_BYTES,
             duplicate_cache_time: Duration::from_secs(60),
             hash_topics: false, // default compatibility with floodsub
             no_source_id: false,
@@ -212,6 +218,11 @@ impl GossipsubConfigBuilder {
         self
     }
 
+    pub fn max_cache_bytes(&mut self, max_cache_bytes: usize) -> &mut Self {
+        self.config.max_cache_bytes = max_cache_bytes;
+        self
+    }
+
     pub fn hash_topics(&mut self) -> &mut Self {
         self.config.hash_topics = true;
         self
@@ -254,6 +265,7 @@ impl std::fmt::Debug for GossipsubConfig {
         let _ = builder.field("heartbeat_interval", &self.heartbeat_interval);
         let _ = builder.field("fanout_ttl", &self.fanout_ttl);
         let _ = builder.field("max_transmit_size", &self.max_transmit_size);
+        let _ = builder.field("max_cache_bytes", &self.max_cache_bytes);
         let _ = builder.field("hash_topics", &self.hash_topics);
         let _ = builder.field("no_source_id", &self.no_source_id);
         let _ = builder.field("manual_propagation", &self.manual_propagation);
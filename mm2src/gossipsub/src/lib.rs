@@ -150,5 +150,6 @@ mod rpc_proto {
 
 pub use self::behaviour::{Gossipsub, GossipsubEvent, GossipsubRpc};
 pub use self::config::{GossipsubConfig, GossipsubConfigBuilder};
+pub use self::mcache::MessageCacheStats;
 pub use self::protocol::{GossipsubMessage, MessageId};
 pub use self::topic::{Topic, TopicHash};
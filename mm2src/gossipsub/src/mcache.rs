@@ -22,21 +22,53 @@ extern crate fnv;
 
 use crate::protocol::{GossipsubMessage, MessageId};
 use crate::topic::TopicHash;
-use std::collections::HashMap;
+use std::collections::{HashMap, VecDeque};
 
-/// CacheEntry stored in the history.
-#[derive(Debug, Clone, PartialEq, Eq, Hash)]
-pub struct CacheEntry {
-    mid: MessageId,
-    topics: Vec<TopicHash>,
+/// The default limit of the approximate size of the cached messages.
+pub const DEFAULT_MAX_CACHE_BYTES: usize = 64 * 1024 * 1024;
+
+/// The message is stored once, the history windows and the topics index refer to it by the id.
+#[derive(Debug, Clone)]
+struct CachedMessage {
+    msg: GossipsubMessage,
+    /// The approximate memory the message takes, see `message_size`.
+    size: usize,
+}
+
+/// The approximate memory the message and its id take.
+fn message_size(message_id: &MessageId, msg: &GossipsubMessage) -> usize {
+    std::mem::size_of::<GossipsubMessage>()
+        + message_id.0.len()
+        + msg.data.len()
+        + msg.topics.iter().map(|topic| topic.as_str().len()).sum::<usize>()
+}
+
+/// The state of the `MessageCache` reported to the metrics.
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct MessageCacheStats {
+    /// The number of the cached messages.
+    pub messages: usize,
+    /// The approximate size of the cached messages.
+    pub bytes: usize,
+    /// The number of the messages evicted before leaving the history to keep the cache within the bytes limit.
+    pub evicted: u64,
 }
 
 /// MessageCache struct holding history of messages.
 #[derive(Clone)]
 pub struct MessageCache {
-    msgs: HashMap<MessageId, GossipsubMessage>,
-    history: Vec<Vec<CacheEntry>>,
+    msgs: HashMap<MessageId, CachedMessage>,
+    history: Vec<VecDeque<MessageId>>,
+    /// The ids of the messages of every topic in the order they are put, labeled by the history window
+    /// they are put in, so the gossip ids of a topic are collected without scanning the other topics messages.
+    /// The ids leave the index once their window leaves the history, the evicted ones are skipped until then.
+    topic_index: HashMap<TopicHash, VecDeque<(u64, MessageId)>>,
+    /// The number of the shifts done, labels the current history window.
+    window: u64,
     gossip: usize,
+    max_bytes: usize,
+    bytes: usize,
+    evicted: u64,
     msg_id: fn(&GossipsubMessage) -> MessageId,
 }
 
@@ -46,7 +78,12 @@ impl MessageCache {
         MessageCache {
             gossip,
             msgs: HashMap::default(),
-            history: vec![Vec::new(); history_capacity],
+            history: vec![VecDeque::new(); history_capacity],
+            topic_index: HashMap::default(),
+            window: 0,
+            max_bytes: DEFAULT_MAX_CACHE_BYTES,
+            bytes: 0,
+            evicted: 0,
             msg_id,
         }
     }
@@ -60,62 +97,104 @@ impl MessageCache {
             source_string.push_str(&message.sequence_number.to_string());
             MessageId(source_string)
         };
-        MessageCache {
-            gossip,
-            msgs: HashMap::default(),
-            history: vec![Vec::new(); history_capacity],
-            msg_id: default_id,
-        }
+        MessageCache::new(gossip, history_capacity, default_id)
+    }
+
+    /// Limits the approximate size of the cached messages, the oldest messages are evicted once it's exceeded.
+    /// The last put message is kept even if it doesn't fit the limit alone.
+    pub fn with_max_bytes(mut self, max_bytes: usize) -> MessageCache {
+        self.max_bytes = max_bytes;
+        self
     }
 
     /// Put a message into the memory cache
     pub fn put(&mut self, msg: GossipsubMessage) {
         let message_id = (self.msg_id)(&msg);
-        let cache_entry = CacheEntry {
-            mid: message_id.clone(),
-            topics: msg.topics.clone(),
-        };
+        for topic in msg.topics.iter() {
+            self.topic_index
+                .entry(topic.clone())
+                .or_insert_with(VecDeque::new)
+                .push_back((self.window, message_id.clone()));
+        }
+        self.history[0].push_back(message_id.clone());
 
-        self.msgs.insert(message_id, msg);
+        let size = message_size(&message_id, &msg);
+        self.bytes += size;
+        if let Some(replaced) = self.msgs.insert(message_id, CachedMessage { msg, size }) {
+            self.bytes -= replaced.size;
+        }
 
-        self.history[0].push(cache_entry);
+        while self.bytes > self.max_bytes && self.msgs.len() > 1 {
+            // the ids are popped from the oldest window, the just put message id is the last one
+            let oldest = match self.history.iter_mut().rev().find_map(|entries| entries.pop_front()) {
+                Some(id) => id,
+                None => break,
+            };
+            if self.remove(&oldest) {
+                self.evicted += 1;
+            }
+        }
     }
 
     /// Get a message with `message_id`
-    pub fn get(&self, message_id: &MessageId) -> Option<&GossipsubMessage> { self.msgs.get(message_id) }
+    pub fn get(&self, message_id: &MessageId) -> Option<&GossipsubMessage> {
+        self.msgs.get(message_id).map(|cached| &cached.msg)
+    }
 
-    /// Get a list of GossipIds for a given topic
+    /// Get a list of GossipIds for a given topic, the latest messages go first.
     pub fn get_gossip_ids(&self, topic: &TopicHash) -> Vec<MessageId> {
-        self.history[..self.gossip]
-            .iter()
-            .fold(vec![], |mut current_entries, entries| {
-                // search for entries with desired topic
-                let mut found_entries: Vec<MessageId> = entries
-                    .iter()
-                    .filter_map(|entry| {
-                        if entry.topics.iter().any(|t| t == topic) {
-                            Some(entry.mid.clone())
-                        } else {
-                            None
-                        }
-                    })
-                    .collect();
-
-                // generate the list
-                current_entries.append(&mut found_entries);
-                current_entries
-            })
+        let ids = match self.topic_index.get(topic) {
+            Some(ids) => ids,
+            None => return Vec::new(),
+        };
+        // the windows of history[..self.gossip]
+        let min_window = (self.window + 1).saturating_sub(self.gossip as u64);
+        ids.iter()
+            .rev()
+            .take_while(|(window, _)| *window >= min_window)
+            .filter(|(_, id)| self.msgs.contains_key(id))
+            .map(|(_, id)| id.clone())
+            .collect()
     }
 
     /// Shift the history array down one and delete messages associated with the
     /// last entry
     pub fn shift(&mut self) {
-        for entry in self.history.pop().expect("history is always > 1") {
-            self.msgs.remove(&entry.mid);
+        for id in self.history.pop().expect("history is always > 1") {
+            self.remove(&id);
         }
 
         // Insert an empty vec in position 0
-        self.history.insert(0, Vec::new());
+        self.history.insert(0, VecDeque::new());
+        self.window += 1;
+
+        // the windows older than the history ones
+        let min_window = (self.window + 1).saturating_sub(self.history.len() as u64);
+        self.topic_index.retain(|_, ids| {
+            while ids.front().map_or(false, |(window, _)| *window < min_window) {
+                ids.pop_front();
+            }
+            !ids.is_empty()
+        });
+    }
+
+    pub fn stats(&self) -> MessageCacheStats {
+        MessageCacheStats {
+            messages: self.msgs.len(),
+            bytes: self.bytes,
+            evicted: self.evicted,
+        }
+    }
+
+    /// Returns false if the message is removed already.
+    fn remove(&mut self, message_id: &MessageId) -> bool {
+        match self.msgs.remove(message_id) {
+            Some(cached) => {
+                self.bytes -= cached.size;
+                true
+            },
+            None => false,
+        }
     }
 }
 
@@ -305,4 +384,68 @@ mod tests {
         assert_eq!(mc.history[0].len(), 0);
         assert_eq!(mc.msgs.len(), 0);
     }
+
+    #[test]
+    /// Test the gossip ids are collected by the topic and the gossip windows.
+    fn test_get_gossip_ids() {
+        let mut mc = MessageCache::new_default(2, 3);
+
+        let topic1_hash = Topic::new("topic1".into()).no_hash().clone();
+        let topic2_hash = Topic::new("topic2".into()).no_hash().clone();
+        let topic3_hash = Topic::new("topic3".into()).no_hash().clone();
+
+        let m1 = gen_testm(1, vec![topic1_hash.clone()]);
+        let m2 = gen_testm(2, vec![topic1_hash.clone(), topic2_hash.clone()]);
+        mc.put(m1.clone());
+        mc.shift();
+        mc.put(m2.clone());
+
+        let id1 = (mc.msg_id)(&m1);
+        let id2 = (mc.msg_id)(&m2);
+        assert_eq!(mc.get_gossip_ids(&topic1_hash), vec![id2.clone(), id1.clone()]);
+        assert_eq!(mc.get_gossip_ids(&topic2_hash), vec![id2.clone()]);
+        assert!(mc.get_gossip_ids(&topic3_hash).is_empty());
+
+        // m1 is out of the gossip windows but still in the history
+        mc.shift();
+        assert_eq!(mc.get_gossip_ids(&topic1_hash), vec![id2.clone()]);
+        assert!(mc.get(&id1).is_some());
+
+        // m1 is out of the history
+        mc.shift();
+        assert!(mc.get(&id1).is_none());
+        assert!(mc.get_gossip_ids(&topic1_hash).is_empty());
+        assert_eq!(mc.topic_index.len(), 2);
+
+        mc.shift();
+        assert!(mc.topic_index.is_empty());
+        assert_eq!(mc.stats(), MessageCacheStats::default());
+    }
+
+    #[test]
+    /// Test the oldest messages are evicted once the bytes limit is exceeded.
+    fn test_max_bytes() {
+        let topic1_hash = Topic::new("topic1".into()).no_hash().clone();
+        let msgs: Vec<_> = (0..10).map(|i| gen_testm(i, vec![topic1_hash.clone()])).collect();
+        let mut mc = MessageCache::new_default(3, 5);
+        // the messages ids and contents are of the same length
+        let msg_size = message_size(&(mc.msg_id)(&msgs[0]), &msgs[0]);
+
+        mc = mc.with_max_bytes(msg_size * 3);
+        for (i, m) in msgs.iter().enumerate() {
+            mc.put(m.clone());
+            if i % 2 == 1 {
+                mc.shift();
+            }
+        }
+
+        assert_eq!(mc.stats(), MessageCacheStats {
+            messages: 3,
+            bytes: msg_size * 3,
+            evicted: 7,
+        });
+        let ids: Vec<_> = msgs[7..].iter().rev().map(|m| (mc.msg_id)(m)).collect();
+        assert_eq!(mc.get_gossip_ids(&topic1_hash), ids);
+        assert!(mc.get(&(mc.msg_id)(&msgs[6])).is_none());
+    }
 }
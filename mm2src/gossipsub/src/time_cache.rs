@@ -139,10 +139,10 @@ where
                 self.list.push_front(element);
                 break;
             }
-            if let Occupied(entry) = self.map.entry(element.element.clone()) {
-                if entry.get().expires <= now {
-                    entry.remove();
-                }
+            // the key is looked up twice instead of being cloned for the `entry`
+            let is_expired = self.map.get(&element.element).map_or(false, |e| e.expires <= now);
+            if is_expired {
+                self.map.remove(&element.element);
             }
         }
     }
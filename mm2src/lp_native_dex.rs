@@ -33,6 +33,8 @@ use crate::mm2::database::init_and_migrate_db;
 use crate::mm2::lp_network::{p2p_event_process_loop, P2PContext};
 use crate::mm2::lp_ordermatch::{broadcast_maker_orders_keep_alive_loop, lp_ordermatch_loop, orders_kick_start,
                                 BalanceUpdateOrdermatchHandler};
+#[cfg(not(target_arch = "wasm32"))]
+use crate::mm2::lp_swap::spawn_swaps_indexing;
 use crate::mm2::lp_swap::{running_swaps_num, swap_kick_starts};
 use crate::mm2::rpc::spawn_rpc;
 use crate::mm2::{MM_DATETIME, MM_VERSION};
@@ -339,7 +341,7 @@ pub async fn lp_init(mypubport: u16, ctx: MmArc) -> Result<(), String> {
     #[cfg(not(target_arch = "wasm32"))]
     {
         try_s!(ctx.init_sqlite_connection());
-        try_s!(init_and_migrate_db(&ctx, &ctx.sqlite_connection()));
+        try_s!(init_and_migrate_db(&ctx.sqlite_connection()));
         try_s!(migrate_db(&ctx));
     }
 
@@ -355,9 +357,12 @@ pub async fn lp_init(mypubport: u16, ctx: MmArc) -> Result<(), String> {
     {
         // launch kickstart threads before RPC is available, this will prevent the API user to place
         // an order and start new swap that might get started 2 times because of kick-start
+        // only the swaps that are not known to be finished and the active orders are loaded here
         let mut coins_needed_for_kick_start = swap_kick_starts(ctx.clone());
         coins_needed_for_kick_start.extend(try_s!(orders_kick_start(&ctx).await));
         *(try_s!(ctx.coins_needed_for_kick_start.lock())) = coins_needed_for_kick_start;
+        // the swaps history is indexed while the RPC is already available
+        try_s!(spawn_swaps_indexing(&ctx));
     }
 
     spawn(lp_ordermatch_loop(ctx.clone()));
@@ -505,6 +510,8 @@ async fn init_p2p(mypubport: u16, ctx: MmArc) -> Result<(), String> {
     let i_am_seed = ctx.conf["i_am_seed"].as_bool().unwrap_or(false);
 
     let seednodes: Option<Vec<String>> = try_s!(json::from_value(ctx.conf["seednodes"].clone()));
+    // the number of the fastest relays kept connected
+    let pinned_relays: Option<usize> = try_s!(json::from_value(ctx.conf["p2p_pinned_relays"].clone()));
     let seednodes = match seednodes {
         Some(s) => s,
         None => {
@@ -547,6 +554,7 @@ async fn init_p2p(mypubport: u16, ctx: MmArc) -> Result<(), String> {
         spawn_boxed,
         seednodes,
         node_type,
+        pinned_relays,
         move |swarm| {
             mm_gauge!(
                 ctx_on_poll.metrics,
@@ -554,6 +562,11 @@ async fn init_p2p(mypubport: u16, ctx: MmArc) -> Result<(), String> {
                 swarm.connected_relays_len() as i64
             );
             mm_gauge!(ctx_on_poll.metrics, "p2p.relay_mesh.len", swarm.relay_mesh_len() as i64);
+            mm_gauge!(
+                ctx_on_poll.metrics,
+                "p2p.pinned_relays.len",
+                swarm.pinned_relays_len() as i64
+            );
             let (period, received_msgs) = swarm.received_messages_in_period();
             mm_gauge!(
                 ctx_on_poll.metrics,
@@ -570,6 +583,19 @@ async fn init_p2p(mypubport: u16, ctx: MmArc) -> Result<(), String> {
                 "p2p.connected_peers.count",
                 connected_peers_count as i64
             );
+
+            let cache_stats = swarm.message_cache_stats();
+            mm_gauge!(
+                ctx_on_poll.metrics,
+                "p2p.message_cache.len",
+                cache_stats.messages as i64
+            );
+            mm_gauge!(ctx_on_poll.metrics, "p2p.message_cache.bytes", cache_stats.bytes as i64);
+            mm_gauge!(
+                ctx_on_poll.metrics,
+                "p2p.message_cache.evicted",
+                cache_stats.evicted as i64
+            );
         },
     );
     let mut p2p_abort = Some(p2p_abort);
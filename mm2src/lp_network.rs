@@ -26,7 +26,10 @@ use mm2_libp2p::atomicdex_behaviour::{AdexBehaviourCmd, AdexBehaviourEvent, Adex
 use mm2_libp2p::{decode_message, encode_message, GossipsubMessage, MessageId, PeerId, TOPIC_SEPARATOR};
 #[cfg(test)] use mocktopus::macros::*;
 use serde::de;
+use std::collections::HashMap;
+use std::future::Future;
 use std::sync::Arc;
+use std::task::Poll;
 
 use crate::mm2::{lp_ordermatch, lp_swap};
 
@@ -62,7 +65,43 @@ impl P2PContext {
     }
 }
 
+/// The `topics_ordering` map is pruned from the handed over topics once it reaches this size.
+const TOPICS_ORDERING_PRUNE_AT: usize = 1024;
+
+/// Hands the verified messages of the same topic over to the processing in the order they were received,
+/// while the messages themselves are verified in parallel.
+struct TopicsOrdering {
+    /// Notified when the latest received message of the topic is handed over.
+    handed_over: HashMap<String, oneshot::Receiver<()>>,
+    prune_at: usize,
+}
+
+impl Default for TopicsOrdering {
+    fn default() -> Self {
+        TopicsOrdering {
+            handed_over: HashMap::new(),
+            prune_at: TOPICS_ORDERING_PRUNE_AT,
+        }
+    }
+}
+
+impl TopicsOrdering {
+    /// Returns the notification of the previous message of the `topic` and the notifier of the new one.
+    fn enqueue(&mut self, topic: &str) -> (Option<oneshot::Receiver<()>>, oneshot::Sender<()>) {
+        if self.handed_over.len() >= self.prune_at {
+            self.handed_over
+                .retain(|_, handed_over| matches!(handed_over.try_recv(), Ok(None)));
+            self.prune_at = (self.handed_over.len() * 2).max(TOPICS_ORDERING_PRUNE_AT);
+        }
+
+        let (handed_over_tx, handed_over_rx) = oneshot::channel();
+        let prev_handed_over = self.handed_over.insert(topic.to_owned(), handed_over_rx);
+        (prev_handed_over, handed_over_tx)
+    }
+}
+
 pub async fn p2p_event_process_loop(ctx: MmWeak, mut rx: AdexEventRx, i_am_relay: bool) {
+    let mut topics_ordering = TopicsOrdering::default();
     loop {
         let adex_event = rx.next().await;
         let ctx = match MmArc::from_weak(&ctx) {
@@ -71,14 +110,24 @@ pub async fn p2p_event_process_loop(ctx: MmWeak, mut rx: AdexEventRx, i_am_relay
         };
         match adex_event {
             Some(AdexBehaviourEvent::Message(peer_id, message_id, message)) => {
-                spawn(process_p2p_message(ctx, peer_id, message_id, message, i_am_relay));
+                let topic = message.topics.first().map(|topic| topic.as_str()).unwrap_or_default();
+                let (prev_handed_over, handed_over) = topics_ordering.enqueue(topic);
+                spawn(async move {
+                    let decoded = verify_p2p_message(ctx.clone(), message).await;
+                    if let Some(prev_handed_over) = prev_handed_over {
+                        // the sender is dropped without notification if the previous message processing panics
+                        prev_handed_over.await.ok();
+                    }
+                    process_p2p_message(ctx, peer_id, message_id, decoded, i_am_relay, handed_over).await;
+                });
             },
             Some(AdexBehaviourEvent::PeerRequest {
                 peer_id,
                 request,
+                compact_response,
                 response_channel,
             }) => {
-                if let Err(e) = process_p2p_request(ctx, peer_id, request, response_channel).await {
+                if let Err(e) = process_p2p_request(ctx, peer_id, request, compact_response, response_channel).await {
                     log::error!("Error on process P2P request: {:?}", e);
                 }
             },
@@ -88,43 +137,106 @@ pub async fn p2p_event_process_loop(ctx: MmWeak, mut rx: AdexEventRx, i_am_relay
     }
 }
 
-async fn process_p2p_message(
-    ctx: MmArc,
-    peer_id: PeerId,
-    message_id: MessageId,
-    message: GossipsubMessage,
-    i_am_relay: bool,
-) {
-    let mut to_propagate = false;
-    let mut orderbook_pairs = vec![];
+/// The gossip message with the verified signatures.
+struct DecodedP2PMessage {
+    ordermatch: Option<lp_ordermatch::DecodedMsg>,
+    swaps: Vec<lp_swap::DecodedMsg>,
+    /// The messages with a swap topic are always propagated.
+    has_swap_topic: bool,
+}
 
-    for topic in message.topics {
+fn decode_p2p_message(ctx: &MmArc, message: &GossipsubMessage) -> DecodedP2PMessage {
+    let mut has_orderbook_topic = false;
+    let mut has_swap_topic = false;
+    let mut swaps = vec![];
+
+    for topic in message.topics.iter() {
         let mut split = topic.as_str().split(TOPIC_SEPARATOR);
         match split.next() {
             Some(lp_ordermatch::ORDERBOOK_PREFIX) => {
-                if let Some(pair) = split.next() {
-                    orderbook_pairs.push(pair.to_string());
+                if split.next().is_some() {
+                    has_orderbook_topic = true;
                 }
             },
             Some(lp_swap::SWAP_PREFIX) => {
-                lp_swap::process_msg(ctx.clone(), split.next().unwrap_or_default(), &message.data);
-                to_propagate = true;
+                has_swap_topic = true;
+                if let Some(decoded) = lp_swap::decode_msg(ctx, split.next().unwrap_or_default(), &message.data) {
+                    swaps.push(decoded);
+                }
             },
             None | Some(_) => (),
         }
     }
 
-    if !orderbook_pairs.is_empty() {
-        let process_fut = lp_ordermatch::process_msg(
-            ctx.clone(),
-            orderbook_pairs,
-            peer_id.to_string(),
-            &message.data,
-            i_am_relay,
-        );
-        if process_fut.await {
-            to_propagate = true;
-        }
+    let ordermatch = if has_orderbook_topic {
+        lp_ordermatch::decode_msg(ctx, &message.data)
+    } else {
+        None
+    };
+
+    DecodedP2PMessage {
+        ordermatch,
+        swaps,
+        has_swap_topic,
+    }
+}
+
+/// Verifies and decodes the message on the [`P2P_VERIFY_POOL`] not to load the event loop with the signature checks.
+#[cfg(not(target_arch = "wasm32"))]
+async fn verify_p2p_message(ctx: MmArc, message: GossipsubMessage) -> DecodedP2PMessage {
+    use common::wio::P2P_VERIFY_POOL;
+    use futures::FutureExt;
+
+    let (verify_fut, decoded) = async move { decode_p2p_message(&ctx, &message) }.remote_handle();
+    P2P_VERIFY_POOL.spawn_ok(verify_fut);
+    decoded.await
+}
+
+#[cfg(target_arch = "wasm32")]
+async fn verify_p2p_message(ctx: MmArc, message: GossipsubMessage) -> DecodedP2PMessage {
+    decode_p2p_message(&ctx, &message)
+}
+
+/// Starts the `fut`, notifies the next message of the topic that it can be processed, and completes the `fut`.
+/// So the messages are started in order, but don't wait for each other to complete.
+async fn start_then_hand_over<F: Future + Unpin>(mut fut: F, handed_over: oneshot::Sender<()>) -> F::Output {
+    let started = futures::poll!(&mut fut);
+    handed_over.send(()).ok();
+    match started {
+        Poll::Ready(output) => output,
+        Poll::Pending => fut.await,
+    }
+}
+
+async fn process_p2p_message(
+    ctx: MmArc,
+    peer_id: PeerId,
+    message_id: MessageId,
+    decoded: DecodedP2PMessage,
+    i_am_relay: bool,
+    handed_over: oneshot::Sender<()>,
+) {
+    let mut to_propagate = decoded.has_swap_topic;
+
+    for swap_msg in decoded.swaps {
+        lp_swap::process_decoded_msg(&ctx, swap_msg);
+    }
+
+    match decoded.ordermatch {
+        Some(ordermatch_msg) => {
+            let process_fut = Box::pin(lp_ordermatch::process_decoded_msg(
+                ctx.clone(),
+                peer_id.to_string(),
+                ordermatch_msg,
+                i_am_relay,
+            ));
+            if start_then_hand_over(process_fut, handed_over).await {
+                to_propagate = true;
+            }
+        },
+        None => {
+            handed_over.send(()).ok();
+        },
     }
 
     if to_propagate && i_am_relay {
@@ -136,11 +248,12 @@ async fn process_p2p_request(
     ctx: MmArc,
     _peer_id: PeerId,
     request: Vec<u8>,
+    compact_response: bool,
     response_channel: AdexResponseChannel,
 ) -> Result<(), String> {
     let request = try_s!(decode_message::<P2PRequest>(&request));
     let result = match request {
-        P2PRequest::Ordermatch(req) => lp_ordermatch::process_peer_request(ctx.clone(), req).await,
+        P2PRequest::Ordermatch(req) => lp_ordermatch::process_peer_request(ctx.clone(), req, compact_response).await,
     };
 
     let res = match result {
@@ -183,6 +296,19 @@ pub async fn request_any_relay<T: de::DeserializeOwned>(
     ctx: MmArc,
     req: P2PRequest,
 ) -> Result<Option<(T, PeerId)>, String> {
+    match try_s!(request_any_relay_encoded(ctx, req).await) {
+        Some((response, from_peer)) => {
+            let response = try_s!(decode_message::<T>(&response));
+            Ok(Some((response, from_peer)))
+        },
+        None => Ok(None),
+    }
+}
+
+/// Same as [`request_any_relay`], but leaves the decoding of the response to the caller
+/// that may receive it in the request specific format.
+pub async fn request_any_relay_encoded(ctx: MmArc, req: P2PRequest) -> Result<Option<(Vec<u8>, PeerId)>, String> {
+    let _span = trace_span!("p2p_request", "any relay");
     let encoded = try_s!(encode_message(&req));
 
     let (response_tx, response_rx) = oneshot::channel();
@@ -192,13 +318,7 @@ pub async fn request_any_relay<T: de::DeserializeOwned>(
         response_tx,
     };
     try_s!(p2p_ctx.cmd_tx.lock().await.try_send(cmd));
-    match try_s!(response_rx.await) {
-        Some((from_peer, response)) => {
-            let response = try_s!(decode_message::<T>(&response));
-            Ok(Some((response, from_peer)))
-        },
-        None => Ok(None),
-    }
+    Ok(try_s!(response_rx.await).map(|(from_peer, response)| (response, from_peer)))
 }
 
 pub enum PeerDecodedResponse<T> {
@@ -212,6 +332,7 @@ pub async fn request_relays<T: de::DeserializeOwned>(
     ctx: MmArc,
     req: P2PRequest,
 ) -> Result<Vec<(PeerId, PeerDecodedResponse<T>)>, String> {
+    let _span = trace_span!("p2p_request", "relays");
     let encoded = try_s!(encode_message(&req));
 
     let (response_tx, response_rx) = oneshot::channel();
@@ -230,6 +351,7 @@ pub async fn request_peers<T: de::DeserializeOwned>(
     req: P2PRequest,
     peers: Vec<String>,
 ) -> Result<Vec<(PeerId, PeerDecodedResponse<T>)>, String> {
+    let _span = trace_span!("p2p_request", "{} peers", peers.len());
     let encoded = try_s!(encode_message(&req));
 
     let (response_tx, response_rx) = oneshot::channel();
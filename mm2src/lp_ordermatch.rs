@@ -19,7 +19,7 @@
 //
 
 use async_trait::async_trait;
-use best_orders::BestOrdersAction;
+use best_orders::{BestOrdersAction, BestOrdersCache};
 use bigdecimal::BigDecimal;
 use blake2::digest::{Update, VariableOutput};
 use blake2::VarBlake2b;
@@ -27,35 +27,45 @@ use coins::utxo::{compressed_pub_key_from_priv_raw, ChecksumType};
 use coins::{lp_coinfind, BalanceTradeFeeUpdatedHandler, FeeApproxStage, MmCoinEnum};
 use common::executor::{spawn, Timer};
 use common::log::error;
+use common::lru_cache::LruCache;
 use common::mm_ctx::{from_ctx, MmArc, MmWeak};
 use common::mm_number::{Fraction, MmNumber};
 use common::{bits256, json_dir_entries, log, new_uuid, now_ms, remove_file, write};
+use compact_orderbook::CompactPairOrders;
+use deadline_queue::DeadlineQueue;
 use derive_more::Display;
 use futures::{compat::Future01CompatExt, lock::Mutex as AsyncMutex, StreamExt, TryFutureExt};
 use gstuff::slurp;
 use hash256_std_hasher::Hash256StdHasher;
 use hash_db::{Hasher, EMPTY_PREFIX};
 use http::Response;
-use mm2_libp2p::{decode_signed, encode_and_sign, encode_message, pub_sub_topic, TopicPrefix, TOPIC_SEPARATOR};
+use mm2_libp2p::{decode_message, decode_signed_unverified, encode_and_sign, encode_message, pub_sub_topic, PublicKey,
+                 TopicPrefix, TOPIC_SEPARATOR};
 #[cfg(test)] use mocktopus::macros::*;
 use num_rational::BigRational;
 use num_traits::identities::Zero;
 use order_requests_tracker::OrderRequestsTracker;
+use orderbook_index::OrderbookIndex;
+use orderbook_ingestion::{process_order_update, OrderUpdate, OrderbookIngestion};
+use orderbook_snapshot::OrderbookSnapshots;
+use parking_lot::Mutex as PaMutex;
 use rpc::v1::types::H256 as H256Json;
 use serde_json::{self as json, Value as Json};
 use sp_trie::{delta_trie_root, DBValue, HashDBT, MemoryDB, Trie, TrieConfiguration, TrieDB, TrieDBMut, TrieHash,
               TrieMut};
 use std::collections::hash_map::{Entry, HashMap, RawEntryMut};
-use std::collections::{BTreeSet, HashSet};
+use std::collections::{HashSet, VecDeque};
 use std::convert::TryInto;
 use std::fmt;
 use std::fs::DirEntry;
+use std::ops::{Deref, DerefMut};
 use std::path::PathBuf;
 use std::sync::Arc;
 use trie_db::NodeCodec as NodeCodecT;
 use uuid::Uuid;
 
-use crate::mm2::lp_network::{broadcast_p2p_msg, request_any_relay, request_one_peer, subscribe_to_topic, P2PRequest};
+use crate::mm2::lp_network::{broadcast_p2p_msg, request_any_relay_encoded, request_one_peer, subscribe_to_topic,
+                             P2PRequest};
 use crate::mm2::lp_swap::{calc_max_maker_vol, check_balance_for_maker_swap, check_balance_for_taker_swap,
                           check_other_coin_balance_for_swap, insert_new_swap_to_db, is_pubkey_banned,
                           lp_atomic_locktime, run_maker_swap, run_taker_swap, AtomicLocktimeVersion, MakerSwap,
@@ -66,14 +76,23 @@ pub use orderbook_depth::orderbook_depth_rpc;
 pub use orderbook_rpc::orderbook_rpc;
 
 #[path = "lp_ordermatch/best_orders.rs"] mod best_orders;
+#[path = "lp_ordermatch/compact_orderbook.rs"]
+mod compact_orderbook;
+#[path = "lp_ordermatch/deadline_queue.rs"] mod deadline_queue;
 #[path = "lp_ordermatch/new_protocol.rs"] mod new_protocol;
 #[path = "lp_ordermatch/order_requests_tracker.rs"]
 mod order_requests_tracker;
 #[path = "lp_ordermatch/orderbook_depth.rs"] mod orderbook_depth;
+#[path = "lp_ordermatch/orderbook_index.rs"] mod orderbook_index;
+#[path = "lp_ordermatch/orderbook_ingestion.rs"]
+mod orderbook_ingestion;
 #[path = "lp_ordermatch/orderbook_rpc.rs"] mod orderbook_rpc;
+#[path = "lp_ordermatch/orderbook_snapshot.rs"]
+mod orderbook_snapshot;
 #[cfg(all(test, not(target_arch = "wasm32")))]
 #[path = "ordermatch_tests.rs"]
 mod ordermatch_tests;
+#[path = "lp_ordermatch/pair_tree.rs"] mod pair_tree;
 
 pub const ORDERBOOK_PREFIX: TopicPrefix = "orbk";
 const MIN_ORDER_KEEP_ALIVE_INTERVAL: u64 = 30;
@@ -82,6 +101,8 @@ const TAKER_ORDER_TIMEOUT: u64 = 30;
 const ORDER_MATCH_TIMEOUT: u64 = 30;
 const ORDERBOOK_REQUESTING_TIMEOUT: u64 = MIN_ORDER_KEEP_ALIVE_INTERVAL * 2;
 const MAX_ORDERS_NUMBER_IN_ORDERBOOK_RESPONSE: usize = 1000;
+/// The number of the pairs the encoded orderbook responses are cached for.
+const MAX_ENCODED_PAIR_SNAPSHOTS: usize = 100;
 
 /// Alphabetically ordered orderbook pair
 type AlbOrderedOrderbookPair = String;
@@ -116,7 +137,7 @@ fn process_pubkey_full_trie(
         orderbook.insert_or_update_order_update_trie(order);
     }
 
-    let new_root = pubkey_state_mut(&mut orderbook.pubkeys_state, pubkey)
+    let new_root = pubkey_state_mut(&mut orderbook.pubkeys_state, &mut orderbook.pubkeys_expiry, pubkey)
         .trie_roots
         .get(alb_pair)
         .copied()
@@ -186,33 +207,10 @@ async fn process_orders_keep_alive(
             DeltaOrFullTrie::FullTrie(values) => process_pubkey_full_trie(&mut orderbook, &from_pubkey, &pair, values),
         };
     }
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
     true
 }
 
-async fn process_maker_order_updated(
-    ctx: MmArc,
-    from_pubkey: String,
-    updated_msg: new_protocol::MakerOrderUpdated,
-) -> bool {
-    let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).expect("from_ctx failed");
-    let uuid = updated_msg.uuid();
-    let mut orderbook = ordermatch_ctx.orderbook.lock().await;
-    match orderbook.find_order_by_uuid_and_pubkey(&uuid, &from_pubkey) {
-        Some(mut order) => {
-            order.apply_updated(&updated_msg);
-            orderbook.insert_or_update_order_update_trie(order);
-            true
-        },
-        None => {
-            log::warn!(
-                "Couldn't find an order {}, ignoring, it will be synced upon pubkey keep alive",
-                uuid
-            );
-            false
-        },
-    }
-}
-
 // fn verify_pubkey_orderbook(orderbook: &GetOrderbookPubkeyItem) -> Result<(), String> {
 //     let keys: Vec<(_, _)> = orderbook
 //         .orders
@@ -235,14 +233,19 @@ async fn process_maker_order_updated(
 ///
 /// The function locks [`MmCtx::p2p_ctx`] and [`MmCtx::ordermatch_ctx`]
 async fn request_and_fill_orderbook(ctx: &MmArc, base: &str, rel: &str) -> Result<(), String> {
+    let _span = trace_span!("request_and_fill_orderbook", "{}/{}", base, rel);
     let request = OrdermatchRequest::GetOrderbook {
         base: base.to_string(),
         rel: rel.to_string(),
     };
 
-    let response = try_s!(request_any_relay::<GetOrderbookRes>(ctx.clone(), P2PRequest::Ordermatch(request)).await);
+    let response = try_s!(request_any_relay_encoded(ctx.clone(), P2PRequest::Ordermatch(request)).await);
     let pubkey_orders = match response {
-        Some((GetOrderbookRes { pubkey_orders }, _peer_id)) => pubkey_orders,
+        // the relays send the compact responses to the peers negotiated `/request-response/2`
+        Some((encoded, _peer_id)) if compact_orderbook::is_compact_response(&encoded) => {
+            try_s!(compact_orderbook::decode_compact_response(&encoded)).pubkey_orders
+        },
+        Some((encoded, _peer_id)) => try_s!(decode_message::<GetOrderbookRes>(&encoded)).pubkey_orders,
         None => return Ok(()),
     };
 
@@ -264,6 +267,7 @@ async fn request_and_fill_orderbook(ctx: &MmArc, base: &str, rel: &str) -> Resul
         }
         let _new_root = process_pubkey_full_trie(&mut orderbook, &pubkey, &alb_pair, orders);
     }
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
 
     let topic = orderbook_topic_from_base_rel(base, rel);
     orderbook
@@ -278,10 +282,12 @@ async fn request_and_fill_orderbook(ctx: &MmArc, base: &str, rel: &str) -> Resul
 async fn insert_or_update_order(ctx: &MmArc, item: OrderbookItem) {
     let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).expect("from_ctx failed");
     let mut orderbook = ordermatch_ctx.orderbook.lock().await;
-    orderbook.insert_or_update_order_update_trie(item)
+    orderbook.insert_or_update_order_update_trie(item);
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
 }
 
-async fn delete_order(ctx: &MmArc, pubkey: &str, uuid: Uuid) {
+/// The order is removed from the orderbook by [`orderbook_ingestion::process_order_update`].
+async fn delete_inactive_order(ctx: &MmArc, pubkey: &str, uuid: Uuid) {
     let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).expect("from_ctx failed");
 
     let mut inactive = ordermatch_ctx.inactive_orders.lock().await;
@@ -293,22 +299,13 @@ async fn delete_order(ctx: &MmArc, pubkey: &str, uuid: Uuid) {
         },
         None => (),
     }
-
-    let mut orderbook = ordermatch_ctx.orderbook.lock().await;
-    match orderbook.order_set.get(&uuid) {
-        // don't remove the order if the pubkey is not equal
-        Some(order) if order.pubkey != pubkey => (),
-        Some(_) => {
-            orderbook.remove_order_trie_update(uuid);
-        },
-        None => (),
-    }
 }
 
 async fn delete_my_order(ctx: &MmArc, uuid: Uuid) {
     let ordermatch_ctx: Arc<OrdermatchContext> = OrdermatchContext::from_ctx(&ctx).expect("from_ctx failed");
     let mut orderbook = ordermatch_ctx.orderbook.lock().await;
     orderbook.remove_order_trie_update(uuid);
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
 }
 
 fn remove_and_purge_pubkey_pair_orders(orderbook: &mut Orderbook, pubkey: &str, alb_pair: &str) {
@@ -344,53 +341,79 @@ fn remove_and_purge_pubkey_pair_orders(orderbook: &mut Orderbook, pubkey: &str,
     }
 }
 
-/// Attempts to decode a message and process it returning whether the message is valid and worth rebroadcasting
-pub async fn process_msg(ctx: MmArc, _topics: Vec<String>, from_peer: String, msg: &[u8], i_am_relay: bool) -> bool {
-    match decode_signed::<new_protocol::OrdermatchMessage>(msg) {
-        Ok((message, _sig, pubkey)) => {
-            if is_pubkey_banned(&ctx, &pubkey.unprefixed().into()) {
-                log::warn!("Pubkey {} is banned", pubkey.to_hex());
-                return false;
-            }
-            match message {
-                new_protocol::OrdermatchMessage::MakerOrderCreated(created_msg) => {
-                    let order: OrderbookItem = (created_msg, hex::encode(pubkey.to_bytes().as_slice())).into();
-                    insert_or_update_order(&ctx, order).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::PubkeyKeepAlive(keep_alive) => {
-                    process_orders_keep_alive(ctx, from_peer, pubkey.to_hex(), keep_alive, i_am_relay).await
-                },
-                new_protocol::OrdermatchMessage::TakerRequest(taker_request) => {
-                    let msg = TakerRequest::from_new_proto_and_pubkey(taker_request, pubkey.unprefixed().into());
-                    process_taker_request(ctx, pubkey.unprefixed().into(), msg).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::MakerReserved(maker_reserved) => {
-                    let msg = MakerReserved::from_new_proto_and_pubkey(maker_reserved, pubkey.unprefixed().into());
-                    process_maker_reserved(ctx, pubkey.unprefixed().into(), msg).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::TakerConnect(taker_connect) => {
-                    process_taker_connect(ctx, pubkey.unprefixed().into(), taker_connect.into()).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::MakerConnected(maker_connected) => {
-                    process_maker_connected(ctx, pubkey.unprefixed().into(), maker_connected.into()).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::MakerOrderCancelled(cancelled_msg) => {
-                    delete_order(&ctx, &pubkey.to_hex(), cancelled_msg.uuid.into()).await;
-                    true
-                },
-                new_protocol::OrdermatchMessage::MakerOrderUpdated(updated_msg) => {
-                    process_maker_order_updated(ctx, pubkey.to_hex(), updated_msg).await
-                },
-            }
+/// The ordermatch message with the verified signature.
+pub struct DecodedMsg {
+    message: new_protocol::OrdermatchMessage,
+    pubkey: PublicKey,
+}
+
+/// Decodes the message and verifies its signature.
+/// The messages of the banned pubkeys are rejected before the signature verification.
+///
+/// This is CPU-bound, so it's called on the verification pool by the `lp_network::p2p_event_process_loop`.
+pub fn decode_msg(ctx: &MmArc, msg: &[u8]) -> Option<DecodedMsg> {
+    let unverified = match decode_signed_unverified(msg) {
+        Ok(unverified) => unverified,
+        Err(e) => {
+            log::error!("Error {} while decoding signed message", e);
+            return None;
         },
+    };
+    if is_pubkey_banned(ctx, &unverified.pubkey().unprefixed().into()) {
+        log::warn!("Pubkey {} is banned", unverified.pubkey().to_hex());
+        return None;
+    }
+
+    match unverified.verify_and_decode::<new_protocol::OrdermatchMessage>() {
+        Ok((message, _sig, pubkey)) => Some(DecodedMsg { message, pubkey }),
         Err(e) => {
             log::error!("Error {} while decoding signed message", e);
-            false
+            None
+        },
+    }
+}
+
+/// Processes the decoded message returning whether the message is worth rebroadcasting
+pub async fn process_decoded_msg(ctx: MmArc, from_peer: String, decoded: DecodedMsg, i_am_relay: bool) -> bool {
+    let DecodedMsg { message, pubkey } = decoded;
+    match message {
+        new_protocol::OrdermatchMessage::MakerOrderCreated(created_msg) => {
+            let order: OrderbookItem = (created_msg, hex::encode(pubkey.to_bytes().as_slice())).into();
+            process_order_update(&ctx, OrderUpdate::Created(order)).await
+        },
+        new_protocol::OrdermatchMessage::PubkeyKeepAlive(keep_alive) => {
+            process_orders_keep_alive(ctx, from_peer, pubkey.to_hex(), keep_alive, i_am_relay).await
+        },
+        new_protocol::OrdermatchMessage::TakerRequest(taker_request) => {
+            let msg = TakerRequest::from_new_proto_and_pubkey(taker_request, pubkey.unprefixed().into());
+            process_taker_request(ctx, pubkey.unprefixed().into(), msg).await;
+            true
+        },
+        new_protocol::OrdermatchMessage::MakerReserved(maker_reserved) => {
+            let msg = MakerReserved::from_new_proto_and_pubkey(maker_reserved, pubkey.unprefixed().into());
+            process_maker_reserved(ctx, pubkey.unprefixed().into(), msg).await;
+            true
+        },
+        new_protocol::OrdermatchMessage::TakerConnect(taker_connect) => {
+            process_taker_connect(ctx, pubkey.unprefixed().into(), taker_connect.into()).await;
+            true
+        },
+        new_protocol::OrdermatchMessage::MakerConnected(maker_connected) => {
+            process_maker_connected(ctx, pubkey.unprefixed().into(), maker_connected.into()).await;
+            true
+        },
+        new_protocol::OrdermatchMessage::MakerOrderCancelled(cancelled_msg) => {
+            let pubkey = pubkey.to_hex();
+            let uuid = cancelled_msg.uuid.into();
+            delete_inactive_order(&ctx, &pubkey, uuid).await;
+            process_order_update(&ctx, OrderUpdate::Cancelled { pubkey, uuid }).await
+        },
+        new_protocol::OrdermatchMessage::MakerOrderUpdated(updated_msg) => {
+            let update = OrderUpdate::Updated {
+                pubkey: pubkey.to_hex(),
+                updated_msg,
+            };
+            process_order_update(&ctx, update).await
         },
     }
 }
@@ -455,10 +478,18 @@ impl TryFromBytes for Uuid {
     }
 }
 
-pub async fn process_peer_request(ctx: MmArc, request: OrdermatchRequest) -> Result<Option<Vec<u8>>, String> {
+/// Processes the ordermatch request of the peer.
+/// `compact_response` is whether the peer decodes the compact `GetOrderbook` response, see [`compact_orderbook`].
+pub async fn process_peer_request(
+    ctx: MmArc,
+    request: OrdermatchRequest,
+    compact_response: bool,
+) -> Result<Option<Vec<u8>>, String> {
     log::debug!("Got ordermatch request {:?}", request);
     match request {
-        OrdermatchRequest::GetOrderbook { base, rel } => process_get_orderbook_request(ctx, base, rel).await,
+        OrdermatchRequest::GetOrderbook { base, rel } => {
+            process_get_orderbook_request(ctx, base, rel, compact_response).await
+        },
         OrdermatchRequest::SyncPubkeyOrderbookState { pubkey, trie_roots } => {
             let response = process_sync_pubkey_orderbook_state(ctx, pubkey, trie_roots).await;
             response.map(|res| res.map(|r| encode_message(&r).expect("Serialization failed")))
@@ -490,62 +521,139 @@ struct GetOrderbookRes {
     pubkey_orders: HashMap<String, GetOrderbookPubkeyItem>,
 }
 
-async fn process_get_orderbook_request(ctx: MmArc, base: String, rel: String) -> Result<Option<Vec<u8>>, String> {
-    fn get_pubkeys_orders(orderbook: &Orderbook, base: String, rel: String) -> (usize, HashMap<String, PubkeyOrders>) {
-        let asks = orderbook.unordered.get(&(base.clone(), rel.clone()));
-        let bids = orderbook.unordered.get(&(rel, base));
-
-        let asks_num = asks.map(|x| x.len()).unwrap_or(0);
-        let bids_num = bids.map(|x| x.len()).unwrap_or(0);
-        let total_orders_number = asks_num + bids_num;
-
-        // flatten Option(asks) and Option(bids) to avoid cloning
-        let orders = asks.iter().chain(bids.iter()).copied().flatten();
+async fn process_get_orderbook_request(
+    ctx: MmArc,
+    base: String,
+    rel: String,
+    compact_response: bool,
+) -> Result<Option<Vec<u8>>, String> {
+    fn get_pubkeys_orders(orderbook: &Orderbook, base: String, rel: String) -> HashMap<String, PubkeyOrders> {
+        let orders = orderbook
+            .orders
+            .pair_orders(&base, &rel)
+            .chain(orderbook.orders.pair_orders(&rel, &base));
 
         let mut uuids_by_pubkey = HashMap::new();
-        for uuid in orders {
-            let order = orderbook
-                .order_set
-                .get(uuid)
-                .expect("Orderbook::ordered contains an uuid that is not in Orderbook::order_set");
+        for order in orders {
             let uuids = uuids_by_pubkey.entry(order.pubkey.clone()).or_insert_with(Vec::new);
-            uuids.push((*uuid, order.clone()))
+            uuids.push((order.uuid, order.clone()))
         }
 
-        (total_orders_number, uuids_by_pubkey)
+        uuids_by_pubkey
+    }
+
+    fn encode_plain_response(orderbook: &Orderbook, base: String, rel: String) -> Result<PlainEncodedResponse, String> {
+        let orders = get_pubkeys_orders(orderbook, base, rel);
+        let mut keep_alives = Vec::with_capacity(orders.len());
+        let orders_to_send: Result<HashMap<_, _>, String> = orders
+            .into_iter()
+            .map(|(pubkey, orders)| {
+                let pubkey_state = orderbook.pubkeys_state.get(&pubkey).ok_or(ERRL!(
+                    "Orderbook::pubkeys_state is expected to contain the {:?} pubkey",
+                    pubkey
+                ))?;
+
+                keep_alives.push((pubkey.clone(), pubkey_state.last_keep_alive));
+                let item = GetOrderbookPubkeyItem {
+                    last_keep_alive: pubkey_state.last_keep_alive,
+                    orders,
+                    // TODO save last signed payload to pubkey state
+                    last_signed_pubkey_payload: vec![],
+                };
+
+                Ok((pubkey, item))
+            })
+            .collect();
+
+        let pubkey_orders = orders_to_send?;
+        let response = GetOrderbookRes { pubkey_orders };
+        let encoded = try_s!(encode_message(&response));
+        Ok(PlainEncodedResponse { keep_alives, encoded })
     }
 
     let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
-    let orderbook = ordermatch_ctx.orderbook.lock().await;
+    let mut orderbook = ordermatch_ctx.orderbook.lock().await;
+
+    // the relays are requested the same popular pairs by every joining peer
+    let alb_pair = alb_ordered_pair(&base, &rel);
+    let pair_version = orderbook.pair_version(&base, &rel);
+    let Orderbook {
+        encoded_pair_snapshots,
+        pubkeys_state,
+        ..
+    } = &mut *orderbook;
+    if let Some(snapshot) = encoded_pair_snapshots.get(&alb_pair) {
+        if snapshot.pair_version == pair_version {
+            match (compact_response, &snapshot.plain, &snapshot.compact) {
+                (true, _, Some(compact)) => return compact.encode_response(pubkeys_state).map(Some),
+                (false, Some(plain), _) if plain.is_actual(pubkeys_state) => return Ok(Some(plain.encoded.clone())),
+                _ => (),
+            }
+        }
+    }
 
-    let (total_orders_number, orders) = get_pubkeys_orders(&orderbook, base, rel);
+    let total_orders_number = orderbook.orders.pair_len(&base, &rel) + orderbook.orders.pair_len(&rel, &base);
     if total_orders_number > MAX_ORDERS_NUMBER_IN_ORDERBOOK_RESPONSE {
         return ERR!("Orderbook too large");
     }
 
-    let orders_to_send: Result<HashMap<_, _>, String> = orders
-        .into_iter()
-        .map(|(pubkey, orders)| {
-            let pubkey_state = orderbook.pubkeys_state.get(&pubkey).ok_or(ERRL!(
-                "Orderbook::pubkeys_state is expected to contain the {:?} pubkey",
-                pubkey
-            ))?;
-
-            let item = GetOrderbookPubkeyItem {
-                last_keep_alive: pubkey_state.last_keep_alive,
-                orders,
-                // TODO save last signed payload to pubkey state
-                last_signed_pubkey_payload: vec![],
-            };
+    if compact_response {
+        let orders = orderbook
+            .orders
+            .pair_orders(&base, &rel)
+            .chain(orderbook.orders.pair_orders(&rel, &base));
+        let compact = CompactPairOrders::new(orders);
+        let encoded = try_s!(compact.encode_response(&orderbook.pubkeys_state));
+        orderbook.cache_encoded_pair_snapshot(alb_pair, pair_version, |snapshot| snapshot.compact = Some(compact));
+        Ok(Some(encoded))
+    } else {
+        let plain = try_s!(encode_plain_response(&orderbook, base, rel));
+        let encoded = plain.encoded.clone();
+        orderbook.cache_encoded_pair_snapshot(alb_pair, pair_version, |snapshot| snapshot.plain = Some(plain));
+        Ok(Some(encoded))
+    }
+}
+
+/// The encoded responses of the pair orders at the `pair_version`, see `Orderbook::pair_version`.
+/// The plain and the compact responses are encoded on the first request of the corresponding format.
+struct EncodedPairSnapshot {
+    pair_version: u64,
+    plain: Option<PlainEncodedResponse>,
+    /// The compact orders are encoded with the actual keep alives on every request, see [`CompactPairOrders::encode_response`].
+    compact: Option<CompactPairOrders>,
+}
+
+/// The `rmp_serde` encoded `GetOrderbookRes`.
+struct PlainEncodedResponse {
+    /// The pubkeys of the response with the `last_keep_alive` timestamps the response is encoded with.
+    keep_alives: Vec<(String, u64)>,
+    encoded: Vec<u8>,
+}
 
-            Ok((pubkey, item))
+impl PlainEncodedResponse {
+    /// Whether the keep alives of the pubkeys have not changed since the response is encoded.
+    fn is_actual(&self, pubkeys_state: &HashMap<String, OrderbookPubkeyState>) -> bool {
+        self.keep_alives.iter().all(|(pubkey, last_keep_alive)| {
+            pubkeys_state.get(pubkey).map(|state| state.last_keep_alive) == Some(*last_keep_alive)
         })
-        .collect();
+    }
+}
+
+/// The encoded orderbook responses of the recently requested pairs.
+struct EncodedPairSnapshots(LruCache<AlbOrderedOrderbookPair, EncodedPairSnapshot>);
+
+impl Default for EncodedPairSnapshots {
+    fn default() -> Self { EncodedPairSnapshots(LruCache::new(MAX_ENCODED_PAIR_SNAPSHOTS)) }
+}
 
-    let pubkey_orders = orders_to_send?;
-    let response = GetOrderbookRes { pubkey_orders };
-    let encoded = try_s!(encode_message(&response));
-    Ok(Some(encoded))
+impl Deref for EncodedPairSnapshots {
+    type Target = LruCache<AlbOrderedOrderbookPair, EncodedPairSnapshot>;
+
+    fn deref(&self) -> &Self::Target { &self.0 }
+}
+
+impl DerefMut for EncodedPairSnapshots {
+    fn deref_mut(&mut self) -> &mut Self::Target { &mut self.0 }
 }
 
 #[derive(Debug, Deserialize, Serialize)]
@@ -594,6 +702,7 @@ where
 }
 
 impl<Key: Clone + Eq + std::hash::Hash + TryFromBytes, Value: Clone + TryFromBytes> DeltaOrFullTrie<Key, Value> {
+    /// Falls back to the full trie if `from_hash` or any diff after it has been evicted from the `history`.
     fn from_history(
         history: &TrieDiffHistory<Key, Value>,
         from_hash: H64,
@@ -749,9 +858,11 @@ async fn process_my_maker_order_updated(ctx: &MmArc, message: &new_protocol::Mak
     let mut orderbook = ordermatch_ctx.orderbook.lock().await;
 
     let uuid = message.uuid();
-    if let Some(mut order) = orderbook.find_order_by_uuid(&uuid) {
+    if let Some(order) = orderbook.find_order_by_uuid(&uuid) {
+        let mut order = order.clone();
         order.apply_updated(message);
         orderbook.insert_or_update_order_update_trie(order);
+        ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
     }
 }
 
@@ -1208,6 +1319,9 @@ enum MatchReservedResult {
 impl TakerOrder {
     fn is_cancellable(&self) -> bool { self.matches.is_empty() }
 
+    /// The time in milliseconds the order is timed out at.
+    fn timed_out_at(&self) -> u64 { self.created_at + self.timeout * 1000 }
+
     fn match_reserved(&self, reserved: &MakerReserved) -> MatchReservedResult {
         match &self.request.match_by {
             MatchBy::Any => (),
@@ -1791,13 +1905,6 @@ fn broadcast_ordermatch_message(
     broadcast_p2p_msg(ctx, topics.into_iter().collect(), encoded_msg);
 }
 
-/// The order is ordered by [`OrderbookItem::price`] and [`OrderbookItem::uuid`].
-#[derive(Debug, Eq, Ord, PartialEq, PartialOrd)]
-struct OrderedByPriceOrder {
-    price: MmNumber,
-    uuid: Uuid,
-}
-
 #[derive(Clone, Debug, PartialEq)]
 enum OrderbookRequestingState {
     /// The orderbook was requested from relays.
@@ -1815,20 +1922,72 @@ struct TrieDiff<Key, Value> {
     next_root: H64,
 }
 
-#[derive(Debug, Eq, PartialEq)]
+/// Approximate number of bytes occupied by a key or a value stored in the [`TrieDiffHistory`].
+trait HistoryMemoryUsage {
+    fn memory_usage(&self) -> usize;
+}
+
+impl HistoryMemoryUsage for Uuid {
+    fn memory_usage(&self) -> usize { std::mem::size_of::<Uuid>() }
+}
+
+impl HistoryMemoryUsage for String {
+    fn memory_usage(&self) -> usize { std::mem::size_of::<String>() + self.capacity() }
+}
+
+impl HistoryMemoryUsage for OrderbookItem {
+    fn memory_usage(&self) -> usize {
+        fn rational_bytes(rational: &BigRational) -> usize {
+            (rational.numer().bits() as usize + rational.denom().bits() as usize) / 8
+        }
+
+        std::mem::size_of::<OrderbookItem>()
+            + self.pubkey.capacity()
+            + self.base.capacity()
+            + self.rel.capacity()
+            + rational_bytes(&self.price)
+            + rational_bytes(&self.max_volume)
+            + rational_bytes(&self.min_volume)
+    }
+}
+
+impl<Key: HistoryMemoryUsage, Value: HistoryMemoryUsage> TrieDiff<Key, Value> {
+    fn memory_usage(&self) -> usize {
+        let delta = self.delta.iter().fold(0, |total, (key, value)| {
+            total + key.memory_usage() + value.as_ref().map_or(0, HistoryMemoryUsage::memory_usage)
+        });
+        std::mem::size_of::<H64>() + std::mem::size_of::<TrieDiff<Key, Value>>() + delta
+    }
+}
+
+#[derive(Debug)]
 struct TrieDiffHistory<Key, Value> {
     inner: HashMap<H64, TrieDiff<Key, Value>>,
+    /// The roots the diffs were inserted at from the oldest to the newest.
+    /// Might contain the roots that were removed from `inner` already, they are skipped on eviction.
+    insertion_order: VecDeque<H64>,
+    /// Approximate number of bytes occupied by the `inner` diffs.
+    memory_usage: usize,
 }
 
 impl<Key, Value> Default for TrieDiffHistory<Key, Value> {
     fn default() -> Self {
         TrieDiffHistory {
             inner: Default::default(),
+            insertion_order: Default::default(),
+            memory_usage: 0,
         }
     }
 }
 
-impl<Key, Value> TrieDiffHistory<Key, Value> {
+/// The bookkeeping fields are derived from `inner`, so only the diffs are compared.
+impl<Key: PartialEq, Value: PartialEq> PartialEq for TrieDiffHistory<Key, Value> {
+    fn eq(&self, other: &Self) -> bool { self.inner == other.inner }
+}
+
+impl<Key: Eq, Value: Eq> Eq for TrieDiffHistory<Key, Value> {}
+
+impl<Key: HistoryMemoryUsage, Value: HistoryMemoryUsage> TrieDiffHistory<Key, Value> {
     fn insert_new_diff(&mut self, insert_at: H64, diff: TrieDiff<Key, Value>) {
         if insert_at == diff.next_root {
             // do nothing to avoid cycles in diff history
@@ -1839,18 +1998,76 @@ impl<Key, Value> TrieDiffHistory<Key, Value> {
             Some(mut diff) => {
                 // we reached a state that was already reached previously
                 // history can be cleaned up to this state hash
+                self.memory_usage -= diff.memory_usage();
                 while let Some(next_diff) = self.inner.remove(&diff.next_root) {
+                    self.memory_usage -= next_diff.memory_usage();
                     diff = next_diff;
                 }
             },
             None => {
-                self.inner.insert(insert_at, diff);
+                self.memory_usage += diff.memory_usage();
+                if let Some(replaced) = self.inner.insert(insert_at, diff) {
+                    self.memory_usage -= replaced.memory_usage();
+                }
+                self.insertion_order.push_back(insert_at);
             },
         };
+        self.compact_insertion_order();
+    }
+
+    /// Removes the oldest diff returning the number of bytes freed or `None` if the history is empty.
+    /// The peers requesting a delta from the evicted root receive the full trie instead.
+    fn evict_oldest(&mut self) -> Option<usize> {
+        while let Some(root) = self.insertion_order.pop_front() {
+            if let Some(diff) = self.inner.remove(&root) {
+                let freed = diff.memory_usage();
+                self.memory_usage -= freed;
+                return Some(freed);
+            }
+        }
+        None
+    }
+
+    /// Evicts the oldest diffs until the history fits into `max_bytes`.
+    fn evict_to_fit(&mut self, max_bytes: usize) {
+        while self.memory_usage > max_bytes {
+            if self.evict_oldest().is_none() {
+                break;
+            }
+        }
+    }
+
+    #[allow(dead_code)]
+    fn remove_key(&mut self, key: &H64) {
+        if let Some(diff) = self.inner.remove(key) {
+            self.memory_usage -= diff.memory_usage();
+        }
+    }
+
+    /// Drops the roots that were removed from `inner` to keep `insertion_order` bounded.
+    fn compact_insertion_order(&mut self) {
+        if self.insertion_order.len() <= self.inner.len() * 2 + 16 {
+            return;
+        }
+        let inner = &self.inner;
+        let mut seen = HashSet::with_capacity(inner.len());
+        // iterate from the newest to keep the latest insertion of every root
+        let compacted: VecDeque<_> = self
+            .insertion_order
+            .iter()
+            .rev()
+            .filter(|root| inner.contains_key(*root) && seen.insert(**root))
+            .copied()
+            .collect();
+        self.insertion_order = compacted.into_iter().rev().collect();
     }
+}
+
+impl<Key, Value> TrieDiffHistory<Key, Value> {
+    fn memory_usage(&self) -> usize { self.memory_usage }
 
     #[allow(dead_code)]
-    fn remove_key(&mut self, key: &H64) { self.inner.remove(key); }
+    fn len(&self) -> usize { self.inner.len() }
 
     #[allow(dead_code)]
     fn contains_key(&self, key: &H64) -> bool { self.inner.contains_key(key) }
@@ -1873,6 +2090,68 @@ struct OrderbookPubkeyState {
     trie_roots: HashMap<AlbOrderedOrderbookPair, H64>,
 }
 
+impl OrderbookPubkeyState {
+    fn history_memory_usage(&self) -> usize {
+        self.order_pairs_trie_state_history
+            .values()
+            .fold(0, |total, history| total + history.memory_usage())
+    }
+
+    /// Evicts the oldest diffs of the largest pair histories until the pubkey history fits into `max_bytes`.
+    fn evict_history_to_fit(&mut self, max_bytes: usize) {
+        let mut total = self.history_memory_usage();
+        while total > max_bytes {
+            let largest = match self
+                .order_pairs_trie_state_history
+                .values_mut()
+                .max_by_key(|history| history.memory_usage())
+            {
+                Some(history) => history,
+                None => break,
+            };
+            match largest.evict_oldest() {
+                Some(freed) => total -= freed,
+                None => break,
+            }
+        }
+    }
+}
+
+const DEFAULT_HISTORY_MAX_BYTES_PER_PUBKEY: usize = 512 * 1024;
+const DEFAULT_HISTORY_MAX_BYTES: usize = 128 * 1024 * 1024;
+
+/// The memory limits of the [`OrderbookPubkeyState::order_pairs_trie_state_history`].
+#[derive(Clone, Copy, Debug)]
+struct OrderbookHistoryBudget {
+    /// Checked on every history update of the pubkey.
+    max_bytes_per_pubkey: usize,
+    /// Checked periodically by the [`lp_ordermatch_loop`].
+    max_bytes: usize,
+}
+
+impl Default for OrderbookHistoryBudget {
+    fn default() -> Self {
+        OrderbookHistoryBudget {
+            max_bytes_per_pubkey: DEFAULT_HISTORY_MAX_BYTES_PER_PUBKEY,
+            max_bytes: DEFAULT_HISTORY_MAX_BYTES,
+        }
+    }
+}
+
+impl OrderbookHistoryBudget {
+    fn from_conf(conf: &Json) -> OrderbookHistoryBudget {
+        let default = OrderbookHistoryBudget::default();
+        OrderbookHistoryBudget {
+            max_bytes_per_pubkey: conf["orderbook_history_max_bytes_per_pubkey"]
+                .as_u64()
+                .map_or(default.max_bytes_per_pubkey, |bytes| bytes as usize),
+            max_bytes: conf["orderbook_history_max_bytes"]
+                .as_u64()
+                .map_or(default.max_bytes, |bytes| bytes as usize),
+        }
+    }
+}
+
 fn get_trie_mut<'a>(
     mem_db: &'a mut MemoryDB<Blake2Hasher64>,
     root: &'a mut H64,
@@ -1886,6 +2165,7 @@ fn get_trie_mut<'a>(
 
 fn pubkey_state_mut<'a>(
     state: &'a mut HashMap<String, OrderbookPubkeyState>,
+    expiry: &mut DeadlineQueue<String>,
     from_pubkey: &str,
 ) -> &'a mut OrderbookPubkeyState {
     match state.raw_entry_mut().from_key(from_pubkey) {
@@ -1893,6 +2173,7 @@ fn pubkey_state_mut<'a>(
         RawEntryMut::Vacant(e) => {
             let mut state: OrderbookPubkeyState = Default::default();
             state.last_keep_alive = now_ms() / 1000;
+            expiry.schedule(from_pubkey.to_string(), state.last_keep_alive);
             e.insert(from_pubkey.to_string(), state).1
         },
     }
@@ -1944,8 +2225,13 @@ fn collect_orderbook_metrics(ctx: &MmArc, orderbook: &Orderbook) {
     }
 
     let memory_db_size = malloc_size(&orderbook.memory_db);
-    mm_gauge!(ctx.metrics, "orderbook.len", orderbook.order_set.len() as i64);
+    mm_gauge!(ctx.metrics, "orderbook.len", orderbook.orders.len() as i64);
     mm_gauge!(ctx.metrics, "orderbook.memory_db", memory_db_size as i64);
+    mm_gauge!(
+        ctx.metrics,
+        "orderbook.history_memory_usage",
+        orderbook.history_memory_usage() as i64
+    );
     // mm_gauge!(ctx.metrics, "inactive_orders.len", inactive.len() as i64);
 
     // TODO remove metrics below after testing
@@ -1957,36 +2243,86 @@ fn collect_orderbook_metrics(ctx: &MmArc, orderbook: &Orderbook) {
 
 #[derive(Default)]
 struct Orderbook {
-    /// A map from (base, rel).
-    ordered: HashMap<(String, String), BTreeSet<OrderedByPriceOrder>>,
-    /// A map from base ticker to the set of another tickers to track the existing pairs
-    pairs_existing_for_base: HashMap<String, HashSet<String>>,
-    /// A map from rel ticker to the set of another tickers to track the existing pairs
-    pairs_existing_for_rel: HashMap<String, HashSet<String>>,
-    /// A map from (base, rel).
-    unordered: HashMap<(String, String), HashSet<Uuid>>,
-    order_set: HashMap<Uuid, OrderbookItem>,
+    /// The orders indexed by uuid and sorted by price within each (base, rel) pair.
+    orders: OrderbookIndex,
     /// a map of orderbook states of known maker pubkeys
     pubkeys_state: HashMap<String, OrderbookPubkeyState>,
+    /// The pubkeys scheduled by their `last_keep_alive` to be expired by the `lp_ordermatch_loop`.
+    pubkeys_expiry: DeadlineQueue<String>,
     topics_subscribed_to: HashMap<String, OrderbookRequestingState>,
     /// MemoryDB instance to store Patricia Tries data
     memory_db: MemoryDB<Blake2Hasher64>,
+    /// The memory limits of the pubkey trie diff histories
+    history_budget: OrderbookHistoryBudget,
+    /// The encoded orderbook responses of the recently requested pairs, see `process_get_orderbook_request`.
+    encoded_pair_snapshots: EncodedPairSnapshots,
 }
 
 fn hashed_null_node<T: TrieConfiguration>() -> TrieHash<T> { <T::Codec as NodeCodecT>::hashed_null_node() }
 
 impl Orderbook {
-    fn find_order_by_uuid_and_pubkey(&self, uuid: &Uuid, from_pubkey: &str) -> Option<OrderbookItem> {
-        self.order_set.get(uuid).and_then(|order| {
-            if order.pubkey == from_pubkey {
-                Some(order.clone())
-            } else {
-                None
-            }
-        })
+    fn with_history_budget(history_budget: OrderbookHistoryBudget) -> Orderbook {
+        Orderbook {
+            history_budget,
+            ..Default::default()
+        }
+    }
+
+    /// Returns the number that increases once the orders of the (base, rel) or the (rel, base) pair are changed.
+    fn pair_version(&self, base: &str, rel: &str) -> u64 {
+        self.orders
+            .pair_version(base, rel)
+            .max(self.orders.pair_version(rel, base))
+    }
+
+    /// Updates the cached snapshot of the pair at the `pair_version` dropping the snapshot of an older version.
+    fn cache_encoded_pair_snapshot(
+        &mut self,
+        alb_pair: AlbOrderedOrderbookPair,
+        pair_version: u64,
+        update: impl FnOnce(&mut EncodedPairSnapshot),
+    ) {
+        let mut snapshot = match self.encoded_pair_snapshots.remove(&alb_pair) {
+            Some(snapshot) if snapshot.pair_version == pair_version => snapshot,
+            _ => EncodedPairSnapshot {
+                pair_version,
+                plain: None,
+                compact: None,
+            },
+        };
+        update(&mut snapshot);
+        self.encoded_pair_snapshots.insert(alb_pair, snapshot);
+    }
+
+    fn history_memory_usage(&self) -> usize {
+        self.pubkeys_state
+            .values()
+            .fold(0, |total, state| total + state.history_memory_usage())
+    }
+
+    /// Shrinks every pubkey history proportionally if the total history doesn't fit into the budget.
+    fn evict_history_to_fit_budget(&mut self) {
+        let max_bytes = self.history_budget.max_bytes;
+        let total = self.history_memory_usage();
+        if total <= max_bytes {
+            return;
+        }
+
+        for state in self.pubkeys_state.values_mut() {
+            let usage = state.history_memory_usage();
+            let fit = (usage as u128 * max_bytes as u128 / total as u128) as usize;
+            state.evict_history_to_fit(fit);
+        }
+    }
+
+    /// Removes the trie nodes that are not referenced by any trie root anymore.
+    fn purge_unreachable_trie_nodes(&mut self) { self.memory_db.purge(); }
+
+    fn find_order_by_uuid_and_pubkey(&self, uuid: &Uuid, from_pubkey: &str) -> Option<&OrderbookItem> {
+        self.orders.get(uuid).filter(|order| order.pubkey == from_pubkey)
     }
 
-    fn find_order_by_uuid(&self, uuid: &Uuid) -> Option<OrderbookItem> { self.order_set.get(uuid).cloned() }
+    fn find_order_by_uuid(&self, uuid: &Uuid) -> Option<&OrderbookItem> { self.orders.get(uuid) }
 
     fn insert_or_update_order_update_trie(&mut self, order: OrderbookItem) {
         let zero = BigRational::from_integer(0.into());
@@ -1995,9 +2331,7 @@ impl Orderbook {
             return;
         } // else insert the order
 
-        self.insert_or_update_order(order.clone());
-
-        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &order.pubkey);
+        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &mut self.pubkeys_expiry, &order.pubkey);
 
         let alb_ordered = alb_ordered_pair(&order.base, &order.rel);
         let pair_root = order_pair_root_mut(&mut pubkey_state.trie_roots, &alb_ordered);
@@ -2009,6 +2343,7 @@ impl Orderbook {
             Ok(trie) => trie,
             Err(e) => {
                 log::error!("Error getting {} trie with root {:?}", e, prev_root);
+                self.orders.insert_or_update(order);
                 return;
             },
         };
@@ -2020,6 +2355,7 @@ impl Orderbook {
                 order.uuid,
                 order_bytes
             );
+            self.orders.insert_or_update(order);
             return;
         };
         drop(pair_trie);
@@ -2030,7 +2366,10 @@ impl Orderbook {
                 delta: vec![(order.uuid, Some(order.clone()))],
                 next_root: *pair_root,
             });
+            pubkey_state.evict_history_to_fit(self.history_budget.max_bytes_per_pubkey);
         }
+
+        self.insert_or_update_order(order);
     }
 
     fn insert_or_update_order(&mut self, order: OrderbookItem) {
@@ -2041,94 +2380,16 @@ impl Orderbook {
             return;
         } // else insert the order
 
-        let base_rel = (order.base.clone(), order.rel.clone());
-
-        self.ordered
-            .entry(base_rel.clone())
-            .or_insert_with(BTreeSet::new)
-            .insert(OrderedByPriceOrder {
-                price: order.price.clone().into(),
-                uuid: order.uuid,
-            });
-
-        self.pairs_existing_for_base
-            .entry(order.base.clone())
-            .or_insert_with(HashSet::new)
-            .insert(order.rel.clone());
-
-        self.pairs_existing_for_rel
-            .entry(order.rel.clone())
-            .or_insert_with(HashSet::new)
-            .insert(order.base.clone());
-
-        self.unordered
-            .entry(base_rel)
-            .or_insert_with(HashSet::new)
-            .insert(order.uuid);
-
-        self.order_set.insert(order.uuid, order);
+        self.orders.insert_or_update(order);
     }
 
-    fn remove_order(&mut self, uuid: Uuid) -> Option<OrderbookItem> {
-        let order = match self.order_set.remove(&uuid) {
-            Some(order) => order,
-            None => return None,
-        };
-        let base_rel = (order.base.clone(), order.rel.clone());
-
-        // create an `order_to_delete` that allows to find and remove an element from `self.ordered` by hash
-        let order_to_delete = OrderedByPriceOrder {
-            price: order.price.clone().into(),
-            uuid,
-        };
-
-        if let Some(orders) = self.ordered.get_mut(&base_rel) {
-            orders.remove(&order_to_delete);
-            if orders.is_empty() {
-                self.ordered.remove(&base_rel);
-            }
-        }
-
-        if let Some(orders) = self.unordered.get_mut(&base_rel) {
-            // use the same uuid to remove an order
-            orders.remove(&order_to_delete.uuid);
-            if orders.is_empty() {
-                self.unordered.remove(&base_rel);
-            }
-        };
-        Some(order)
-    }
+    fn remove_order(&mut self, uuid: Uuid) -> Option<OrderbookItem> { self.orders.remove(&uuid) }
 
     fn remove_order_trie_update(&mut self, uuid: Uuid) -> Option<OrderbookItem> {
-        let order = match self.order_set.remove(&uuid) {
-            Some(order) => order,
-            None => return None,
-        };
-        let base_rel = (order.base.clone(), order.rel.clone());
-
-        // create an `order_to_delete` that allows to find and remove an element from `self.ordered` by hash
-        let order_to_delete = OrderedByPriceOrder {
-            price: order.price.clone().into(),
-            uuid,
-        };
-
-        if let Some(orders) = self.ordered.get_mut(&base_rel) {
-            orders.remove(&order_to_delete);
-            if orders.is_empty() {
-                self.ordered.remove(&base_rel);
-            }
-        }
-
-        if let Some(orders) = self.unordered.get_mut(&base_rel) {
-            // use the same uuid to remove an order
-            orders.remove(&order_to_delete.uuid);
-            if orders.is_empty() {
-                self.unordered.remove(&base_rel);
-            }
-        }
+        let order = self.orders.remove(&uuid)?;
 
         let alb_ordered = alb_ordered_pair(&order.base, &order.rel);
-        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &order.pubkey);
+        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &mut self.pubkeys_expiry, &order.pubkey);
         let pair_state = order_pair_root_mut(&mut pubkey_state.trie_roots, &alb_ordered);
         let old_state = *pair_state;
 
@@ -2151,9 +2412,98 @@ impl Orderbook {
             delta: vec![(uuid, None)],
             next_root: *pair_state,
         });
+        pubkey_state.evict_history_to_fit(self.history_budget.max_bytes_per_pubkey);
         Some(order)
     }
 
+    /// Applies the latest states of the orders, `None` removes the order.
+    /// The orders of every pubkey pair are committed to the trie at once and recorded as a single history diff.
+    fn apply_order_updates_trie(&mut self, updates: HashMap<Uuid, Option<OrderbookItem>>) {
+        let zero = BigRational::from_integer(0.into());
+        let mut pairs_updates: HashMap<(String, AlbOrderedOrderbookPair), Vec<_>> = HashMap::new();
+        for (uuid, update) in updates {
+            let update =
+                update.filter(|order| order.max_volume > zero && order.price > zero && order.min_volume >= zero);
+            let order = match &update {
+                Some(order) => order,
+                None => match self.orders.get(&uuid) {
+                    Some(order) => order,
+                    // the order was created and removed within the batch
+                    None => continue,
+                },
+            };
+            let pubkey_pair = (order.pubkey.clone(), alb_ordered_pair(&order.base, &order.rel));
+            pairs_updates
+                .entry(pubkey_pair)
+                .or_insert_with(Vec::new)
+                .push((uuid, update));
+        }
+
+        for ((pubkey, alb_pair), updates) in pairs_updates {
+            self.update_pair_orders_trie(&pubkey, &alb_pair, updates);
+        }
+    }
+
+    fn update_pair_orders_trie(&mut self, pubkey: &str, alb_pair: &str, updates: Vec<(Uuid, Option<OrderbookItem>)>) {
+        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &mut self.pubkeys_expiry, pubkey);
+        let pair_root = order_pair_root_mut(&mut pubkey_state.trie_roots, alb_pair);
+        let prev_root = *pair_root;
+
+        let mut pair_trie = match get_trie_mut(&mut self.memory_db, pair_root) {
+            Ok(trie) => Some(trie),
+            Err(e) => {
+                log::error!("Error getting {} trie with root {:?}", e, prev_root);
+                None
+            },
+        };
+
+        let mut delta = Vec::with_capacity(updates.len());
+        for (uuid, update) in updates {
+            let updated = match (pair_trie.as_mut(), &update) {
+                (Some(trie), Some(order)) => {
+                    let order_bytes = rmp_serde::to_vec(order).expect("Serialization should never fail");
+                    trie.insert(uuid.as_bytes(), &order_bytes)
+                        .map_err(|e| log::error!("Error {} on insertion to trie. Key {}", e, uuid))
+                        .is_ok()
+                },
+                (Some(trie), None) => trie
+                    .remove(uuid.as_bytes())
+                    .map_err(|e| log::error!("Error {} on removal from trie. Key {}", e, uuid))
+                    .is_ok(),
+                (None, _) => false,
+            };
+
+            let orders_uuid = (uuid, alb_pair.to_owned());
+            match update {
+                Some(order) => {
+                    pubkey_state.orders_uuids.insert(orders_uuid);
+                    if updated {
+                        delta.push((uuid, Some(order.clone())));
+                    }
+                    self.orders.insert_or_update(order);
+                },
+                None => {
+                    pubkey_state.orders_uuids.remove(&orders_uuid);
+                    if updated {
+                        delta.push((uuid, None));
+                    }
+                    self.orders.remove(&uuid);
+                },
+            }
+        }
+        // the trie changes are committed on drop
+        drop(pair_trie);
+
+        if prev_root != H64::default() && !delta.is_empty() {
+            let history = pair_history_mut(&mut pubkey_state.order_pairs_trie_state_history, alb_pair);
+            history.insert_new_diff(prev_root, TrieDiff {
+                delta,
+                next_root: *pair_root,
+            });
+            pubkey_state.evict_history_to_fit(self.history_budget.max_bytes_per_pubkey);
+        }
+    }
+
     fn is_subscribed_to(&self, topic: &str) -> bool { self.topics_subscribed_to.contains_key(topic) }
 
     fn process_keep_alive(
@@ -2162,7 +2512,7 @@ impl Orderbook {
         message: new_protocol::PubkeyKeepAlive,
         i_am_relay: bool,
     ) -> Option<OrdermatchRequest> {
-        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, from_pubkey);
+        let pubkey_state = pubkey_state_mut(&mut self.pubkeys_state, &mut self.pubkeys_expiry, from_pubkey);
 
         let mut trie_roots_to_request = HashMap::new();
         for (alb_pair, trie_root) in message.trie_roots {
@@ -2190,6 +2540,7 @@ impl Orderbook {
 
         if trie_roots_to_request.is_empty() {
             pubkey_state.last_keep_alive = message.timestamp;
+            self.pubkeys_expiry.schedule(from_pubkey.to_owned(), message.timestamp);
             return None;
         }
 
@@ -2199,7 +2550,7 @@ impl Orderbook {
         })
     }
 
-    fn orderbook_item_with_proof(&self, order: OrderbookItem) -> Result<OrderbookItemWithProof, ()> {
+    fn orderbook_item_with_proof(order: OrderbookItem) -> Result<OrderbookItemWithProof, ()> {
         Ok(OrderbookItemWithProof {
             order,
             last_message_payload: vec![],
@@ -2212,8 +2563,16 @@ impl Orderbook {
 struct OrdermatchContext {
     pub my_maker_orders: AsyncMutex<HashMap<Uuid, MakerOrder>>,
     pub my_taker_orders: AsyncMutex<HashMap<Uuid, TakerOrder>>,
+    /// The taker orders scheduled by their timeouts to be processed by the `lp_ordermatch_loop`.
+    pub my_taker_orders_timeouts: PaMutex<DeadlineQueue<Uuid>>,
     pub my_cancelled_orders: AsyncMutex<HashMap<Uuid, MakerOrder>>,
     pub orderbook: AsyncMutex<Orderbook>,
+    /// The latest published version of the orderbook for the readers that shouldn't wait for the `orderbook` mutex.
+    pub orderbook_snapshots: OrderbookSnapshots,
+    /// The encoded responses to the best orders requests of the peers.
+    pub best_orders_cache: PaMutex<BestOrdersCache>,
+    /// The gossiped order updates waiting to be applied to the `orderbook` in a batch.
+    pub orderbook_ingestion: OrderbookIngestion,
     pub order_requests_tracker: AsyncMutex<OrderRequestsTracker>,
     pub inactive_orders: AsyncMutex<HashMap<Uuid, OrderbookItem>>,
 }
@@ -2223,7 +2582,12 @@ impl OrdermatchContext {
     /// Obtains a reference to this crate context, creating it if necessary.
     fn from_ctx(ctx: &MmArc) -> Result<Arc<OrdermatchContext>, String> {
         Ok(try_s!(from_ctx(&ctx.ordermatch_ctx, move || {
-            Ok(OrdermatchContext::default())
+            Ok(OrdermatchContext {
+                orderbook: AsyncMutex::new(Orderbook::with_history_budget(OrderbookHistoryBudget::from_conf(
+                    &ctx.conf,
+                ))),
+                ..Default::default()
+            })
         })))
     }
 
@@ -2421,34 +2785,33 @@ pub async fn lp_ordermatch_loop(ctx: MmArc) {
             let mut my_taker_orders = ordermatch_ctx.my_taker_orders.lock().await;
             let mut my_maker_orders = ordermatch_ctx.my_maker_orders.lock().await;
             let _my_cancelled_orders = ordermatch_ctx.my_cancelled_orders.lock().await;
-            // transform the timed out and unmatched GTC taker orders to maker
-            *my_taker_orders = my_taker_orders
-                .drain()
-                .filter_map(|(uuid, order)| {
-                    if order.created_at + order.timeout * 1000 < now_ms() {
-                        if order.matches.is_empty() && order.order_type == OrderType::GoodTillCancelled {
-                            delete_my_taker_order(&ctx, &order, TakerOrderCancellationReason::ToMaker);
-                            let maker_order: MakerOrder = order.into();
-                            my_maker_orders.insert(uuid, maker_order.clone());
-                            save_my_maker_order(&ctx, &maker_order);
-                            if let Err(e) = update_was_taker_in_db(&ctx, uuid) {
-                                error!("Error {} on order update", e);
-                            }
-                            spawn({
-                                let ctx = ctx.clone();
-                                async move {
-                                    maker_order_created_p2p_notify(ctx, &maker_order).await;
-                                }
-                            });
-                        } else {
-                            delete_my_taker_order(&ctx, &order, TakerOrderCancellationReason::TimedOut);
-                        }
-                        None
-                    } else {
-                        Some((uuid, order))
+            // transform the timed out and unmatched GTC taker orders to maker,
+            // only the orders the timeouts of which are due are popped
+            let timed_out = ordermatch_ctx.my_taker_orders_timeouts.lock().pop_due(now_ms());
+            for uuid in timed_out {
+                // the order could be matched or cancelled already
+                let order = match my_taker_orders.remove(&uuid) {
+                    Some(order) => order,
+                    None => continue,
+                };
+                if order.matches.is_empty() && order.order_type == OrderType::GoodTillCancelled {
+                    delete_my_taker_order(&ctx, &order, TakerOrderCancellationReason::ToMaker);
+                    let maker_order: MakerOrder = order.into();
+                    my_maker_orders.insert(uuid, maker_order.clone());
+                    save_my_maker_order(&ctx, &maker_order);
+                    if let Err(e) = update_was_taker_in_db(&ctx, uuid) {
+                        error!("Error {} on order update", e);
                     }
-                })
-                .collect();
+                    spawn({
+                        let ctx = ctx.clone();
+                        async move {
+                            maker_order_created_p2p_notify(ctx, &maker_order).await;
+                        }
+                    });
+                } else {
+                    delete_my_taker_order(&ctx, &order, TakerOrderCancellationReason::TimedOut);
+                }
+            }
             // remove timed out unfinished matches to unlock the reserved amount
             my_maker_orders.iter_mut().for_each(|(_, order)| {
                 let old_len = order.matches.len();
@@ -2485,18 +2848,20 @@ pub async fn lp_ordermatch_loop(ctx: MmArc) {
             let mut orderbook = ordermatch_ctx.orderbook.lock().await;
             let mut uuids_to_remove = vec![];
             let mut keys_to_remove = vec![];
-            orderbook.pubkeys_state.retain(|pubkey, state| {
-                let to_retain = pubkey == &my_pubsecp || state.last_keep_alive + maker_order_timeout > now_ms() / 1000;
-                if !to_retain {
-                    for (uuid, _) in &state.orders_uuids {
-                        uuids_to_remove.push(*uuid);
-                    }
-                    for root in state.trie_roots.values() {
-                        keys_to_remove.push(*root);
-                    }
+            // only the pubkeys the last keep alive of which is timed out are popped
+            let expired = match (now_ms() / 1000).checked_sub(maker_order_timeout) {
+                Some(last_keep_alive) => orderbook.pubkeys_expiry.pop_due(last_keep_alive),
+                None => Vec::new(),
+            };
+            for pubkey in expired {
+                if pubkey == my_pubsecp {
+                    continue;
                 }
-                to_retain
-            });
+                if let Some(state) = orderbook.pubkeys_state.remove(&pubkey) {
+                    uuids_to_remove.extend(state.orders_uuids.iter().map(|(uuid, _)| *uuid));
+                    keys_to_remove.extend(state.trie_roots.values().copied());
+                }
+            }
             for uuid in uuids_to_remove {
                 orderbook.remove_order(uuid);
             }
@@ -2504,27 +2869,38 @@ pub async fn lp_ordermatch_loop(ctx: MmArc) {
             for key in keys_to_remove {
                 orderbook.memory_db.remove_and_purge(&key, EMPTY_PREFIX);
             }
+            orderbook.evict_history_to_fit_budget();
+            orderbook.purge_unreachable_trie_nodes();
+            ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
 
             collect_orderbook_metrics(&ctx, &orderbook);
         }
 
         {
+            // our maker orders are matched against the orderbook under a single lock, only the missing ones
+            // (e.g. removed on a keep-alive timeout) are broadcasted again
             let my_maker_orders = ordermatch_ctx.my_maker_orders.lock().await;
-            for (uuid, order) in my_maker_orders.iter() {
-                if !ordermatch_ctx.orderbook.lock().await.order_set.contains_key(uuid) {
-                    if let Ok(Some(_)) = lp_coinfind(&ctx, &order.base).await {
-                        if let Ok(Some(_)) = lp_coinfind(&ctx, &order.rel).await {
-                            let topic = orderbook_topic_from_base_rel(&order.base, &order.rel);
-                            if !ordermatch_ctx.orderbook.lock().await.is_subscribed_to(&topic) {
-                                let request_orderbook = false;
-                                if let Err(e) =
-                                    subscribe_to_orderbook_topic(&ctx, &order.base, &order.rel, request_orderbook).await
-                                {
-                                    log::error!("Error {} on subscribing to orderbook topic {}", e, topic);
-                                }
+            let missing: Vec<&MakerOrder> = {
+                let orderbook = ordermatch_ctx.orderbook.lock().await;
+                my_maker_orders
+                    .iter()
+                    .filter(|(uuid, _)| !orderbook.orders.contains(uuid))
+                    .map(|(_, order)| order)
+                    .collect()
+            };
+            for order in missing {
+                if let Ok(Some(_)) = lp_coinfind(&ctx, &order.base).await {
+                    if let Ok(Some(_)) = lp_coinfind(&ctx, &order.rel).await {
+                        let topic = orderbook_topic_from_base_rel(&order.base, &order.rel);
+                        if !ordermatch_ctx.orderbook.lock().await.is_subscribed_to(&topic) {
+                            let request_orderbook = false;
+                            if let Err(e) =
+                                subscribe_to_orderbook_topic(&ctx, &order.base, &order.rel, request_orderbook).await
+                            {
+                                log::error!("Error {} on subscribing to orderbook topic {}", e, topic);
                             }
-                            maker_order_created_p2p_notify(ctx.clone(), order).await;
                         }
+                        maker_order_created_p2p_notify(ctx.clone(), order).await;
                     }
                 }
             }
@@ -2888,6 +3264,7 @@ pub async fn lp_auto_buy(
     rel_coin: &MmCoinEnum,
     input: AutoBuyInput,
 ) -> Result<String, String> {
+    let _span = trace_span!("lp_auto_buy");
     if input.price < MmNumber::from(BigRational::new(1.into(), 100_000_000.into())) {
         return ERR!("Price is too low, minimum is 0.00000001");
     }
@@ -2900,7 +3277,9 @@ pub async fn lp_auto_buy(
     let request_orderbook = false;
     try_s!(subscribe_to_orderbook_topic(&ctx, &input.base, &input.rel, request_orderbook).await);
     let ordermatch_ctx = try_s!(OrdermatchContext::from_ctx(&ctx));
+    let lock_span = trace_span!("my_taker_orders_lock");
     let mut my_taker_orders = ordermatch_ctx.my_taker_orders.lock().await;
+    drop(lock_span);
     let our_public_id = try_s!(ctx.public_id());
     let rel_volume = &input.volume * &input.price;
     let conf_settings = OrderConfirmationsSettings {
@@ -2934,6 +3313,10 @@ pub async fn lp_auto_buy(
         min_volume: order.min_volume.clone().into(),
     } });
     save_my_new_taker_order(ctx, &order);
+    ordermatch_ctx
+        .my_taker_orders_timeouts
+        .lock()
+        .schedule(order.request.uuid, order.timed_out_at());
     my_taker_orders.insert(order.request.uuid, order);
     Ok(result.to_string())
 }
@@ -4066,6 +4449,10 @@ pub async fn orders_kick_start(ctx: &MmArc) -> Result<HashSet<String>, String> {
         if let Ok(order) = json::from_slice::<TakerOrder>(&slurp(&entry.path())) {
             coins.insert(order.request.base.clone());
             coins.insert(order.request.rel.clone());
+            ordermatch_ctx
+                .my_taker_orders_timeouts
+                .lock()
+                .schedule(order.request.uuid, order.timed_out_at());
             taker_orders.insert(order.request.uuid, order);
         }
     });
@@ -4200,11 +4587,14 @@ pub(self) async fn subscribe_to_orderbook_topic(
     rel: &str,
     request_orderbook: bool,
 ) -> Result<(), String> {
+    let _span = trace_span!("subscribe_to_orderbook_topic", "{}/{}", base, rel);
     let current_timestamp = now_ms() / 1000;
     let topic = orderbook_topic_from_base_rel(base, rel);
     let is_orderbook_filled = {
         let ordermatch_ctx = try_s!(OrdermatchContext::from_ctx(ctx));
+        let lock_span = trace_span!("orderbook_lock");
         let mut orderbook = ordermatch_ctx.orderbook.lock().await;
+        drop(lock_span);
 
         match orderbook.topics_subscribed_to.entry(topic.clone()) {
             Entry::Vacant(e) => {
@@ -4227,7 +4617,7 @@ pub(self) async fn subscribe_to_orderbook_topic(
                     // We are subscribed to the topic. Also we didn't request the orderbook,
                     // but enough time has passed for the orderbook to fill by OrdermatchRequest::SyncPubkeyOrderbookState.
                     true
-                }
+                },
                 OrderbookRequestingState::NotRequested { .. } => {
                     // We are subscribed to the topic. Also we didn't request the orderbook,
                     // and the orderbook has not filled up yet.
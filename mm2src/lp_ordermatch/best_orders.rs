@@ -1,16 +1,17 @@
-use super::{OrderbookItemWithProof, OrdermatchContext, OrdermatchRequest};
+use super::pair_tree::VolumeIn;
+use super::{Orderbook, OrderbookItemWithProof, OrdermatchContext, OrdermatchRequest};
 use crate::mm2::lp_network::{request_any_relay, P2PRequest};
 use coins::{address_by_coin_conf_and_pubkey_str, coin_conf, is_wallet_only_conf, is_wallet_only_ticker};
 use common::log;
+use common::lru_cache::LruCache;
 use common::mm_ctx::MmArc;
 use common::mm_number::MmNumber;
 use http::Response;
 use num_rational::BigRational;
-use num_traits::Zero;
 use serde_json::{self as json, Value as Json};
 use std::collections::HashMap;
 
-#[derive(Clone, Copy, Debug, Deserialize, Eq, PartialEq, Serialize)]
+#[derive(Clone, Copy, Debug, Deserialize, Eq, Hash, PartialEq, Serialize)]
 #[serde(rename_all = "lowercase")]
 pub enum BestOrdersAction {
     Buy,
@@ -25,8 +26,43 @@ struct BestOrdersRequest {
 }
 
 #[derive(Debug, Deserialize, Serialize)]
-struct BestOrdersRes {
-    orders: HashMap<String, Vec<OrderbookItemWithProof>>,
+pub struct BestOrdersRes {
+    pub orders: HashMap<String, Vec<OrderbookItemWithProof>>,
+}
+
+/// The number of the encoded best orders responses cached by the relay.
+const MAX_CACHED_BEST_ORDERS: usize = 1000;
+
+struct CachedBestOrders {
+    /// The [`super::orderbook_snapshot::CoinPairs::epoch`] the response is computed at.
+    version: u64,
+    encoded: Vec<u8>,
+}
+
+/// The encoded responses to the identical best orders requests, valid until the pairs of the coin are changed.
+pub struct BestOrdersCache {
+    responses: LruCache<(String, BestOrdersAction, BigRational), CachedBestOrders>,
+}
+
+impl Default for BestOrdersCache {
+    fn default() -> Self {
+        BestOrdersCache {
+            responses: LruCache::new(MAX_CACHED_BEST_ORDERS),
+        }
+    }
+}
+
+impl BestOrdersCache {
+    fn get(&mut self, key: &(String, BestOrdersAction, BigRational), version: u64) -> Option<Vec<u8>> {
+        self.responses
+            .get(key)
+            .filter(|cached| cached.version == version)
+            .map(|cached| cached.encoded.clone())
+    }
+
+    fn insert(&mut self, key: (String, BestOrdersAction, BigRational), version: u64, encoded: Vec<u8>) {
+        self.responses.insert(key, CachedBestOrders { version, encoded });
+    }
 }
 
 pub async fn process_best_orders_p2p_request(
@@ -36,71 +72,40 @@ pub async fn process_best_orders_p2p_request(
     required_volume: BigRational,
 ) -> Result<Option<Vec<u8>>, String> {
     let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).expect("ordermatch_ctx must exist at this point");
-    let orderbook = ordermatch_ctx.orderbook.lock().await;
-    let search_pairs_in = match action {
-        BestOrdersAction::Buy => &orderbook.pairs_existing_for_base,
-        BestOrdersAction::Sell => &orderbook.pairs_existing_for_rel,
+    let orderbook = ordermatch_ctx.orderbook_snapshots.latest();
+    let (pairs, volume_in) = match action {
+        BestOrdersAction::Buy => (orderbook.base_pairs(&coin), VolumeIn::Base),
+        BestOrdersAction::Sell => (orderbook.rel_pairs(&coin), VolumeIn::Rel),
     };
-    let tickers = match search_pairs_in.get(&coin) {
-        Some(tickers) => tickers,
+    let pairs = match pairs {
+        Some(pairs) => pairs,
         None => return Ok(None),
     };
+
+    let version = pairs.epoch();
+    let cache_key = (coin, action, required_volume);
+    if let Some(encoded) = ordermatch_ctx.best_orders_cache.lock().get(&cache_key, version) {
+        return Ok(Some(encoded));
+    }
+    let required_volume = &cache_key.2;
+
     let mut result = HashMap::new();
-    let pairs = tickers.iter().map(|ticker| match action {
-        BestOrdersAction::Buy => (coin.clone(), ticker.clone()),
-        BestOrdersAction::Sell => (ticker.clone(), coin.clone()),
-    });
-    for pair in pairs {
-        let orders = match orderbook.ordered.get(&pair) {
-            Some(orders) => orders,
-            None => {
-                log::warn!("No orders for pair {:?}", pair);
-                continue;
-            },
-        };
+    for (ticker, pair) in pairs.iter() {
         let mut best_orders = vec![];
-        let mut collected_volume = BigRational::zero();
-        for ordered in orders {
-            match orderbook.order_set.get(&ordered.uuid) {
-                Some(o) => {
-                    let min_volume = match action {
-                        BestOrdersAction::Buy => o.min_volume.clone(),
-                        BestOrdersAction::Sell => &o.min_volume * &o.price,
-                    };
-                    if min_volume > required_volume {
-                        log::debug!("Order {} min_vol {:?} > {:?}", o.uuid, min_volume, required_volume);
-                        continue;
-                    }
-
-                    let max_volume = match action {
-                        BestOrdersAction::Buy => o.max_volume.clone(),
-                        BestOrdersAction::Sell => &o.max_volume * &o.price,
-                    };
-                    match orderbook.orderbook_item_with_proof(o.clone()) {
-                        Ok(order_w_proof) => best_orders.push(order_w_proof),
-                        Err(e) => {
-                            log::error!("Error {:?} on proof generation for order {:?}", e, o);
-                            continue;
-                        },
-                    };
-                    collected_volume += max_volume;
-                    if collected_volume >= required_volume {
-                        break;
-                    }
-                },
-                None => {
-                    log::warn!("No order with uuid {:?}", ordered.uuid);
-                    continue;
-                },
+        for o in pair.orders().covering_orders(volume_in, required_volume) {
+            match Orderbook::orderbook_item_with_proof(o.clone()) {
+                Ok(order_w_proof) => best_orders.push(order_w_proof),
+                Err(e) => log::error!("Error {:?} on proof generation for order {:?}", e, o),
             };
         }
-        match action {
-            BestOrdersAction::Buy => result.insert(pair.1, best_orders),
-            BestOrdersAction::Sell => result.insert(pair.0, best_orders),
-        };
+        result.insert(ticker.to_owned(), best_orders);
     }
     let response = BestOrdersRes { orders: result };
     let encoded = rmp_serde::to_vec(&response).expect("rmp_serde::to_vec should not fail here");
+    ordermatch_ctx
+        .best_orders_cache
+        .lock()
+        .insert(cache_key, version, encoded.clone());
     Ok(Some(encoded))
 }
 
@@ -0,0 +1,333 @@
+//! The compact encoding of the `GetOrderbook` responses sent to the peers requesting over `/request-response/2`.
+//!
+//! The tickers and the pubkeys are written once per response into the dictionaries, and the orders refer to them
+//! by index. The integers, the numerators and the denominators of the rationals are LEB128 varints,
+//! so a typical order takes a few dozen bytes instead of repeating the tickers, the pubkey and the `BigInt` digits.
+//!
+//! The orders are encoded once per pair version and cached by the relays,
+//! while the pubkeys dictionary carrying the `last_keep_alive` timestamps is encoded on every response.
+//!
+//! The response starts with the [`COMPACT_ORDERBOOK_MARKER`] byte that is never used by MessagePack,
+//! so the requester tells it from the plain `rmp_serde` encoded [`GetOrderbookRes`] of the older relays.
+
+use super::{GetOrderbookPubkeyItem, GetOrderbookRes, OrderbookItem, OrderbookPubkeyState};
+use common::mm_number::{BigInt, Sign};
+use num_rational::BigRational;
+use num_traits::Zero;
+use std::collections::HashMap;
+use std::convert::TryInto;
+use uuid::Uuid;
+
+/// The byte MessagePack never uses, see https://github.com/msgpack/msgpack/blob/master/spec.md#formats
+pub const COMPACT_ORDERBOOK_MARKER: u8 = 0xc1;
+const COMPACT_ORDERBOOK_VERSION: u8 = 1;
+/// The radix of the LEB128 digits.
+const VARINT_RADIX: u32 = 128;
+const VARINT_CONTINUATION: u8 = 0x80;
+
+fn write_u64(buf: &mut Vec<u8>, mut value: u64) {
+    while value >= VARINT_RADIX as u64 {
+        buf.push(value as u8 | VARINT_CONTINUATION);
+        value >>= 7;
+    }
+    buf.push(value as u8);
+}
+
+fn write_bytes(buf: &mut Vec<u8>, bytes: &[u8]) {
+    write_u64(buf, bytes.len() as u64);
+    buf.extend_from_slice(bytes);
+}
+
+/// Writes the zigzag encoded `value`, so the sign takes the lowest bit.
+fn write_big_int(buf: &mut Vec<u8>, value: &BigInt) {
+    let negative = value.sign() == Sign::Minus;
+    let magnitude = if negative { -value } else { value.clone() };
+    let zigzag = (magnitude << 1) + BigInt::from(negative as u8);
+    let (_sign, digits) = zigzag.to_radix_le(VARINT_RADIX);
+    let last = digits.len() - 1;
+    for (idx, digit) in digits.into_iter().enumerate() {
+        if idx == last {
+            buf.push(digit);
+        } else {
+            buf.push(digit | VARINT_CONTINUATION);
+        }
+    }
+}
+
+fn write_rational(buf: &mut Vec<u8>, value: &BigRational) {
+    write_big_int(buf, value.numer());
+    write_big_int(buf, value.denom());
+}
+
+struct Reader<'a> {
+    buf: &'a [u8],
+}
+
+impl<'a> Reader<'a> {
+    fn read_byte(&mut self) -> Result<u8, String> {
+        let (byte, rest) = self
+            .buf
+            .split_first()
+            .ok_or("Unexpected end of the compact orderbook")?;
+        self.buf = rest;
+        Ok(*byte)
+    }
+
+    fn read_slice(&mut self, len: usize) -> Result<&'a [u8], String> {
+        if self.buf.len() < len {
+            return ERR!("Unexpected end of the compact orderbook");
+        }
+        let (slice, rest) = self.buf.split_at(len);
+        self.buf = rest;
+        Ok(slice)
+    }
+
+    /// Returns the LEB128 digits without the continuation bits.
+    fn read_digits(&mut self) -> Result<Vec<u8>, String> {
+        let mut digits = Vec::new();
+        loop {
+            let byte = try_s!(self.read_byte());
+            digits.push(byte & !VARINT_CONTINUATION);
+            if byte & VARINT_CONTINUATION == 0 {
+                return Ok(digits);
+            }
+        }
+    }
+
+    fn read_u64(&mut self) -> Result<u64, String> {
+        let digits = try_s!(self.read_digits());
+        // the 10th digit can carry the highest bit only
+        if digits.len() > 10 || (digits.len() == 10 && digits[9] > 1) {
+            return ERR!("Varint overflows u64");
+        }
+        Ok(digits.iter().rev().fold(0, |value, digit| (value << 7) | *digit as u64))
+    }
+
+    fn read_usize(&mut self) -> Result<usize, String> {
+        let value = try_s!(self.read_u64());
+        Ok(try_s!(value.try_into()))
+    }
+
+    fn read_bytes(&mut self) -> Result<&'a [u8], String> {
+        let len = try_s!(self.read_usize());
+        self.read_slice(len)
+    }
+
+    fn read_string(&mut self) -> Result<String, String> {
+        let bytes = try_s!(self.read_bytes());
+        Ok(try_s!(String::from_utf8(bytes.to_vec())))
+    }
+
+    fn read_big_int(&mut self) -> Result<BigInt, String> {
+        let digits = try_s!(self.read_digits());
+        let negative = digits[0] & 1 == 1;
+        let zigzag = try_s!(BigInt::from_radix_le(Sign::Plus, &digits, VARINT_RADIX).ok_or("Invalid varint digits"));
+        let magnitude = zigzag >> 1;
+        Ok(if negative { -magnitude } else { magnitude })
+    }
+
+    fn read_rational(&mut self) -> Result<BigRational, String> {
+        let numer = try_s!(self.read_big_int());
+        let denom = try_s!(self.read_big_int());
+        if denom.is_zero() {
+            return ERR!("Zero denominator");
+        }
+        Ok(BigRational::new(numer, denom))
+    }
+
+    /// Returns the element of the `dictionary` referred by the next varint index.
+    fn read_index<'d, T>(&mut self, dictionary: &'d [T]) -> Result<&'d T, String> {
+        let idx = try_s!(self.read_usize());
+        dictionary
+            .get(idx)
+            .ok_or_else(|| ERRL!("Index {} is out of the dictionary of {}", idx, dictionary.len()))
+    }
+}
+
+/// Interns the strings of the dictionary to their indexes.
+#[derive(Default)]
+struct Dictionary<'a> {
+    indexes: HashMap<&'a str, u64>,
+    values: Vec<&'a str>,
+}
+
+impl<'a> Dictionary<'a> {
+    fn index(&mut self, value: &'a str) -> u64 {
+        let values = &mut self.values;
+        *self.indexes.entry(value).or_insert_with(|| {
+            values.push(value);
+            values.len() as u64 - 1
+        })
+    }
+}
+
+/// The compact encoded orders of a pair, cached by the relays until the pair orders change.
+pub struct CompactPairOrders {
+    /// The pubkeys the `encoded` orders refer to by index.
+    pubkeys: Vec<String>,
+    /// The tickers dictionary and the orders.
+    encoded: Vec<u8>,
+}
+
+impl CompactPairOrders {
+    pub fn new<'a>(orders: impl Iterator<Item = &'a OrderbookItem>) -> CompactPairOrders {
+        let mut pubkeys = Dictionary::default();
+        let mut tickers = Dictionary::default();
+        let mut encoded_orders = Vec::new();
+        let mut orders_number = 0;
+        for order in orders {
+            orders_number += 1;
+            write_u64(&mut encoded_orders, pubkeys.index(&order.pubkey));
+            write_u64(&mut encoded_orders, tickers.index(&order.base));
+            write_u64(&mut encoded_orders, tickers.index(&order.rel));
+            write_rational(&mut encoded_orders, &order.price);
+            write_rational(&mut encoded_orders, &order.max_volume);
+            write_rational(&mut encoded_orders, &order.min_volume);
+            encoded_orders.extend_from_slice(order.uuid.as_bytes());
+            write_u64(&mut encoded_orders, order.created_at);
+        }
+
+        let mut encoded = Vec::with_capacity(encoded_orders.len() + 64);
+        write_u64(&mut encoded, tickers.values.len() as u64);
+        for ticker in tickers.values {
+            write_bytes(&mut encoded, ticker.as_bytes());
+        }
+        write_u64(&mut encoded, orders_number);
+        encoded.extend_from_slice(&encoded_orders);
+
+        CompactPairOrders {
+            pubkeys: pubkeys.values.into_iter().map(str::to_owned).collect(),
+            encoded,
+        }
+    }
+
+    /// Encodes the response with the latest `last_keep_alive` timestamps of the pubkeys.
+    pub fn encode_response(&self, pubkeys_state: &HashMap<String, OrderbookPubkeyState>) -> Result<Vec<u8>, String> {
+        let mut response = Vec::with_capacity(self.encoded.len() + self.pubkeys.len() * 80 + 2);
+        response.push(COMPACT_ORDERBOOK_MARKER);
+        response.push(COMPACT_ORDERBOOK_VERSION);
+        write_u64(&mut response, self.pubkeys.len() as u64);
+        for pubkey in self.pubkeys.iter() {
+            let pubkey_state = try_s!(pubkeys_state.get(pubkey).ok_or(ERRL!(
+                "Orderbook::pubkeys_state is expected to contain the {:?} pubkey",
+                pubkey
+            )));
+            write_bytes(&mut response, pubkey.as_bytes());
+            write_u64(&mut response, pubkey_state.last_keep_alive);
+            // TODO save last signed payload to pubkey state
+            write_bytes(&mut response, &[]);
+        }
+        response.extend_from_slice(&self.encoded);
+        Ok(response)
+    }
+}
+
+pub fn is_compact_response(encoded: &[u8]) -> bool { encoded.first() == Some(&COMPACT_ORDERBOOK_MARKER) }
+
+pub fn decode_compact_response(encoded: &[u8]) -> Result<GetOrderbookRes, String> {
+    let mut reader = Reader { buf: encoded };
+    if try_s!(reader.read_byte()) != COMPACT_ORDERBOOK_MARKER {
+        return ERR!("The response is not a compact orderbook");
+    }
+    let version = try_s!(reader.read_byte());
+    if version != COMPACT_ORDERBOOK_VERSION {
+        return ERR!("Unsupported compact orderbook version {}", version);
+    }
+
+    let pubkeys_number = try_s!(reader.read_usize());
+    let mut pubkeys = Vec::new();
+    let mut pubkey_orders = HashMap::new();
+    for _ in 0..pubkeys_number {
+        let pubkey = try_s!(reader.read_string());
+        let item = GetOrderbookPubkeyItem {
+            last_keep_alive: try_s!(reader.read_u64()),
+            last_signed_pubkey_payload: try_s!(reader.read_bytes()).to_vec(),
+            orders: Vec::new(),
+        };
+        pubkey_orders.insert(pubkey.clone(), item);
+        pubkeys.push(pubkey);
+    }
+
+    let tickers_number = try_s!(reader.read_usize());
+    let mut tickers = Vec::new();
+    for _ in 0..tickers_number {
+        tickers.push(try_s!(reader.read_string()));
+    }
+
+    let orders_number = try_s!(reader.read_usize());
+    for _ in 0..orders_number {
+        let pubkey = try_s!(reader.read_index(&pubkeys));
+        let order = OrderbookItem {
+            pubkey: pubkey.clone(),
+            base: try_s!(reader.read_index(&tickers)).clone(),
+            rel: try_s!(reader.read_index(&tickers)).clone(),
+            price: try_s!(reader.read_rational()),
+            max_volume: try_s!(reader.read_rational()),
+            min_volume: try_s!(reader.read_rational()),
+            uuid: try_s!(Uuid::from_slice(try_s!(reader.read_slice(16)))),
+            created_at: try_s!(reader.read_u64()),
+        };
+        let item = pubkey_orders
+            .get_mut(pubkey)
+            .expect("the pubkey is read from the dictionary");
+        item.orders.push((order.uuid, order));
+    }
+
+    if !reader.buf.is_empty() {
+        return ERR!("{} trailing bytes after the compact orderbook", reader.buf.len());
+    }
+    Ok(GetOrderbookRes { pubkey_orders })
+}
+
+#[cfg(test)]
+mod compact_orderbook_tests {
+    use super::*;
+
+    fn int(n: i64) -> BigInt { BigInt::from(n) }
+
+    #[test]
+    fn test_varints() {
+        for value in &[0, 1, 127, 128, 300, u32::MAX as u64, u64::MAX] {
+            let mut buf = Vec::new();
+            write_u64(&mut buf, *value);
+            let mut reader = Reader { buf: &buf };
+            assert_eq!(reader.read_u64().unwrap(), *value);
+            assert!(reader.buf.is_empty());
+        }
+        let mut small = Vec::new();
+        write_u64(&mut small, 127);
+        assert_eq!(small.len(), 1);
+
+        let huge = int(i64::MAX) * int(i64::MAX) * int(7);
+        for value in &[
+            int(0),
+            int(1),
+            int(-1),
+            int(63),
+            int(64),
+            int(-64),
+            int(-65),
+            huge.clone(),
+            -huge,
+        ] {
+            let mut buf = Vec::new();
+            write_big_int(&mut buf, value);
+            let mut reader = Reader { buf: &buf };
+            assert_eq!(&reader.read_big_int().unwrap(), value);
+            assert!(reader.buf.is_empty());
+        }
+
+        // the 11 digits overflow u64
+        let overflow = [0xff; 10].iter().copied().chain(Some(1)).collect::<Vec<_>>();
+        assert!(Reader { buf: &overflow }.read_u64().is_err());
+        assert!(Reader { buf: &[0x80] }.read_u64().is_err());
+    }
+
+    #[test]
+    fn test_rational_zero_denominator() {
+        let mut buf = Vec::new();
+        write_big_int(&mut buf, &int(1));
+        write_big_int(&mut buf, &int(0));
+        assert!(Reader { buf: &buf }.read_rational().is_err());
+    }
+}
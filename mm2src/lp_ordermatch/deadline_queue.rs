@@ -0,0 +1,96 @@
+//! The keys scheduled by their deadlines, so the periodic expiration processes only the keys that are due
+//! instead of scanning the whole state, e.g. the thousands of the maker pubkeys a seed node watches.
+//!
+//! The deadline of a key is usually postponed (every keep-alive of a pubkey postpones its expiration),
+//! so it's not pushed to the heap again while its queued entry precedes it: the entry is rescheduled once it's popped.
+
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap};
+use std::hash::Hash;
+
+pub struct DeadlineQueue<K> {
+    /// The actual deadlines of the keys.
+    deadlines: HashMap<K, u64>,
+    /// Every key of the `deadlines` has an entry here preceding or equal to its actual deadline.
+    /// The entries of the removed keys are skipped once popped.
+    queue: BinaryHeap<Reverse<(u64, K)>>,
+}
+
+impl<K: Clone + Eq + Hash + Ord> Default for DeadlineQueue<K> {
+    fn default() -> Self {
+        DeadlineQueue {
+            deadlines: HashMap::new(),
+            queue: BinaryHeap::new(),
+        }
+    }
+}
+
+impl<K: Clone + Eq + Hash + Ord> DeadlineQueue<K> {
+    /// Schedules the `key` to be due at the `deadline` replacing its previous deadline.
+    pub fn schedule(&mut self, key: K, deadline: u64) {
+        match self.deadlines.insert(key.clone(), deadline) {
+            // the queued entry precedes the new deadline
+            Some(previous) if previous <= deadline => (),
+            _ => self.queue.push(Reverse((deadline, key))),
+        }
+    }
+
+    pub fn remove(&mut self, key: &K) { self.deadlines.remove(key); }
+
+    pub fn len(&self) -> usize { self.deadlines.len() }
+
+    /// Removes and returns the keys the deadlines of which are not later than the `now`.
+    pub fn pop_due(&mut self, now: u64) -> Vec<K> {
+        let mut due = Vec::new();
+        while let Some(Reverse((queued, _))) = self.queue.peek() {
+            if *queued > now {
+                break;
+            }
+            let Reverse((queued, key)) = self.queue.pop().expect("The queue is not empty");
+            match self.deadlines.get(&key) {
+                Some(deadline) if *deadline <= now => {
+                    self.deadlines.remove(&key);
+                    due.push(key);
+                },
+                // the deadline is postponed, the entry is queued again unless there is a later entry of the key already
+                Some(deadline) if *deadline > queued => {
+                    let deadline = *deadline;
+                    self.queue.push(Reverse((deadline, key)));
+                },
+                // the key is removed or the entry is a duplicate
+                _ => (),
+            }
+        }
+        due
+    }
+}
+
+#[cfg(test)]
+mod deadline_queue_tests {
+    use super::*;
+
+    #[test]
+    fn test_deadline_queue() {
+        let mut queue = DeadlineQueue::default();
+        queue.schedule("first", 10);
+        queue.schedule("second", 20);
+        queue.schedule("third", 30);
+        assert_eq!(queue.pop_due(5), Vec::<&str>::new());
+
+        // the first is postponed, the second is removed
+        queue.schedule("first", 25);
+        queue.remove(&"second");
+        assert_eq!(queue.pop_due(20), Vec::<&str>::new());
+        assert_eq!(queue.len(), 2);
+        assert_eq!(queue.pop_due(25), vec!["first"]);
+
+        // the third is brought forward
+        queue.schedule("third", 15);
+        queue.schedule("fourth", 30);
+        assert_eq!(queue.pop_due(15), vec!["third"]);
+        // the stale entry of the third is skipped
+        assert_eq!(queue.pop_due(30), vec!["fourth"]);
+        assert_eq!(queue.len(), 0);
+        assert!(queue.queue.is_empty());
+    }
+}
@@ -45,31 +45,23 @@ pub async fn orderbook_depth_rpc(ctx: MmArc, req: Json) -> Result<Response<Vec<u
     let mut result = Vec::with_capacity(req.pairs.len());
 
     let orderbook = ordermatch_ctx.orderbook.lock().await;
-
-    // the Iter::filter uses &Self::Item, which is undesirable, we need owned pair
-    #[allow(clippy::unnecessary_filter_map)]
-    let to_request_from_relay: Vec<_> = req
+    let (subscribed, to_request_from_relay): (Vec<_>, Vec<_>) = req
         .pairs
         .into_iter()
-        .filter_map(|pair| {
-            let topic = orderbook_topic_from_base_rel(&pair.0, &pair.1);
-            if orderbook.is_subscribed_to(&topic) {
-                let asks = orderbook.unordered.get(&pair).map_or(0, |orders| orders.len());
-                let reversed = (pair.1.clone(), pair.0.clone());
-                let bids = orderbook.unordered.get(&reversed).map_or(0, |orders| orders.len());
-                result.push(PairWithDepth {
-                    pair,
-                    depth: PairDepth { asks, bids },
-                });
-                None
-            } else {
-                Some(pair)
-            }
-        })
-        .collect();
-
-    // avoid locking orderbook for long time during P2P request
+        .partition(|pair| orderbook.is_subscribed_to(&orderbook_topic_from_base_rel(&pair.0, &pair.1)));
+    // the orders are read from the snapshot to avoid locking orderbook for long time
     drop(orderbook);
+
+    let snapshot = ordermatch_ctx.orderbook_snapshots.latest();
+    for pair in subscribed {
+        let asks = snapshot.pair_len(&pair.0, &pair.1);
+        let bids = snapshot.pair_len(&pair.1, &pair.0);
+        result.push(PairWithDepth {
+            pair,
+            depth: PairDepth { asks, bids },
+        });
+    }
+
     if !to_request_from_relay.is_empty() {
         let p2p_request = OrdermatchRequest::OrderbookDepth {
             pairs: to_request_from_relay,
@@ -97,13 +89,12 @@ pub async fn process_orderbook_depth_p2p_request(
     pairs: Vec<(String, String)>,
 ) -> Result<Option<Vec<u8>>, String> {
     let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).expect("ordermatch_ctx must exist at this point");
-    let orderbook = ordermatch_ctx.orderbook.lock().await;
+    let orderbook = ordermatch_ctx.orderbook_snapshots.latest();
     let depth = pairs
         .into_iter()
         .map(|pair| {
-            let asks = orderbook.unordered.get(&pair).map_or(0, |orders| orders.len());
-            let reversed = (pair.1.clone(), pair.0.clone());
-            let bids = orderbook.unordered.get(&reversed).map_or(0, |orders| orders.len());
+            let asks = orderbook.pair_len(&pair.0, &pair.1);
+            let bids = orderbook.pair_len(&pair.1, &pair.0);
             (pair, PairDepth { asks, bids })
         })
         .collect();
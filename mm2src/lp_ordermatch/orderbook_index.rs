@@ -0,0 +1,403 @@
+//! The in-memory storage of the orderbook orders.
+//!
+//! Tickers are interned to small integer ids, so the per-pair maps are keyed by a pair of `u32`
+//! instead of a pair of `String`s, and inserting or updating an order of already known pair doesn't allocate
+//! new strings. The orders are stored in a slab and referenced by compact handles.
+//! Each pair keeps a map of handles ordered by price then uuid, so the best prices can be walked
+//! in order without any lookups by uuid and without cloning the [`OrderbookItem`]s,
+//! and an order is inserted or removed in `O(log n)` regardless of the pair depth.
+
+use super::OrderbookItem;
+use num_rational::BigRational;
+use std::collections::hash_map::{HashMap, RawEntryMut};
+use std::collections::{BTreeMap, HashSet};
+use uuid::Uuid;
+
+/// Compact identifier of an interned ticker.
+#[derive(Clone, Copy, Debug, Eq, Hash, Ord, PartialEq, PartialOrd)]
+struct TickerId(u32);
+
+/// Compact handle of an order stored in the [`OrderSlab`].
+#[derive(Clone, Copy, Debug, Eq, Hash, PartialEq)]
+struct OrderHandle(u32);
+
+/// The (base, rel) pair of interned tickers.
+type PairKey = (TickerId, TickerId);
+
+/// The position of an order within its pair.
+type LevelKey = (BigRational, Uuid);
+
+fn level_key(order: &OrderbookItem) -> LevelKey { (order.price.clone(), order.uuid) }
+
+/// Maps tickers to [`TickerId`]s and back.
+/// The set of tickers is small and bounded by the coins config, so the interned tickers are never released.
+#[derive(Default)]
+struct TickerInterner {
+    ids: HashMap<String, TickerId>,
+    names: Vec<String>,
+}
+
+impl TickerInterner {
+    /// Returns the id of the `ticker`, allocating a new one only if the ticker is seen the first time.
+    fn intern(&mut self, ticker: &str) -> TickerId {
+        match self.ids.raw_entry_mut().from_key(ticker) {
+            RawEntryMut::Occupied(e) => *e.get(),
+            RawEntryMut::Vacant(e) => {
+                let id = TickerId(self.names.len() as u32);
+                self.names.push(ticker.to_owned());
+                e.insert(ticker.to_owned(), id);
+                id
+            },
+        }
+    }
+
+    fn get(&self, ticker: &str) -> Option<TickerId> { self.ids.get(ticker).copied() }
+
+    fn name(&self, id: TickerId) -> &str { &self.names[id.0 as usize] }
+}
+
+struct SlabEntry {
+    order: OrderbookItem,
+    pair: PairKey,
+}
+
+/// The arena of orders, vacant slots are reused by the next insertions.
+#[derive(Default)]
+struct OrderSlab {
+    entries: Vec<Option<SlabEntry>>,
+    vacant: Vec<u32>,
+}
+
+impl OrderSlab {
+    fn insert(&mut self, entry: SlabEntry) -> OrderHandle {
+        match self.vacant.pop() {
+            Some(idx) => {
+                self.entries[idx as usize] = Some(entry);
+                OrderHandle(idx)
+            },
+            None => {
+                self.entries.push(Some(entry));
+                OrderHandle((self.entries.len() - 1) as u32)
+            },
+        }
+    }
+
+    fn remove(&mut self, handle: OrderHandle) -> Option<SlabEntry> {
+        let entry = self.entries.get_mut(handle.0 as usize)?.take();
+        if entry.is_some() {
+            self.vacant.push(handle.0);
+        }
+        entry
+    }
+
+    fn get(&self, handle: OrderHandle) -> &SlabEntry {
+        self.entries
+            .get(handle.0 as usize)
+            .and_then(Option::as_ref)
+            .expect("OrderbookIndex contains a handle that is not in OrderSlab")
+    }
+
+    fn get_mut(&mut self, handle: OrderHandle) -> &mut SlabEntry {
+        self.entries
+            .get_mut(handle.0 as usize)
+            .and_then(Option::as_mut)
+            .expect("OrderbookIndex contains a handle that is not in OrderSlab")
+    }
+}
+
+#[derive(Default)]
+pub struct OrderbookIndex {
+    tickers: TickerInterner,
+    slab: OrderSlab,
+    handles: HashMap<Uuid, OrderHandle>,
+    /// A map from (base, rel) to the order handles ordered by price then uuid.
+    pairs: HashMap<PairKey, BTreeMap<LevelKey, OrderHandle>>,
+    /// A map from base ticker to the set of another tickers to track the existing pairs
+    pairs_existing_for_base: HashMap<TickerId, HashSet<TickerId>>,
+    /// A map from rel ticker to the set of another tickers to track the existing pairs
+    pairs_existing_for_rel: HashMap<TickerId, HashSet<TickerId>>,
+    /// The orders changed since the last [`OrderbookIndex::take_changed_pairs`] call.
+    changed_pairs: HashMap<PairKey, HashMap<Uuid, OrderChange>>,
+    /// The number of the changes of the orders, see [`OrderbookIndex::pair_version`].
+    changes: u64,
+    /// The `changes` number the pair was changed at last time.
+    pair_versions: HashMap<PairKey, u64>,
+}
+
+/// The net change of an order of a pair since the last [`OrderbookIndex::take_changed_pairs`] call.
+/// The repeated updates of the order are coalesced, so the pending changes are bounded by the number of the orders.
+#[derive(Default)]
+pub struct OrderChange {
+    /// The price the order had on the pair before the first change, `None` if the order was not on the pair.
+    pub removed: Option<BigRational>,
+    /// The current state of the order, `None` if the order is not on the pair anymore.
+    pub inserted: Option<OrderbookItem>,
+}
+
+/// The orders of a pair changed since the last [`OrderbookIndex::take_changed_pairs`] call.
+pub struct ChangedPair {
+    pub base: String,
+    pub rel: String,
+    pub changes: HashMap<Uuid, OrderChange>,
+}
+
+impl OrderbookIndex {
+    pub fn len(&self) -> usize { self.handles.len() }
+
+    pub fn contains(&self, uuid: &Uuid) -> bool { self.handles.contains_key(uuid) }
+
+    pub fn get(&self, uuid: &Uuid) -> Option<&OrderbookItem> {
+        self.handles.get(uuid).map(|handle| &self.slab.get(*handle).order)
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = &OrderbookItem> {
+        self.handles.values().map(move |handle| &self.slab.get(*handle).order)
+    }
+
+    /// Inserts the new order or replaces the existing one with the same uuid.
+    /// The slab slot of the existing order is reused.
+    pub fn insert_or_update(&mut self, order: OrderbookItem) {
+        let pair = (self.tickers.intern(&order.base), self.tickers.intern(&order.rel));
+        let handle = match self.handles.get(&order.uuid).copied() {
+            Some(handle) => {
+                self.unlink(handle);
+                let entry = self.slab.get_mut(handle);
+                entry.order = order;
+                entry.pair = pair;
+                handle
+            },
+            None => {
+                let uuid = order.uuid;
+                let handle = self.slab.insert(SlabEntry { order, pair });
+                self.handles.insert(uuid, handle);
+                handle
+            },
+        };
+        self.link(handle);
+    }
+
+    pub fn remove(&mut self, uuid: &Uuid) -> Option<OrderbookItem> {
+        let handle = self.handles.remove(uuid)?;
+        self.unlink(handle);
+        self.slab.remove(handle).map(|entry| entry.order)
+    }
+
+    /// Returns the orders of the (base, rel) pair sorted by price then uuid.
+    pub fn pair_orders<'a>(&'a self, base: &str, rel: &str) -> impl Iterator<Item = &'a OrderbookItem> + 'a {
+        let levels = self.pair_key(base, rel).and_then(|pair| self.pairs.get(&pair));
+        levels
+            .into_iter()
+            .flat_map(move |levels| levels.values().map(move |handle| &self.slab.get(*handle).order))
+    }
+
+    pub fn pair_len(&self, base: &str, rel: &str) -> usize {
+        self.pair_key(base, rel)
+            .and_then(|pair| self.pairs.get(&pair))
+            .map_or(0, |levels| levels.len())
+    }
+
+    /// Returns the tickers having at least one order on the (base, ticker) pair.
+    pub fn rels_for_base<'a>(&'a self, base: &str) -> impl Iterator<Item = &'a str> + 'a {
+        let rels = self
+            .tickers
+            .get(base)
+            .and_then(|base| self.pairs_existing_for_base.get(&base));
+        rels.into_iter()
+            .flat_map(move |rels| rels.iter().map(move |rel| self.tickers.name(*rel)))
+    }
+
+    /// Returns the tickers having at least one order on the (ticker, rel) pair.
+    pub fn bases_for_rel<'a>(&'a self, rel: &str) -> impl Iterator<Item = &'a str> + 'a {
+        let bases = self
+            .tickers
+            .get(rel)
+            .and_then(|rel| self.pairs_existing_for_rel.get(&rel));
+        bases
+            .into_iter()
+            .flat_map(move |bases| bases.iter().map(move |base| self.tickers.name(*base)))
+    }
+
+    /// Returns the orders changed since the previous call grouped by pair.
+    /// Only the changed orders are copied, the cost doesn't depend on the pair depth.
+    pub fn take_changed_pairs(&mut self) -> Vec<ChangedPair> {
+        let changed_pairs = std::mem::take(&mut self.changed_pairs);
+        changed_pairs
+            .into_iter()
+            .map(|(pair, changes)| ChangedPair {
+                base: self.tickers.name(pair.0).to_owned(),
+                rel: self.tickers.name(pair.1).to_owned(),
+                changes,
+            })
+            .collect()
+    }
+
+    /// Returns the number that increases once the orders of the (base, rel) pair are changed.
+    /// The number is unique across the pairs, so the greater version of the (base, rel) and the (rel, base) pairs
+    /// identifies the orders of both.
+    pub fn pair_version(&self, base: &str, rel: &str) -> u64 {
+        self.pair_key(base, rel)
+            .and_then(|pair| self.pair_versions.get(&pair))
+            .copied()
+            .unwrap_or_default()
+    }
+
+    fn mark_changed(&mut self, pair: PairKey, uuid: Uuid) -> &mut OrderChange {
+        self.changes += 1;
+        self.pair_versions.insert(pair, self.changes);
+        self.changed_pairs
+            .entry(pair)
+            .or_insert_with(HashMap::new)
+            .entry(uuid)
+            .or_insert_with(OrderChange::default)
+    }
+
+    fn pair_key(&self, base: &str, rel: &str) -> Option<PairKey> {
+        Some((self.tickers.get(base)?, self.tickers.get(rel)?))
+    }
+
+    /// Adds the order to the sorted levels of its pair.
+    fn link(&mut self, handle: OrderHandle) {
+        let entry = self.slab.get(handle);
+        let (pair, key, order) = (entry.pair, level_key(&entry.order), entry.order.clone());
+        self.mark_changed(pair, key.1).inserted = Some(order);
+        self.pairs.entry(pair).or_insert_with(BTreeMap::new).insert(key, handle);
+
+        self.pairs_existing_for_base
+            .entry(pair.0)
+            .or_insert_with(HashSet::new)
+            .insert(pair.1);
+        self.pairs_existing_for_rel
+            .entry(pair.1)
+            .or_insert_with(HashSet::new)
+            .insert(pair.0);
+    }
+
+    /// Removes the order from the sorted levels of its pair, the slab entry is kept untouched.
+    fn unlink(&mut self, handle: OrderHandle) {
+        let entry = self.slab.get(handle);
+        let (pair, key) = (entry.pair, level_key(&entry.order));
+        let change = self.mark_changed(pair, key.1);
+        if change.inserted.take().is_none() {
+            // the order is on the pair since the previous call, that has to be removed
+            change.removed = Some(key.0.clone());
+        }
+        let levels = match self.pairs.get_mut(&pair) {
+            Some(levels) => levels,
+            None => return,
+        };
+        levels.remove(&key);
+        if !levels.is_empty() {
+            return;
+        }
+
+        self.pairs.remove(&pair);
+        if let Some(rels) = self.pairs_existing_for_base.get_mut(&pair.0) {
+            rels.remove(&pair.1);
+            if rels.is_empty() {
+                self.pairs_existing_for_base.remove(&pair.0);
+            }
+        }
+        if let Some(bases) = self.pairs_existing_for_rel.get_mut(&pair.1) {
+            bases.remove(&pair.0);
+            if bases.is_empty() {
+                self.pairs_existing_for_rel.remove(&pair.1);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod orderbook_index_tests {
+    use super::*;
+
+    fn order(base: &str, rel: &str, price: i64) -> OrderbookItem {
+        OrderbookItem {
+            pubkey: "pubkey".into(),
+            base: base.into(),
+            rel: rel.into(),
+            price: BigRational::from_integer(price.into()),
+            max_volume: BigRational::from_integer(1.into()),
+            min_volume: BigRational::from_integer(0.into()),
+            uuid: Uuid::new_v4(),
+            created_at: 0,
+        }
+    }
+
+    fn pair_prices(index: &OrderbookIndex, base: &str, rel: &str) -> Vec<BigRational> {
+        index.pair_orders(base, rel).map(|order| order.price.clone()).collect()
+    }
+
+    #[test]
+    fn test_pair_orders_sorted_by_price() {
+        let mut index = OrderbookIndex::default();
+        for price in &[5, 1, 3, 2, 4] {
+            index.insert_or_update(order("RICK", "MORTY", *price));
+        }
+        index.insert_or_update(order("MORTY", "RICK", 10));
+
+        let expected: Vec<_> = (1..=5).map(|p| BigRational::from_integer(p.into())).collect();
+        assert_eq!(pair_prices(&index, "RICK", "MORTY"), expected);
+        assert_eq!(index.pair_len("MORTY", "RICK"), 1);
+        assert_eq!(index.pair_len("RICK", "KMD"), 0);
+        assert_eq!(index.len(), 6);
+    }
+
+    #[test]
+    fn test_update_moves_order_to_new_price() {
+        let mut index = OrderbookIndex::default();
+        let mut first = order("RICK", "MORTY", 1);
+        index.insert_or_update(first.clone());
+        index.insert_or_update(order("RICK", "MORTY", 2));
+
+        first.price = BigRational::from_integer(3.into());
+        index.insert_or_update(first.clone());
+
+        let expected = vec![BigRational::from_integer(2.into()), BigRational::from_integer(3.into())];
+        assert_eq!(pair_prices(&index, "RICK", "MORTY"), expected);
+        assert_eq!(index.get(&first.uuid), Some(&first));
+        assert_eq!(index.len(), 2);
+    }
+
+    #[test]
+    fn test_remove_cleans_up_pairs_and_reuses_slots() {
+        let mut index = OrderbookIndex::default();
+        let rick_morty = order("RICK", "MORTY", 1);
+        let rick_kmd = order("RICK", "KMD", 1);
+        index.insert_or_update(rick_morty.clone());
+        index.insert_or_update(rick_kmd.clone());
+
+        let mut rels: Vec<_> = index.rels_for_base("RICK").collect();
+        rels.sort_unstable();
+        assert_eq!(rels, vec!["KMD", "MORTY"]);
+
+        assert_eq!(index.remove(&rick_morty.uuid), Some(rick_morty.clone()));
+        assert_eq!(index.remove(&rick_morty.uuid), None);
+        assert_eq!(index.rels_for_base("RICK").collect::<Vec<_>>(), vec!["KMD"]);
+        assert_eq!(index.bases_for_rel("MORTY").count(), 0);
+
+        index.insert_or_update(order("RICK", "MORTY", 1));
+        assert_eq!(index.slab.entries.len(), 2);
+        assert_eq!(index.len(), 2);
+    }
+
+    #[test]
+    fn test_pair_version() {
+        let mut index = OrderbookIndex::default();
+        assert_eq!(index.pair_version("RICK", "MORTY"), 0);
+        let rick_morty = order("RICK", "MORTY", 1);
+        index.insert_or_update(rick_morty.clone());
+        index.insert_or_update(order("MORTY", "RICK", 1));
+        let rick_morty_version = index.pair_version("RICK", "MORTY");
+        let morty_rick_version = index.pair_version("MORTY", "RICK");
+        assert!(morty_rick_version > rick_morty_version);
+
+        // the other pairs don't change the version
+        index.insert_or_update(order("RICK", "KMD", 1));
+        assert_eq!(index.pair_version("RICK", "MORTY"), rick_morty_version);
+
+        // the removed pair is versioned still
+        index.remove(&rick_morty.uuid);
+        assert!(index.pair_version("RICK", "MORTY") > morty_rick_version);
+        assert_eq!(index.pair_len("RICK", "MORTY"), 0);
+    }
+}
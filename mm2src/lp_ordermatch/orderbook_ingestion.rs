@@ -0,0 +1,159 @@
+//! Batched application of the gossiped order updates.
+//!
+//! Every `process_p2p_message` task pushes its decoded update to the queue and then competes for the orderbook mutex.
+//! The task that acquires the mutex drains the queue and applies all the pending updates,
+//! so under a repricing burst the updates are coalesced by uuid and committed to the trie once per (pubkey, pair)
+//! instead of once per message. The results are sent to the waiting tasks before the mutex is released,
+//! so a task that finds the queue empty already has its result.
+
+use super::{new_protocol, Orderbook, OrderbookItem, OrdermatchContext};
+use common::log;
+use common::mm_ctx::MmArc;
+use common::mm_metrics::{ClockOps, MetricsOps};
+use futures::channel::oneshot;
+use parking_lot::Mutex as PaMutex;
+use std::collections::HashMap;
+use uuid::Uuid;
+
+/// Limits the number of the updates staged and committed to the trie at once.
+/// The queue is drained by several batches if it's longer.
+const MAX_BATCH_SIZE: usize = 1024;
+
+pub enum OrderUpdate {
+    Created(OrderbookItem),
+    Updated {
+        pubkey: String,
+        updated_msg: new_protocol::MakerOrderUpdated,
+    },
+    Cancelled {
+        pubkey: String,
+        uuid: Uuid,
+    },
+}
+
+struct PendingUpdate {
+    update: OrderUpdate,
+    /// Whether the message should be propagated further.
+    result_tx: oneshot::Sender<bool>,
+}
+
+#[derive(Default)]
+pub struct OrderbookIngestion {
+    queue: PaMutex<Vec<PendingUpdate>>,
+}
+
+impl OrderbookIngestion {
+    /// Returns the receiver of the update result and the queue depth.
+    fn push(&self, update: OrderUpdate) -> (oneshot::Receiver<bool>, usize) {
+        let (result_tx, result_rx) = oneshot::channel();
+        let mut queue = self.queue.lock();
+        queue.push(PendingUpdate { update, result_tx });
+        (result_rx, queue.len())
+    }
+
+    /// Must be called with the orderbook mutex held.
+    fn take_batch(&self) -> Vec<PendingUpdate> {
+        let mut queue = self.queue.lock();
+        let batch_size = queue.len().min(MAX_BATCH_SIZE);
+        queue.drain(..batch_size).collect()
+    }
+}
+
+/// Queues the `update` and applies the pending updates if no other task does it already.
+/// Returns whether the message should be propagated further.
+pub async fn process_order_update(ctx: &MmArc, update: OrderUpdate) -> bool {
+    let ordermatch_ctx = OrdermatchContext::from_ctx(ctx).expect("from_ctx failed");
+    let (result_rx, queue_depth) = ordermatch_ctx.orderbook_ingestion.push(update);
+    mm_gauge!(ctx.metrics, "orderbook.ingestion.queue_depth", queue_depth as i64);
+
+    {
+        let mut orderbook = ordermatch_ctx.orderbook.lock().await;
+        let clock = ctx.metrics.clock().ok();
+        let start = clock.as_ref().map(ClockOps::now);
+        let mut applied = 0;
+        // the queue is drained completely, so the update of this task is applied even if it's queued
+        // behind more than a batch of the updates
+        loop {
+            let batch = ordermatch_ctx.orderbook_ingestion.take_batch();
+            if batch.is_empty() {
+                break;
+            }
+            applied += batch.len();
+            apply_batch(&mut orderbook, batch);
+        }
+
+        if applied > 0 {
+            ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+            mm_gauge!(ctx.metrics, "orderbook.ingestion.batch_size", applied as i64);
+            if let (Some(clock), Some(start)) = (clock, start) {
+                mm_timing!(ctx.metrics, "orderbook.ingestion.apply_timing", start, clock.now());
+            }
+        }
+    }
+
+    // the result is sent before the orderbook mutex is released by the task that applied the update
+    result_rx.await.unwrap_or(false)
+}
+
+fn apply_batch(orderbook: &mut Orderbook, batch: Vec<PendingUpdate>) {
+    // the latest state of every updated order, `None` if the order is removed
+    let mut staged = HashMap::new();
+    let mut results = Vec::with_capacity(batch.len());
+    for PendingUpdate { update, result_tx } in batch {
+        let to_propagate = stage_update(orderbook, &mut staged, update);
+        results.push((result_tx, to_propagate));
+    }
+
+    orderbook.apply_order_updates_trie(staged);
+
+    for (result_tx, to_propagate) in results {
+        // the receiver might be dropped if the task is cancelled
+        result_tx.send(to_propagate).ok();
+    }
+}
+
+/// Returns the order owned by `pubkey` taking the updates staged earlier in the batch into account.
+fn staged_order<'a>(
+    orderbook: &'a Orderbook,
+    staged: &'a HashMap<Uuid, Option<OrderbookItem>>,
+    uuid: &Uuid,
+    pubkey: &str,
+) -> Option<&'a OrderbookItem> {
+    match staged.get(uuid) {
+        Some(order) => order.as_ref().filter(|order| order.pubkey == pubkey),
+        None => orderbook.find_order_by_uuid_and_pubkey(uuid, pubkey),
+    }
+}
+
+fn stage_update(orderbook: &Orderbook, staged: &mut HashMap<Uuid, Option<OrderbookItem>>, update: OrderUpdate) -> bool {
+    match update {
+        OrderUpdate::Created(order) => {
+            staged.insert(order.uuid, Some(order));
+            true
+        },
+        OrderUpdate::Updated { pubkey, updated_msg } => {
+            let uuid = updated_msg.uuid();
+            match staged_order(orderbook, staged, &uuid, &pubkey).cloned() {
+                Some(mut order) => {
+                    order.apply_updated(&updated_msg);
+                    staged.insert(uuid, Some(order));
+                    true
+                },
+                None => {
+                    log::warn!(
+                        "Couldn't find an order {}, ignoring, it will be synced upon pubkey keep alive",
+                        uuid
+                    );
+                    false
+                },
+            }
+        },
+        OrderUpdate::Cancelled { pubkey, uuid } => {
+            // don't remove the order if the pubkey is not equal
+            if staged_order(orderbook, staged, &uuid, &pubkey).is_some() {
+                staged.insert(uuid, None);
+            }
+            true
+        },
+    }
+}
@@ -95,55 +95,34 @@ pub async fn orderbook_rpc(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, S
     let request_orderbook = true;
     try_s!(subscribe_to_orderbook_topic(&ctx, &req.base, &req.rel, request_orderbook).await);
     let ordermatch_ctx = try_s!(OrdermatchContext::from_ctx(&ctx));
-    let orderbook = ordermatch_ctx.orderbook.lock().await;
+    let orderbook = ordermatch_ctx.orderbook_snapshots.latest();
     let my_pubsecp = hex::encode(&**ctx.secp256k1_key_pair().public());
 
-    let mut asks = match orderbook.unordered.get(&(req.base.clone(), req.rel.clone())) {
-        Some(uuids) => {
-            let mut orderbook_entries = Vec::new();
-            for uuid in uuids {
-                let ask = orderbook.order_set.get(uuid).ok_or(ERRL!(
-                    "Orderbook::unordered contains {:?} uuid that is not in Orderbook::order_set",
-                    uuid
-                ))?;
-
-                let address = try_s!(address_by_coin_conf_and_pubkey_str(
-                    &req.base,
-                    &base_coin_conf,
-                    &ask.pubkey
-                ));
-                let is_mine = my_pubsecp == ask.pubkey;
-                orderbook_entries.push(ask.as_rpc_entry_ask(address, is_mine));
-            }
-            orderbook_entries
-        },
-        None => Vec::new(),
-    };
-    asks.sort_unstable_by(|ask1, ask2| ask1.price_rat.cmp(&ask2.price_rat));
+    // the orders are already sorted by price within each pair
+    let mut asks = Vec::with_capacity(orderbook.pair_len(&req.base, &req.rel));
+    for ask in orderbook.pair_orders(&req.base, &req.rel) {
+        let address = try_s!(address_by_coin_conf_and_pubkey_str(
+            &req.base,
+            &base_coin_conf,
+            &ask.pubkey
+        ));
+        let is_mine = my_pubsecp == ask.pubkey;
+        asks.push(ask.as_rpc_entry_ask(address, is_mine));
+    }
     let (mut asks, total_asks_base_vol, total_asks_rel_vol) = build_aggregated_entries(asks);
     asks.reverse();
 
-    let mut bids = match orderbook.unordered.get(&(req.rel.clone(), req.base.clone())) {
-        Some(uuids) => {
-            let mut orderbook_entries = vec![];
-            for uuid in uuids {
-                let bid = orderbook.order_set.get(uuid).ok_or(ERRL!(
-                    "Orderbook::unordered contains {:?} uuid that is not in Orderbook::order_set",
-                    uuid
-                ))?;
-                let address = try_s!(address_by_coin_conf_and_pubkey_str(
-                    &req.rel,
-                    &rel_coin_conf,
-                    &bid.pubkey
-                ));
-                let is_mine = my_pubsecp == bid.pubkey;
-                orderbook_entries.push(bid.as_rpc_entry_bid(address, is_mine));
-            }
-            orderbook_entries
-        },
-        None => vec![],
-    };
-    bids.sort_unstable_by(|bid1, bid2| bid2.price_rat.cmp(&bid1.price_rat));
+    // the bid price is inverted, so the ascending order of (rel, base) pair gives the descending bids
+    let mut bids = Vec::with_capacity(orderbook.pair_len(&req.rel, &req.base));
+    for bid in orderbook.pair_orders(&req.rel, &req.base) {
+        let address = try_s!(address_by_coin_conf_and_pubkey_str(
+            &req.rel,
+            &rel_coin_conf,
+            &bid.pubkey
+        ));
+        let is_mine = my_pubsecp == bid.pubkey;
+        bids.push(bid.as_rpc_entry_bid(address, is_mine));
+    }
     let (bids, total_bids_base_vol, total_bids_rel_vol) = build_aggregated_entries(bids);
 
     let response = OrderbookResponse {
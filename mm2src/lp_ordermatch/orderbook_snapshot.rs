@@ -0,0 +1,281 @@
+//! Immutable, copy-on-write versions of the orderbook used by the read-only RPCs and P2P requests.
+//!
+//! The writer holding [`super::OrdermatchContext::orderbook`] publishes a new version after applying a batch of updates.
+//! Only the changed orders are applied to the persistent [`PairTree`]s of their pairs copying `O(log n)` nodes per order,
+//! and only the pair maps of the changed coins are copied,
+//! the unchanged nodes, pairs and coins are shared with the previous version by `Arc`.
+//! The pairs are indexed both by base and by rel, so the requests for all the pairs of a coin visit only these pairs.
+//! Readers take the latest version without awaiting the orderbook mutex, so the read latency doesn't depend on the
+//! gossip write load. The `RwLock` below is held only to swap or clone the `Arc`.
+
+use super::orderbook_index::OrderbookIndex;
+use super::pair_tree::{self, PairTree};
+use parking_lot::RwLock as PaRwLock;
+use std::collections::HashMap;
+use std::sync::Arc;
+
+/// The orders of a single (base, rel) pair sorted by price then uuid.
+pub struct PairSnapshot {
+    orders: PairTree,
+}
+
+impl PairSnapshot {
+    pub fn orders(&self) -> &PairTree { &self.orders }
+}
+
+/// The pairs of a coin, either all the pairs the coin is the base of or all the pairs the coin is the rel of.
+#[derive(Clone, Default)]
+pub struct CoinPairs {
+    /// The epoch any of the pairs was changed, added or removed at last time.
+    epoch: u64,
+    /// A map from the other ticker of the pair to the pair.
+    pairs: HashMap<String, Arc<PairSnapshot>>,
+}
+
+impl CoinPairs {
+    /// Identifies the version of all the pairs, so the responses computed from the pairs can be cached until it changes.
+    pub fn epoch(&self) -> u64 { self.epoch }
+
+    /// Returns the other ticker and the pair of every non-empty pair.
+    pub fn iter(&self) -> impl Iterator<Item = (&str, &PairSnapshot)> {
+        self.pairs.iter().map(|(ticker, pair)| (ticker.as_str(), pair.as_ref()))
+    }
+
+    fn update(
+        coins: &mut HashMap<String, Arc<CoinPairs>>,
+        coin: &str,
+        other: &str,
+        epoch: u64,
+        pair: Option<&Arc<PairSnapshot>>,
+    ) {
+        match pair {
+            Some(pair) => {
+                let coin_pairs = Arc::make_mut(coins.entry(coin.to_owned()).or_insert_with(Default::default));
+                coin_pairs.epoch = epoch;
+                coin_pairs.pairs.insert(other.to_owned(), pair.clone());
+            },
+            None => {
+                let coin_pairs = match coins.get_mut(coin) {
+                    Some(coin_pairs) if coin_pairs.pairs.contains_key(other) => Arc::make_mut(coin_pairs),
+                    _ => return,
+                };
+                coin_pairs.epoch = epoch;
+                coin_pairs.pairs.remove(other);
+                if coin_pairs.pairs.is_empty() {
+                    coins.remove(coin);
+                }
+            },
+        }
+    }
+}
+
+#[derive(Default)]
+pub struct OrderbookSnapshot {
+    epoch: u64,
+    /// A map from base ticker to the pairs of the base.
+    pairs_by_base: HashMap<String, Arc<CoinPairs>>,
+    /// A map from rel ticker to the pairs of the rel, shares the pair versions with the `pairs_by_base`.
+    pairs_by_rel: HashMap<String, Arc<CoinPairs>>,
+}
+
+impl OrderbookSnapshot {
+    pub fn epoch(&self) -> u64 { self.epoch }
+
+    pub fn pair(&self, base: &str, rel: &str) -> Option<&Arc<PairSnapshot>> {
+        self.pairs_by_base.get(base)?.pairs.get(rel)
+    }
+
+    /// Returns the orders of the (base, rel) pair sorted by price then uuid.
+    pub fn pair_orders(&self, base: &str, rel: &str) -> pair_tree::Iter<'_> {
+        match self.pair(base, rel) {
+            Some(pair) => pair.orders().iter(),
+            None => pair_tree::Iter::empty(),
+        }
+    }
+
+    pub fn pair_len(&self, base: &str, rel: &str) -> usize {
+        self.pair(base, rel).map_or(0, |pair| pair.orders().len())
+    }
+
+    /// Returns the non-empty pairs with the given `base` keyed by rel.
+    pub fn base_pairs(&self, base: &str) -> Option<&CoinPairs> { self.pairs_by_base.get(base).map(AsRef::as_ref) }
+
+    /// Returns the non-empty pairs with the given `rel` keyed by base.
+    pub fn rel_pairs(&self, rel: &str) -> Option<&CoinPairs> { self.pairs_by_rel.get(rel).map(AsRef::as_ref) }
+}
+
+#[derive(Default)]
+pub struct OrderbookSnapshots {
+    latest: PaRwLock<Arc<OrderbookSnapshot>>,
+}
+
+impl OrderbookSnapshots {
+    /// Returns the latest published version of the orderbook.
+    pub fn latest(&self) -> Arc<OrderbookSnapshot> { self.latest.read().clone() }
+
+    /// Publishes a new version containing the orders changed since the previous publication.
+    /// Does nothing if there are no changes.
+    ///
+    /// Must be called with the orderbook mutex held, that serializes the publishers.
+    pub fn publish(&self, orders: &mut OrderbookIndex) {
+        let changed_pairs = orders.take_changed_pairs();
+        if changed_pairs.is_empty() {
+            return;
+        }
+
+        let latest = self.latest();
+        let epoch = latest.epoch + 1;
+        // only the `Arc`s of the coins are cloned, the pairs of a coin are copied once they're changed first time
+        let mut pairs_by_base = latest.pairs_by_base.clone();
+        let mut pairs_by_rel = latest.pairs_by_rel.clone();
+        for changed in changed_pairs {
+            let mut orders = latest
+                .pair(&changed.base, &changed.rel)
+                .map(|pair| pair.orders.clone())
+                .unwrap_or_default();
+            for (uuid, change) in changed.changes {
+                if let Some(price) = change.removed {
+                    orders.remove(&price, &uuid);
+                }
+                if let Some(order) = change.inserted {
+                    orders.insert(order);
+                }
+            }
+
+            let pair = if orders.is_empty() {
+                None
+            } else {
+                Some(Arc::new(PairSnapshot { orders }))
+            };
+            CoinPairs::update(&mut pairs_by_base, &changed.base, &changed.rel, epoch, pair.as_ref());
+            CoinPairs::update(&mut pairs_by_rel, &changed.rel, &changed.base, epoch, pair.as_ref());
+        }
+
+        *self.latest.write() = Arc::new(OrderbookSnapshot {
+            epoch,
+            pairs_by_base,
+            pairs_by_rel,
+        });
+    }
+}
+
+#[cfg(test)]
+mod orderbook_snapshot_tests {
+    use super::super::OrderbookItem;
+    use super::*;
+    use num_rational::BigRational;
+    use uuid::Uuid;
+
+    fn order(base: &str, rel: &str, price: i64) -> OrderbookItem {
+        OrderbookItem {
+            pubkey: "pubkey".into(),
+            base: base.into(),
+            rel: rel.into(),
+            price: BigRational::from_integer(price.into()),
+            max_volume: BigRational::from_integer(1.into()),
+            min_volume: BigRational::from_integer(0.into()),
+            uuid: Uuid::new_v4(),
+            created_at: 0,
+        }
+    }
+
+    #[test]
+    fn test_publish_copies_only_changed_pairs() {
+        let mut index = OrderbookIndex::default();
+        let snapshots = OrderbookSnapshots::default();
+        index.insert_or_update(order("RICK", "MORTY", 2));
+        index.insert_or_update(order("RICK", "MORTY", 1));
+        index.insert_or_update(order("MORTY", "RICK", 1));
+        snapshots.publish(&mut index);
+
+        let first = snapshots.latest();
+        assert_eq!(first.epoch(), 1);
+        let prices: Vec<_> = first
+            .pair_orders("RICK", "MORTY")
+            .map(|order| order.price.clone())
+            .collect();
+        assert_eq!(prices, vec![
+            BigRational::from_integer(1.into()),
+            BigRational::from_integer(2.into())
+        ]);
+
+        // nothing has changed, the same version is kept
+        snapshots.publish(&mut index);
+        assert!(Arc::ptr_eq(&first, &snapshots.latest()));
+
+        let removed = order("MORTY", "RICK", 3);
+        index.insert_or_update(removed.clone());
+        snapshots.publish(&mut index);
+        index.remove(&removed.uuid);
+        index.insert_or_update(order("RICK", "KMD", 1));
+        snapshots.publish(&mut index);
+
+        let latest = snapshots.latest();
+        assert_eq!(latest.epoch(), 3);
+        // the readers of the previous version are not affected
+        assert_eq!(first.pair_len("RICK", "KMD"), 0);
+        assert_eq!(latest.pair_len("RICK", "KMD"), 1);
+        assert_eq!(latest.pair_len("MORTY", "RICK"), 1);
+        assert!(Arc::ptr_eq(
+            first.pair("RICK", "MORTY").unwrap(),
+            latest.pair("RICK", "MORTY").unwrap()
+        ));
+
+        let mut rels: Vec<_> = latest.base_pairs("RICK").unwrap().iter().map(|(rel, _)| rel).collect();
+        rels.sort_unstable();
+        assert_eq!(rels, vec!["KMD", "MORTY"]);
+        let bases: Vec<_> = latest.rel_pairs("RICK").unwrap().iter().map(|(base, _)| base).collect();
+        assert_eq!(bases, vec!["MORTY"]);
+
+        // the pairs of the unchanged coins are shared
+        index.insert_or_update(order("KMD", "RICK", 1));
+        snapshots.publish(&mut index);
+        let next = snapshots.latest();
+        assert_eq!(next.pair_len("KMD", "RICK"), 1);
+        assert!(Arc::ptr_eq(&latest.pairs_by_base["RICK"], &next.pairs_by_base["RICK"]));
+        assert!(Arc::ptr_eq(
+            &latest.pairs_by_base["MORTY"],
+            &next.pairs_by_base["MORTY"]
+        ));
+        assert!(Arc::ptr_eq(&latest.pairs_by_rel["MORTY"], &next.pairs_by_rel["MORTY"]));
+        assert!(!latest.pairs_by_base.contains_key("KMD"));
+        // the epochs of the changed coins only are increased
+        assert_eq!(next.rel_pairs("RICK").unwrap().epoch(), next.epoch());
+        assert_eq!(next.base_pairs("KMD").unwrap().epoch(), next.epoch());
+        assert_eq!(next.base_pairs("RICK").unwrap().epoch(), latest.epoch());
+    }
+
+    #[test]
+    fn test_publish_applies_coalesced_order_changes() {
+        let mut index = OrderbookIndex::default();
+        let snapshots = OrderbookSnapshots::default();
+        let mut updated = order("RICK", "MORTY", 1);
+        let removed = order("RICK", "MORTY", 2);
+        index.insert_or_update(updated.clone());
+        index.insert_or_update(removed.clone());
+        snapshots.publish(&mut index);
+        let first = snapshots.latest();
+
+        // the order is repriced several times, the other one is removed, a new one is inserted and removed
+        for price in 3..6 {
+            updated.price = BigRational::from_integer(price.into());
+            index.insert_or_update(updated.clone());
+        }
+        index.remove(&removed.uuid);
+        let transient = order("RICK", "MORTY", 4);
+        index.insert_or_update(transient.clone());
+        index.remove(&transient.uuid);
+        snapshots.publish(&mut index);
+
+        let latest = snapshots.latest();
+        let published: Vec<_> = latest.pair_orders("RICK", "MORTY").cloned().collect();
+        assert_eq!(published, vec![updated]);
+        assert_eq!(first.pair_len("RICK", "MORTY"), 2);
+
+        index.remove(&published[0].uuid);
+        snapshots.publish(&mut index);
+        assert!(snapshots.latest().pair("RICK", "MORTY").is_none());
+        assert!(snapshots.latest().base_pairs("RICK").is_none());
+        assert!(snapshots.latest().rel_pairs("MORTY").is_none());
+    }
+}
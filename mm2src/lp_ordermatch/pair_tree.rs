@@ -0,0 +1,471 @@
+//! The persistent ordered set of the orders of a single pair used by the orderbook snapshots.
+//!
+//! The set is an AVL tree the nodes of which are shared by `Arc`, so cloning the set is `O(1)`
+//! and inserting or removing an order copies only the `O(log n)` nodes on the path to it,
+//! the rest of the nodes are shared with the previous versions of the set that might be still read.
+//!
+//! Every node keeps the aggregated volumes of its subtree in both coins of the pair. The aggregates are recomputed
+//! only for the copied nodes, so the best orders covering a volume are found without summing the volumes of the pair.
+
+use super::OrderbookItem;
+use num_rational::BigRational;
+use num_traits::Zero;
+use std::cmp::{max, Ordering};
+use std::sync::Arc;
+use uuid::Uuid;
+
+/// The coin of the pair the volumes are measured in.
+#[derive(Clone, Copy, Debug)]
+pub enum VolumeIn {
+    Base,
+    /// The volumes are multiplied by the price.
+    Rel,
+}
+
+/// The min and max volumes of an order or the aggregated volumes of a subtree.
+#[derive(Clone)]
+struct Volumes {
+    /// The greatest of the min volumes.
+    min: BigRational,
+    /// The sum of the max volumes.
+    max: BigRational,
+}
+
+impl Volumes {
+    fn zero() -> Volumes {
+        Volumes {
+            min: BigRational::zero(),
+            max: BigRational::zero(),
+        }
+    }
+
+    fn aggregate(left: &Volumes, own: &Volumes, right: &Volumes) -> Volumes {
+        Volumes {
+            min: max(max(&left.min, &own.min), &right.min).clone(),
+            max: &(&left.max + &own.max) + &right.max,
+        }
+    }
+}
+
+/// The order with its volumes in both coins, computed once the order is inserted.
+struct PairOrder {
+    order: OrderbookItem,
+    base: Volumes,
+    rel: Volumes,
+}
+
+impl PairOrder {
+    fn new(order: OrderbookItem) -> PairOrder {
+        let base = Volumes {
+            min: order.min_volume.clone(),
+            max: order.max_volume.clone(),
+        };
+        let rel = Volumes {
+            min: &order.min_volume * &order.price,
+            max: &order.max_volume * &order.price,
+        };
+        PairOrder { order, base, rel }
+    }
+
+    fn volumes(&self, volume_in: VolumeIn) -> &Volumes {
+        match volume_in {
+            VolumeIn::Base => &self.base,
+            VolumeIn::Rel => &self.rel,
+        }
+    }
+}
+
+type Link = Option<Arc<Node>>;
+
+struct Node {
+    order: Arc<PairOrder>,
+    left: Link,
+    right: Link,
+    height: u32,
+    /// The number of the orders in the subtree.
+    len: usize,
+    /// The aggregated volumes of the subtree in the base coin.
+    base: Volumes,
+    /// The aggregated volumes of the subtree in the rel coin.
+    rel: Volumes,
+}
+
+impl Node {
+    fn volumes(&self, volume_in: VolumeIn) -> &Volumes {
+        match volume_in {
+            VolumeIn::Base => &self.base,
+            VolumeIn::Rel => &self.rel,
+        }
+    }
+}
+
+fn height(link: &Link) -> u32 { link.as_ref().map_or(0, |node| node.height) }
+
+fn len(link: &Link) -> usize { link.as_ref().map_or(0, |node| node.len) }
+
+fn cmp_key(order: &OrderbookItem, price: &BigRational, uuid: &Uuid) -> Ordering {
+    order.price.cmp(price).then_with(|| order.uuid.cmp(uuid))
+}
+
+fn volumes<'a>(link: &'a Link, volume_in: VolumeIn, zero: &'a Volumes) -> &'a Volumes {
+    link.as_ref().map_or(zero, |node| node.volumes(volume_in))
+}
+
+fn new_node(order: Arc<PairOrder>, left: Link, right: Link) -> Arc<Node> {
+    let zero = Volumes::zero();
+    let base = Volumes::aggregate(
+        volumes(&left, VolumeIn::Base, &zero),
+        &order.base,
+        volumes(&right, VolumeIn::Base, &zero),
+    );
+    let rel = Volumes::aggregate(
+        volumes(&left, VolumeIn::Rel, &zero),
+        &order.rel,
+        volumes(&right, VolumeIn::Rel, &zero),
+    );
+    Arc::new(Node {
+        order,
+        height: height(&left).max(height(&right)) + 1,
+        len: len(&left) + len(&right) + 1,
+        left,
+        right,
+        base,
+        rel,
+    })
+}
+
+/// Creates a node restoring the balance if the heights of the subtrees differ by 2.
+fn balance(order: Arc<PairOrder>, left: Link, right: Link) -> Arc<Node> {
+    let (left_height, right_height) = (height(&left), height(&right));
+    if left_height > right_height + 1 {
+        let left = left.expect("the higher subtree can't be empty");
+        if height(&left.left) >= height(&left.right) {
+            let right = new_node(order, left.right.clone(), right);
+            return new_node(left.order.clone(), left.left.clone(), Some(right));
+        }
+        let left_right = left.right.as_ref().expect("the higher subtree can't be empty");
+        let new_left = new_node(left.order.clone(), left.left.clone(), left_right.left.clone());
+        let new_right = new_node(order, left_right.right.clone(), right);
+        return new_node(left_right.order.clone(), Some(new_left), Some(new_right));
+    }
+    if right_height > left_height + 1 {
+        let right = right.expect("the higher subtree can't be empty");
+        if height(&right.right) >= height(&right.left) {
+            let left = new_node(order, left, right.left.clone());
+            return new_node(right.order.clone(), Some(left), right.right.clone());
+        }
+        let right_left = right.left.as_ref().expect("the higher subtree can't be empty");
+        let new_left = new_node(order, left, right_left.left.clone());
+        let new_right = new_node(right.order.clone(), right_left.right.clone(), right.right.clone());
+        return new_node(right_left.order.clone(), Some(new_left), Some(new_right));
+    }
+    new_node(order, left, right)
+}
+
+fn insert(link: &Link, order: Arc<PairOrder>) -> Arc<Node> {
+    let node = match link {
+        Some(node) => node,
+        None => return new_node(order, None, None),
+    };
+    match cmp_key(&order.order, &node.order.order.price, &node.order.order.uuid) {
+        Ordering::Less => balance(node.order.clone(), Some(insert(&node.left, order)), node.right.clone()),
+        Ordering::Greater => balance(node.order.clone(), node.left.clone(), Some(insert(&node.right, order))),
+        Ordering::Equal => new_node(order, node.left.clone(), node.right.clone()),
+    }
+}
+
+/// Returns the new subtree or `None` if there is no such order.
+fn remove(link: &Link, price: &BigRational, uuid: &Uuid) -> Option<Link> {
+    let node = link.as_ref()?;
+    match cmp_key(&node.order.order, price, uuid) {
+        Ordering::Greater => {
+            let left = remove(&node.left, price, uuid)?;
+            Some(Some(balance(node.order.clone(), left, node.right.clone())))
+        },
+        Ordering::Less => {
+            let right = remove(&node.right, price, uuid)?;
+            Some(Some(balance(node.order.clone(), node.left.clone(), right)))
+        },
+        Ordering::Equal => match (&node.left, &node.right) {
+            (None, right) => Some(right.clone()),
+            (left, None) => Some(left.clone()),
+            (left, Some(right)) => {
+                let (first, right) = remove_first(right);
+                Some(Some(balance(first, left.clone(), right)))
+            },
+        },
+    }
+}
+
+/// Returns the first order of the subtree and the subtree without it.
+fn remove_first(node: &Arc<Node>) -> (Arc<PairOrder>, Link) {
+    match &node.left {
+        Some(left) => {
+            let (first, left) = remove_first(left);
+            (first, Some(balance(node.order.clone(), left, node.right.clone())))
+        },
+        None => (node.order.clone(), node.right.clone()),
+    }
+}
+
+/// Collects the orders of the subtree to the `covering` ones until the `collected` volume covers the `required`.
+/// Returns whether the `required` volume is covered.
+fn collect_covering<'a>(
+    link: &'a Link,
+    volume_in: VolumeIn,
+    required: &BigRational,
+    collected: &mut BigRational,
+    covering: &mut Vec<&'a OrderbookItem>,
+) -> bool {
+    let node = match link {
+        Some(node) => node,
+        None => return false,
+    };
+    let volumes = node.volumes(volume_in);
+    if &volumes.min <= required && &(&*collected + &volumes.max) < required {
+        // no order of the subtree is skipped and they all don't cover the required volume yet
+        let mut subtree = Iter::empty();
+        subtree.push_left(link);
+        covering.extend(subtree);
+        *collected += &volumes.max;
+        return false;
+    }
+
+    if collect_covering(&node.left, volume_in, required, collected, covering) {
+        return true;
+    }
+    let own = node.order.volumes(volume_in);
+    if &own.min <= required {
+        covering.push(&node.order.order);
+        *collected += &own.max;
+        if &*collected >= required {
+            return true;
+        }
+    }
+    collect_covering(&node.right, volume_in, required, collected, covering)
+}
+
+/// The orders sorted by price then uuid.
+#[derive(Clone, Default)]
+pub struct PairTree {
+    root: Link,
+}
+
+impl PairTree {
+    pub fn len(&self) -> usize { len(&self.root) }
+
+    pub fn is_empty(&self) -> bool { self.root.is_none() }
+
+    /// Inserts the order or replaces the one with the same price and uuid.
+    pub fn insert(&mut self, order: OrderbookItem) {
+        self.root = Some(insert(&self.root, Arc::new(PairOrder::new(order))));
+    }
+
+    /// Returns whether the order was found.
+    pub fn remove(&mut self, price: &BigRational, uuid: &Uuid) -> bool {
+        match remove(&self.root, price, uuid) {
+            Some(root) => {
+                self.root = root;
+                true
+            },
+            None => false,
+        }
+    }
+
+    /// Returns the best priced orders the max volumes of which cover the `required_volume` together.
+    /// The orders the min volume of which is greater than the `required_volume` are skipped.
+    /// All the suitable orders are returned if they don't cover the `required_volume`.
+    pub fn covering_orders(&self, volume_in: VolumeIn, required_volume: &BigRational) -> Vec<&OrderbookItem> {
+        let mut covering = Vec::new();
+        let mut collected = BigRational::zero();
+        collect_covering(&self.root, volume_in, required_volume, &mut collected, &mut covering);
+        covering
+    }
+
+    pub fn iter(&self) -> Iter<'_> {
+        let mut iter = Iter { stack: Vec::new() };
+        iter.push_left(&self.root);
+        iter
+    }
+}
+
+/// Iterates over the orders of the [`PairTree`] in order.
+pub struct Iter<'a> {
+    /// The nodes the left subtrees of which are already visited.
+    stack: Vec<&'a Node>,
+}
+
+impl<'a> Iter<'a> {
+    /// The iterator over no orders.
+    pub fn empty() -> Iter<'a> { Iter { stack: Vec::new() } }
+
+    fn push_left(&mut self, mut link: &'a Link) {
+        while let Some(node) = link {
+            self.stack.push(node);
+            link = &node.left;
+        }
+    }
+}
+
+impl<'a> Iterator for Iter<'a> {
+    type Item = &'a OrderbookItem;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        let node = self.stack.pop()?;
+        self.push_left(&node.right);
+        Some(&node.order.order)
+    }
+}
+
+#[cfg(test)]
+mod pair_tree_tests {
+    use super::*;
+    use rand::rngs::StdRng;
+    use rand::{Rng, SeedableRng};
+
+    fn order(price: i64) -> OrderbookItem {
+        OrderbookItem {
+            pubkey: "pubkey".into(),
+            base: "RICK".into(),
+            rel: "MORTY".into(),
+            price: BigRational::from_integer(price.into()),
+            max_volume: BigRational::from_integer(1.into()),
+            min_volume: BigRational::from_integer(0.into()),
+            uuid: Uuid::new_v4(),
+            created_at: 0,
+        }
+    }
+
+    fn check_balanced(link: &Link) {
+        if let Some(node) = link {
+            let left = node.left.as_ref().map_or(Volumes::zero(), |node| node.base.clone());
+            let right = node.right.as_ref().map_or(Volumes::zero(), |node| node.base.clone());
+            assert_eq!(node.base.max, &(&left.max + &right.max) + &node.order.base.max);
+            let (left, right) = (height(&node.left), height(&node.right));
+            assert!(left <= right + 1 && right <= left + 1);
+            assert_eq!(node.height, left.max(right) + 1);
+            assert_eq!(node.len, len(&node.left) + len(&node.right) + 1);
+            check_balanced(&node.left);
+            check_balanced(&node.right);
+        }
+    }
+
+    fn keys(tree: &PairTree) -> Vec<(BigRational, Uuid)> {
+        tree.iter().map(|order| (order.price.clone(), order.uuid)).collect()
+    }
+
+    #[test]
+    fn test_pair_tree_insert_remove() {
+        let mut rng = StdRng::seed_from_u64(0);
+        let mut tree = PairTree::default();
+        let mut expected = Vec::new();
+        for _ in 0..1000 {
+            let order = order(rng.gen_range(0, 100));
+            expected.push((order.price.clone(), order.uuid));
+            tree.insert(order);
+        }
+        expected.sort();
+        check_balanced(&tree.root);
+        assert_eq!(keys(&tree), expected);
+        assert_eq!(tree.len(), 1000);
+
+        let previous = tree.clone();
+        for _ in 0..900 {
+            let (price, uuid) = expected.remove(rng.gen_range(0, expected.len()));
+            assert!(tree.remove(&price, &uuid));
+            assert!(!tree.remove(&price, &uuid));
+        }
+        check_balanced(&tree.root);
+        assert_eq!(keys(&tree), expected);
+        // the previous version is not affected
+        assert_eq!(previous.len(), 1000);
+        check_balanced(&previous.root);
+
+        for (price, uuid) in expected.drain(..) {
+            assert!(tree.remove(&price, &uuid));
+        }
+        assert!(tree.is_empty());
+        assert_eq!(tree.iter().count(), 0);
+    }
+
+    /// The orders with the given (min, max) volumes and the ascending prices.
+    fn tree_with_volumes(volumes: &[(i64, i64)]) -> (PairTree, Vec<Uuid>) {
+        let mut tree = PairTree::default();
+        let mut uuids = Vec::new();
+        for (price, (min, max)) in volumes.iter().enumerate() {
+            let mut order = order(price as i64 + 1);
+            order.min_volume = BigRational::from_integer((*min).into());
+            order.max_volume = BigRational::from_integer((*max).into());
+            uuids.push(order.uuid);
+            tree.insert(order);
+        }
+        (tree, uuids)
+    }
+
+    fn covering(tree: &PairTree, uuids: &[Uuid], volume_in: VolumeIn, required: i64) -> Vec<usize> {
+        tree.covering_orders(volume_in, &BigRational::from_integer(required.into()))
+            .iter()
+            .map(|order| uuids.iter().position(|uuid| *uuid == order.uuid).unwrap())
+            .collect()
+    }
+
+    #[test]
+    fn test_covering_orders() {
+        let (tree, uuids) = tree_with_volumes(&[(0, 1), (0, 2), (0, 3)]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 0), vec![0]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 1), vec![0]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 2), vec![0, 1]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 3), vec![0, 1]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 6), vec![0, 1, 2]);
+        // the orders don't cover the required volume
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 7), vec![0, 1, 2]);
+        // the rel volumes are multiplied by the prices 1, 2 and 3
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Rel, 5), vec![0, 1]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Rel, 6), vec![0, 1, 2]);
+
+        // the order 1 requires the min volume greater than 2
+        let (tree, uuids) = tree_with_volumes(&[(0, 1), (3, 2), (1, 3)]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 2), vec![0, 2]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 3), vec![0, 1]);
+        assert_eq!(covering(&tree, &uuids, VolumeIn::Base, 0), vec![0]);
+    }
+
+    #[test]
+    fn test_covering_orders_matches_linear_scan() {
+        let mut rng = StdRng::seed_from_u64(1);
+        let volumes: Vec<_> = (0..500)
+            .map(|_| {
+                let min = rng.gen_range(0, 10);
+                (min, min + rng.gen_range(0, 10))
+            })
+            .collect();
+        let (tree, uuids) = tree_with_volumes(&volumes);
+        for required in 0..3000 {
+            let mut expected = Vec::new();
+            let mut collected = 0;
+            for (idx, (min, max)) in volumes.iter().enumerate() {
+                if *min > required {
+                    continue;
+                }
+                expected.push(idx);
+                collected += max;
+                if collected >= required {
+                    break;
+                }
+            }
+            assert_eq!(covering(&tree, &uuids, VolumeIn::Base, required), expected);
+        }
+    }
+
+    #[test]
+    fn test_pair_tree_insert_replaces_equal_order() {
+        let mut tree = PairTree::default();
+        let mut first = order(1);
+        tree.insert(first.clone());
+        tree.insert(order(2));
+        first.max_volume = BigRational::from_integer(2.into());
+        tree.insert(first.clone());
+        assert_eq!(tree.len(), 2);
+        assert_eq!(tree.iter().next(), Some(&first));
+    }
+}
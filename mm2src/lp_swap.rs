@@ -57,6 +57,10 @@
 
 #[cfg(not(target_arch = "wasm32"))]
 use crate::mm2::database::database_common::PagingOptions;
+#[cfg(not(target_arch = "wasm32"))]
+use crate::mm2::database::my_swaps::RecentSwapsSelectSqlResult;
+#[cfg(not(target_arch = "wasm32"))]
+use crate::mm2::database::swaps_indexing::{spawn_json_swaps_indexing, SwapsIndexingProgress};
 use crate::mm2::lp_network::broadcast_p2p_msg;
 use async_std::sync as async_std_sync;
 use bigdecimal::BigDecimal;
@@ -69,7 +73,7 @@ use common::{bits256, block_on, calc_total_pages,
              now_ms, read_dir, rpc_response, slurp, var, write, HyRes};
 use futures::future::{abortable, AbortHandle, TryFutureExt};
 use http::Response;
-use mm2_libp2p::{decode_signed, encode_and_sign, pub_sub_topic, TopicPrefix};
+use mm2_libp2p::{decode_signed_unverified, encode_and_sign, pub_sub_topic, TopicPrefix};
 use num_rational::BigRational;
 use primitives::hash::{H160, H264};
 use rpc::v1::types::{Bytes as BytesJson, H256 as H256Json};
@@ -90,6 +94,7 @@ use uuid::Uuid;
 #[path = "lp_swap/pubkey_banning.rs"] mod pubkey_banning;
 
 #[path = "lp_swap/check_balance.rs"] mod check_balance;
+#[path = "lp_swap/swap_journal.rs"] mod swap_journal;
 #[path = "lp_swap/trade_preimage.rs"] mod trade_preimage;
 
 pub use check_balance::check_other_coin_balance_for_swap;
@@ -98,6 +103,8 @@ pub use maker_swap::{calc_max_maker_vol, check_balance_for_maker_swap, maker_swa
 use maker_swap::{stats_maker_swap_file_path, MakerSwapEvent};
 use pubkey_banning::BanReason;
 pub use pubkey_banning::{ban_pubkey_rpc, is_pubkey_banned, list_banned_pubkeys_rpc, unban_pubkeys_rpc};
+pub use swap_journal::load_my_swap;
+use swap_journal::MySwapsStorage;
 pub use taker_swap::{calc_max_taker_vol, check_balance_for_taker_swap, max_taker_vol, max_taker_vol_from_available,
                      run_taker_swap, stats_taker_swap_dir, taker_swap_trade_preimage, RunTakerSwapInput,
                      TakerSavedSwap, TakerSwap, TakerSwapPreparedParams, TakerTradePreimage};
@@ -164,29 +171,60 @@ pub fn broadcast_swap_message(ctx: &MmArc, topic: String, msg: SwapMsg) {
     broadcast_p2p_msg(ctx, vec![topic], encoded_msg);
 }
 
-pub fn process_msg(ctx: MmArc, topic: &str, msg: &[u8]) {
-    let uuid = match Uuid::from_str(topic) {
-        Ok(u) => u,
-        Err(_) => return,
+/// The swap message with the verified signature or the swap status to save to the stats.
+pub enum DecodedMsg {
+    Msg { uuid: Uuid, msg: SwapMsg, sender: [u8; 32] },
+    Status(SwapStatus),
+}
+
+/// Decodes the message and verifies its signature.
+/// The messages of unknown swaps and of unexpected senders are rejected before the signature verification.
+///
+/// This is CPU-bound, so it's called on the verification pool by the `lp_network::p2p_event_process_loop`.
+pub fn decode_msg(ctx: &MmArc, topic: &str, msg: &[u8]) -> Option<DecodedMsg> {
+    let uuid = Uuid::from_str(topic).ok()?;
+    let unverified = match decode_signed_unverified(msg) {
+        Ok(unverified) => unverified,
+        Err(swap_msg_err) => return decode_swap_status(msg, swap_msg_err),
     };
-    let msg = match decode_signed::<SwapMsg>(msg) {
-        Ok(m) => m,
-        Err(swap_msg_err) => {
-            match json::from_slice::<SwapStatus>(msg) {
-                Ok(status) => save_stats_swap(&ctx, &status.data).unwrap(),
-                Err(swap_status_err) => {
-                    error!("Couldn't deserialize 'SwapMsg': {:?}", swap_msg_err);
-                    error!("Couldn't deserialize 'SwapStatus': {:?}", swap_status_err);
-                },
-            };
+
+    let sender = unverified.pubkey().unprefixed();
+    let swap_ctx = SwapsContext::from_ctx(&ctx).unwrap();
+    match swap_ctx.swap_msgs.lock().unwrap().get(&uuid) {
+        Some(msg_store) if msg_store.accept_only_from.bytes == sender => (),
+        _ => return None,
+    }
+
+    match unverified.verify_and_decode::<SwapMsg>() {
+        Ok((msg, ..)) => Some(DecodedMsg::Msg { uuid, msg, sender }),
+        Err(swap_msg_err) => decode_swap_status(msg, swap_msg_err),
+    }
+}
+
+fn decode_swap_status(msg: &[u8], swap_msg_err: rmp_serde::decode::Error) -> Option<DecodedMsg> {
+    match json::from_slice::<SwapStatus>(msg) {
+        Ok(status) => Some(DecodedMsg::Status(status)),
+        Err(swap_status_err) => {
+            error!("Couldn't deserialize 'SwapMsg': {:?}", swap_msg_err);
+            error!("Couldn't deserialize 'SwapStatus': {:?}", swap_status_err);
+            None
+        },
+    }
+}
+
+pub fn process_decoded_msg(ctx: &MmArc, decoded: DecodedMsg) {
+    let (uuid, msg, sender) = match decoded {
+        DecodedMsg::Msg { uuid, msg, sender } => (uuid, msg, sender),
+        DecodedMsg::Status(status) => {
+            save_stats_swap(ctx, &status.data).unwrap();
             return;
         },
     };
     let swap_ctx = SwapsContext::from_ctx(&ctx).unwrap();
     let mut msgs = swap_ctx.swap_msgs.lock().unwrap();
     if let Some(msg_store) = msgs.get_mut(&uuid) {
-        if msg_store.accept_only_from.bytes == msg.2.unprefixed() {
-            match msg.0 {
+        if msg_store.accept_only_from.bytes == sender {
+            match msg {
                 SwapMsg::Negotiation(data) => msg_store.negotiation = Some(data),
                 SwapMsg::NegotiationReply(data) => msg_store.negotiation_reply = Some(data),
                 SwapMsg::Negotiated(negotiated) => msg_store.negotiated = Some(negotiated),
@@ -294,6 +332,11 @@ struct SwapsContext {
     /// Very unpleasant consequences
     shutdown_rx: async_std_sync::Receiver<()>,
     swap_msgs: Mutex<HashMap<Uuid, SwapMsgStore>>,
+    /// The materialized `my` swaps.
+    my_swaps: MySwapsStorage,
+    /// The progress of the background indexing of the swap files saved before the SQLite index was created.
+    #[cfg(not(target_arch = "wasm32"))]
+    swaps_indexing: Arc<SwapsIndexingProgress>,
 }
 
 impl SwapsContext {
@@ -319,6 +362,9 @@ impl SwapsContext {
                 banned_pubkeys: Mutex::new(HashMap::new()),
                 swap_msgs: Mutex::new(HashMap::new()),
                 shutdown_rx,
+                my_swaps: MySwapsStorage::default(),
+                #[cfg(not(target_arch = "wasm32"))]
+                swaps_indexing: Arc::new(SwapsIndexingProgress::default()),
             })
         })))
     }
@@ -645,6 +691,96 @@ fn add_swap_to_db_index(ctx: &MmArc, swap: &SavedSwap) {
 #[cfg(target_arch = "wasm32")]
 fn add_swap_to_db_index(_ctx: &MmArc, _swap: &SavedSwap) {}
 
+#[cfg(not(target_arch = "wasm32"))]
+fn mark_swap_finished_in_db(ctx: &MmArc, uuid: &Uuid) {
+    use crate::mm2::database::my_swaps::mark_swaps_finished;
+
+    if let Err(e) = mark_swaps_finished(&ctx.sqlite_connection(), &[*uuid]) {
+        error!("Error {} marking the swap {} finished", e, uuid);
+    }
+}
+
+#[cfg(target_arch = "wasm32")]
+fn mark_swap_finished_in_db(_ctx: &MmArc, _uuid: &Uuid) {}
+
+/// Starts indexing the swap files that are not in the SQLite index yet in background.
+/// The history RPCs select the swaps from the swap files until the my_swaps table is complete.
+#[cfg(not(target_arch = "wasm32"))]
+pub fn spawn_swaps_indexing(ctx: &MmArc) -> Result<(), String> {
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(ctx));
+    spawn_json_swaps_indexing(ctx.clone(), swaps_ctx.swaps_indexing.clone())
+}
+
+/// Selects the uuids of my swaps matching the filter from the my_swaps table if it's indexed completely,
+/// or from the swap files otherwise.
+#[cfg(not(target_arch = "wasm32"))]
+fn select_my_swaps_uuids(
+    ctx: &MmArc,
+    filter: &MySwapsFilter,
+    paging_options: Option<&PagingOptions>,
+) -> Result<RecentSwapsSelectSqlResult, String> {
+    use crate::mm2::database::my_swaps::select_uuids_by_my_swaps_filter;
+
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(ctx));
+    if swaps_ctx.swaps_indexing.is_my_swaps_indexed() {
+        return Ok(try_s!(select_uuids_by_my_swaps_filter(
+            &ctx.sqlite_connection(),
+            filter,
+            paging_options
+        )));
+    }
+
+    let uuids = try_s!(my_swaps_uuids(ctx));
+    let infos = load_my_swaps(ctx, &uuids)
+        .into_iter()
+        .filter_map(|swap| swap.get_my_info().map(|info| (*swap.uuid(), info)))
+        .collect();
+    filter_my_swaps_infos(infos, filter, paging_options)
+}
+
+/// Filters, orders and pages the swaps the same way `select_uuids_by_my_swaps_filter` does.
+#[cfg(not(target_arch = "wasm32"))]
+fn filter_my_swaps_infos(
+    mut infos: Vec<(Uuid, MySwapInfo)>,
+    filter: &MySwapsFilter,
+    paging_options: Option<&PagingOptions>,
+) -> Result<RecentSwapsSelectSqlResult, String> {
+    infos.retain(|(_, info)| {
+        filter.my_coin.as_ref().map_or(true, |coin| *coin == info.my_coin)
+            && filter.other_coin.as_ref().map_or(true, |coin| *coin == info.other_coin)
+            && filter.from_timestamp.map_or(true, |from| info.started_at >= from)
+            && filter.to_timestamp.map_or(true, |to| info.started_at < to)
+    });
+    let total_count = infos.len();
+    if total_count == 0 {
+        return Ok(RecentSwapsSelectSqlResult::default());
+    }
+
+    infos.sort_by(|(_, a), (_, b)| b.started_at.cmp(&a.started_at));
+    let mut uuids: Vec<Uuid> = infos.into_iter().map(|(uuid, _)| uuid).collect();
+    let skipped = match paging_options {
+        Some(paging) => {
+            // page_number is ignored if from_uuid is set
+            let offset = match paging.from_uuid {
+                Some(from_uuid) => match uuids.iter().position(|uuid| *uuid == from_uuid) {
+                    Some(position) => position + 1,
+                    None => return ERR!("The swap {} is not found", from_uuid),
+                },
+                None => (paging.page_number.get() - 1) * paging.limit,
+            };
+            uuids = uuids.into_iter().skip(offset).take(paging.limit).collect();
+            offset
+        },
+        None => 0,
+    };
+
+    Ok(RecentSwapsSelectSqlResult {
+        uuids,
+        total_count,
+        skipped,
+    })
+}
+
 fn save_stats_swap(ctx: &MmArc, swap: &SavedSwap) -> Result<(), String> {
     let (path, content) = match &swap {
         SavedSwap::Maker(maker_swap) => (
@@ -670,7 +806,7 @@ pub enum SavedSwap {
 
 /// The helper structure that makes easier to parse the response for GUI devs
 /// They won't have to parse the events themselves handling possible errors, index out of bounds etc.
-#[derive(Debug, Serialize, Deserialize)]
+#[derive(Clone, Debug, Serialize, Deserialize)]
 pub struct MySwapInfo {
     pub my_coin: String,
     pub other_coin: String,
@@ -680,7 +816,7 @@ pub struct MySwapInfo {
 }
 
 impl SavedSwap {
-    fn is_finished(&self) -> bool {
+    pub fn is_finished(&self) -> bool {
         match self {
             SavedSwap::Maker(swap) => swap.is_finished(),
             SavedSwap::Taker(swap) => swap.is_finished(),
@@ -822,25 +958,28 @@ impl<'a> From<&'a SavedSwap> for MySwapStatusResponse<'a> {
 }
 
 /// Returns the status of swap performed on `my` node
-pub fn my_swap_status(ctx: MmArc, req: Json) -> HyRes {
-    let uuid: Uuid = try_h!(json::from_value(req["params"]["uuid"].clone()));
-    let path = my_swap_file_path(&ctx, &uuid);
-    let content = try_h!(slurp(&path));
-    if content.is_empty() {
-        return rpc_response(
-            404,
-            json!({
-                "error": "swap data is not found"
+pub async fn my_swap_status(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
+    let uuid: Uuid = try_s!(json::from_value(req["params"]["uuid"].clone()));
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(&ctx));
+    let status = try_s!(
+        swaps_ctx
+            .my_swaps
+            .with_swap(&ctx, &uuid, |swap| {
+                json!({ "result": MySwapStatusResponse::from(swap) }).to_string()
             })
-            .to_string(),
-        );
+            .await
+    );
+    match status {
+        Some(status) => Ok(try_s!(Response::builder().body(status.into_bytes()))),
+        None => {
+            let res = json!({
+                "error": "swap data is not found"
+            });
+            Ok(try_s!(Response::builder()
+                .status(404)
+                .body(res.to_string().into_bytes())))
+        },
     }
-    let status: SavedSwap = try_h!(json::from_slice(&content));
-
-    rpc_response(
-        200,
-        json!({ "result": MySwapStatusResponse::from(&status) }).to_string(),
-    )
 }
 
 /// Returns the status of requested swap, typically performed by other nodes and saved by `save_stats_swap_status`
@@ -885,16 +1024,17 @@ pub fn stats_swap_status(ctx: MmArc, req: Json) -> HyRes {
 }
 
 #[derive(Debug, Deserialize, Serialize)]
-struct SwapStatus {
+pub struct SwapStatus {
     method: String,
     data: SavedSwap,
 }
 
 /// Broadcasts `my` swap status to P2P network
 fn broadcast_my_swap_status(uuid: &Uuid, ctx: &MmArc) -> Result<(), String> {
-    let path = my_swap_file_path(ctx, uuid);
-    let content = try_s!(slurp(&path));
-    let mut status: SavedSwap = try_s!(json::from_slice(&content));
+    let mut status = match try_s!(load_my_swap(ctx, uuid)) {
+        Some(status) => status,
+        None => return ERR!("swap data is not found"),
+    };
     match &mut status {
         SavedSwap::Taker(_) => (), // do nothing for taker
         SavedSwap::Maker(ref mut swap) => swap.hide_secret(),
@@ -929,10 +1069,8 @@ pub fn all_swaps_uuids_by_filter(_ctx: MmArc, _req: Json) -> HyRes {
 /// Returns *all* uuids of swaps, which match the selected filter.
 #[cfg(not(target_arch = "wasm32"))]
 pub fn all_swaps_uuids_by_filter(ctx: MmArc, req: Json) -> HyRes {
-    use crate::mm2::database::my_swaps::select_uuids_by_my_swaps_filter;
-
     let filter: MySwapsFilter = try_h!(json::from_value(req));
-    let db_result = try_h!(select_uuids_by_my_swaps_filter(&ctx.sqlite_connection(), &filter, None));
+    let db_result = try_h!(select_my_swaps_uuids(&ctx, &filter, None));
 
     rpc_response(
         200,
@@ -960,158 +1098,231 @@ pub struct MyRecentSwapsReq {
 }
 
 #[cfg(target_arch = "wasm32")]
-pub fn my_recent_swaps(_ctx: MmArc, _req: Json) -> HyRes {
-    Box::new(futures01::future::err::<Response<Vec<u8>>, String>(ERRL!(
-        "'my_recent_swaps' is only supported in native mode yet"
-    )))
+pub async fn my_recent_swaps(_ctx: MmArc, _req: Json) -> Result<Response<Vec<u8>>, String> {
+    ERR!("'my_recent_swaps' is only supported in native mode yet")
 }
 
 /// Returns the data of recent swaps of `my` node.
 #[cfg(not(target_arch = "wasm32"))]
-pub fn my_recent_swaps(ctx: MmArc, req: Json) -> HyRes {
-    use crate::mm2::database::my_swaps::select_uuids_by_my_swaps_filter;
+pub async fn my_recent_swaps(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
+    let req: MyRecentSwapsReq = try_s!(json::from_value(req));
+    // the swaps are selected on the blocking thread pool, the swap files are read until the index is complete
+    let (req, db_result) = {
+        let ctx = ctx.clone();
+        common::executor::spawn_blocking(move || {
+            let db_result = select_my_swaps_uuids(&ctx, &req.filter, Some(&req.paging_options));
+            (req, db_result)
+        })
+        .await
+    };
+    let db_result = try_s!(db_result);
+
+    // iterate over uuids trying to get the materialized swaps and add to result vector
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(&ctx));
+    let mut swaps = Vec::with_capacity(db_result.uuids.len());
+    for uuid in db_result.uuids.iter() {
+        let swap = swaps_ctx
+            .my_swaps
+            .with_swap(&ctx, uuid, |swap| {
+                json::to_value(MySwapStatusResponse::from(swap)).unwrap()
+            })
+            .await;
+        match swap {
+            Ok(Some(swap)) => swaps.push(swap),
+            Ok(None) => swaps.push(Json::Null),
+            Err(e) => {
+                error!("Error {} loading the swap {}", e, uuid);
+                swaps.push(Json::Null)
+            },
+        }
+    }
 
-    let req: MyRecentSwapsReq = try_h!(json::from_value(req));
-    let db_result = try_h!(select_uuids_by_my_swaps_filter(
-        &ctx.sqlite_connection(),
-        &req.filter,
-        Some(&req.paging_options),
-    ));
+    let res = json!({
+        "result": {
+            "swaps": swaps,
+            "from_uuid": req.paging_options.from_uuid,
+            "skipped": db_result.skipped,
+            "limit": req.paging_options.limit,
+            "total": db_result.total_count,
+            "page_number": req.paging_options.page_number,
+            "total_pages": calc_total_pages(db_result.total_count, req.paging_options.limit),
+            "found_records": db_result.uuids.len(),
+        },
+    });
+    Ok(try_s!(Response::builder().body(res.to_string().into_bytes())))
+}
 
-    // iterate over uuids trying to parse the corresponding files content and add to result vector
-    let swaps: Vec<Json> = db_result
-        .uuids
-        .iter()
-        .map(|uuid| {
-            let path = my_swap_file_path(&ctx, uuid);
-            match json::from_slice::<SavedSwap>(&slurp(&path).unwrap()) {
-                Ok(swap) => json::to_value(MySwapStatusResponse::from(&swap)).unwrap(),
-                Err(e) => {
-                    error!("Error {} parsing JSON from {}", e, path.display());
-                    Json::Null
-                },
+/// The number of threads loading the swaps on kick-start.
+#[cfg(not(target_arch = "wasm32"))]
+const KICK_START_LOADING_THREADS: usize = 4;
+
+fn my_swaps_uuids(ctx: &MmArc) -> Result<Vec<Uuid>, String> {
+    Ok(try_s!(read_dir(&my_swaps_dir(ctx)))
+        .into_iter()
+        .filter_map(|(_lm, path)| {
+            if path.extension() != Some(OsStr::new("json")) {
+                return None;
             }
+            path.file_stem()
+                .and_then(OsStr::to_str)
+                .and_then(|stem| Uuid::from_str(stem).ok())
         })
-        .collect();
+        .collect())
+}
 
-    rpc_response(
-        200,
-        json!({
-            "result": {
-                "swaps": swaps,
-                "from_uuid": req.paging_options.from_uuid,
-                "skipped": db_result.skipped,
-                "limit": req.paging_options.limit,
-                "total": db_result.total_count,
-                "page_number": req.paging_options.page_number,
-                "total_pages": calc_total_pages(db_result.total_count, req.paging_options.limit),
-                "found_records": db_result.uuids.len(),
+fn load_my_swaps(ctx: &MmArc, uuids: &[Uuid]) -> Vec<SavedSwap> {
+    uuids
+        .iter()
+        .filter_map(|uuid| match load_my_swap(ctx, uuid) {
+            Ok(swap) => swap,
+            Err(e) => {
+                error!("Error {} loading the swap {}", e, uuid);
+                None
             },
         })
-        .to_string(),
-    )
+        .collect()
+}
+
+/// Loads the swaps that are not known to be finished, the swap files are parsed in parallel.
+/// The swaps found finished are marked in the my_swaps table, so they are not loaded on the next start.
+#[cfg(not(target_arch = "wasm32"))]
+fn load_unfinished_swaps(ctx: &MmArc) -> Result<Vec<SavedSwap>, String> {
+    use crate::mm2::database::my_swaps::{mark_swaps_finished, select_finished_uuids};
+
+    let finished = try_s!(select_finished_uuids(&ctx.sqlite_connection()));
+    let uuids: Vec<Uuid> = try_s!(my_swaps_uuids(ctx))
+        .into_iter()
+        .filter(|uuid| !finished.contains(&uuid.to_string()))
+        .collect();
+
+    let chunk_size = std::cmp::max(
+        1,
+        (uuids.len() + KICK_START_LOADING_THREADS - 1) / KICK_START_LOADING_THREADS,
+    );
+    let loaded = crossbeam::scope(|scope| {
+        let handles: Vec<_> = uuids
+            .chunks(chunk_size)
+            .map(|chunk| scope.spawn(move |_| load_my_swaps(ctx, chunk)))
+            .collect();
+        handles
+            .into_iter()
+            .map(|handle| handle.join())
+            .collect::<Result<Vec<_>, _>>()
+    });
+    let swaps: Vec<SavedSwap> = match loaded {
+        Ok(Ok(swaps)) => swaps.into_iter().flatten().collect(),
+        _ => return ERR!("Swaps loading thread panicked"),
+    };
+
+    let (finished, unfinished): (Vec<_>, Vec<_>) = swaps.into_iter().partition(SavedSwap::is_finished);
+    let finished: Vec<Uuid> = finished.iter().map(|swap| *swap.uuid()).collect();
+    if let Err(e) = mark_swaps_finished(&ctx.sqlite_connection(), &finished) {
+        error!("Error {} marking the finished swaps", e);
+    }
+    Ok(unfinished)
+}
+
+#[cfg(target_arch = "wasm32")]
+fn load_unfinished_swaps(ctx: &MmArc) -> Result<Vec<SavedSwap>, String> {
+    let uuids = try_s!(my_swaps_uuids(ctx));
+    Ok(load_my_swaps(ctx, &uuids)
+        .into_iter()
+        .filter(|swap| !swap.is_finished())
+        .collect())
 }
 
 /// Find out the swaps that need to be kick-started, continue from the point where swap was interrupted
 /// Return the tickers of coins that must be enabled for swaps to continue
 pub fn swap_kick_starts(ctx: MmArc) -> HashSet<String> {
     let mut coins = HashSet::new();
-    let entries: Vec<PathBuf> = read_dir(&my_swaps_dir(&ctx))
-        .unwrap()
-        .into_iter()
-        .filter_map(|(_lm, path)| {
-            if path.extension() == Some(OsStr::new("json")) {
-                Some(path)
-            } else {
-                None
-            }
-        })
-        .collect();
+    let swaps = match load_unfinished_swaps(&ctx) {
+        Ok(swaps) => swaps,
+        Err(e) => {
+            error!("Error {} loading the unfinished swaps", e);
+            return coins;
+        },
+    };
 
-    entries.iter().for_each(|path| {
-        if let Ok(swap) = json::from_slice::<SavedSwap>(&slurp(&path).unwrap()) {
-            if !swap.is_finished() {
-                info!("Kick starting the swap {}", swap.uuid());
-                let maker_coin_ticker = match swap.maker_coin_ticker() {
-                    Ok(t) => t,
-                    Err(e) => {
-                        error!("Error {} getting maker coin of swap: {}", e, swap.uuid());
-                        return;
-                    },
+    swaps.into_iter().for_each(|swap| {
+        info!("Kick starting the swap {}", swap.uuid());
+        let maker_coin_ticker = match swap.maker_coin_ticker() {
+            Ok(t) => t,
+            Err(e) => {
+                error!("Error {} getting maker coin of swap: {}", e, swap.uuid());
+                return;
+            },
+        };
+        let taker_coin_ticker = match swap.taker_coin_ticker() {
+            Ok(t) => t,
+            Err(e) => {
+                error!("Error {} getting taker coin of swap {}", e, swap.uuid());
+                return;
+            },
+        };
+        coins.insert(maker_coin_ticker.clone());
+        coins.insert(taker_coin_ticker.clone());
+        thread::spawn({
+            let ctx = ctx.clone();
+            move || {
+                let taker_coin = loop {
+                    match block_on(lp_coinfind(&ctx, &taker_coin_ticker)) {
+                        Ok(Some(c)) => break c,
+                        Ok(None) => {
+                            info!(
+                                "Can't kickstart the swap {} until the coin {} is activated",
+                                swap.uuid(),
+                                taker_coin_ticker
+                            );
+                            thread::sleep(Duration::from_secs(5));
+                        },
+                        Err(e) => {
+                            error!("Error {} on {} find attempt", e, taker_coin_ticker);
+                            return;
+                        },
+                    };
                 };
-                let taker_coin_ticker = match swap.taker_coin_ticker() {
-                    Ok(t) => t,
-                    Err(e) => {
-                        error!("Error {} getting taker coin of swap {}", e, swap.uuid());
-                        return;
-                    },
+
+                let maker_coin = loop {
+                    match block_on(lp_coinfind(&ctx, &maker_coin_ticker)) {
+                        Ok(Some(c)) => break c,
+                        Ok(None) => {
+                            info!(
+                                "Can't kickstart the swap {} until the coin {} is activated",
+                                swap.uuid(),
+                                maker_coin_ticker
+                            );
+                            thread::sleep(Duration::from_secs(5));
+                        },
+                        Err(e) => {
+                            error!("Error {} on {} find attempt", e, maker_coin_ticker);
+                            return;
+                        },
+                    };
                 };
-                coins.insert(maker_coin_ticker.clone());
-                coins.insert(taker_coin_ticker.clone());
-                thread::spawn({
-                    let ctx = ctx.clone();
-                    move || {
-                        let taker_coin = loop {
-                            match block_on(lp_coinfind(&ctx, &taker_coin_ticker)) {
-                                Ok(Some(c)) => break c,
-                                Ok(None) => {
-                                    info!(
-                                        "Can't kickstart the swap {} until the coin {} is activated",
-                                        swap.uuid(),
-                                        taker_coin_ticker
-                                    );
-                                    thread::sleep(Duration::from_secs(5));
-                                },
-                                Err(e) => {
-                                    error!("Error {} on {} find attempt", e, taker_coin_ticker);
-                                    return;
-                                },
-                            };
-                        };
-
-                        let maker_coin = loop {
-                            match block_on(lp_coinfind(&ctx, &maker_coin_ticker)) {
-                                Ok(Some(c)) => break c,
-                                Ok(None) => {
-                                    info!(
-                                        "Can't kickstart the swap {} until the coin {} is activated",
-                                        swap.uuid(),
-                                        maker_coin_ticker
-                                    );
-                                    thread::sleep(Duration::from_secs(5));
-                                },
-                                Err(e) => {
-                                    error!("Error {} on {} find attempt", e, maker_coin_ticker);
-                                    return;
-                                },
-                            };
-                        };
-                        match swap {
-                            SavedSwap::Maker(saved_swap) => {
-                                block_on(run_maker_swap(
-                                    RunMakerSwapInput::KickStart {
-                                        maker_coin,
-                                        taker_coin,
-                                        swap_uuid: saved_swap.uuid,
-                                    },
-                                    ctx,
-                                ));
+                match swap {
+                    SavedSwap::Maker(saved_swap) => {
+                        block_on(run_maker_swap(
+                            RunMakerSwapInput::KickStart {
+                                maker_coin,
+                                taker_coin,
+                                swap_uuid: saved_swap.uuid,
                             },
-                            SavedSwap::Taker(saved_swap) => {
-                                block_on(run_taker_swap(
-                                    RunTakerSwapInput::KickStart {
-                                        maker_coin,
-                                        taker_coin,
-                                        swap_uuid: saved_swap.uuid,
-                                    },
-                                    ctx,
-                                ));
+                            ctx,
+                        ));
+                    },
+                    SavedSwap::Taker(saved_swap) => {
+                        block_on(run_taker_swap(
+                            RunTakerSwapInput::KickStart {
+                                maker_coin,
+                                taker_coin,
+                                swap_uuid: saved_swap.uuid,
                             },
-                        }
-                    }
-                });
+                            ctx,
+                        ));
+                    },
+                }
             }
-        }
+        });
     });
     coins
 }
@@ -1125,13 +1336,10 @@ pub async fn coins_needed_for_kick_start(ctx: MmArc) -> Result<Response<Vec<u8>>
 
 pub async fn recover_funds_of_swap(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
     let uuid: Uuid = try_s!(json::from_value(req["params"]["uuid"].clone()));
-    let path = my_swap_file_path(&ctx, &uuid);
-    let content = try_s!(slurp(&path));
-    if content.is_empty() {
-        return ERR!("swap data is not found");
-    }
-
-    let swap: SavedSwap = try_s!(json::from_slice(&content));
+    let swap = match try_s!(load_my_swap(&ctx, &uuid)) {
+        Some(swap) => swap,
+        None => return ERR!("swap data is not found"),
+    };
 
     let recover_data = try_s!(swap.recover_funds(ctx));
     let res = try_s!(json::to_vec(&json!({
@@ -1197,25 +1405,13 @@ pub async fn active_swaps_rpc(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>
     let statuses = if req.include_status {
         let mut map = HashMap::new();
         for uuid in uuids.iter() {
-            let path = my_swap_file_path(&ctx, &uuid);
-            let content = match slurp(&path) {
-                Ok(c) => c,
-                Err(e) => {
-                    error!("Error {} on slurp({})", e, path.display());
-                    continue;
+            match load_my_swap(&ctx, uuid) {
+                Ok(Some(status)) => {
+                    map.insert(*uuid, status);
                 },
-            };
-            if content.is_empty() {
-                continue;
+                Ok(None) => (),
+                Err(e) => error!("Error {} loading the swap {}", e, uuid),
             }
-            let status: SavedSwap = match json::from_slice(&content) {
-                Ok(s) => s,
-                Err(e) => {
-                    error!("Error {} on deserializing the content {:?}", e, content);
-                    continue;
-                },
-            };
-            map.insert(*uuid, status);
         }
         Some(map)
     } else {
@@ -1264,6 +1460,68 @@ mod lp_swap_tests {
         assert_eq!(dex_fee_threshold, actual_fee);
     }
 
+    #[test]
+    #[cfg(not(target_arch = "wasm32"))]
+    fn test_filter_my_swaps_infos() {
+        use std::num::NonZeroUsize;
+
+        let info = |my_coin: &str, started_at: u64| MySwapInfo {
+            my_coin: my_coin.into(),
+            other_coin: "MORTY".into(),
+            my_amount: 1.into(),
+            other_amount: 1.into(),
+            started_at,
+        };
+        let uuids: Vec<Uuid> = (0..4).map(|_| Uuid::new_v4()).collect();
+        let infos = vec![
+            (uuids[0], info("RICK", 100)),
+            (uuids[1], info("RICK", 300)),
+            (uuids[2], info("MORTY", 200)),
+            (uuids[3], info("RICK", 200)),
+        ];
+        let filter = MySwapsFilter {
+            my_coin: Some("RICK".into()),
+            other_coin: None,
+            from_timestamp: None,
+            to_timestamp: None,
+        };
+
+        let result = filter_my_swaps_infos(infos.clone(), &filter, None).unwrap();
+        assert_eq!(result.uuids, vec![uuids[1], uuids[3], uuids[0]]);
+        assert_eq!(result.total_count, 3);
+        assert_eq!(result.skipped, 0);
+
+        let paging = PagingOptions {
+            limit: 1,
+            page_number: NonZeroUsize::new(2).unwrap(),
+            from_uuid: None,
+        };
+        let result = filter_my_swaps_infos(infos.clone(), &filter, Some(&paging)).unwrap();
+        assert_eq!(result.uuids, vec![uuids[3]]);
+        assert_eq!(result.total_count, 3);
+        assert_eq!(result.skipped, 1);
+
+        // page_number is ignored if from_uuid is set
+        let paging = PagingOptions {
+            limit: 10,
+            page_number: NonZeroUsize::new(2).unwrap(),
+            from_uuid: Some(uuids[1]),
+        };
+        let result = filter_my_swaps_infos(infos.clone(), &filter, Some(&paging)).unwrap();
+        assert_eq!(result.uuids, vec![uuids[3], uuids[0]]);
+        assert_eq!(result.skipped, 1);
+
+        let filter = MySwapsFilter {
+            my_coin: None,
+            other_coin: Some("MORTY".into()),
+            from_timestamp: Some(200),
+            to_timestamp: Some(300),
+        };
+        let result = filter_my_swaps_infos(infos, &filter, None).unwrap();
+        assert_eq!(result.total_count, 2);
+        assert!(result.uuids.contains(&uuids[2]) && result.uuids.contains(&uuids[3]));
+    }
+
     #[test]
     fn test_serde_swap_negotiation_data() {
         let data = SwapNegotiationData::default();
@@ -1,10 +1,11 @@
 use super::check_balance::{check_base_coin_balance_for_swap, check_my_coin_balance_for_swap, CheckBalanceError,
                            CheckBalanceResult};
 use super::pubkey_banning::ban_pubkey_on_failed_swap;
+use super::swap_journal::SavedSwapEvent;
 use super::trade_preimage::{TradePreimageRequest, TradePreimageRpcError, TradePreimageRpcResult};
 use super::{broadcast_my_swap_status, broadcast_swap_message_every, check_other_coin_balance_for_swap,
-            dex_fee_amount_from_taker_coin, get_locked_amount, my_swap_file_path, my_swaps_dir, recv_swap_msg,
-            swap_topic, AtomicSwap, LockedAmount, MySwapInfo, NegotiationDataMsg, NegotiationDataV2, RecoveredSwap,
+            dex_fee_amount_from_taker_coin, get_locked_amount, load_my_swap, my_swaps_dir, recv_swap_msg, swap_topic,
+            AtomicSwap, LockedAmount, MySwapInfo, NegotiationDataMsg, NegotiationDataV2, RecoveredSwap,
             RecoveredSwapAction, SavedSwap, SavedTradeFee, SwapConfirmationsSettings, SwapError, SwapMsg,
             SwapsContext, TransactionIdentifier, WAIT_CONFIRM_INTERVAL};
 
@@ -17,7 +18,7 @@ use bitcrypto::dhash160;
 use coins::{CanRefundHtlc, FeeApproxStage, FoundSwapTxSpend, MmCoinEnum, TradeFee, TradePreimageValue, TransactionEnum};
 use common::mm_error::prelude::*;
 use common::{bits256, executor::Timer, file_lock::FileLock, log::error, mm_ctx::MmArc, mm_number::MmNumber, now_ms,
-             slurp, write, DEX_FEE_ADDR_RAW_PUBKEY};
+             DEX_FEE_ADDR_RAW_PUBKEY};
 use futures::{compat::Future01CompatExt, select, FutureExt};
 use futures01::Future;
 use parking_lot::Mutex as PaMutex;
@@ -35,10 +36,9 @@ pub fn stats_maker_swap_file_path(ctx: &MmArc, uuid: &Uuid) -> PathBuf {
     stats_maker_swap_dir(ctx).join(format!("{}.json", uuid))
 }
 
-fn save_my_maker_swap_event(ctx: &MmArc, swap: &MakerSwap, event: MakerSavedEvent) -> Result<(), String> {
-    let path = my_swap_file_path(ctx, &swap.uuid);
-    let content = try_s!(slurp(&path));
-    let swap: SavedSwap = if content.is_empty() {
+async fn save_my_maker_swap_event(ctx: &MmArc, swap: &MakerSwap, event: MakerSavedEvent) -> Result<(), String> {
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(ctx));
+    let new_swap = || {
         SavedSwap::Maker(MakerSavedSwap {
             uuid: swap.uuid,
             my_order_uuid: swap.my_order_uuid,
@@ -78,19 +78,8 @@ fn save_my_maker_swap_event(ctx: &MmArc, swap: &MakerSwap, event: MakerSavedEven
                 "MakerPaymentRefundFailed".into(),
             ],
         })
-    } else {
-        try_s!(json::from_slice(&content))
     };
-
-    if let SavedSwap::Maker(mut maker_swap) = swap {
-        maker_swap.events.push(event);
-        let new_swap = SavedSwap::Maker(maker_swap);
-        let new_content = try_s!(json::to_vec(&new_swap));
-        try_s!(write(&path, &new_content));
-        Ok(())
-    } else {
-        ERR!("Expected SavedSwap::Maker at {}, got {:?}", path.display(), swap)
-    }
+    swaps_ctx.my_swaps.save_event(ctx, &swap.uuid, new_swap, event).await
 }
 
 #[derive(Clone, Debug, Deserialize, Eq, PartialEq, Serialize)]
@@ -868,8 +857,10 @@ impl MakerSwap {
         taker_coin: MmCoinEnum,
         swap_uuid: &Uuid,
     ) -> Result<(Self, Option<MakerSwapCommand>), String> {
-        let path = my_swap_file_path(&ctx, swap_uuid);
-        let saved: SavedSwap = try_s!(json::from_slice(&try_s!(slurp(&path))));
+        let saved = match try_s!(load_my_swap(&ctx, swap_uuid)) {
+            Some(saved) => saved,
+            None => return ERR!("swap data is not found, uuid: {}", swap_uuid),
+        };
         let saved = match saved {
             SavedSwap::Maker(swap) => swap,
             SavedSwap::Taker(_) => return ERR!("Can not load MakerSwap from SavedSwap::Taker uuid: {}", swap_uuid),
@@ -1214,11 +1205,20 @@ impl MakerSwapEvent {
 }
 
 #[derive(Debug, Deserialize, PartialEq, Serialize)]
-struct MakerSavedEvent {
+pub struct MakerSavedEvent {
     timestamp: u64,
     event: MakerSwapEvent,
 }
 
+impl SavedSwapEvent for MakerSavedEvent {
+    fn swap_events(swap: &mut SavedSwap) -> Option<&mut Vec<Self>> {
+        match swap {
+            SavedSwap::Maker(swap) => Some(&mut swap.events),
+            _ => None,
+        }
+    }
+}
+
 impl MakerSavedEvent {
     /// next command that must be executed after swap is restored
     fn get_command(&self) -> Option<MakerSwapCommand> {
@@ -1471,44 +1471,52 @@ pub async fn run_maker_swap(swap: RunMakerSwapInput, ctx: MmArc) {
     swap_ctx.running_swaps.lock().unwrap().push(weak_ref);
     let shutdown_rx = swap_ctx.shutdown_rx.clone();
     let swap_for_log = running_swap.clone();
+    let trace_name = format!("maker_swap {}", running_swap.uuid);
+    let tracer_ctx = ctx.clone();
     let mut swap_fut = Box::pin(
-        async move {
-            let mut events;
-            loop {
-                let res = running_swap.handle_command(command).await.expect("!handle_command");
-                events = res.1;
-                for event in events {
-                    let to_save = MakerSavedEvent {
-                        timestamp: now_ms(),
-                        event: event.clone(),
-                    };
-
-                    save_my_maker_swap_event(&ctx, &running_swap, to_save).expect("!save_my_maker_swap_event");
-                    if event.should_ban_taker() {
-                        ban_pubkey_on_failed_swap(
-                            &ctx,
-                            running_swap.taker.bytes.into(),
-                            &running_swap.uuid,
-                            event.clone().into(),
-                        )
-                    }
-                    status.status(swap_tags!(), &event.status_str());
-                    running_swap.apply_event(event).expect("!apply_event");
-                }
-                match res.0 {
-                    Some(c) => {
-                        command = c;
-                    },
-                    None => {
-                        if let Err(e) = broadcast_my_swap_status(&uuid, &ctx) {
-                            log!("!broadcast_my_swap_status(" (uuid) "): " (e));
+        tracer_ctx
+            .tracer
+            .trace(move || trace_name, async move {
+                let mut events;
+                loop {
+                    let span = trace_span!("swap_command", "{:?}", command);
+                    let res = running_swap.handle_command(command).await.expect("!handle_command");
+                    drop(span);
+                    events = res.1;
+                    for event in events {
+                        let to_save = MakerSavedEvent {
+                            timestamp: now_ms(),
+                            event: event.clone(),
+                        };
+
+                        save_my_maker_swap_event(&ctx, &running_swap, to_save)
+                            .await
+                            .expect("!save_my_maker_swap_event");
+                        if event.should_ban_taker() {
+                            ban_pubkey_on_failed_swap(
+                                &ctx,
+                                running_swap.taker.bytes.into(),
+                                &running_swap.uuid,
+                                event.clone().into(),
+                            )
                         }
-                        break;
-                    },
+                        status.status(swap_tags!(), &event.status_str());
+                        running_swap.apply_event(event).expect("!apply_event");
+                    }
+                    match res.0 {
+                        Some(c) => {
+                            command = c;
+                        },
+                        None => {
+                            if let Err(e) = broadcast_my_swap_status(&uuid, &ctx) {
+                                log!("!broadcast_my_swap_status(" (uuid) "): " (e));
+                            }
+                            break;
+                        },
+                    }
                 }
-            }
-        }
-        .fuse(),
+            })
+            .fuse(),
     );
     let mut shutdown_fut = Box::pin(shutdown_rx.recv().fuse());
     select! {
@@ -1532,6 +1540,7 @@ pub async fn check_balance_for_maker_swap(
     prepared_params: Option<MakerSwapPreparedParams>,
     stage: FeeApproxStage,
 ) -> CheckBalanceResult<()> {
+    let _span = trace_span!("check_balance_for_maker_swap", "{}", my_coin.ticker());
     let (maker_payment_trade_fee, taker_payment_spend_trade_fee) = match prepared_params {
         Some(MakerSwapPreparedParams {
             maker_payment_trade_fee,
@@ -0,0 +1,404 @@
+//! The append-only journal of `my` swap events.
+//!
+//! `SWAPS/MY/<uuid>.json` keeps the `SavedSwap` with the events compacted so far,
+//! the newer events are appended to `SWAPS/MY/<uuid>.journal`, so saving an event doesn't rewrite the whole swap.
+//! The journal is compacted into the JSON file once the swap is finished or the journal grows to
+//! `MAX_JOURNAL_EVENTS`, so the finished swaps are stored in the `SavedSwap` format as before.
+//!
+//! The journal record layout is `[payload len: u32 LE][event index: u32 LE][CRC32 of index and payload: u32 LE][payload]`,
+//! where the payload is the JSON-encoded event. The records of the events that are already compacted are skipped,
+//! so the journal stays valid if the node stops between the JSON file rewrite and the journal removal.
+//! A torn or corrupted record and the records after it are ignored.
+//!
+//! The swaps are materialized in memory on the first access, `my_swap_status` and `my_recent_swaps` read them there.
+//! Every swap is guarded by its own lock, so the events of the concurrent swaps are saved in parallel,
+//! and the file I/O with fsync runs on the blocking thread pool instead of the executor threads.
+
+use super::{mark_swap_finished_in_db, my_swap_file_path, my_swaps_dir, SavedSwap};
+use common::log::warn;
+use common::mm_ctx::MmArc;
+use common::slurp;
+use futures::lock::Mutex as AsyncMutex;
+use serde::de::DeserializeOwned;
+use serde::Serialize;
+use serde_json as json;
+use std::collections::HashMap;
+use std::convert::TryInto;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+use uuid::Uuid;
+
+/// Compact the journal into the JSON file once it contains this number of events.
+const MAX_JOURNAL_EVENTS: usize = 16;
+/// The finished swaps are evicted from the memory once the number of materialized swaps reaches this limit.
+const MAX_MATERIALIZED_SWAPS: usize = 1024;
+const RECORD_HEADER_LEN: usize = 4 + 4 + 4;
+
+/// The event of a `SavedSwap` variant.
+pub trait SavedSwapEvent: Serialize + DeserializeOwned {
+    /// Returns the events of the `swap` if the swap is of the corresponding variant.
+    fn swap_events(swap: &mut SavedSwap) -> Option<&mut Vec<Self>>;
+}
+
+pub fn my_swap_journal_path(ctx: &MmArc, uuid: &Uuid) -> PathBuf { my_swaps_dir(ctx).join(format!("{}.journal", uuid)) }
+
+struct MaterializedSwap {
+    swap: SavedSwap,
+    /// The number of the events in the journal.
+    journal_events: usize,
+    /// Whether the journal ends with a torn or corrupted record, the records can't be appended after it then.
+    journal_torn: bool,
+}
+
+/// The lock of a swap, `None` until the swap is loaded.
+type SwapSlot = Arc<AsyncMutex<Option<MaterializedSwap>>>;
+
+/// The materialized view of `my` swaps backed by the swap files and journals.
+#[derive(Default)]
+pub struct MySwapsStorage {
+    /// The lock is held only to find or insert the swap slot.
+    swaps: Mutex<HashMap<Uuid, SwapSlot>>,
+}
+
+impl MySwapsStorage {
+    /// Saves the `event` to the swap journal creating the swap file with the `new_swap` if the swap is not saved yet.
+    pub async fn save_event<E: SavedSwapEvent>(
+        &self,
+        ctx: &MmArc,
+        uuid: &Uuid,
+        new_swap: impl FnOnce() -> SavedSwap,
+        event: E,
+    ) -> Result<(), String> {
+        let slot = self.swap_slot(uuid);
+        let mut slot = slot.lock().await;
+        if slot.is_none() {
+            let materialized = match try_s!(load_materialized_async(ctx, uuid).await) {
+                Some(materialized) => materialized,
+                None => {
+                    let swap = new_swap();
+                    try_s!(store_swap_file(ctx, &swap, None).await);
+                    MaterializedSwap {
+                        swap,
+                        journal_events: 0,
+                        journal_torn: false,
+                    }
+                },
+            };
+            *slot = Some(materialized);
+        }
+        let materialized = slot.as_mut().expect("loaded above");
+
+        let payload = try_s!(json::to_vec(&event));
+        let events = match E::swap_events(&mut materialized.swap) {
+            Some(events) => events,
+            None => return ERR!("Unexpected SavedSwap variant of {}", uuid),
+        };
+        let index = events.len();
+        events.push(event);
+
+        let is_finished = materialized.swap.is_finished();
+        let compact = cfg!(target_arch = "wasm32")
+            || materialized.journal_torn
+            || materialized.journal_events + 1 >= MAX_JOURNAL_EVENTS
+            || is_finished;
+        let result = if compact {
+            compact_journal(ctx, uuid, materialized).await
+        } else {
+            let path = my_swap_journal_path(ctx, uuid);
+            let record = encode_record(index as u32, &payload);
+            blocking_io(move || append_journal_record(&path, &record))
+                .await
+                .map(|_| {
+                    materialized.journal_events += 1;
+                })
+        };
+        if let Err(e) = result {
+            // the in-memory view must not diverge from the stored one, the swap is loaded again on the next access
+            *slot = None;
+            return ERR!("{}", e);
+        }
+        drop(slot);
+        if is_finished {
+            // the finished swaps are not loaded on kick-start
+            mark_swap_finished_in_db(ctx, uuid);
+        }
+        Ok(())
+    }
+
+    /// Calls the `f` with the materialized swap. Returns `None` if the swap is not found.
+    pub async fn with_swap<R>(
+        &self,
+        ctx: &MmArc,
+        uuid: &Uuid,
+        f: impl FnOnce(&SavedSwap) -> R,
+    ) -> Result<Option<R>, String> {
+        let slot = self.swap_slot(uuid);
+        let mut slot = slot.lock().await;
+        if slot.is_none() {
+            *slot = try_s!(load_materialized_async(ctx, uuid).await);
+        }
+        Ok(slot.as_ref().map(|materialized| f(&materialized.swap)))
+    }
+
+    /// Returns the lock of the swap inserting it if the swap is not materialized yet.
+    fn swap_slot(&self, uuid: &Uuid) -> SwapSlot {
+        let mut swaps = self.swaps.lock().unwrap();
+        if let Some(slot) = swaps.get(uuid) {
+            return slot.clone();
+        }
+        if swaps.len() >= MAX_MATERIALIZED_SWAPS {
+            // the finished swaps are not updated anymore, they can be loaded again on demand
+            swaps.retain(|_, slot| {
+                // the slot is in use
+                if Arc::strong_count(slot) > 1 {
+                    return true;
+                }
+                match slot.try_lock() {
+                    Some(materialized) => materialized
+                        .as_ref()
+                        .map_or(false, |materialized| !materialized.swap.is_finished()),
+                    None => true,
+                }
+            });
+        }
+        swaps.entry(*uuid).or_default().clone()
+    }
+}
+
+/// Loads the swap from the swap file and the journal. Returns `None` if the swap is not found.
+pub fn load_my_swap(ctx: &MmArc, uuid: &Uuid) -> Result<Option<SavedSwap>, String> {
+    Ok(try_s!(load_materialized(ctx, uuid)).map(|materialized| materialized.swap))
+}
+
+/// Runs the blocking file I/O on the blocking thread pool.
+#[cfg(not(target_arch = "wasm32"))]
+async fn blocking_io<R: Send + 'static>(f: impl FnOnce() -> R + Send + 'static) -> R {
+    common::executor::spawn_blocking(f).await
+}
+
+#[cfg(target_arch = "wasm32")]
+async fn blocking_io<R>(f: impl FnOnce() -> R) -> R { f() }
+
+async fn load_materialized_async(ctx: &MmArc, uuid: &Uuid) -> Result<Option<MaterializedSwap>, String> {
+    let ctx = ctx.clone();
+    let uuid = *uuid;
+    blocking_io(move || load_materialized(&ctx, &uuid)).await
+}
+
+fn load_materialized(ctx: &MmArc, uuid: &Uuid) -> Result<Option<MaterializedSwap>, String> {
+    let path = my_swap_file_path(ctx, uuid);
+    let content = try_s!(slurp(&path));
+    if content.is_empty() {
+        return Ok(None);
+    }
+    let mut swap: SavedSwap = try_s!(json::from_slice(&content));
+
+    let journal = try_s!(read_journal(&my_swap_journal_path(ctx, uuid)));
+    let journal_events = match swap {
+        SavedSwap::Maker(_) => try_s!(replay_journal::<super::maker_swap::MakerSavedEvent>(
+            &mut swap,
+            journal.records
+        )),
+        SavedSwap::Taker(_) => try_s!(replay_journal::<super::taker_swap::TakerSavedEvent>(
+            &mut swap,
+            journal.records
+        )),
+    };
+    if journal.torn {
+        warn!(
+            "The journal of the swap {} ends with a corrupted record, it will be compacted",
+            uuid
+        );
+    }
+    Ok(Some(MaterializedSwap {
+        swap,
+        journal_events,
+        journal_torn: journal.torn,
+    }))
+}
+
+/// Returns the number of the journal events.
+fn replay_journal<E: SavedSwapEvent>(swap: &mut SavedSwap, records: Vec<(u32, Vec<u8>)>) -> Result<usize, String> {
+    let journal_events = records.len();
+    let events = E::swap_events(swap).ok_or("Unexpected SavedSwap variant")?;
+    for (index, payload) in records {
+        let index = index as usize;
+        // the event is compacted already
+        if index < events.len() {
+            continue;
+        }
+        if index > events.len() {
+            return ERR!("Expected the event {}, found {} in the journal", events.len(), index);
+        }
+        events.push(try_s!(json::from_slice(&payload)));
+    }
+    Ok(journal_events)
+}
+
+/// Writes the swap with all its events to the swap file and removes the journal.
+async fn compact_journal(ctx: &MmArc, uuid: &Uuid, materialized: &mut MaterializedSwap) -> Result<(), String> {
+    try_s!(store_swap_file(ctx, &materialized.swap, Some(my_swap_journal_path(ctx, uuid))).await);
+    materialized.journal_events = 0;
+    materialized.journal_torn = false;
+    Ok(())
+}
+
+fn encode_record(index: u32, payload: &[u8]) -> Vec<u8> {
+    let mut hasher = crc32fast::Hasher::new();
+    hasher.update(&index.to_le_bytes());
+    hasher.update(payload);
+
+    let mut record = Vec::with_capacity(RECORD_HEADER_LEN + payload.len());
+    record.extend_from_slice(&(payload.len() as u32).to_le_bytes());
+    record.extend_from_slice(&index.to_le_bytes());
+    record.extend_from_slice(&hasher.finalize().to_le_bytes());
+    record.extend_from_slice(payload);
+    record
+}
+
+#[derive(Debug, Default)]
+struct Journal {
+    /// The event indexes and payloads.
+    records: Vec<(u32, Vec<u8>)>,
+    torn: bool,
+}
+
+fn decode_journal(bytes: &[u8]) -> Journal {
+    let mut journal = Journal::default();
+    let mut offset = 0;
+    while offset < bytes.len() {
+        let header = match bytes.get(offset..offset + RECORD_HEADER_LEN) {
+            Some(header) => header,
+            None => {
+                journal.torn = true;
+                break;
+            },
+        };
+        let payload_len = u32::from_le_bytes(header[..4].try_into().expect("4 bytes")) as usize;
+        let index = u32::from_le_bytes(header[4..8].try_into().expect("4 bytes"));
+        let checksum = u32::from_le_bytes(header[8..].try_into().expect("4 bytes"));
+        let payload_offset = offset + RECORD_HEADER_LEN;
+        let payload = match bytes.get(payload_offset..payload_offset + payload_len) {
+            Some(payload) => payload,
+            None => {
+                journal.torn = true;
+                break;
+            },
+        };
+
+        let mut hasher = crc32fast::Hasher::new();
+        hasher.update(&index.to_le_bytes());
+        hasher.update(payload);
+        if hasher.finalize() != checksum {
+            journal.torn = true;
+            break;
+        }
+        journal.records.push((index, payload.to_vec()));
+        offset = payload_offset + payload_len;
+    }
+    journal
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+fn read_journal(path: &Path) -> Result<Journal, String> {
+    match std::fs::read(path) {
+        Ok(bytes) => Ok(decode_journal(&bytes)),
+        Err(ref e) if e.kind() == std::io::ErrorKind::NotFound => Ok(Journal::default()),
+        Err(e) => ERR!("Error {} reading {}", e, path.display()),
+    }
+}
+
+/// The events are not journaled in a browser, the swap file is rewritten on every event.
+#[cfg(target_arch = "wasm32")]
+fn read_journal(_path: &Path) -> Result<Journal, String> { Ok(Journal::default()) }
+
+#[cfg(not(target_arch = "wasm32"))]
+fn append_journal_record(path: &Path, record: &[u8]) -> Result<(), String> {
+    use std::io::Write;
+
+    let mut file = try_s!(std::fs::OpenOptions::new().create(true).append(true).open(path));
+    try_s!(file.write_all(record));
+    try_s!(file.sync_data());
+    Ok(())
+}
+
+#[cfg(target_arch = "wasm32")]
+fn append_journal_record(_path: &Path, _record: &[u8]) -> Result<(), String> {
+    ERR!("The swap journal is not supported in a browser")
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+fn remove_journal(path: &Path) -> Result<(), String> {
+    match std::fs::remove_file(path) {
+        Ok(()) => Ok(()),
+        Err(ref e) if e.kind() == std::io::ErrorKind::NotFound => Ok(()),
+        Err(e) => ERR!("Error {} removing {}", e, path.display()),
+    }
+}
+
+#[cfg(target_arch = "wasm32")]
+fn remove_journal(_path: &Path) -> Result<(), String> { Ok(()) }
+
+/// Writes the swap file and then removes the compacted journal if the `journal_path` is given.
+async fn store_swap_file(ctx: &MmArc, swap: &SavedSwap, journal_path: Option<PathBuf>) -> Result<(), String> {
+    let path = my_swap_file_path(ctx, swap.uuid());
+    let content = try_s!(json::to_vec(swap));
+    blocking_io(move || {
+        try_s!(write_swap_file(&path, &content));
+        match journal_path {
+            Some(journal_path) => remove_journal(&journal_path),
+            None => Ok(()),
+        }
+    })
+    .await
+}
+
+/// Writes the swap file atomically, so a crash can't leave it half-written.
+#[cfg(not(target_arch = "wasm32"))]
+fn write_swap_file(path: &Path, content: &[u8]) -> Result<(), String> {
+    use std::io::Write;
+
+    let tmp_path = path.with_extension("json.tmp");
+    {
+        let mut file = try_s!(std::fs::File::create(&tmp_path));
+        try_s!(file.write_all(content));
+        try_s!(file.sync_data());
+    }
+    try_s!(std::fs::rename(&tmp_path, path));
+    Ok(())
+}
+
+#[cfg(target_arch = "wasm32")]
+fn write_swap_file(path: &Path, content: &[u8]) -> Result<(), String> { common::write(&path, &content) }
+
+#[cfg(test)]
+mod swap_journal_tests {
+    use super::*;
+
+    #[test]
+    fn test_decode_journal() {
+        let mut bytes = encode_record(0, b"{\"event\":0}");
+        bytes.extend(encode_record(1, b"{\"event\":1}"));
+        let journal = decode_journal(&bytes);
+        assert!(!journal.torn);
+        assert_eq!(journal.records, vec![
+            (0, b"{\"event\":0}".to_vec()),
+            (1, b"{\"event\":1}".to_vec())
+        ]);
+
+        // the last record is torn
+        let mut torn = bytes.clone();
+        torn.extend(&encode_record(2, b"{\"event\":2}")[..RECORD_HEADER_LEN + 3]);
+        let journal = decode_journal(&torn);
+        assert!(journal.torn);
+        assert_eq!(journal.records.len(), 2);
+
+        // the second record is corrupted
+        let mut corrupted = bytes;
+        let last = corrupted.len() - 2;
+        corrupted[last] = b'2';
+        let journal = decode_journal(&corrupted);
+        assert!(journal.torn);
+        assert_eq!(journal.records, vec![(0, b"{\"event\":0}".to_vec())]);
+    }
+}
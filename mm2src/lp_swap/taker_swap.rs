@@ -1,9 +1,10 @@
 use super::check_balance::{check_my_coin_balance_for_swap, CheckBalanceError, CheckBalanceResult,
                            TakerFeeAdditionalInfo};
 use super::pubkey_banning::ban_pubkey_on_failed_swap;
+use super::swap_journal::SavedSwapEvent;
 use super::trade_preimage::{TradePreimageRequest, TradePreimageRpcError, TradePreimageRpcResult};
 use super::{broadcast_my_swap_status, broadcast_swap_message_every, check_other_coin_balance_for_swap,
-            dex_fee_amount_from_taker_coin, dex_fee_rate, dex_fee_threshold, get_locked_amount, my_swap_file_path,
+            dex_fee_amount_from_taker_coin, dex_fee_rate, dex_fee_threshold, get_locked_amount, load_my_swap,
             my_swaps_dir, recv_swap_msg, swap_topic, AtomicSwap, LockedAmount, MySwapInfo, NegotiationDataMsg,
             NegotiationDataV2, RecoveredSwap, RecoveredSwapAction, SavedSwap, SavedTradeFee,
             SwapConfirmationsSettings, SwapError, SwapMsg, SwapsContext, TransactionIdentifier, WAIT_CONFIRM_INTERVAL};
@@ -18,7 +19,7 @@ use common::log::{debug, error, warn};
 use common::mm_ctx::MmArc;
 use common::mm_error::prelude::*;
 use common::mm_number::MmNumber;
-use common::{bits256, file_lock::FileLock, now_ms, slurp, write, DEX_FEE_ADDR_RAW_PUBKEY};
+use common::{bits256, file_lock::FileLock, now_ms, DEX_FEE_ADDR_RAW_PUBKEY};
 use futures::{compat::Future01CompatExt, select, FutureExt};
 use futures01::Future;
 use http::Response;
@@ -36,10 +37,9 @@ pub fn stats_taker_swap_file_path(ctx: &MmArc, uuid: &Uuid) -> PathBuf {
     stats_taker_swap_dir(ctx).join(format!("{}.json", uuid))
 }
 
-fn save_my_taker_swap_event(ctx: &MmArc, swap: &TakerSwap, event: TakerSavedEvent) -> Result<(), String> {
-    let path = my_swap_file_path(ctx, &swap.uuid);
-    let content = try_s!(slurp(&path));
-    let swap: SavedSwap = if content.is_empty() {
+async fn save_my_taker_swap_event(ctx: &MmArc, swap: &TakerSwap, event: TakerSavedEvent) -> Result<(), String> {
+    let swaps_ctx = try_s!(SwapsContext::from_ctx(ctx));
+    let new_swap = || {
         SavedSwap::Taker(TakerSavedSwap {
             uuid: swap.uuid,
             my_order_uuid: swap.my_order_uuid,
@@ -78,19 +78,8 @@ fn save_my_taker_swap_event(ctx: &MmArc, swap: &TakerSwap, event: TakerSavedEven
                 "TakerPaymentRefundFailed".into(),
             ],
         })
-    } else {
-        try_s!(json::from_slice(&content))
     };
-
-    if let SavedSwap::Taker(mut taker_swap) = swap {
-        taker_swap.events.push(event);
-        let new_swap = SavedSwap::Taker(taker_swap);
-        let new_content = try_s!(json::to_vec(&new_swap));
-        try_s!(write(&path, &new_content));
-        Ok(())
-    } else {
-        ERR!("Expected SavedSwap::Taker at {}, got {:?}", path.display(), swap)
-    }
+    swaps_ctx.my_swaps.save_event(ctx, &swap.uuid, new_swap, event).await
 }
 
 #[derive(Debug, Serialize, Deserialize)]
@@ -99,6 +88,15 @@ pub struct TakerSavedEvent {
     event: TakerSwapEvent,
 }
 
+impl SavedSwapEvent for TakerSavedEvent {
+    fn swap_events(swap: &mut SavedSwap) -> Option<&mut Vec<Self>> {
+        match swap {
+            SavedSwap::Taker(swap) => Some(&mut swap.events),
+            _ => None,
+        }
+    }
+}
+
 impl TakerSavedEvent {
     /// get the next swap command that must be executed after swap restore
     fn get_command(&self) -> Option<TakerSwapCommand> {
@@ -340,44 +338,52 @@ pub async fn run_taker_swap(swap: RunTakerSwapInput, ctx: MmArc) {
     let shutdown_rx = swap_ctx.shutdown_rx.clone();
     let swap_for_log = running_swap.clone();
 
+    let trace_name = format!("taker_swap {}", running_swap.uuid);
+    let tracer_ctx = ctx.clone();
     let mut swap_fut = Box::pin(
-        async move {
-            let mut events;
-            loop {
-                let res = running_swap.handle_command(command).await.expect("!handle_command");
-                events = res.1;
-                for event in events {
-                    let to_save = TakerSavedEvent {
-                        timestamp: now_ms(),
-                        event: event.clone(),
-                    };
-
-                    save_my_taker_swap_event(&ctx, &running_swap, to_save).expect("!save_my_taker_swap_event");
-                    if event.should_ban_maker() {
-                        ban_pubkey_on_failed_swap(
-                            &ctx,
-                            running_swap.maker.bytes.into(),
-                            &running_swap.uuid,
-                            event.clone().into(),
-                        )
-                    }
-                    status.status(&[&"swap", &("uuid", uuid.as_str())], &event.status_str());
-                    running_swap.apply_event(event).expect("!apply_event");
-                }
-                match res.0 {
-                    Some(c) => {
-                        command = c;
-                    },
-                    None => {
-                        if let Err(e) = broadcast_my_swap_status(&running_swap.uuid, &ctx) {
-                            log!("!broadcast_my_swap_status(" (uuid) "): " (e));
+        tracer_ctx
+            .tracer
+            .trace(move || trace_name, async move {
+                let mut events;
+                loop {
+                    let span = trace_span!("swap_command", "{:?}", command);
+                    let res = running_swap.handle_command(command).await.expect("!handle_command");
+                    drop(span);
+                    events = res.1;
+                    for event in events {
+                        let to_save = TakerSavedEvent {
+                            timestamp: now_ms(),
+                            event: event.clone(),
+                        };
+
+                        save_my_taker_swap_event(&ctx, &running_swap, to_save)
+                            .await
+                            .expect("!save_my_taker_swap_event");
+                        if event.should_ban_maker() {
+                            ban_pubkey_on_failed_swap(
+                                &ctx,
+                                running_swap.maker.bytes.into(),
+                                &running_swap.uuid,
+                                event.clone().into(),
+                            )
                         }
-                        break;
-                    },
+                        status.status(&[&"swap", &("uuid", uuid.as_str())], &event.status_str());
+                        running_swap.apply_event(event).expect("!apply_event");
+                    }
+                    match res.0 {
+                        Some(c) => {
+                            command = c;
+                        },
+                        None => {
+                            if let Err(e) = broadcast_my_swap_status(&running_swap.uuid, &ctx) {
+                                log!("!broadcast_my_swap_status(" (uuid) "): " (e));
+                            }
+                            break;
+                        },
+                    }
                 }
-            }
-        }
-        .fuse(),
+            })
+            .fuse(),
     );
     let mut shutdown_fut = Box::pin(shutdown_rx.recv().fuse());
     select! {
@@ -1239,8 +1245,10 @@ impl TakerSwap {
         taker_coin: MmCoinEnum,
         swap_uuid: &Uuid,
     ) -> Result<(Self, Option<TakerSwapCommand>), String> {
-        let path = my_swap_file_path(&ctx, swap_uuid);
-        let saved: SavedSwap = try_s!(json::from_slice(&try_s!(slurp(&path))));
+        let saved = match try_s!(load_my_swap(&ctx, swap_uuid)) {
+            Some(saved) => saved,
+            None => return ERR!("swap data is not found, uuid: {}", swap_uuid),
+        };
         let saved = match saved {
             SavedSwap::Taker(swap) => swap,
             SavedSwap::Maker(_) => return ERR!("Can not load TakerSwap from SavedSwap::Maker uuid: {}", swap_uuid),
@@ -1521,6 +1529,7 @@ pub async fn check_balance_for_taker_swap(
     prepared_params: Option<TakerSwapPreparedParams>,
     stage: FeeApproxStage,
 ) -> CheckBalanceResult<()> {
+    let _span = trace_span!("check_balance_for_taker_swap", "{}", my_coin.ticker());
     let params = match prepared_params {
         Some(params) => params,
         None => {
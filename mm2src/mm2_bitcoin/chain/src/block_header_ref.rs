@@ -0,0 +1,141 @@
+//! Block header view borrowing the fields from the serialized header.
+//! The equihash solution and the aux pow aren't copied, so it's cheap to read many headers just to check
+//! the time or the hashes chaining.
+
+use bigint::U256;
+use block_header::{AUX_POW_VERSION_DOGE, AUX_POW_VERSION_SYS, MTP_POW_VERSION, QTUM_BLOCK_HEADER_VERSION};
+use compact::Compact;
+use crypto::dhash256;
+use hash::H256;
+use raw_reader::RawReader;
+use ser::{CoinVariant, Error};
+use transaction::TxType;
+use transaction_ref::read_tx_ref;
+
+#[derive(Clone, Copy, Debug)]
+pub struct BlockHeaderRef<'a> {
+    raw: &'a [u8],
+    /// The length of the header without the aux pow.
+    base_len: usize,
+    version: u32,
+    is_verus: bool,
+    time: u32,
+    bits: u32,
+}
+
+impl<'a> BlockHeaderRef<'a> {
+    /// Parses the header the `raw` starts with, the bytes following the header are ignored.
+    pub fn parse(raw: &'a [u8], coin_variant: &CoinVariant) -> Result<Self, Error> {
+        read_header_ref(&mut RawReader::new(raw), coin_variant)
+    }
+
+    /// Parses the headers following each other, like in the response of the Electrum `blockchain.block.headers`.
+    pub fn parse_list(raw: &'a [u8], coin_variant: &CoinVariant) -> Result<Vec<Self>, Error> {
+        let mut reader = RawReader::new(raw);
+        let mut headers = Vec::new();
+        while !reader.is_finished() {
+            headers.push(read_header_ref(&mut reader, coin_variant)?);
+        }
+        Ok(headers)
+    }
+
+    /// The serialized header.
+    pub fn raw(&self) -> &'a [u8] { self.raw }
+
+    pub fn version(&self) -> u32 { self.version }
+
+    pub fn is_verus(&self) -> bool { self.is_verus }
+
+    pub fn is_aux_pow(&self) -> bool { self.base_len < self.raw.len() }
+
+    pub fn previous_header_hash(&self) -> H256 { H256::from(&self.raw[4..36]) }
+
+    pub fn merkle_root_hash(&self) -> H256 { H256::from(&self.raw[36..68]) }
+
+    pub fn time(&self) -> u32 { self.time }
+
+    /// The compact or the u32 bits depending on the header version.
+    pub fn bits(&self) -> u32 { self.bits }
+
+    /// Returns the same hash as `BlockHeader::hash` does without serializing the header again.
+    pub fn hash(&self) -> H256 { dhash256(self.raw) }
+
+    /// The hash the next header refers to as the previous one, the aux pow isn't hashed.
+    /// Note the Verus headers are chained by the verushash instead.
+    pub fn block_hash(&self) -> H256 { dhash256(&self.raw[..self.base_len]) }
+
+    /// Checks the `block_hash` against the target the header bits encode.
+    /// The bits themselves aren't checked against the difficulty adjustment rules of the coin.
+    /// Note the check doesn't apply to the aux pow headers (the parent block is mined instead)
+    /// and to the proof-of-stake blocks.
+    pub fn is_pow_valid(&self) -> bool {
+        let target = match Compact::new(self.bits).to_u256() {
+            Ok(target) => target,
+            Err(_) => return false,
+        };
+        U256::from(&*self.block_hash().reversed() as &[u8]) <= target
+    }
+}
+
+/// Reads the header the same way as `BlockHeader` is deserialized.
+fn read_header_ref<'a>(reader: &mut RawReader<'a>, coin_variant: &CoinVariant) -> Result<BlockHeaderRef<'a>, Error> {
+    let start = reader.position();
+    let mut version = reader.read_u32()?;
+    let is_verus = (version ^ 0x00010000) == 4;
+    if is_verus {
+        version ^= 0x00010000;
+    }
+    // previous_header_hash and merkle_root_hash
+    reader.skip(32 + 32)?;
+    if version == 4 {
+        // hash_final_sapling_root
+        reader.skip(32)?;
+    }
+    let time = reader.read_u32()?;
+    let bits = reader.read_u32()?;
+    if version == 4 {
+        // 32 bytes nonce and the equihash solution
+        reader.skip(32)?;
+        reader.read_bytes(usize::max_value())?;
+    } else {
+        // nonce
+        reader.skip(4)?;
+    }
+
+    let mut aux_pow_start = None;
+    // https://en.bitcoin.it/wiki/Merged_mining_specification#Merged_mining_coinbase
+    if version == AUX_POW_VERSION_DOGE || version == AUX_POW_VERSION_SYS {
+        aux_pow_start = Some(reader.position());
+        read_tx_ref(reader, TxType::StandardWithWitness)?;
+        // parent_block_hash
+        reader.skip(32)?;
+        // coinbase_branch and blockchain_branch hashes followed by the side masks
+        reader.skip_list(usize::max_value(), 32)?;
+        reader.skip(4)?;
+        reader.skip_list(usize::max_value(), 32)?;
+        reader.skip(4)?;
+        // parent_block_header
+        read_header_ref(reader, coin_variant)?;
+    }
+
+    if version == MTP_POW_VERSION {
+        // n_version_mtp, mtp_hash_value, reserved_0 and reserved_1
+        reader.skip(4 + 32 * 3)?;
+    }
+
+    if version == QTUM_BLOCK_HEADER_VERSION && coin_variant.is_qtum() {
+        // hash_state_root, hash_utxo_root, prevout_stake and vch_block_sig_dlgt
+        reader.skip(32 + 32 + 36)?;
+        reader.read_bytes(usize::max_value())?;
+    }
+
+    let raw = reader.read_since(start);
+    Ok(BlockHeaderRef {
+        raw,
+        base_len: aux_pow_start.map_or(raw.len(), |aux_pow_start| aux_pow_start - start),
+        version,
+        is_verus,
+        time,
+        bits,
+    })
+}
@@ -1,15 +1,21 @@
+#![cfg_attr(test, feature(test))]
+
 extern crate bitcrypto as crypto;
 extern crate primitives;
 extern crate rustc_hex as hex;
 extern crate serialization as ser;
 #[macro_use] extern crate serialization_derive;
+#[cfg(test)] extern crate test;
 
 pub mod constants;
 
 mod block;
 mod block_header;
+mod block_header_ref;
 mod merkle_root;
+mod raw_reader;
 mod transaction;
+mod transaction_ref;
 
 /// `IndexedBlock` extension
 mod read_and_hash;
@@ -22,9 +28,11 @@ pub use primitives::{bigint, bytes, compact, hash};
 
 pub use block::Block;
 pub use block_header::BlockHeader;
+pub use block_header_ref::BlockHeaderRef;
 pub use merkle_root::{merkle_node_hash, merkle_root};
 pub use transaction::{JoinSplit, OutPoint, ShieldedOutput, ShieldedSpend, Transaction, TransactionInput,
                       TransactionOutput, TxHashAlgo};
+pub use transaction_ref::{TransactionRef, TxInputRef, TxInputsRef, TxOutputRef, TxOutputsRef};
 
 pub use read_and_hash::{HashedData, ReadAndHash};
 
@@ -0,0 +1,107 @@
+//! The reader borrowing the variable-length fields from the underlying buffer instead of copying them.
+
+use hash::H256;
+use ser::Error;
+
+pub(crate) struct RawReader<'a> {
+    buffer: &'a [u8],
+    position: usize,
+}
+
+impl<'a> RawReader<'a> {
+    pub fn new(buffer: &'a [u8]) -> Self { RawReader { buffer, position: 0 } }
+
+    pub fn position(&self) -> usize { self.position }
+
+    pub fn is_finished(&self) -> bool { self.position >= self.buffer.len() }
+
+    /// Returns the bytes read since the `start` position.
+    pub fn read_since(&self, start: usize) -> &'a [u8] { &self.buffer[start..self.position] }
+
+    pub fn read_slice(&mut self, len: usize) -> Result<&'a [u8], Error> {
+        let end = self.position.checked_add(len).ok_or(Error::UnexpectedEnd)?;
+        let slice = self.buffer.get(self.position..end).ok_or(Error::UnexpectedEnd)?;
+        self.position = end;
+        Ok(slice)
+    }
+
+    pub fn skip(&mut self, len: usize) -> Result<(), Error> { self.read_slice(len).map(|_| ()) }
+
+    pub fn read_u8(&mut self) -> Result<u8, Error> { Ok(self.read_slice(1)?[0]) }
+
+    pub fn read_u16(&mut self) -> Result<u16, Error> {
+        let mut bytes = [0; 2];
+        bytes.copy_from_slice(self.read_slice(2)?);
+        Ok(u16::from_le_bytes(bytes))
+    }
+
+    pub fn read_u32(&mut self) -> Result<u32, Error> {
+        let mut bytes = [0; 4];
+        bytes.copy_from_slice(self.read_slice(4)?);
+        Ok(u32::from_le_bytes(bytes))
+    }
+
+    pub fn read_u64(&mut self) -> Result<u64, Error> {
+        let mut bytes = [0; 8];
+        bytes.copy_from_slice(self.read_slice(8)?);
+        Ok(u64::from_le_bytes(bytes))
+    }
+
+    pub fn read_h256(&mut self) -> Result<H256, Error> { self.read_slice(32).map(H256::from) }
+
+    /// Reads the `CompactInteger`.
+    pub fn read_compact(&mut self) -> Result<u64, Error> {
+        match self.read_u8()? {
+            i @ 0..=0xfc => Ok(i.into()),
+            0xfd => self.read_u16().map(u64::from),
+            0xfe => self.read_u32().map(u64::from),
+            _ => self.read_u64(),
+        }
+    }
+
+    /// Reads the `CompactInteger` length of the list, `Error::MalformedData` is returned if it exceeds the `max`.
+    pub fn read_list_len(&mut self, max: usize) -> Result<usize, Error> {
+        let len = self.read_compact()?;
+        if len > max as u64 {
+            return Err(Error::MalformedData);
+        }
+        Ok(len as usize)
+    }
+
+    /// Skips the list of the fixed-size items.
+    pub fn skip_list(&mut self, max: usize, item_len: usize) -> Result<usize, Error> {
+        let len = self.read_list_len(max)?;
+        self.skip(len.checked_mul(item_len).ok_or(Error::UnexpectedEnd)?)?;
+        Ok(len)
+    }
+
+    /// Reads the bytes prefixed with the `CompactInteger` length like `Bytes` are serialized.
+    pub fn read_bytes(&mut self, max: usize) -> Result<&'a [u8], Error> {
+        let len = self.read_list_len(max)?;
+        self.read_slice(len)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::RawReader;
+    use ser::Error;
+
+    #[test]
+    fn test_raw_reader() {
+        let buffer = [1, 2, 0, 3, 0, 0, 0, 0xfd, 2, 0, 4, 5, 2, 6, 7];
+        let mut reader = RawReader::new(&buffer);
+        assert_eq!(reader.read_u8(), Ok(1));
+        assert_eq!(reader.read_u16(), Ok(2));
+        assert_eq!(reader.read_u32(), Ok(3));
+        assert_eq!(reader.read_compact(), Ok(2));
+        assert_eq!(reader.read_slice(2), Ok(&[4, 5][..]));
+        assert_eq!(reader.read_since(3), &buffer[3..12]);
+        assert_eq!(reader.read_bytes(1), Err(Error::MalformedData));
+
+        let mut reader = RawReader::new(&buffer[12..]);
+        assert_eq!(reader.read_bytes(2), Ok(&[6, 7][..]));
+        assert!(reader.is_finished());
+        assert_eq!(reader.read_u8(), Err(Error::UnexpectedEnd));
+    }
+}
@@ -14,9 +14,9 @@ use std::io::Read;
 /// Must be zero.
 const WITNESS_MARKER: u8 = 0;
 /// Must be nonzero.
-const WITNESS_FLAG: u8 = 1;
+pub(crate) const WITNESS_FLAG: u8 = 1;
 /// Maximum supported list size (inputs, outputs, etc.)
-const MAX_LIST_SIZE: usize = 8192;
+pub(crate) const MAX_LIST_SIZE: usize = 8192;
 
 #[derive(Debug, PartialEq, Eq, Hash, Clone, Default, Serializable, Deserializable)]
 pub struct OutPoint {
@@ -506,7 +506,8 @@ mod tests {
     use hash::{H256, H512};
     use hex::ToHex;
     use ser::{deserialize, serialize, serialize_with_flags, Serializable, SERIALIZE_TRANSACTION_WITNESS};
-    use TxHashAlgo;
+    use test::{black_box, Bencher};
+    use {TransactionRef, TxHashAlgo};
 
     // real transaction from block 80000
     // https://blockchain.info/rawtx/5a4ebf66822b0b2d56bd9dc64ece0bc38ee7844a23ff1d7320a88c5fdb2ad3e2
@@ -899,4 +900,42 @@ mod tests {
         println!("{:?}", t);
         assert_eq!(transaction, serialize(&t).to_hex::<String>());
     }
+
+    const BENCH_INPUTS_COUNT: usize = 1000;
+
+    /// The serialized transaction spending `BENCH_INPUTS_COUNT` P2PKH outputs to the same number of outputs.
+    fn large_transaction_for_bench() -> Vec<u8> {
+        let mut t: Transaction = "0100000001a6b97044d03da79c005b20ea9c0e1a6d9dc12d9f7b91a5911c9030a439eed8f5000000004948304502206e21798a42fae0e854281abd38bacd1aeed3ee3738d9e1446618c4571d1090db022100e2ac980643b0b82c0e88ffdfec6b64e3e6ba35e7ba5fdd7d5d6cc8d25c6b241501ffffffff0100f2052a010000001976a914404371705fa9bd789a2fcd52d2c580b65d35549d88ac00000000".into();
+        let input = t.inputs[0].clone();
+        let output = t.outputs[0].clone();
+        t.inputs = (0..BENCH_INPUTS_COUNT as u32)
+            .map(|index| TransactionInput {
+                previous_output: OutPoint {
+                    hash: H256::from(index as u8),
+                    index,
+                },
+                ..input.clone()
+            })
+            .collect();
+        t.outputs = vec![output; BENCH_INPUTS_COUNT];
+        serialize(&t).take()
+    }
+
+    #[bench]
+    fn bench_deserialize_large_transaction(b: &mut Bencher) {
+        let raw = large_transaction_for_bench();
+        b.iter(|| {
+            let t: Transaction = deserialize(raw.as_slice()).unwrap();
+            black_box(t)
+        });
+    }
+
+    #[bench]
+    fn bench_parse_large_transaction_ref(b: &mut Bencher) {
+        let raw = large_transaction_for_bench();
+        b.iter(|| {
+            let view = TransactionRef::parse(&raw).unwrap();
+            black_box(view.inputs().count() + view.outputs().count())
+        });
+    }
 }
@@ -0,0 +1,378 @@
+//! Transaction view borrowing the fields from the serialized transaction.
+//! Unlike `Transaction` the view doesn't allocate the inputs, outputs and scripts,
+//! so it's cheap to look through many transactions for the one spending the given output.
+
+use crypto::{dhash256, sha256};
+use hash::H256;
+use raw_reader::RawReader;
+use ser::Error;
+use transaction::{TxType, MAX_LIST_SIZE, WITNESS_FLAG};
+use {OutPoint, TxHashAlgo};
+
+/// The max length of the script `Bytes` are deserialized with.
+const MAX_SCRIPT_SIZE: usize = 10000;
+const OUTPOINT_LEN: usize = 36;
+const SHIELDED_SPEND_LEN: usize = 32 * 4 + 192 + 64;
+const SHIELDED_OUTPUT_LEN: usize = 32 * 3 + 580 + 80 + 192;
+/// The length of the join split without the proof.
+const JOIN_SPLIT_LEN: usize = 8 * 2 + 32 * 8 + 601 * 2;
+const GROTH_PROOF_LEN: usize = 192;
+const PHGR_PROOF_LEN: usize = 296;
+
+#[derive(Clone, Copy, Debug)]
+pub struct TransactionRef<'a> {
+    raw: &'a [u8],
+    version: i32,
+    overwintered: bool,
+    has_witness: bool,
+    /// The length of the header, the version group id and the n_time.
+    header_len: usize,
+    /// The offset of the inputs count, the inputs and the outputs follow it.
+    inputs_offset: usize,
+    /// The offset after the outputs, the witnesses follow it.
+    outputs_end: usize,
+    /// The offset of the lock time, the rest of the transaction follows it.
+    lock_time_offset: usize,
+    inputs_count: usize,
+    inputs: &'a [u8],
+    outputs_count: usize,
+    outputs: &'a [u8],
+}
+
+#[derive(Debug, PartialEq)]
+pub struct TxInputRef<'a> {
+    pub previous_output: OutPoint,
+    pub script_sig: &'a [u8],
+    pub sequence: u32,
+}
+
+#[derive(Debug, PartialEq)]
+pub struct TxOutputRef<'a> {
+    pub value: u64,
+    pub script_pubkey: &'a [u8],
+}
+
+impl<'a> TransactionRef<'a> {
+    /// Parses the transaction trying the same transaction types `Transaction` is deserialized with.
+    /// The bytes following the transaction are ignored.
+    pub fn parse(raw: &'a [u8]) -> Result<Self, Error> {
+        TransactionRef::parse_with_type(raw, TxType::StandardWithWitness)
+            .or_else(|_| TransactionRef::parse_with_type(raw, TxType::PosWithNTime))
+            .or_else(|_| TransactionRef::parse_with_type(raw, TxType::Zcash))
+    }
+
+    fn parse_with_type(raw: &'a [u8], tx_type: TxType) -> Result<Self, Error> {
+        read_tx_ref(&mut RawReader::new(raw), tx_type)
+    }
+
+    /// The serialized transaction, the witnesses are included if any.
+    pub fn raw(&self) -> &'a [u8] { self.raw }
+
+    pub fn version(&self) -> i32 { self.version }
+
+    pub fn overwintered(&self) -> bool { self.overwintered }
+
+    /// Whether the transaction is serialized with the witnesses.
+    pub fn has_witness(&self) -> bool { self.has_witness }
+
+    pub fn inputs_count(&self) -> usize { self.inputs_count }
+
+    pub fn inputs(&self) -> TxInputsRef<'a> {
+        TxInputsRef {
+            reader: RawReader::new(self.inputs),
+            remaining: self.inputs_count,
+        }
+    }
+
+    pub fn outputs_count(&self) -> usize { self.outputs_count }
+
+    pub fn outputs(&self) -> TxOutputsRef<'a> {
+        TxOutputsRef {
+            reader: RawReader::new(self.outputs),
+            remaining: self.outputs_count,
+        }
+    }
+
+    pub fn lock_time(&self) -> u32 {
+        let mut lock_time = [0; 4];
+        lock_time.copy_from_slice(&self.raw[self.lock_time_offset..self.lock_time_offset + 4]);
+        u32::from_le_bytes(lock_time)
+    }
+
+    /// Returns the same hash as `Transaction::hash` does.
+    /// Only the witnesses are excluded from the hashed bytes, so the transaction isn't serialized again.
+    pub fn hash(&self, tx_hash_algo: TxHashAlgo) -> H256 {
+        let hash = |bytes: &[u8]| match tx_hash_algo {
+            TxHashAlgo::DSHA256 => dhash256(bytes),
+            TxHashAlgo::SHA256 => sha256(bytes),
+        };
+        if !self.has_witness {
+            return hash(self.raw);
+        }
+        let lock_time_onward = &self.raw[self.lock_time_offset..];
+        let mut stripped =
+            Vec::with_capacity(self.header_len + self.outputs_end - self.inputs_offset + lock_time_onward.len());
+        stripped.extend_from_slice(&self.raw[..self.header_len]);
+        stripped.extend_from_slice(&self.raw[self.inputs_offset..self.outputs_end]);
+        stripped.extend_from_slice(lock_time_onward);
+        hash(&stripped)
+    }
+}
+
+pub struct TxInputsRef<'a> {
+    reader: RawReader<'a>,
+    remaining: usize,
+}
+
+impl<'a> Iterator for TxInputsRef<'a> {
+    type Item = TxInputRef<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.remaining == 0 {
+            return None;
+        }
+        self.remaining -= 1;
+        // the inputs are read once already when the transaction is parsed
+        read_input(&mut self.reader).ok()
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) { (self.remaining, Some(self.remaining)) }
+}
+
+pub struct TxOutputsRef<'a> {
+    reader: RawReader<'a>,
+    remaining: usize,
+}
+
+impl<'a> Iterator for TxOutputsRef<'a> {
+    type Item = TxOutputRef<'a>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.remaining == 0 {
+            return None;
+        }
+        self.remaining -= 1;
+        // the outputs are read once already when the transaction is parsed
+        read_output(&mut self.reader).ok()
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) { (self.remaining, Some(self.remaining)) }
+}
+
+fn read_input<'a>(reader: &mut RawReader<'a>) -> Result<TxInputRef<'a>, Error> {
+    Ok(TxInputRef {
+        previous_output: OutPoint {
+            hash: reader.read_h256()?,
+            index: reader.read_u32()?,
+        },
+        script_sig: reader.read_bytes(MAX_SCRIPT_SIZE)?,
+        sequence: reader.read_u32()?,
+    })
+}
+
+fn read_output<'a>(reader: &mut RawReader<'a>) -> Result<TxOutputRef<'a>, Error> {
+    Ok(TxOutputRef {
+        value: reader.read_u64()?,
+        script_pubkey: reader.read_bytes(MAX_SCRIPT_SIZE)?,
+    })
+}
+
+/// Reads the list of the inputs, returns the count and the inputs bytes without the count.
+fn read_inputs<'a>(reader: &mut RawReader<'a>) -> Result<(usize, &'a [u8]), Error> {
+    let count = reader.read_list_len(MAX_LIST_SIZE)?;
+    let start = reader.position();
+    for _ in 0..count {
+        reader.skip(OUTPOINT_LEN)?;
+        reader.read_bytes(MAX_SCRIPT_SIZE)?;
+        reader.skip(4)?;
+    }
+    Ok((count, reader.read_since(start)))
+}
+
+/// Reads the list of the outputs, returns the count and the outputs bytes without the count.
+fn read_outputs<'a>(reader: &mut RawReader<'a>) -> Result<(usize, &'a [u8]), Error> {
+    let count = reader.read_list_len(MAX_LIST_SIZE)?;
+    let start = reader.position();
+    for _ in 0..count {
+        reader.skip(8)?;
+        reader.read_bytes(MAX_SCRIPT_SIZE)?;
+    }
+    Ok((count, reader.read_since(start)))
+}
+
+/// Reads the transaction the same way as `deserialize_tx` does.
+pub(crate) fn read_tx_ref<'a>(reader: &mut RawReader<'a>, tx_type: TxType) -> Result<TransactionRef<'a>, Error> {
+    let start = reader.position();
+    let header = reader.read_u32()? as i32;
+    let overwintered = (header >> 31) != 0;
+    let version = if overwintered { header & 0x7FFFFFFF } else { header };
+
+    if overwintered {
+        // version_group_id
+        reader.skip(4)?;
+    }
+    if tx_type == TxType::PosWithNTime {
+        // n_time
+        reader.skip(4)?;
+    }
+    let header_len = reader.position() - start;
+
+    let mut inputs_offset = header_len;
+    let (mut inputs_count, mut inputs) = read_inputs(reader)?;
+    let has_witness = inputs_count == 0 && !overwintered && tx_type == TxType::StandardWithWitness;
+    if has_witness {
+        if reader.read_u8()? != WITNESS_FLAG {
+            return Err(Error::MalformedData);
+        }
+        inputs_offset = reader.position() - start;
+        let (count, bytes) = read_inputs(reader)?;
+        inputs_count = count;
+        inputs = bytes;
+    }
+    let (outputs_count, outputs) = read_outputs(reader)?;
+    let outputs_end = reader.position() - start;
+    if has_witness {
+        for _ in 0..inputs_count {
+            let witness_len = reader.read_list_len(MAX_LIST_SIZE)?;
+            for _ in 0..witness_len {
+                reader.read_bytes(MAX_SCRIPT_SIZE)?;
+            }
+        }
+    }
+
+    let lock_time_offset = reader.position() - start;
+    reader.skip(4)?;
+
+    let mut has_shielded = false;
+    if overwintered && version >= 3 {
+        // expiry_height
+        reader.skip(4)?;
+        if version >= 4 {
+            // value_balance
+            reader.skip(8)?;
+            let spends = reader.skip_list(MAX_LIST_SIZE, SHIELDED_SPEND_LEN)?;
+            let outputs = reader.skip_list(MAX_LIST_SIZE, SHIELDED_OUTPUT_LEN)?;
+            has_shielded = spends > 0 || outputs > 0;
+        }
+    }
+
+    let zcash = overwintered || tx_type == TxType::Zcash;
+    if zcash {
+        if version == 2 || overwintered {
+            let proof_len = if version > 2 { GROTH_PROOF_LEN } else { PHGR_PROOF_LEN };
+            let join_splits = reader.skip_list(MAX_LIST_SIZE, JOIN_SPLIT_LEN + proof_len)?;
+            if join_splits > 0 {
+                // join_split_pubkey and join_split_sig
+                reader.skip(32 + 64)?;
+            }
+        }
+        if overwintered && version >= 4 && has_shielded {
+            // binding_sig
+            reader.skip(64)?;
+        }
+    }
+
+    if tx_type == TxType::PosWithNTime && !reader.is_finished() {
+        let str_d_zeel = reader.read_bytes(usize::max_value())?;
+        std::str::from_utf8(str_d_zeel).map_err(|_| Error::MalformedData)?;
+    }
+
+    Ok(TransactionRef {
+        raw: reader.read_since(start),
+        version,
+        overwintered,
+        has_witness,
+        header_len,
+        inputs_offset,
+        outputs_end,
+        lock_time_offset,
+        inputs_count,
+        inputs,
+        outputs_count,
+        outputs,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::TransactionRef;
+    use hash::H256;
+    use hex::FromHex;
+    use ser::{deserialize, Error};
+    use {Transaction, TxHashAlgo};
+
+    fn assert_view_matches(raw: &str) {
+        let raw: Vec<u8> = raw.from_hex().unwrap();
+        let view = TransactionRef::parse(&raw).unwrap();
+        let tx: Transaction = deserialize(raw.as_slice()).unwrap();
+
+        assert_eq!(view.raw(), raw.as_slice());
+        assert_eq!(view.version(), tx.version);
+        assert_eq!(view.overwintered(), tx.overwintered);
+        assert_eq!(view.lock_time(), tx.lock_time);
+        assert_eq!(view.inputs_count(), tx.inputs.len());
+        assert_eq!(view.inputs().count(), tx.inputs.len());
+        for (input, expected) in view.inputs().zip(tx.inputs.iter()) {
+            assert_eq!(input.previous_output, expected.previous_output);
+            assert_eq!(input.script_sig, &expected.script_sig[..]);
+            assert_eq!(input.sequence, expected.sequence);
+        }
+        assert_eq!(view.outputs_count(), tx.outputs.len());
+        assert_eq!(view.outputs().count(), tx.outputs.len());
+        for (output, expected) in view.outputs().zip(tx.outputs.iter()) {
+            assert_eq!(output.value, expected.value);
+            assert_eq!(output.script_pubkey, &expected.script_pubkey[..]);
+        }
+
+        assert_eq!(view.hash(TxHashAlgo::DSHA256), tx.hash());
+        let mut sha256_tx = tx;
+        sha256_tx.tx_hash_algo = TxHashAlgo::SHA256;
+        assert_eq!(view.hash(TxHashAlgo::SHA256), sha256_tx.hash());
+    }
+
+    #[test]
+    fn test_transaction_ref_legacy() {
+        assert_view_matches("0100000001a6b97044d03da79c005b20ea9c0e1a6d9dc12d9f7b91a5911c9030a439eed8f5000000004948304502206e21798a42fae0e854281abd38bacd1aeed3ee3738d9e1446618c4571d1090db022100e2ac980643b0b82c0e88ffdfec6b64e3e6ba35e7ba5fdd7d5d6cc8d25c6b241501ffffffff0100f2052a010000001976a914404371705fa9bd789a2fcd52d2c580b65d35549d88ac00000000");
+        let raw: Vec<u8> = "0100000001a6b97044d03da79c005b20ea9c0e1a6d9dc12d9f7b91a5911c9030a439eed8f5000000004948304502206e21798a42fae0e854281abd38bacd1aeed3ee3738d9e1446618c4571d1090db022100e2ac980643b0b82c0e88ffdfec6b64e3e6ba35e7ba5fdd7d5d6cc8d25c6b241501ffffffff0100f2052a010000001976a914404371705fa9bd789a2fcd52d2c580b65d35549d88ac00000000".from_hex().unwrap();
+        let view = TransactionRef::parse(&raw).unwrap();
+        assert_eq!(
+            view.hash(TxHashAlgo::DSHA256),
+            H256::from_reversed_str("5a4ebf66822b0b2d56bd9dc64ece0bc38ee7844a23ff1d7320a88c5fdb2ad3e2")
+        );
+        assert!(!view.has_witness());
+    }
+
+    // test case from https://github.com/bitcoin/bips/blob/master/bip-0143.mediawiki
+    #[test]
+    fn test_transaction_ref_with_witness() {
+        let raw = "01000000000102fff7f7881a8099afa6940d42d1e7f6362bec38171ea3edf433541db4e4ad969f00000000494830450221008b9d1dc26ba6a9cb62127b02742fa9d754cd3bebf337f7a55d114c8e5cdd30be022040529b194ba3f9281a99f2b1c0a19c0489bc22ede944ccf4ecbab4cc618ef3ed01eeffffffef51e1b804cc89d182d279655c3aa89e815b1b309fe287d9b2b55d57b90ec68a0100000000ffffffff02202cb206000000001976a9148280b37df378db99f66f85c95a783a76ac7a6d5988ac9093510d000000001976a9143bde42dbee7e4dbe6a21b2d50ce2f0167faa815988ac000247304402203609e17b84f6a7d30c80bfa610b5b4542f32a8a0d5447a12fb1366d7f01cc44a0220573a954c4518331561406f90300e8f3358f51928d43c212a8caed02de67eebee0121025476c2e83188368da1ff3e292e7acafcdb3566bb0ad253f62fc70f07aeee635711000000";
+        assert_view_matches(raw);
+        let raw: Vec<u8> = raw.from_hex().unwrap();
+        assert!(TransactionRef::parse(&raw).unwrap().has_witness());
+    }
+
+    #[test]
+    fn test_transaction_ref_overwintered_sapling() {
+        assert_view_matches("0400008085202f890199cc492c24cc617731d13cff0ef22e7b0c277a64e7368a615b46214424a1c894020000006a473044022071edae37cf518e98db3f7637b9073a7a980b957b0c7b871415dbb4898ec3ebdc022031b402a6b98e64ffdf752266449ca979a9f70144dba77ed7a6a25bfab11648f6012103ad6f89abc2e5beaa8a3ac28e22170659b3209fe2ddf439681b4b8f31508c36faffffffff0202290200000000001976a914ca1e04745e8ca0c60d8c5881531d51bec470743f88ac8a96e70b000000001976a914d55f0df6cb82630ad21a4e6049522a6f2b6c9d4588ac8afb2c60000000000000000000000000000000");
+    }
+
+    #[test]
+    fn test_transaction_ref_pos_with_n_time() {
+        // ECC is PoS coin having nTime field in transaction
+        assert_view_matches("0100000046fea85c01aa6350db797b0a96e8609a66f2d060643b723426618fc2ef069a04e8527cbdf0000000006a47304402204b125c386d45fe4db92b9d0da61e811eb948a17d258678dad592e5087585a4260220285b56596b600fca0c7ca8fc4b8bbf5dd890d43a9fa640ca489bb6de2a8ca780012103940de0b0de5c237a124e7142339eace1e529772cd475b0e842fa644bcafe49ccfeffffff02c1c62d00000000001976a9148305167ef95a1b1e9acdf634a7686cb76993406a88ac7f841e00000000001976a914c3f710deb7320b0efa6edb14e3ebeeb9155fa90d88acee642000");
+    }
+
+    #[test]
+    fn test_transaction_ref_trailing_bytes_ignored() {
+        let raw: Vec<u8> = "0100000001a6b97044d03da79c005b20ea9c0e1a6d9dc12d9f7b91a5911c9030a439eed8f5000000004948304502206e21798a42fae0e854281abd38bacd1aeed3ee3738d9e1446618c4571d1090db022100e2ac980643b0b82c0e88ffdfec6b64e3e6ba35e7ba5fdd7d5d6cc8d25c6b241501ffffffff0100f2052a010000001976a914404371705fa9bd789a2fcd52d2c580b65d35549d88ac00000000".from_hex().unwrap();
+        let mut with_trailing = raw.clone();
+        with_trailing.extend_from_slice(&[1, 2, 3]);
+        let view = TransactionRef::parse(&with_trailing).unwrap();
+        assert_eq!(view.raw(), raw.as_slice());
+
+        assert_eq!(
+            TransactionRef::parse(&raw[..raw.len() - 1]).unwrap_err(),
+            Error::UnexpectedEnd
+        );
+    }
+}
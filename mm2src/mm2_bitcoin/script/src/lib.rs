@@ -1,3 +1,5 @@
+#![cfg_attr(test, feature(test))]
+
 extern crate bitcrypto as crypto;
 extern crate blake2b_simd;
 extern crate chain;
@@ -5,6 +7,7 @@ extern crate keys;
 extern crate log;
 extern crate primitives;
 extern crate serialization as ser;
+#[cfg(test)] extern crate test;
 
 mod builder;
 mod error;
@@ -24,6 +27,6 @@ pub use self::flags::VerificationFlags;
 pub use self::num::Num;
 pub use self::opcode::Opcode;
 pub use self::script::{is_witness_commitment_script, Script, ScriptAddress, ScriptType, ScriptWitness};
-pub use self::sign::{SignatureVersion, SignerHashAlgo, TransactionInputSigner, UnsignedTransactionInput};
+pub use self::sign::{SighashCache, SignatureVersion, SignerHashAlgo, TransactionInputSigner, UnsignedTransactionInput};
 pub use self::stack::Stack;
 pub use self::verify::{NoopSignatureChecker, SignatureChecker, TransactionSignatureChecker};
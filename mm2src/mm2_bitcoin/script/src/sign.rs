@@ -7,7 +7,7 @@ use chain::{JoinSplit, OutPoint, ShieldedOutput, ShieldedSpend, Transaction, Tra
 use crypto::{dhash256, sha256};
 use hash::{H256, H512};
 use keys::KeyPair;
-use ser::Stream;
+use ser::{serialize, CompactInteger, Serializable, Stream};
 use {Builder, Script};
 
 const ZCASH_PREVOUTS_HASH_PERSONALIZATION: &[u8] = b"ZcashPrevoutHash";
@@ -17,6 +17,10 @@ const ZCASH_JOIN_SPLITS_HASH_PERSONALIZATION: &[u8] = b"ZcashJSplitsHash";
 const ZCASH_SHIELDED_SPENDS_HASH_PERSONALIZATION: &[u8] = b"ZcashSSpendsHash";
 const ZCASH_SHIELDED_OUTPUTS_HASH_PERSONALIZATION: &[u8] = b"ZcashSOutputHash";
 const ZCASH_SIG_HASH_PERSONALIZATION: &[u8] = b"ZcashSigHash";
+/// The serialized outpoint: the transaction hash and the output index.
+const OUTPOINT_LEN: usize = 32 + 4;
+/// The serialized input with the empty script: the outpoint, the script length and the sequence.
+const LEGACY_EMPTY_INPUT_LEN: usize = OUTPOINT_LEN + 1 + 4;
 
 #[derive(Debug, PartialEq, Clone, Copy)]
 pub enum SignatureVersion {
@@ -136,6 +140,22 @@ impl Into<TxHashAlgo> for SignerHashAlgo {
     }
 }
 
+/// The sighash components shared by the inputs of one transaction: the BIP143 hashPrevouts, hashSequence and
+/// hashOutputs, the legacy SIGHASH_ALL preimage with the empty input scripts and the ZIP-243 preimage
+/// without the input part. They are computed on the first use, so signing a transaction with many inputs
+/// doesn't rehash and reserialize the whole transaction for every input.
+#[derive(Default)]
+pub struct SighashCache {
+    hash_prevouts: Option<H256>,
+    hash_sequence: Option<H256>,
+    hash_outputs: Option<H256>,
+    legacy_preimage: Option<Bytes>,
+    /// The sighash type the part is computed for and the part itself.
+    overwintered_shared_part: Option<(u32, Bytes)>,
+    /// The buffer the preimages are built in, reused between the inputs.
+    stream: Stream,
+}
+
 #[derive(Clone, Debug)]
 pub struct TransactionInputSigner {
     pub version: i32,
@@ -239,6 +259,180 @@ impl TransactionInputSigner {
         }
     }
 
+    /// Same as [`TransactionInputSigner::signature_hash`], but the components shared by the inputs
+    /// are computed once and stored in the `cache`. The `cache` must not be used with another signer.
+    pub fn signature_hash_cached(
+        &self,
+        cache: &mut SighashCache,
+        input_index: usize,
+        input_amount: u64,
+        script_pubkey: &Script,
+        sigversion: SignatureVersion,
+        sighashtype: u32,
+    ) -> H256 {
+        let sighash = Sighash::from_u32(sigversion, sighashtype);
+        let out_of_range = input_index >= self.inputs.len()
+            || (sighash.base == SighashBase::Single && input_index >= self.outputs.len());
+        match sigversion {
+            SignatureVersion::ForkId if sighash.fork_id => {
+                if out_of_range {
+                    return 1u8.into();
+                }
+                self.signature_hash_witness0_cached(
+                    cache,
+                    input_index,
+                    input_amount,
+                    script_pubkey,
+                    sighashtype,
+                    sighash,
+                )
+            },
+            SignatureVersion::Base | SignatureVersion::ForkId => {
+                if out_of_range {
+                    return 1u8.into();
+                }
+                if self.version >= 3 && self.overwintered {
+                    return self.signature_hash_overwintered_cached(cache, input_index, script_pubkey, sighashtype);
+                }
+                self.signature_hash_original_cached(cache, input_index, script_pubkey, sighashtype, sighash)
+            },
+            SignatureVersion::WitnessV0 => self.signature_hash_witness0_cached(
+                cache,
+                input_index,
+                input_amount,
+                script_pubkey,
+                sighashtype,
+                sighash,
+            ),
+        }
+    }
+
+    /// The legacy preimage of the SIGHASH_ALL differs only by the script of the signed input,
+    /// so it's spliced into the preimage with the empty scripts of all inputs.
+    fn signature_hash_original_cached(
+        &self,
+        cache: &mut SighashCache,
+        input_index: usize,
+        script_pubkey: &Script,
+        sighashtype: u32,
+        sighash: Sighash,
+    ) -> H256 {
+        if sighash.base != SighashBase::All || sighash.anyone_can_pay {
+            return self.signature_hash_original(input_index, script_pubkey, sighashtype, sighash);
+        }
+
+        if cache.legacy_preimage.is_none() {
+            let inputs = self
+                .inputs
+                .iter()
+                .map(|input| TransactionInput {
+                    previous_output: input.previous_output.clone(),
+                    script_sig: Bytes::default(),
+                    sequence: input.sequence,
+                    script_witness: vec![],
+                })
+                .collect();
+            let tx = self.legacy_sighash_tx(inputs, self.outputs.clone());
+            cache.legacy_preimage = Some(serialize(&tx));
+        }
+        let preimage = cache.legacy_preimage.as_ref().expect("The preimage is set above");
+
+        // the header is not overwintered, see `legacy_sighash_tx`
+        let header_len =
+            4 + if self.n_time.is_some() { 4 } else { 0 } + CompactInteger::from(self.inputs.len()).serialized_size();
+        // the empty script length follows the outpoint
+        let script_len_pos = header_len + LEGACY_EMPTY_INPUT_LEN * input_index + OUTPOINT_LEN;
+
+        let stream = &mut cache.stream;
+        stream.clear();
+        stream
+            .append_slice(&preimage[..script_len_pos])
+            .append(&script_pubkey.without_separators().to_bytes())
+            .append_slice(&preimage[script_len_pos + 1..])
+            .append(&sighashtype);
+        match self.hash_algo {
+            SignerHashAlgo::DSHA256 => dhash256(stream.as_slice()),
+            SignerHashAlgo::SHA256 => sha256(stream.as_slice()),
+        }
+    }
+
+    fn signature_hash_witness0_cached(
+        &self,
+        cache: &mut SighashCache,
+        input_index: usize,
+        input_amount: u64,
+        script_pubkey: &Script,
+        sighashtype: u32,
+        sighash: Sighash,
+    ) -> H256 {
+        let inputs = &self.inputs;
+        let outputs = &self.outputs;
+        let hash_prevouts = if sighash.anyone_can_pay {
+            compute_hash_prevouts(sighash, inputs)
+        } else {
+            cache
+                .hash_prevouts
+                .get_or_insert_with(|| compute_hash_prevouts(sighash, inputs))
+                .clone()
+        };
+        let hash_sequence = if sighash.base == SighashBase::All && !sighash.anyone_can_pay {
+            cache
+                .hash_sequence
+                .get_or_insert_with(|| compute_hash_sequence(sighash, inputs))
+                .clone()
+        } else {
+            compute_hash_sequence(sighash, inputs)
+        };
+        let hash_outputs = if sighash.base == SighashBase::All {
+            cache
+                .hash_outputs
+                .get_or_insert_with(|| compute_hash_outputs(sighash, input_index, outputs))
+                .clone()
+        } else {
+            compute_hash_outputs(sighash, input_index, outputs)
+        };
+
+        let stream = &mut cache.stream;
+        stream.clear();
+        stream
+            .append(&self.version)
+            .append(&hash_prevouts)
+            .append(&hash_sequence)
+            .append(&self.inputs[input_index].previous_output)
+            .append_list(&**script_pubkey)
+            .append(&input_amount)
+            .append(&self.inputs[input_index].sequence)
+            .append(&hash_outputs)
+            .append(&self.lock_time)
+            .append(&sighashtype);
+        dhash256(stream.as_slice())
+    }
+
+    fn signature_hash_overwintered_cached(
+        &self,
+        cache: &mut SighashCache,
+        input_index: usize,
+        script_pubkey: &Script,
+        sighashtype: u32,
+    ) -> H256 {
+        let shared_part_matches = match &cache.overwintered_shared_part {
+            Some((cached_sighashtype, _)) => *cached_sighashtype == sighashtype,
+            None => false,
+        };
+        if !shared_part_matches {
+            let mut shared_part = Stream::new();
+            self.append_overwintered_shared_part(&mut shared_part, sighashtype);
+            cache.overwintered_shared_part = Some((sighashtype, shared_part.out()));
+        }
+        let (_, shared_part) = cache.overwintered_shared_part.as_ref().expect("The part is set above");
+
+        let stream = &mut cache.stream;
+        stream.clear();
+        stream.append_slice(shared_part);
+        self.append_overwintered_input_part(stream, input_index, script_pubkey);
+        blake_2b_256_personal(stream.as_slice(), &self.overwintered_personalization())
+    }
+
     /// input_index - index of input to sign
     /// script_pubkey - script_pubkey of input's previous_output pubkey
     pub fn signed_input(
@@ -250,7 +444,55 @@ impl TransactionInputSigner {
         sigversion: SignatureVersion,
         sighash: u32,
     ) -> TransactionInput {
-        let hash = self.signature_hash(input_index, input_amount, script_pubkey, sigversion, sighash);
+        let mut cache = SighashCache::default();
+        self.signed_input_cached(
+            &mut cache,
+            keypair,
+            input_index,
+            input_amount,
+            script_pubkey,
+            sigversion,
+            sighash,
+        )
+    }
+
+    /// Signs all inputs spending the `script_pubkey` outputs, the sighash components are computed once for all of them.
+    pub fn sign_all_inputs(
+        &self,
+        keypair: &KeyPair,
+        script_pubkey: &Script,
+        sigversion: SignatureVersion,
+        sighash: u32,
+    ) -> Vec<TransactionInput> {
+        let mut cache = SighashCache::default();
+        (0..self.inputs.len())
+            .map(|input_index| {
+                let input_amount = self.inputs[input_index].amount;
+                self.signed_input_cached(
+                    &mut cache,
+                    keypair,
+                    input_index,
+                    input_amount,
+                    script_pubkey,
+                    sigversion,
+                    sighash,
+                )
+            })
+            .collect()
+    }
+
+    #[allow(clippy::too_many_arguments)]
+    fn signed_input_cached(
+        &self,
+        cache: &mut SighashCache,
+        keypair: &KeyPair,
+        input_index: usize,
+        input_amount: u64,
+        script_pubkey: &Script,
+        sigversion: SignatureVersion,
+        sighash: u32,
+    ) -> TransactionInput {
+        let hash = self.signature_hash_cached(cache, input_index, input_amount, script_pubkey, sigversion, sighash);
 
         let mut signature: Vec<u8> = keypair.private().sign(&hash).unwrap().into();
         signature.push(sighash as u8);
@@ -337,7 +579,20 @@ impl TransactionInputSigner {
             SighashBase::None => Vec::new(),
         };
 
-        let tx = Transaction {
+        let tx = self.legacy_sighash_tx(inputs, outputs);
+        let mut stream = Stream::default();
+        stream.append(&tx);
+        stream.append(&sighashtype);
+        let out = stream.out();
+        match self.hash_algo {
+            SignerHashAlgo::DSHA256 => dhash256(&out),
+            SignerHashAlgo::SHA256 => sha256(&out),
+        }
+    }
+
+    /// The transaction of the legacy sighash preimage.
+    fn legacy_sighash_tx(&self, inputs: Vec<TransactionInput>, outputs: Vec<TransactionOutput>) -> Transaction {
+        Transaction {
             inputs,
             outputs,
             version: self.version,
@@ -356,15 +611,6 @@ impl TransactionInputSigner {
             zcash: self.zcash,
             str_d_zeel: self.str_d_zeel.clone(),
             tx_hash_algo: self.hash_algo.into(),
-        };
-
-        let mut stream = Stream::default();
-        stream.append(&tx);
-        stream.append(&sighashtype);
-        let out = stream.out();
-        match self.hash_algo {
-            SignerHashAlgo::DSHA256 => dhash256(&out),
-            SignerHashAlgo::SHA256 => sha256(&out),
         }
     }
 
@@ -426,7 +672,15 @@ impl TransactionInputSigner {
         _sighash: Sighash,
     ) -> Result<H256, String> {
         let mut sig_hash_stream = Stream::new();
+        self.append_overwintered_shared_part(&mut sig_hash_stream, sighashtype);
+        self.append_overwintered_input_part(&mut sig_hash_stream, input_index, script_pubkey);
+        Ok(blake_2b_256_personal(
+            sig_hash_stream.as_slice(),
+            &self.overwintered_personalization(),
+        ))
+    }
 
+    fn overwintered_personalization(&self) -> Vec<u8> {
         let mut personalization = ZCASH_SIG_HASH_PERSONALIZATION.to_vec();
         // uint32_t leConsensusBranchId = htole32(consensusBranchId);
         // unsigned char personalization[16] = {};
@@ -436,7 +690,11 @@ impl TransactionInputSigner {
         if self.version >= 3 {
             personalization.extend_from_slice(&self.consensus_branch_id.to_le_bytes());
         }
+        personalization
+    }
 
+    /// Appends the part of the ZIP-243 preimage that is the same for all inputs.
+    fn append_overwintered_shared_part(&self, sig_hash_stream: &mut Stream, sighashtype: u32) {
         let mut header = self.version;
         if self.overwintered {
             header |= 1 << 31;
@@ -521,13 +779,13 @@ impl TransactionInputSigner {
         sig_hash_stream.append(&self.expiry_height);
         sig_hash_stream.append(&self.value_balance);
         sig_hash_stream.append(&sighashtype);
+    }
 
+    fn append_overwintered_input_part(&self, sig_hash_stream: &mut Stream, input_index: usize, script_pubkey: &Script) {
         sig_hash_stream.append(&self.inputs[input_index].previous_output);
         sig_hash_stream.append(&script_pubkey.to_bytes());
         sig_hash_stream.append(&self.inputs[input_index].amount);
         sig_hash_stream.append(&self.inputs[input_index].sequence);
-
-        Ok(blake_2b_256_personal(&sig_hash_stream.out(), &personalization))
     }
 }
 
@@ -589,14 +847,15 @@ fn blake_2b_256_personal(input: &[u8], personal: &[u8]) -> H256 {
 
 #[cfg(test)]
 mod tests {
-    use super::{blake_2b_256_personal, Sighash, SighashBase, SignatureVersion, TransactionInputSigner,
+    use super::{blake_2b_256_personal, Sighash, SighashBase, SighashCache, SignatureVersion, TransactionInputSigner,
                 UnsignedTransactionInput};
     use bytes::Bytes;
     use chain::{OutPoint, Transaction, TransactionOutput};
     use hash::H256;
-    use keys::{Address, Private};
+    use keys::{Address, KeyPair, Private};
     use script::Script;
     use sign::SignerHashAlgo;
+    use test::{black_box, Bencher};
 
     // http://www.righto.com/2014/02/bitcoins-hard-way-using-raw-bitcoin.html
     // https://blockchain.info/rawtx/81b4c832d70cb56ff957589752eb4125a4cab78a25a8fc52d6a09e5bd4404d48
@@ -800,4 +1059,157 @@ mod tests {
             hash.reversed()
         );
     }
+
+    fn signer_for_test(inputs_count: usize, outputs_count: usize) -> TransactionInputSigner {
+        let inputs = (0..inputs_count)
+            .map(|i| UnsignedTransactionInput {
+                sequence: 0xffff_fff0 + (i % 8) as u32,
+                previous_output: OutPoint {
+                    hash: H256::from([i as u8; 32]),
+                    index: i as u32,
+                },
+                amount: 100000 + i as u64,
+            })
+            .collect();
+        let outputs = (0..outputs_count)
+            .map(|i| TransactionOutput {
+                value: 1000 + i as u64,
+                script_pubkey: "76a914c8e90996c7c6080ee06284600c684ed904d14c5c88ac".into(),
+            })
+            .collect();
+        TransactionInputSigner {
+            version: 1,
+            n_time: None,
+            overwintered: false,
+            version_group_id: 0,
+            consensus_branch_id: 0,
+            expiry_height: 0,
+            value_balance: 0,
+            lock_time: 1234,
+            inputs,
+            outputs,
+            join_splits: vec![],
+            shielded_spends: vec![],
+            shielded_outputs: vec![],
+            zcash: false,
+            str_d_zeel: None,
+            hash_algo: SignerHashAlgo::DSHA256,
+        }
+    }
+
+    fn assert_cached_sighashes_eq(
+        signer: &TransactionInputSigner,
+        sigversion: SignatureVersion,
+        sighash_types: &[u32],
+    ) {
+        let script: Script = "76a914df3bd30160e6c6145baaf2c88a8844c13a00d1d588ac".into();
+        let mut cache = SighashCache::default();
+        // the input out of the range is checked too, the witness sighash doesn't expect it
+        let inputs_count = match sigversion {
+            SignatureVersion::WitnessV0 => signer.inputs.len(),
+            _ => signer.inputs.len() + 1,
+        };
+        for input_index in 0..inputs_count {
+            for sighash_type in sighash_types {
+                let amount = 100000 + input_index as u64;
+                let expected = signer.signature_hash(input_index, amount, &script, sigversion, *sighash_type);
+                let actual =
+                    signer.signature_hash_cached(&mut cache, input_index, amount, &script, sigversion, *sighash_type);
+                assert_eq!(
+                    actual, expected,
+                    "input {} sigversion {:?} sighash {:x}",
+                    input_index, sigversion, sighash_type
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn test_signature_hash_cached() {
+        let legacy_types = [1, 2, 3, 0x81, 0x82, 0x83];
+        let fork_id_types = [0x41, 0x42, 0x43, 0xc1, 0xc2, 0xc3, 1];
+
+        // more outputs than inputs and vice versa for SIGHASH_SINGLE
+        for (inputs_count, outputs_count) in [(3, 5), (5, 3), (300, 2)].iter() {
+            let mut signer = signer_for_test(*inputs_count, *outputs_count);
+            assert_cached_sighashes_eq(&signer, SignatureVersion::Base, &legacy_types);
+            assert_cached_sighashes_eq(&signer, SignatureVersion::ForkId, &fork_id_types);
+            assert_cached_sighashes_eq(&signer, SignatureVersion::WitnessV0, &legacy_types);
+
+            signer.n_time = Some(1620235027);
+            signer.str_d_zeel = Some("".into());
+            signer.hash_algo = SignerHashAlgo::SHA256;
+            assert_cached_sighashes_eq(&signer, SignatureVersion::Base, &legacy_types);
+
+            signer.n_time = None;
+            signer.str_d_zeel = None;
+            signer.hash_algo = SignerHashAlgo::DSHA256;
+            signer.version = 4;
+            signer.overwintered = true;
+            signer.zcash = true;
+            signer.version_group_id = 0x892f2085;
+            signer.consensus_branch_id = 0x76b809bb;
+            assert_cached_sighashes_eq(&signer, SignatureVersion::Base, &legacy_types);
+        }
+    }
+
+    #[test]
+    fn test_sign_all_inputs() {
+        let private: Private = "5HusYj2b2x4nroApgfvaSfKYZhRbKFH41bVyPooymbC6KfgSXdD".into();
+        let key_pair = KeyPair::from_private(private).unwrap();
+        let script: Script = "76a914df3bd30160e6c6145baaf2c88a8844c13a00d1d588ac".into();
+        let signer = signer_for_test(4, 2);
+
+        let signed = signer.sign_all_inputs(&key_pair, &script, SignatureVersion::Base, 1);
+        assert_eq!(signed.len(), 4);
+        for (i, input) in signed.into_iter().enumerate() {
+            let expected = signer.signed_input(&key_pair, i, 100000 + i as u64, &script, SignatureVersion::Base, 1);
+            assert_eq!(input, expected);
+        }
+    }
+
+    const BENCH_INPUTS_COUNT: usize = 200;
+
+    fn bench_signature_hashes(b: &mut Bencher, signer: TransactionInputSigner, cached: bool) {
+        let script: Script = "76a914df3bd30160e6c6145baaf2c88a8844c13a00d1d588ac".into();
+        b.iter(|| {
+            let mut cache = SighashCache::default();
+            for i in 0..signer.inputs.len() {
+                let amount = signer.inputs[i].amount;
+                let hash = if cached {
+                    signer.signature_hash_cached(&mut cache, i, amount, &script, SignatureVersion::Base, 1)
+                } else {
+                    signer.signature_hash(i, amount, &script, SignatureVersion::Base, 1)
+                };
+                black_box(hash);
+            }
+        });
+    }
+
+    fn overwintered_signer_for_bench() -> TransactionInputSigner {
+        let mut signer = signer_for_test(BENCH_INPUTS_COUNT, 2);
+        signer.version = 4;
+        signer.overwintered = true;
+        signer.zcash = true;
+        signer.version_group_id = 0x892f2085;
+        signer
+    }
+
+    #[bench]
+    fn bench_legacy_sighash(b: &mut Bencher) {
+        bench_signature_hashes(b, signer_for_test(BENCH_INPUTS_COUNT, 2), false)
+    }
+
+    #[bench]
+    fn bench_legacy_sighash_cached(b: &mut Bencher) {
+        bench_signature_hashes(b, signer_for_test(BENCH_INPUTS_COUNT, 2), true)
+    }
+
+    #[bench]
+    fn bench_overwintered_sighash(b: &mut Bencher) { bench_signature_hashes(b, overwintered_signer_for_bench(), false) }
+
+    #[bench]
+    fn bench_overwintered_sighash_cached(b: &mut Bencher) {
+        bench_signature_hashes(b, overwintered_signer_for_bench(), true)
+    }
 }
@@ -140,6 +140,12 @@ impl Stream {
 
     /// Full stream.
     pub fn out(self) -> Bytes { self.buffer.into() }
+
+    /// The bytes written to the stream so far.
+    pub fn as_slice(&self) -> &[u8] { &self.buffer }
+
+    /// Clears the stream keeping the allocated buffer, so the stream can be reused.
+    pub fn clear(&mut self) { self.buffer.clear() }
 }
 
 impl Write for Stream {
@@ -11,24 +11,26 @@ use void::Void;
 /// event.
 /// Libp2p has unclear ConnectionHandlers keep alive logic so in some cases even if Ping handler emits Close event the
 /// connection is kept active which is undesirable.
+/// The ping events are forwarded to score the round trip times of the peers.
 #[derive(NetworkBehaviour)]
-#[behaviour(out_event = "Void")]
+#[behaviour(out_event = "PingEvent")]
 #[behaviour(poll_method = "poll_event")]
 pub struct AdexPing {
     ping: Ping,
     #[behaviour(ignore)]
-    events: VecDeque<NetworkBehaviourAction<Void, Void>>,
+    events: VecDeque<NetworkBehaviourAction<Void, PingEvent>>,
 }
 
 impl NetworkBehaviourEventProcess<PingEvent> for AdexPing {
     fn inject_event(&mut self, event: PingEvent) {
-        if let Err(e) = event.result {
+        if let Err(e) = &event.result {
             error!("Ping error {}. Disconnecting peer {}", e, event.peer);
             self.events.push_back(NetworkBehaviourAction::DisconnectPeer {
-                peer_id: event.peer,
+                peer_id: event.peer.clone(),
                 handler: DisconnectPeerHandler::All,
             });
         }
+        self.events.push_back(NetworkBehaviourAction::GenerateEvent(event));
     }
 }
 
@@ -45,7 +47,7 @@ impl AdexPing {
         &mut self,
         _cx: &mut Context,
         _params: &mut impl PollParameters,
-    ) -> Poll<NetworkBehaviourAction<Void, Void>> {
+    ) -> Poll<NetworkBehaviourAction<Void, PingEvent>> {
         if let Some(event) = self.events.pop_front() {
             return Poll::Ready(event);
         }
@@ -1,19 +1,22 @@
 use crate::{adex_ping::AdexPing,
+            peer_scores::PeerScores,
             peers_exchange::{PeerAddresses, PeersExchange},
             request_response::{build_request_response_behaviour, PeerRequest, PeerResponse, RequestResponseBehaviour,
                                RequestResponseBehaviourEvent, RequestResponseSender},
             runtime::{SwarmRuntimeOps, SWARM_RUNTIME}};
-use atomicdex_gossipsub::{Gossipsub, GossipsubConfigBuilder, GossipsubEvent, GossipsubMessage, MessageId, Topic,
-                          TopicHash};
+use atomicdex_gossipsub::{Gossipsub, GossipsubConfigBuilder, GossipsubEvent, GossipsubMessage, MessageCacheStats,
+                          MessageId, Topic, TopicHash};
 use futures::{channel::{mpsc::{channel, Receiver, Sender},
                         oneshot},
-              future::{abortable, join_all, poll_fn, AbortHandle},
-              Future, SinkExt, StreamExt};
+              future::{abortable, join_all, poll_fn, select, AbortHandle, Either},
+              stream::FuturesUnordered,
+              Future, FutureExt, SinkExt, StreamExt};
 use libp2p::swarm::{IntoProtocolsHandler, NetworkBehaviour, ProtocolsHandler};
 use libp2p::{core::{ConnectedPoint, Multiaddr, Transport},
              identity,
              multiaddr::Protocol,
              noise,
+             ping::{PingEvent, PingSuccess},
              request_response::ResponseChannel,
              swarm::{ExpandedSwarm, NetworkBehaviourEventProcess, Swarm},
              NetworkBehaviour, PeerId};
@@ -28,8 +31,7 @@ use std::{collections::hash_map::{DefaultHasher, HashMap},
           str::FromStr,
           task::{Context, Poll},
           time::Duration};
-use void::Void;
-use wasm_timer::{Instant, Interval};
+use wasm_timer::{Delay, Instant, Interval};
 
 pub type AdexCmdTx = Sender<AdexBehaviourCmd>;
 pub type AdexEventRx = Receiver<AdexBehaviourEvent>;
@@ -101,7 +103,8 @@ pub enum AdexBehaviourCmd {
         topics: Vec<String>,
         msg: Vec<u8>,
     },
-    /// Request relays sequential until a response is received.
+    /// Request relays from the fastest one until a response is received.
+    /// The next relay is requested without waiting for the current one if it's slower than expected.
     RequestAnyRelay {
         req: Vec<u8>,
         response_tx: oneshot::Sender<Option<(PeerId, Vec<u8>)>>,
@@ -201,6 +204,8 @@ pub enum AdexBehaviourEvent {
         peer_id: PeerId,
         /// The serialized data.
         request: Vec<u8>,
+        /// Whether the remote decodes the application specific compact responses.
+        compact_response: bool,
         /// A channel for sending a response to this request.
         /// The channel is used to identify the peer on the network that is waiting for an answer to this request.
         /// See [`AdexBehaviourCmd::SendResponse`].
@@ -236,6 +241,13 @@ pub struct AtomicDexBehaviour {
     request_response: RequestResponseBehaviour,
     peers_exchange: PeersExchange,
     ping: AdexPing,
+    #[behaviour(ignore)]
+    peer_scores: PeerScores,
+    /// The fastest relays kept connected, see `maintain_connection_to_relays`.
+    #[behaviour(ignore)]
+    pinned_relays: Vec<PeerId>,
+    #[behaviour(ignore)]
+    pinned_relays_num: usize,
 }
 
 impl AtomicDexBehaviour {
@@ -257,7 +269,15 @@ impl AtomicDexBehaviour {
                 self.gossipsub.publish_many(topics.into_iter().map(Topic::new), msg);
             },
             AdexBehaviourCmd::RequestAnyRelay { req, response_tx } => {
-                let relays = self.gossipsub.get_relay_mesh();
+                let mut relays = self.gossipsub.get_relay_mesh();
+                self.peer_scores.sort_fastest(&mut relays);
+                let relays = relays
+                    .into_iter()
+                    .map(|relay| {
+                        let hedge_delay = self.peer_scores.hedge_delay(&relay);
+                        (relay, hedge_delay)
+                    })
+                    .collect();
                 // spawn the `request_any_peer` future
                 let future = request_any_peer(relays, req, self.request_response.sender(), response_tx);
                 self.spawn(future);
@@ -382,11 +402,15 @@ impl AtomicDexBehaviour {
 
     pub fn connected_relays_len(&self) -> usize { self.gossipsub.connected_relays_len() }
 
+    pub fn pinned_relays_len(&self) -> usize { self.pinned_relays.len() }
+
     pub fn relay_mesh_len(&self) -> usize { self.gossipsub.relay_mesh_len() }
 
     pub fn received_messages_in_period(&self) -> (Duration, usize) { self.gossipsub.get_received_messages_in_period() }
 
     pub fn connected_peers_len(&self) -> usize { self.gossipsub.get_num_peers() }
+
+    pub fn message_cache_stats(&self) -> MessageCacheStats { self.gossipsub.message_cache_stats() }
 }
 
 impl NetworkBehaviourEventProcess<GossipsubEvent> for AtomicDexBehaviour {
@@ -412,8 +436,14 @@ impl NetworkBehaviourEventProcess<FloodsubEvent> for AtomicDexBehaviour {
     }
 }
 
-impl NetworkBehaviourEventProcess<Void> for AtomicDexBehaviour {
-    fn inject_event(&mut self, _event: Void) {}
+impl NetworkBehaviourEventProcess<PingEvent> for AtomicDexBehaviour {
+    fn inject_event(&mut self, event: PingEvent) {
+        match event.result {
+            Ok(PingSuccess::Ping { rtt }) => self.peer_scores.record_rtt(&event.peer, rtt),
+            Ok(PingSuccess::Pong) => (),
+            Err(_) => self.peer_scores.record_failure(&event.peer),
+        }
+    }
 }
 
 impl NetworkBehaviourEventProcess<()> for AtomicDexBehaviour {
@@ -431,11 +461,16 @@ impl NetworkBehaviourEventProcess<RequestResponseBehaviourEvent> for AtomicDexBe
                 let event = AdexBehaviourEvent::PeerRequest {
                     peer_id,
                     request: request.req,
+                    compact_response: request.compact_response,
                     response_channel: response_channel.into(),
                 };
                 // forward the event to the AdexBehaviourCmd handler
                 self.notify_on_adex_event(event);
             },
+            RequestResponseBehaviourEvent::OutboundFinished { peer_id, latency } => match latency {
+                Some(latency) => self.peer_scores.record_response(&peer_id, latency),
+                None => self.peer_scores.record_failure(&peer_id),
+            },
         }
     }
 }
@@ -455,11 +490,40 @@ fn maintain_connection_to_relays(swarm: &mut AtomicDexSwarm, bootstrap_addresses
     let mesh_n = swarm.gossipsub.get_config().mesh_n;
     // allow 2 * mesh_n_high connections to other nodes
     let max_n = swarm.gossipsub.get_config().mesh_n_high * 2;
+
+    // the fastest of the pinned and the connected relays are pinned,
+    // so the requests and the gossips keep going through the same fast relays instead of the random ones
+    let pinned_relays = swarm.peer_scores.fastest(
+        swarm.pinned_relays.iter().chain(connected_relays.iter()),
+        swarm.pinned_relays_num,
+    );
+    swarm.pinned_relays = pinned_relays.clone();
+
+    let mut dialing_pinned = 0;
+    if connected_relays.len() < max_n {
+        for relay in pinned_relays.iter().filter(|relay| !connected_relays.contains(relay)) {
+            // a relay failing to reconnect is ranked lower until it's not pinned anymore
+            swarm.peer_scores.record_failure(relay);
+            let addresses = swarm.peers_exchange.peer_addresses(relay);
+            if !addresses.is_empty() {
+                dialing_pinned += 1;
+            }
+            for addr in addresses {
+                if swarm.gossipsub.is_connected_to_addr(&addr) {
+                    continue;
+                }
+                if let Err(e) = libp2p::Swarm::dial_addr(swarm, addr.clone()) {
+                    error!("Pinned relay {} address {} dial error {}", relay, addr, e);
+                }
+            }
+        }
+    }
+
     if connected_relays.len() < mesh_n_low {
-        let to_connect_num = mesh_n - connected_relays.len();
-        let to_connect = swarm
-            .peers_exchange
-            .get_random_peers(to_connect_num, |peer| !connected_relays.contains(peer));
+        let to_connect_num = (mesh_n - connected_relays.len()).saturating_sub(dialing_pinned);
+        let to_connect = swarm.peers_exchange.get_random_peers(to_connect_num, |peer| {
+            !connected_relays.contains(peer) && !pinned_relays.contains(peer)
+        });
 
         // choose some random bootstrap addresses to connect if peers exchange returned not enough peers
         if to_connect.len() < to_connect_num {
@@ -488,16 +552,18 @@ fn maintain_connection_to_relays(swarm: &mut AtomicDexSwarm, bootstrap_addresses
     }
 
     if connected_relays.len() > max_n {
-        let mut rng = thread_rng();
         let to_disconnect_num = connected_relays.len() - max_n;
         let relays_mesh = swarm.gossipsub.get_relay_mesh();
-        let not_in_mesh: Vec<_> = connected_relays
+        let mut to_disconnect: Vec<_> = connected_relays
             .iter()
-            .filter(|peer| !relays_mesh.contains(peer))
+            .filter(|peer| !relays_mesh.contains(peer) && !pinned_relays.contains(peer))
+            .cloned()
             .collect();
-        for peer in not_in_mesh.choose_multiple(&mut rng, to_disconnect_num) {
+        // disconnect the slowest relays
+        swarm.peer_scores.sort_fastest(&mut to_disconnect);
+        for peer in to_disconnect.iter().rev().take(to_disconnect_num) {
             info!("Disconnecting peer {}", peer);
-            if Swarm::disconnect_peer_id(swarm, (*peer).clone()).is_err() {
+            if Swarm::disconnect_peer_id(swarm, peer.clone()).is_err() {
                 error!("Peer {} disconnect error", peer);
             }
         }
@@ -587,6 +653,7 @@ impl NodeType {
 /// 2. rx emitting gossip events to processing side
 /// 3. our peer_id
 /// 4. abort handle to stop the P2P processing fut
+/// The `pinned_relays` is the number of the fastest relays kept connected, `mesh_n_low` by default.
 #[allow(clippy::too_many_arguments)]
 pub fn start_gossipsub(
     port: u16,
@@ -595,6 +662,7 @@ pub fn start_gossipsub(
     spawn_fn: fn(Box<dyn Future<Output = ()> + Send + Unpin + 'static>) -> (),
     to_dial: Vec<String>,
     node_type: NodeType,
+    pinned_relays: Option<usize>,
     on_poll: impl Fn(&AtomicDexSwarm) + Send + 'static,
 ) -> (Sender<AdexBehaviourCmd>, AdexEventRx, PeerId, AbortHandle) {
     let i_am_relay = node_type.is_relay();
@@ -644,6 +712,7 @@ pub fn start_gossipsub(
         .collect();
 
     let (mesh_n_low, mesh_n, mesh_n_high) = if i_am_relay { (3, 6, 8) } else { (2, 3, 4) };
+    let pinned_relays_num = pinned_relays.unwrap_or(mesh_n_low);
 
     // Create a Swarm to manage peers and events
     let mut swarm = {
@@ -698,6 +767,9 @@ pub fn start_gossipsub(
             request_response,
             peers_exchange,
             ping,
+            peer_scores: PeerScores::default(),
+            pinned_relays: Vec::new(),
+            pinned_relays_num,
             netid,
         };
         libp2p::swarm::SwarmBuilder::new(transport, adex_behavior, local_peer_id.clone())
@@ -782,16 +854,52 @@ fn parse_relay_address(addr: String, port: u16) -> Multiaddr {
 #[cfg(not(test))]
 fn parse_relay_address(addr: String, port: u16) -> Multiaddr { format!("/ip4/{}/tcp/{}", addr, port).parse().unwrap() }
 
-/// Request the peers sequential until a `PeerResponse::Ok()` will not be received.
+/// Request the peers in the order until a `PeerResponse::Ok()` is received.
+/// The next peer is requested too if the current one doesn't respond in its hedge delay,
+/// so a slow peer delays the response by the delay only.
 async fn request_any_peer(
-    peers: Vec<PeerId>,
+    peers: Vec<(PeerId, Duration)>,
     request_data: Vec<u8>,
     request_response_tx: RequestResponseSender,
     response_tx: oneshot::Sender<Option<(PeerId, Vec<u8>)>>,
 ) {
     debug!("start request_any_peer loop: peers {}", peers.len());
-    for peer in peers {
-        match request_one_peer(peer.clone(), request_data.clone(), request_response_tx.clone()).await {
+    let mut peers = peers.into_iter();
+    let mut requests = FuturesUnordered::new();
+    let mut hedge = None;
+    let mut request_next = true;
+    loop {
+        if request_next {
+            request_next = false;
+            hedge = None;
+            if let Some((peer, hedge_delay)) = peers.next() {
+                let request = request_one_peer(peer.clone(), request_data.clone(), request_response_tx.clone());
+                requests.push(request.map(move |response| (peer, response)));
+                hedge = Some(Delay::new(hedge_delay));
+            }
+        }
+
+        let next = match hedge.take() {
+            Some(delay) => match select(requests.next(), delay).await {
+                Either::Left((next, delay)) => {
+                    hedge = Some(delay);
+                    next
+                },
+                Either::Right(_) => {
+                    debug!("The request is not responded in the hedge delay, request next peer");
+                    request_next = true;
+                    continue;
+                },
+            },
+            None => requests.next().await,
+        };
+        // there are no requests in progress and no peers left
+        let (peer, response) = match next {
+            Some(next) => next,
+            None => break,
+        };
+
+        match response {
             PeerResponse::Ok { res } => {
                 debug!("Received a response from peer {:?}, stop the request loop", peer);
                 if response_tx.send(Some((peer, res))).is_err() {
@@ -806,6 +914,8 @@ async fn request_any_peer(
                 error!("Error on request {:?} peer: {:?}. Request next peer", peer, err);
             },
         };
+        // don't wait for the hedge delay if the other requests are failed
+        request_next = requests.is_empty();
     }
 
     debug!("None of the peers responded to the request");
@@ -849,7 +959,10 @@ async fn request_peers(
 async fn request_one_peer(peer: PeerId, req: Vec<u8>, mut request_response_tx: RequestResponseSender) -> PeerResponse {
     // Use the internal receiver to receive a response to this request.
     let (internal_response_tx, internal_response_rx) = oneshot::channel();
-    let request = PeerRequest { req };
+    let request = PeerRequest {
+        req,
+        compact_response: false,
+    };
     request_response_tx
         .send((peer.clone(), request, internal_response_tx))
         .await
@@ -28,7 +28,7 @@ impl Node {
         let secret = SecretKey::new(&mut rng);
         let node_type = NodeType::Relay { ip: my_address };
         let (cmd_tx, mut event_rx, peer_id, _) =
-            start_gossipsub(port, 333, None, spawn_boxed, seednodes, node_type, |_| {});
+            start_gossipsub(port, 333, None, spawn_boxed, seednodes, node_type, None, |_| {});
 
         // spawn a response future
         let cmd_tx_fut = cmd_tx.clone();
@@ -2,6 +2,7 @@
 
 mod adex_ping;
 pub mod atomicdex_behaviour;
+mod peer_scores;
 mod peers_exchange;
 pub mod request_response;
 mod runtime;
@@ -56,20 +57,44 @@ pub fn encode_and_sign<T: Serialize>(message: &T, secret: &[u8; 32]) -> Result<V
 pub fn decode_signed<'de, T: de::Deserialize<'de>>(
     encoded: &'de [u8],
 ) -> Result<(T, Signature, PublicKey), rmp_serde::decode::Error> {
+    decode_signed_unverified(encoded)?.verify_and_decode()
+}
+
+/// The signed message which signature is not verified yet.
+/// Allows to reject the message by its sender before the signature verification.
+pub struct UnverifiedSignedMessage<'a> {
+    helper: SignedMessageSerdeHelper<'a>,
+}
+
+/// Decodes the signed message envelope only, that is much cheaper than [`decode_signed`].
+pub fn decode_signed_unverified(encoded: &[u8]) -> Result<UnverifiedSignedMessage, rmp_serde::decode::Error> {
     let helper: SignedMessageSerdeHelper = decode_message(encoded)?;
-    let signature = Signature::from_compact(helper.signature)
-        .map_err(|e| rmp_serde::decode::Error::Syntax(format!("Failed to parse signature {}", e)))?;
-    let sig_hash = SecpMessage::from_slice(&sha256(&helper.payload)).expect("Message::from_slice should never fail");
-    match &helper.pubkey {
-        PublicKey::Secp256k1(serialized_pub) => {
-            if SECP_VERIFY.verify(&sig_hash, &signature, &serialized_pub.0).is_err() {
-                return Err(rmp_serde::decode::Error::Syntax("Invalid message signature".into()));
-            }
-        },
-    }
+    Ok(UnverifiedSignedMessage { helper })
+}
+
+impl<'a> UnverifiedSignedMessage<'a> {
+    /// The claimed sender of the message.
+    pub fn pubkey(&self) -> &PublicKey { &self.helper.pubkey }
+
+    pub fn verify_and_decode<T: de::Deserialize<'a>>(
+        self,
+    ) -> Result<(T, Signature, PublicKey), rmp_serde::decode::Error> {
+        let helper = self.helper;
+        let signature = Signature::from_compact(helper.signature)
+            .map_err(|e| rmp_serde::decode::Error::Syntax(format!("Failed to parse signature {}", e)))?;
+        let sig_hash =
+            SecpMessage::from_slice(&sha256(&helper.payload)).expect("Message::from_slice should never fail");
+        match &helper.pubkey {
+            PublicKey::Secp256k1(serialized_pub) => {
+                if SECP_VERIFY.verify(&sig_hash, &signature, &serialized_pub.0).is_err() {
+                    return Err(rmp_serde::decode::Error::Syntax("Invalid message signature".into()));
+                }
+            },
+        }
 
-    let payload: T = decode_message(helper.payload)?;
-    Ok((payload, signature, helper.pubkey))
+        let payload: T = decode_message(helper.payload)?;
+        Ok((payload, signature, helper.pubkey))
+    }
 }
 
 fn sha256(input: impl AsRef<[u8]>) -> [u8; 32] { Sha256::new().chain(input).finalize().into() }
@@ -146,3 +171,21 @@ fn signed_message_serde() {
     let (decoded, ..) = decode_signed::<Vec<u8>>(&signed_encoded).unwrap();
     assert_eq!(decoded, initial_msg);
 }
+
+#[test]
+fn signed_message_unverified_pubkey() {
+    let secret = [1u8; 32];
+    let initial_msg = vec![0u8; 32];
+    let mut signed_encoded = encode_and_sign(&initial_msg, &secret).unwrap();
+
+    let secret_key = SecretKey::from_slice(&secret).unwrap();
+    let expected_pubkey = PublicKey::from(Secp256k1Pubkey::from_secret_key(&*SECP_SIGN, &secret_key));
+    let unverified = decode_signed_unverified(&signed_encoded).unwrap();
+    assert_eq!(*unverified.pubkey(), expected_pubkey);
+
+    // corrupt the last byte of the payload
+    *signed_encoded.last_mut().unwrap() ^= 1;
+    let unverified = decode_signed_unverified(&signed_encoded).unwrap();
+    assert_eq!(*unverified.pubkey(), expected_pubkey);
+    unverified.verify_and_decode::<Vec<u8>>().unwrap_err();
+}
@@ -0,0 +1,200 @@
+//! The quality of the peers measured by the pings and the requests, so the requests are sent to the fastest relays
+//! and the fastest relays are kept connected instead of the random ones.
+//!
+//! A peer is scored by its expected latency: the average latency of its responses (or the ping round trip time
+//! until it's requested) divided by the ratio of its successful responses, so a fast but failing peer is ranked
+//! after a slower one answering every request.
+//! The scores of the disconnected peers are kept to prefer the known fast relays on reconnect.
+
+use libp2p::PeerId;
+use std::collections::HashMap;
+use std::time::Duration;
+
+/// The number of the peers scored, the least recently updated scores are forgotten.
+const MAX_SCORED_PEERS: usize = 1000;
+/// The weight of a new measurement in the exponentially weighted moving averages.
+const EWMA_WEIGHT: f64 = 0.2;
+/// The latency in seconds expected of a peer that is not measured yet.
+const DEFAULT_LATENCY: f64 = 0.5;
+/// The success rate is not decreased below it, so a peer failed several times can still be ranked back.
+const MIN_SUCCESS_RATE: f64 = 0.05;
+/// The next peer is requested if the current one doesn't respond in its expected latency multiplied by it.
+const HEDGE_LATENCY_FACTOR: f64 = 2.;
+const MIN_HEDGE_DELAY: Duration = Duration::from_millis(200);
+const MAX_HEDGE_DELAY: Duration = Duration::from_secs(5);
+
+fn ewma(average: Option<f64>, value: f64) -> f64 {
+    match average {
+        Some(average) => average + EWMA_WEIGHT * (value - average),
+        None => value,
+    }
+}
+
+#[derive(Debug)]
+struct PeerScore {
+    /// The average ping round trip time in seconds.
+    rtt: Option<f64>,
+    /// The average time in seconds the peer responds to the requests in.
+    response_latency: Option<f64>,
+    /// The average ratio of the successful pings and responses.
+    success_rate: f64,
+    /// The number of the scores updates when this score was updated last time.
+    updated_at: u64,
+}
+
+impl PeerScore {
+    fn expected_latency(&self) -> f64 {
+        let latency = self.response_latency.or(self.rtt).unwrap_or(DEFAULT_LATENCY);
+        latency / self.success_rate.max(MIN_SUCCESS_RATE)
+    }
+}
+
+#[derive(Default)]
+pub struct PeerScores {
+    scores: HashMap<PeerId, PeerScore>,
+    updates: u64,
+}
+
+impl PeerScores {
+    fn score_mut(&mut self, peer: &PeerId) -> &mut PeerScore {
+        self.updates += 1;
+        if !self.scores.contains_key(peer) && self.scores.len() >= MAX_SCORED_PEERS {
+            let least_recent = self
+                .scores
+                .iter()
+                .min_by_key(|(_, score)| score.updated_at)
+                .map(|(peer, _)| peer.clone());
+            if let Some(least_recent) = least_recent {
+                self.scores.remove(&least_recent);
+            }
+        }
+
+        let updates = self.updates;
+        let score = self.scores.entry(peer.clone()).or_insert_with(|| PeerScore {
+            rtt: None,
+            response_latency: None,
+            success_rate: 1.,
+            updated_at: updates,
+        });
+        score.updated_at = updates;
+        score
+    }
+
+    pub fn record_rtt(&mut self, peer: &PeerId, rtt: Duration) {
+        let score = self.score_mut(peer);
+        score.rtt = Some(ewma(score.rtt, rtt.as_secs_f64()));
+        score.success_rate = ewma(Some(score.success_rate), 1.);
+    }
+
+    pub fn record_response(&mut self, peer: &PeerId, latency: Duration) {
+        let score = self.score_mut(peer);
+        score.response_latency = Some(ewma(score.response_latency, latency.as_secs_f64()));
+        score.success_rate = ewma(Some(score.success_rate), 1.);
+    }
+
+    /// Records a failed ping or request, a timed out one or the failed reconnection of a pinned relay.
+    pub fn record_failure(&mut self, peer: &PeerId) {
+        let score = self.score_mut(peer);
+        score.success_rate = ewma(Some(score.success_rate), 0.);
+    }
+
+    pub fn expected_latency(&self, peer: &PeerId) -> Duration {
+        let latency = self
+            .scores
+            .get(peer)
+            .map_or(DEFAULT_LATENCY, PeerScore::expected_latency);
+        Duration::from_secs_f64(latency)
+    }
+
+    /// Returns how long to wait for the `peer` response before the next peer is requested too.
+    pub fn hedge_delay(&self, peer: &PeerId) -> Duration {
+        let delay = self.expected_latency(peer).mul_f64(HEDGE_LATENCY_FACTOR);
+        delay.max(MIN_HEDGE_DELAY).min(MAX_HEDGE_DELAY)
+    }
+
+    /// Sorts the `peers` by their expected latencies, the fastest first.
+    pub fn sort_fastest(&self, peers: &mut Vec<PeerId>) {
+        peers.sort_by_cached_key(|peer| self.expected_latency(peer));
+    }
+
+    /// Returns the fastest `num` of the `peers`, the peers are deduplicated.
+    pub fn fastest<'a>(&self, peers: impl Iterator<Item = &'a PeerId>, num: usize) -> Vec<PeerId> {
+        let mut peers: Vec<_> = peers.cloned().collect();
+        self.sort_fastest(&mut peers);
+        let mut fastest = Vec::with_capacity(num);
+        for peer in peers {
+            if fastest.len() == num {
+                break;
+            }
+            if !fastest.contains(&peer) {
+                fastest.push(peer);
+            }
+        }
+        fastest
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_peer_scores_ordering() {
+        let mut scores = PeerScores::default();
+        let fast = PeerId::random();
+        let slow = PeerId::random();
+        let failing = PeerId::random();
+        let unknown = PeerId::random();
+
+        scores.record_rtt(&fast, Duration::from_millis(50));
+        scores.record_rtt(&slow, Duration::from_millis(50));
+        // the response latency is preferred over the ping rtt
+        scores.record_response(&slow, Duration::from_millis(300));
+        scores.record_response(&failing, Duration::from_millis(200));
+        for _ in 0..20 {
+            scores.record_failure(&failing);
+        }
+
+        let mut peers = vec![unknown.clone(), failing.clone(), slow.clone(), fast.clone()];
+        scores.sort_fastest(&mut peers);
+        assert_eq!(peers, vec![
+            fast.clone(),
+            slow.clone(),
+            unknown.clone(),
+            failing.clone()
+        ]);
+        assert_eq!(scores.fastest(peers.iter().chain(peers.iter()), 2), vec![
+            fast.clone(),
+            slow
+        ]);
+
+        assert_eq!(scores.hedge_delay(&fast), MIN_HEDGE_DELAY);
+        assert_eq!(scores.hedge_delay(&unknown), Duration::from_secs(1));
+        assert_eq!(scores.hedge_delay(&failing), MAX_HEDGE_DELAY);
+
+        // the failing peer recovers
+        for _ in 0..30 {
+            scores.record_response(&failing, Duration::from_millis(10));
+        }
+        assert_eq!(scores.fastest(peers.iter(), 1), vec![failing]);
+    }
+
+    #[test]
+    fn test_peer_scores_least_recent_forgotten() {
+        let mut scores = PeerScores::default();
+        let first = PeerId::random();
+        scores.record_rtt(&first, Duration::from_millis(10));
+        let second = PeerId::random();
+        scores.record_rtt(&second, Duration::from_millis(10));
+        for _ in 2..MAX_SCORED_PEERS {
+            scores.record_rtt(&PeerId::random(), Duration::from_millis(10));
+        }
+        // the first is updated, the second is the least recent one
+        scores.record_rtt(&first, Duration::from_millis(10));
+        scores.record_rtt(&PeerId::random(), Duration::from_millis(10));
+
+        assert_eq!(scores.scores.len(), MAX_SCORED_PEERS);
+        assert!(scores.scores.contains_key(&first));
+        assert!(!scores.scores.contains_key(&second));
+    }
+}
@@ -1,4 +1,4 @@
-use crate::request_response::Codec;
+use crate::request_response::{Codec, MessageFraming, NegotiatedRequest};
 use futures::StreamExt;
 use libp2p::swarm::NetworkBehaviour;
 use libp2p::{multiaddr::{Multiaddr, Protocol},
@@ -31,6 +31,12 @@ impl ProtocolName for PeersExchangeProtocol {
     }
 }
 
+impl MessageFraming for PeersExchangeProtocol {
+    fn is_deflated(&self) -> bool { false }
+
+    fn supports_compact_response(&self) -> bool { false }
+}
+
 type PeersExchangeCodec = Codec<PeersExchangeProtocol, PeersExchangeRequest, PeersExchangeResponse>;
 
 const DEFAULT_PEERS_NUM: usize = 20;
@@ -64,6 +70,10 @@ pub enum PeersExchangeRequest {
     GetKnownPeers { num: usize },
 }
 
+impl NegotiatedRequest for PeersExchangeRequest {
+    fn set_compact_response(&mut self, _compact_response: bool) {}
+}
+
 #[derive(Clone, Debug, Deserialize, Serialize)]
 pub enum PeersExchangeResponse {
     KnownPeers { peers: HashMap<PeerIdSerde, PeerAddresses> },
@@ -183,6 +193,10 @@ impl PeersExchange {
         result
     }
 
+    pub fn peer_addresses(&mut self, peer: &PeerId) -> PeerAddresses {
+        self.request_response.addresses_of_peer(peer).into_iter().collect()
+    }
+
     pub fn is_known_peer(&self, peer: &PeerId) -> bool { self.known_peers.contains(peer) }
 
     pub fn add_known_peer(&mut self, peer: PeerId) {
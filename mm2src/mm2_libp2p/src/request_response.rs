@@ -1,6 +1,8 @@
 use crate::{decode_message, encode_message};
 use async_trait::async_trait;
-use core::iter;
+use flate2::read::DeflateDecoder;
+use flate2::write::DeflateEncoder;
+use flate2::Compression;
 use futures::channel::{mpsc, oneshot};
 use futures::io::{AsyncRead, AsyncWrite};
 use futures::task::{Context, Poll};
@@ -16,11 +18,13 @@ use log::{debug, error, warn};
 use serde::de::DeserializeOwned;
 use serde::{Deserialize, Serialize};
 use std::collections::{HashMap, VecDeque};
-use std::io;
+use std::io::{self, Read, Write};
 use std::time::Duration;
 use wasm_timer::{Instant, Interval};
 
 const MAX_BUFFER_SIZE: usize = 1024 * 1024 - 100;
+/// The maximum size of a message received deflated.
+const MAX_INFLATED_SIZE: usize = 16 * 1024 * 1024;
 
 pub type RequestResponseReceiver = mpsc::UnboundedReceiver<(PeerId, PeerRequest, oneshot::Sender<PeerResponse>)>;
 pub type RequestResponseSender = mpsc::UnboundedSender<(PeerId, PeerRequest, oneshot::Sender<PeerResponse>)>;
@@ -29,7 +33,11 @@ type ReqResCodec = Codec<Protocol, PeerRequest, PeerResponse>;
 /// Build a request-response network behaviour.
 pub fn build_request_response_behaviour() -> RequestResponseBehaviour {
     let config = RequestResponseConfig::default();
-    let protocol = iter::once((Protocol::Version1, ProtocolSupport::Full));
+    // the peers not supporting the deflated messages negotiate the `Version1`
+    let protocol = vec![
+        (Protocol::Version2, ProtocolSupport::Full),
+        (Protocol::Version1, ProtocolSupport::Full),
+    ];
     let inner = RequestResponse::new(Codec::default(), protocol, config);
 
     let (tx, rx) = mpsc::unbounded();
@@ -55,9 +63,16 @@ pub enum RequestResponseBehaviourEvent {
         request: PeerRequest,
         response_channel: ResponseChannel<PeerResponse>,
     },
+    /// An outbound request is finished, the event is used to score the peer.
+    OutboundFinished {
+        peer_id: PeerId,
+        /// The time the peer responded in, or None if the request failed or timed out.
+        latency: Option<Duration>,
+    },
 }
 
 struct PendingRequest {
+    peer_id: PeerId,
     tx: oneshot::Sender<PeerResponse>,
     initiated_at: Instant,
 }
@@ -100,6 +115,7 @@ impl RequestResponseBehaviour {
     ) -> RequestId {
         let request_id = self.inner.send_request(&peer_id, request);
         let pending_request = PendingRequest {
+            peer_id: peer_id.clone(),
             tx: response_tx,
             initiated_at: Instant::now(),
         };
@@ -123,23 +139,28 @@ impl RequestResponseBehaviour {
             Poll::Pending => (),
         }
 
-        if let Some(event) = self.events.pop_front() {
-            // forward a pending event to the top
-            return Poll::Ready(NetworkBehaviourAction::GenerateEvent(event));
-        }
-
         while let Poll::Ready(Some(())) = self.timeout_interval.poll_next_unpin(cx) {
             let now = Instant::now();
             let timeout = self.timeout;
+            let events = &mut self.events;
             self.pending_requests.retain(|request_id, pending_request| {
                 let retain = now.duration_since(pending_request.initiated_at) < timeout;
                 if !retain {
                     warn!("Request {} timed out", request_id);
+                    events.push_back(RequestResponseBehaviourEvent::OutboundFinished {
+                        peer_id: pending_request.peer_id.clone(),
+                        latency: None,
+                    });
                 }
                 retain
             });
         }
 
+        if let Some(event) = self.events.pop_front() {
+            // forward a pending event to the top
+            return Poll::Ready(NetworkBehaviourAction::GenerateEvent(event));
+        }
+
         Poll::Pending
     }
 
@@ -156,9 +177,19 @@ impl RequestResponseBehaviour {
         })
     }
 
-    fn process_response(&mut self, request_id: RequestId, response: PeerResponse) {
+    /// The `is_failure` is true if the `response` is an outbound failure and not received from the peer.
+    fn process_response(&mut self, request_id: RequestId, response: PeerResponse, is_failure: bool) {
         match self.pending_requests.remove(&request_id) {
             Some(pending) => {
+                let latency = if is_failure {
+                    None
+                } else {
+                    Some(Instant::now().duration_since(pending.initiated_at))
+                };
+                self.events.push_back(RequestResponseBehaviourEvent::OutboundFinished {
+                    peer_id: pending.peer_id,
+                    latency,
+                });
                 if let Err(e) = pending.tx.send(response) {
                     error!("{:?}. Request {:?} is not processed", e, request_id);
                 }
@@ -185,7 +216,7 @@ impl NetworkBehaviourEventProcess<RequestResponseEvent<PeerRequest, PeerResponse
                 let err_response = PeerResponse::Err {
                     err: format!("{:?}", error),
                 };
-                self.process_response(request_id, err_response);
+                self.process_response(request_id, err_response, true);
                 return;
             },
         };
@@ -200,7 +231,7 @@ impl NetworkBehaviourEventProcess<RequestResponseEvent<PeerRequest, PeerResponse
                     "Received a response to the {:?} request from peer {:?}",
                     request_id, peer_id
                 );
-                self.process_response(request_id, response)
+                self.process_response(request_id, response, false)
             },
         }
     }
@@ -222,11 +253,51 @@ impl<Proto, Req, Res> Default for Codec<Proto, Req, Res> {
 #[derive(Debug, Clone)]
 pub enum Protocol {
     Version1,
+    /// The messages are deflated, the orderbook responses repeating the tickers and pubkeys shrink several times.
+    /// The requesters decode the compact application responses.
+    Version2,
+}
+
+/// The framing of the messages depending on the negotiated protocol.
+pub trait MessageFraming {
+    fn is_deflated(&self) -> bool;
+
+    /// Whether the requester decodes the application specific compact responses, see [`PeerRequest::compact_response`].
+    fn supports_compact_response(&self) -> bool;
+}
+
+impl MessageFraming for Protocol {
+    fn is_deflated(&self) -> bool {
+        match self {
+            Protocol::Version1 => false,
+            Protocol::Version2 => true,
+        }
+    }
+
+    fn supports_compact_response(&self) -> bool {
+        match self {
+            Protocol::Version1 => false,
+            Protocol::Version2 => true,
+        }
+    }
+}
+
+/// The request that is told the protocol it's received over.
+pub trait NegotiatedRequest {
+    fn set_compact_response(&mut self, compact_response: bool);
 }
 
 #[derive(Clone, Debug, Deserialize, Serialize)]
 pub struct PeerRequest {
     pub req: Vec<u8>,
+    /// Whether the requester negotiated the protocol the compact responses are supported by.
+    /// The field is set by the codec of the responder and is not sent.
+    #[serde(skip)]
+    pub compact_response: bool,
+}
+
+impl NegotiatedRequest for PeerRequest {
+    fn set_compact_response(&mut self, compact_response: bool) { self.compact_response = compact_response; }
 }
 
 #[derive(Clone, Debug, Deserialize, Serialize)]
@@ -249,14 +320,15 @@ impl ProtocolName for Protocol {
     fn protocol_name(&self) -> &[u8] {
         match self {
             Protocol::Version1 => b"/request-response/1",
+            Protocol::Version2 => b"/request-response/2",
         }
     }
 }
 
 #[async_trait]
 impl<
-        Proto: Clone + ProtocolName + Send + Sync,
-        Req: DeserializeOwned + Serialize + Send + Sync,
+        Proto: Clone + MessageFraming + ProtocolName + Send + Sync,
+        Req: DeserializeOwned + NegotiatedRequest + Serialize + Send + Sync,
         Res: DeserializeOwned + Serialize + Send + Sync,
     > RequestResponseCodec for Codec<Proto, Req, Res>
 {
@@ -264,52 +336,63 @@ impl<
     type Request = Req;
     type Response = Res;
 
-    async fn read_request<T>(&mut self, _protocol: &Self::Protocol, io: &mut T) -> io::Result<Self::Request>
+    async fn read_request<T>(&mut self, protocol: &Self::Protocol, io: &mut T) -> io::Result<Self::Request>
     where
         T: AsyncRead + Unpin + Send,
     {
-        read_to_end(io).await
+        let mut request: Self::Request = read_to_end(io, protocol.is_deflated()).await?;
+        request.set_compact_response(protocol.supports_compact_response());
+        Ok(request)
     }
 
-    async fn read_response<T>(&mut self, _protocol: &Self::Protocol, io: &mut T) -> io::Result<Self::Response>
+    async fn read_response<T>(&mut self, protocol: &Self::Protocol, io: &mut T) -> io::Result<Self::Response>
     where
         T: AsyncRead + Unpin + Send,
     {
-        read_to_end(io).await
+        read_to_end(io, protocol.is_deflated()).await
     }
 
-    async fn write_request<T>(&mut self, _protocol: &Self::Protocol, io: &mut T, req: Self::Request) -> io::Result<()>
+    async fn write_request<T>(&mut self, protocol: &Self::Protocol, io: &mut T, req: Self::Request) -> io::Result<()>
     where
         T: AsyncWrite + Unpin + Send,
     {
-        write_all(io, &req).await
+        write_all(io, &req, protocol.is_deflated()).await
     }
 
-    async fn write_response<T>(&mut self, _protocol: &Self::Protocol, io: &mut T, res: Self::Response) -> io::Result<()>
+    async fn write_response<T>(&mut self, protocol: &Self::Protocol, io: &mut T, res: Self::Response) -> io::Result<()>
     where
         T: AsyncWrite + Unpin + Send,
     {
-        write_all(io, &res).await
+        write_all(io, &res, protocol.is_deflated()).await
     }
 }
 
-async fn read_to_end<T, M>(io: &mut T) -> io::Result<M>
+async fn read_to_end<T, M>(io: &mut T, is_deflated: bool) -> io::Result<M>
 where
     T: AsyncRead + Unpin + Send,
     M: DeserializeOwned,
 {
-    match read_one(io, MAX_BUFFER_SIZE).await {
-        Ok(data) => Ok(try_io!(decode_message(&data))),
-        Err(e) => Err(io::Error::new(io::ErrorKind::InvalidData, e)),
+    let data = match read_one(io, MAX_BUFFER_SIZE).await {
+        Ok(data) => data,
+        Err(e) => return Err(io::Error::new(io::ErrorKind::InvalidData, e)),
+    };
+    if is_deflated {
+        let inflated = inflate(&data)?;
+        Ok(try_io!(decode_message(&inflated)))
+    } else {
+        Ok(try_io!(decode_message(&data)))
     }
 }
 
-async fn write_all<T, M>(io: &mut T, msg: &M) -> io::Result<()>
+async fn write_all<T, M>(io: &mut T, msg: &M, is_deflated: bool) -> io::Result<()>
 where
     T: AsyncWrite + Unpin + Send,
     M: Serialize,
 {
-    let data = try_io!(encode_message(msg));
+    let mut data = try_io!(encode_message(msg));
+    if is_deflated {
+        data = deflate(&data)?;
+    }
     if data.len() > MAX_BUFFER_SIZE {
         return Err(io::Error::new(
             io::ErrorKind::InvalidData,
@@ -318,3 +401,44 @@ where
     }
     write_one(io, data).await
 }
+
+fn deflate(data: &[u8]) -> io::Result<Vec<u8>> {
+    // the fast level shrinks the repeated strings almost as well as the best one
+    let mut encoder = DeflateEncoder::new(Vec::with_capacity(data.len() / 2), Compression::fast());
+    encoder.write_all(data)?;
+    encoder.finish()
+}
+
+fn inflate(data: &[u8]) -> io::Result<Vec<u8>> {
+    let mut inflated = Vec::with_capacity(data.len() * 2);
+    DeflateDecoder::new(data)
+        .take(MAX_INFLATED_SIZE as u64 + 1)
+        .read_to_end(&mut inflated)?;
+    if inflated.len() > MAX_INFLATED_SIZE {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "Received data size over maximum",
+        ));
+    }
+    Ok(inflated)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_deflate_inflate() {
+        let data: Vec<u8> = b"KMD:BTC".iter().cycle().take(10000).cloned().collect();
+        let deflated = deflate(&data).unwrap();
+        assert!(deflated.len() < data.len() / 10);
+        assert_eq!(inflate(&deflated).unwrap(), data);
+
+        // the inflated size is limited
+        let bomb = deflate(&vec![0; MAX_INFLATED_SIZE + 1]).unwrap();
+        assert!(bomb.len() < MAX_BUFFER_SIZE);
+        assert!(inflate(&bomb).is_err());
+
+        assert!(inflate(b"not deflated").is_err());
+    }
+}
@@ -11,10 +11,11 @@ use futures::{channel::mpsc, lock::Mutex as AsyncMutex, StreamExt};
 use mm2_libp2p::atomicdex_behaviour::AdexBehaviourCmd;
 use mm2_libp2p::{decode_message, PeerId};
 use mocktopus::mocking::*;
-use rand::{seq::SliceRandom, thread_rng, Rng};
+use rand::{rngs::StdRng, seq::SliceRandom, thread_rng, Rng, SeedableRng};
 use std::collections::HashSet;
 use std::iter::{self, FromIterator};
 use std::sync::Mutex;
+use test::{black_box, Bencher};
 
 #[test]
 fn test_match_maker_order_and_taker_request() {
@@ -1341,13 +1342,24 @@ fn make_ctx_for_tests() -> (MmArc, String, [u8; 32]) {
     (ctx, pubkey, secret)
 }
 
-fn make_random_orders(pubkey: String, _secret: &[u8; 32], base: String, rel: String, n: usize) -> Vec<OrderbookItem> {
-    let mut rng = rand::thread_rng();
+fn make_random_orders(pubkey: String, secret: &[u8; 32], base: String, rel: String, n: usize) -> Vec<OrderbookItem> {
+    make_random_orders_with_rng(&mut thread_rng(), pubkey, secret, base, rel, n)
+}
+
+/// Generates the orders by the `rng`, so the orders of the seeded `rng` are the same on every run.
+fn make_random_orders_with_rng(
+    rng: &mut impl Rng,
+    pubkey: String,
+    _secret: &[u8; 32],
+    base: String,
+    rel: String,
+    n: usize,
+) -> Vec<OrderbookItem> {
     let mut orders = Vec::with_capacity(n);
     for _i in 0..n {
         let numer: u64 = rng.gen_range(2000, 10000000);
         let order = new_protocol::MakerOrderCreated {
-            uuid: Uuid::new_v4().into(),
+            uuid: Uuid::from_bytes(rng.gen()).into(),
             base: base.clone(),
             rel: rel.clone(),
             price: BigRational::new(numer.into(), 1000000.into()),
@@ -1383,6 +1395,48 @@ fn p2p_context_mock() -> (mpsc::Sender<AdexBehaviourCmd>, mpsc::Receiver<AdexBeh
     (cmd_tx, cmd_rx)
 }
 
+#[test]
+fn test_process_best_orders_p2p_request_cache() {
+    let (ctx, _pubkey, _secret) = make_ctx_for_tests();
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+
+    let (pubkey, secret) = pubkey_and_secret_for_test("passphrase");
+    let mut orders = make_random_orders(pubkey.clone(), &secret, "RICK".into(), "MORTY".into(), 3);
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    for order in orders.iter() {
+        orderbook.insert_or_update_order_update_trie(order.clone());
+    }
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+
+    let request_best_orders = |volume: i64| -> Vec<Uuid> {
+        let encoded = block_on(best_orders::process_best_orders_p2p_request(
+            ctx.clone(),
+            "RICK".into(),
+            BestOrdersAction::Buy,
+            BigRational::from_integer(volume.into()),
+        ))
+        .unwrap()
+        .unwrap();
+        let response: best_orders::BestOrdersRes = rmp_serde::from_read_ref(&encoded).unwrap();
+        response.orders["MORTY"].iter().map(|o| o.order.uuid).collect()
+    };
+
+    orders.sort_by(|a, b| (&a.price, a.uuid).cmp(&(&b.price, b.uuid)));
+    let best_uuids: Vec<_> = orders.iter().map(|o| o.uuid).collect();
+    // the max volume of every order is 1
+    assert_eq!(request_best_orders(2), best_uuids[..2].to_vec());
+    // the cached response is returned until the pair is changed
+    assert_eq!(request_best_orders(2), best_uuids[..2].to_vec());
+    assert_eq!(request_best_orders(10), best_uuids);
+
+    // the best order is removed
+    orderbook.remove_order_trie_update(best_uuids[0]);
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+    assert_eq!(request_best_orders(2), best_uuids[1..].to_vec());
+}
+
 #[test]
 fn test_process_get_orderbook_request() {
     const ORDERS_NUMBER: usize = 10;
@@ -1432,6 +1486,7 @@ fn test_process_get_orderbook_request() {
         ctx.clone(),
         "RICK".into(),
         "MORTY".into(),
+        false,
     ))
     .unwrap()
     .unwrap();
@@ -1449,6 +1504,151 @@ fn test_process_get_orderbook_request() {
     }
 }
 
+#[test]
+fn test_process_get_orderbook_request_cached() {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+
+    let mut orders = make_random_orders(pubkey.clone(), &secret, "RICK".into(), "MORTY".into(), 3);
+    let new_order = orders.pop().unwrap();
+
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    for order in orders {
+        orderbook.insert_or_update_order_update_trie(order);
+    }
+    // avoid dead lock on orderbook as process_get_orderbook_request also acquires it
+    drop(orderbook);
+
+    let request_orders_number = || {
+        let encoded = block_on(process_get_orderbook_request(
+            ctx.clone(),
+            "RICK".into(),
+            "MORTY".into(),
+            false,
+        ))
+        .unwrap()
+        .unwrap();
+        let response = decode_message::<GetOrderbookRes>(&encoded).unwrap();
+        response.pubkey_orders[&pubkey].orders.len()
+    };
+
+    assert_eq!(request_orders_number(), 2);
+    let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    let cached_version = orderbook
+        .encoded_pair_snapshots
+        .peek("MORTY:RICK")
+        .unwrap()
+        .pair_version;
+    assert_eq!(cached_version, orderbook.pair_version("RICK", "MORTY"));
+    drop(orderbook);
+
+    // the snapshot is served until the pair orders change
+    assert_eq!(request_orders_number(), 2);
+
+    // the keep alive of the pubkey invalidates the snapshot, so the requesters get the actual timestamp
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    orderbook.pubkeys_state.get_mut(&pubkey).unwrap().last_keep_alive += 1;
+    let last_keep_alive = orderbook.pubkeys_state[&pubkey].last_keep_alive;
+    drop(orderbook);
+    let encoded = block_on(process_get_orderbook_request(
+        ctx.clone(),
+        "RICK".into(),
+        "MORTY".into(),
+        false,
+    ))
+    .unwrap()
+    .unwrap();
+    let response = decode_message::<GetOrderbookRes>(&encoded).unwrap();
+    assert_eq!(response.pubkey_orders[&pubkey].last_keep_alive, last_keep_alive);
+
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    orderbook.insert_or_update_order_update_trie(new_order);
+    drop(orderbook);
+
+    assert_eq!(request_orders_number(), 3);
+    let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    let cached_version_after = orderbook
+        .encoded_pair_snapshots
+        .peek("MORTY:RICK")
+        .unwrap()
+        .pair_version;
+    assert!(cached_version_after > cached_version);
+    assert_eq!(cached_version_after, orderbook.pair_version("MORTY", "RICK"));
+}
+
+#[test]
+fn test_process_get_orderbook_request_compact() {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+    let (pubkey2, secret2) = pubkey_and_secret_for_test("passphrase-2");
+
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+
+    let mut orders = make_random_orders(pubkey.clone(), &secret, "RICK".into(), "MORTY".into(), 5);
+    orders.extend(make_random_orders(
+        pubkey2.clone(),
+        &secret2,
+        "MORTY".into(),
+        "RICK".into(),
+        5,
+    ));
+
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    for order in orders.iter() {
+        orderbook.insert_or_update_order_update_trie(order.clone());
+    }
+    // avoid dead lock on orderbook as process_get_orderbook_request also acquires it
+    drop(orderbook);
+
+    let request = |compact_response| {
+        block_on(process_get_orderbook_request(
+            ctx.clone(),
+            "RICK".into(),
+            "MORTY".into(),
+            compact_response,
+        ))
+        .unwrap()
+        .unwrap()
+    };
+
+    let plain = request(false);
+    let compact = request(true);
+    assert!(!compact_orderbook::is_compact_response(&plain));
+    assert!(compact_orderbook::is_compact_response(&compact));
+    assert!(compact.len() < plain.len());
+
+    let response = compact_orderbook::decode_compact_response(&compact).unwrap();
+    let mut actual: Vec<_> = response
+        .pubkey_orders
+        .values()
+        .flat_map(|item| item.orders.iter().map(|(_uuid, order)| order.clone()))
+        .collect();
+    actual.sort_unstable_by(|x, y| x.uuid.cmp(&y.uuid));
+    orders.sort_unstable_by(|x, y| x.uuid.cmp(&y.uuid));
+    assert_eq!(actual, orders);
+
+    // both of the responses are cached at the same pair version
+    let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    let snapshot = orderbook.encoded_pair_snapshots.peek("MORTY:RICK").unwrap();
+    assert!(snapshot.plain.is_some());
+    assert!(snapshot.compact.is_some());
+    drop(orderbook);
+
+    // the cached compact orders are sent with the actual keep alive
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    orderbook.pubkeys_state.get_mut(&pubkey).unwrap().last_keep_alive += 1;
+    let last_keep_alive = orderbook.pubkeys_state[&pubkey].last_keep_alive;
+    drop(orderbook);
+    let response = compact_orderbook::decode_compact_response(&request(true)).unwrap();
+    assert_eq!(response.pubkey_orders[&pubkey].last_keep_alive, last_keep_alive);
+    assert_eq!(response.pubkey_orders[&pubkey].orders.len(), 5);
+    assert_eq!(response.pubkey_orders[&pubkey2].orders.len(), 5);
+}
+
 #[test]
 fn test_process_get_orderbook_request_limit() {
     let (ctx, pubkey, secret) = make_ctx_for_tests();
@@ -1478,6 +1678,7 @@ fn test_process_get_orderbook_request_limit() {
         ctx.clone(),
         "RICK".into(),
         "MORTY".into(),
+        false,
     ))
     .err()
     .expect("Expected an error");
@@ -1567,34 +1768,26 @@ fn test_request_and_fill_orderbook() {
         .map(|(_pubkey, orders)| orders.clone())
         .flatten()
         .collect();
-    assert_eq!(orderbook.order_set, expected);
-
-    let expected = expected_orders
+    let actual: HashMap<_, _> = orderbook
+        .orders
         .iter()
-        .map(|(_pubkey, orders)| orders)
-        .flatten()
-        .map(|(uuid, _order)| *uuid)
+        .map(|order| (order.uuid, order.clone()))
         .collect();
-    let unordered = orderbook
-        .unordered
-        .get(&("RICK".to_owned(), "MORTY".to_owned()))
-        .expect("No (RICK, MORTY) in unordered container");
-    assert_eq!(*unordered, expected);
+    assert_eq!(actual, expected);
 
-    let expected = expected_orders
+    let mut expected: Vec<_> = expected_orders
         .iter()
         .map(|(_pubkey, orders)| orders)
         .flatten()
-        .map(|(uuid, order)| OrderedByPriceOrder {
-            uuid: *uuid,
-            price: order.price.clone().into(),
-        })
+        .map(|(uuid, order)| (order.price.clone(), *uuid))
         .collect();
-    let ordered = orderbook
-        .ordered
-        .get(&("RICK".to_owned(), "MORTY".to_owned()))
-        .expect("No (RICK, MORTY) in unordered container");
-    assert_eq!(*ordered, expected);
+    expected.sort();
+    let ordered: Vec<_> = orderbook
+        .orders
+        .pair_orders("RICK", "MORTY")
+        .map(|order| (order.price.clone(), order.uuid))
+        .collect();
+    assert_eq!(ordered, expected);
 
     let rick_morty_pair = alb_ordered_pair("RICK", "MORTY");
     for (pubkey, orders) in expected_orders {
@@ -2182,6 +2375,26 @@ fn test_orderbook_pubkey_sync_request_relay() {
     }
 }
 
+#[test]
+fn test_orderbook_pubkey_expiry_postponed_by_keep_alive() {
+    let mut orderbook = Orderbook::default();
+    let (pubkey, secret) = pubkey_and_secret_for_test("passphrase");
+    for order in make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 2) {
+        orderbook.insert_or_update_order_update_trie(order);
+    }
+    // the pubkey is scheduled once its state is created
+    assert_eq!(orderbook.pubkeys_expiry.len(), 1);
+
+    let now = now_ms() / 1000;
+    let message = PubkeyKeepAlive {
+        trie_roots: HashMap::new(),
+        timestamp: now + 100,
+    };
+    assert!(orderbook.process_keep_alive(&pubkey, message, false).is_none());
+    assert!(orderbook.pubkeys_expiry.pop_due(now + 99).is_empty());
+    assert_eq!(orderbook.pubkeys_expiry.pop_due(now + 100), vec![pubkey]);
+}
+
 #[test]
 fn test_trie_diff_avoid_cycle_on_insertion() {
     let mut history = TrieDiffHistory::<String, String>::default();
@@ -2215,11 +2428,89 @@ fn test_trie_diff_avoid_cycle_on_insertion() {
             delta: vec![],
             next_root: [2; 8],
         }))),
+        ..Default::default()
     };
 
     assert_eq!(expected, history);
 }
 
+#[test]
+fn test_trie_diff_history_evict_to_fit() {
+    let mut history = TrieDiffHistory::<String, String>::default();
+    let mut usages = Vec::new();
+    for i in 0..10u8 {
+        let diff = TrieDiff {
+            delta: vec![(format!("key{}", i), Some(format!("value{}", i)))],
+            next_root: [i + 1; 8],
+        };
+        usages.push(diff.memory_usage());
+        history.insert_new_diff([i; 8], diff);
+    }
+    assert_eq!(history.memory_usage(), usages.iter().sum::<usize>());
+
+    let newest_three: usize = usages[7..].iter().sum();
+    history.evict_to_fit(newest_three);
+    assert_eq!(history.memory_usage(), newest_three);
+    assert_eq!(history.len(), 3);
+    for i in 0..7u8 {
+        assert!(!history.contains_key(&[i; 8]));
+    }
+    for i in 7..10u8 {
+        assert!(history.contains_key(&[i; 8]));
+    }
+
+    history.evict_to_fit(0);
+    assert_eq!(history.memory_usage(), 0);
+    assert_eq!(history.len(), 0);
+}
+
+#[test]
+fn test_process_sync_pubkey_orderbook_state_full_trie_when_history_evicted() {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+    let mut orders = make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 10);
+    for order in orders.iter() {
+        block_on(insert_or_update_order(&ctx, order.clone()));
+    }
+
+    let alb_pair = alb_ordered_pair("C1", "C2");
+    let old_root = pair_trie_root_by_pub(&ctx, &pubkey, &alb_pair);
+
+    {
+        let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
+        let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+        orderbook.history_budget.max_bytes_per_pubkey = 0;
+    }
+
+    let new_orders = make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 10);
+    for order in new_orders.iter() {
+        block_on(insert_or_update_order(&ctx, order.clone()));
+    }
+    orders.extend(new_orders);
+
+    {
+        let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
+        let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+        assert_eq!(orderbook.history_memory_usage(), 0);
+    }
+
+    let roots = HashMap::from_iter(iter::once((alb_pair.clone(), old_root)));
+    let SyncPubkeyOrderbookStateRes {
+        mut pair_orders_diff, ..
+    } = block_on(process_sync_pubkey_orderbook_state(ctx.clone(), pubkey, roots))
+        .expect("!process_sync_pubkey_orderbook_state")
+        .expect("Expected C1:C2 delta, returned None");
+
+    let mut full_trie = match pair_orders_diff.remove(&alb_pair).expect("Expected C1:C2 delta") {
+        DeltaOrFullTrie::Delta(_) => panic!("Expected FullTrie, found Delta"),
+        DeltaOrFullTrie::FullTrie(full_trie) => full_trie,
+    };
+
+    let mut expected: Vec<_> = orders.into_iter().map(|order| (order.uuid, order)).collect();
+    full_trie.sort_by(|x, y| x.0.cmp(&y.0));
+    expected.sort_by(|x, y| x.0.cmp(&y.0));
+    assert_eq!(full_trie, expected);
+}
+
 #[test]
 fn test_process_sync_pubkey_orderbook_state_points_to_not_uptodate_trie_root() {
     let (ctx, pubkey, secret) = make_ctx_for_tests();
@@ -2288,36 +2579,167 @@ fn test_process_sync_pubkey_orderbook_state_points_to_not_uptodate_trie_root() {
     assert_eq!(full_trie, expected);
 }
 
+#[test]
+fn test_apply_order_updates_trie_single_diff_per_pair() {
+    let (_, pubkey, secret) = make_ctx_for_tests();
+    let orders = make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 10);
+    let new_orders = make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 10);
+    let alb_pair = alb_ordered_pair("C1", "C2");
+
+    let mut sequential = Orderbook::default();
+    let mut batched = Orderbook::default();
+    for order in orders.iter() {
+        sequential.insert_or_update_order_update_trie(order.clone());
+        batched.insert_or_update_order_update_trie(order.clone());
+    }
+    let prev_root = batched.pubkeys_state[&pubkey].trie_roots[&alb_pair];
+
+    for order in new_orders.iter() {
+        sequential.insert_or_update_order_update_trie(order.clone());
+    }
+    sequential.remove_order_trie_update(orders[0].uuid);
+    sequential.remove_order_trie_update(orders[1].uuid);
+
+    let mut updates: HashMap<_, _> = new_orders
+        .iter()
+        .map(|order| (order.uuid, Some(order.clone())))
+        .collect();
+    updates.insert(orders[0].uuid, None);
+    updates.insert(orders[1].uuid, None);
+    // removing an unknown order is ignored
+    updates.insert(Uuid::new_v4(), None);
+    batched.apply_order_updates_trie(updates);
+
+    let sequential_root = sequential.pubkeys_state[&pubkey].trie_roots[&alb_pair];
+    let batched_state = &batched.pubkeys_state[&pubkey];
+    assert_eq!(batched_state.trie_roots[&alb_pair], sequential_root);
+    assert_eq!(
+        batched_state.orders_uuids,
+        sequential.pubkeys_state[&pubkey].orders_uuids
+    );
+    assert_eq!(batched.orders.len(), 18);
+
+    let history = &batched_state.order_pairs_trie_state_history[&alb_pair];
+    let diff = history.get(&prev_root).expect("Expected a diff from the previous root");
+    assert_eq!(diff.delta.len(), 12);
+    assert_eq!(diff.next_root, sequential_root);
+    assert!(history.get(&diff.next_root).is_none());
+}
+
+#[test]
+fn test_process_order_update_coalesces_the_same_uuid() {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+    let mut orders = make_random_orders(pubkey.clone(), &secret, "C1".into(), "C2".into(), 2);
+    let cancelled = orders.pop().unwrap();
+    let updated = orders.pop().unwrap();
+
+    let mut updated_msg = new_protocol::MakerOrderUpdated::new(updated.uuid);
+    updated_msg.with_new_price(BigRational::from_integer(2.into()));
+    let mut unknown_updated_msg = new_protocol::MakerOrderUpdated::new(Uuid::new_v4());
+    unknown_updated_msg.with_new_price(BigRational::from_integer(2.into()));
+
+    let updates = vec![
+        OrderUpdate::Created(updated.clone()),
+        OrderUpdate::Created(cancelled.clone()),
+        OrderUpdate::Updated {
+            pubkey: pubkey.clone(),
+            updated_msg,
+        },
+        OrderUpdate::Updated {
+            pubkey: pubkey.clone(),
+            updated_msg: unknown_updated_msg,
+        },
+        // the order of another pubkey must not be removed
+        OrderUpdate::Cancelled {
+            pubkey: "another".into(),
+            uuid: updated.uuid,
+        },
+        OrderUpdate::Cancelled {
+            pubkey: pubkey.clone(),
+            uuid: cancelled.uuid,
+        },
+    ];
+
+    let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
+    // hold the orderbook so all the updates are queued and applied in one batch
+    let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    let mut process_fut = Box::pin(futures::future::join_all(
+        updates.into_iter().map(|update| process_order_update(&ctx, update)),
+    ));
+    assert!(block_on(async { futures::poll!(&mut process_fut) }).is_pending());
+    drop(orderbook);
+
+    let results = block_on(process_fut);
+    assert_eq!(results, vec![true, true, true, false, true, true]);
+
+    let orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    assert_eq!(orderbook.orders.len(), 1);
+    let order = orderbook
+        .find_order_by_uuid(&updated.uuid)
+        .expect("Expected the updated order");
+    assert_eq!(order.price, BigRational::from_integer(2.into()));
+
+    let snapshot = ordermatch_ctx.orderbook_snapshots.latest();
+    let published: Vec<_> = snapshot.pair_orders("C1", "C2").collect();
+    assert_eq!(published, vec![order]);
+}
+
+#[test]
+fn test_decode_msg_rejects_banned_pubkey() {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+    let cancelled = new_protocol::MakerOrderCancelled {
+        uuid: Uuid::new_v4().into(),
+        timestamp: now_ms() / 1000,
+        pair_trie_root: H64::default(),
+    };
+    let encoded = encode_and_sign(
+        &new_protocol::OrdermatchMessage::MakerOrderCancelled(cancelled),
+        &secret,
+    )
+    .unwrap();
+    assert!(decode_msg(&ctx, &encoded).is_some());
+
+    let mut corrupted = encoded.clone();
+    *corrupted.last_mut().unwrap() ^= 1;
+    assert!(decode_msg(&ctx, &corrupted).is_none());
+
+    let req = json!({
+        "pubkey": &pubkey[2..],
+        "reason": "test",
+    });
+    block_on(crate::mm2::lp_swap::ban_pubkey_rpc(ctx.clone(), req)).unwrap();
+    assert!(decode_msg(&ctx, &encoded).is_none());
+}
+
 fn check_if_orderbook_contains_only(orderbook: &Orderbook, pubkey: &str, orders: &Vec<OrderbookItem>) {
     let pubkey_state = orderbook.pubkeys_state.get(pubkey).expect("!pubkeys_state");
 
-    // order_set
+    // orders
     let expected_set: HashMap<_, _> = orders.iter().map(|order| (order.uuid, order.clone())).collect();
-    assert_eq!(orderbook.order_set, expected_set);
+    let actual_set: HashMap<_, _> = orderbook
+        .orders
+        .iter()
+        .map(|order| (order.uuid, order.clone()))
+        .collect();
+    assert_eq!(actual_set, expected_set);
 
-    // ordered
+    // ordered by price within pairs
     let mut expected_ordered = HashMap::new();
     for order in orders.iter() {
-        let item = OrderedByPriceOrder {
-            uuid: order.uuid,
-            price: order.price.clone().into(),
-        };
-        let set = expected_ordered
+        expected_ordered
             .entry((order.base.clone(), order.rel.clone()))
-            .or_insert_with(BTreeSet::default);
-        set.insert(item);
+            .or_insert_with(Vec::new)
+            .push((order.price.clone(), order.uuid));
     }
-    assert_eq!(orderbook.ordered, expected_ordered);
-
-    // unordered
-    let mut expected_unordered = HashMap::new();
-    for order in orders.iter() {
-        let set = expected_unordered
-            .entry((order.base.clone(), order.rel.clone()))
-            .or_insert_with(HashSet::default);
-        set.insert(order.uuid);
+    for ((base, rel), expected) in expected_ordered.iter_mut() {
+        expected.sort();
+        let actual: Vec<_> = orderbook
+            .orders
+            .pair_orders(base, rel)
+            .map(|order| (order.price.clone(), order.uuid))
+            .collect();
+        assert_eq!(actual, *expected);
     }
-    assert_eq!(orderbook.unordered, expected_unordered);
 
     // history
     let actual_keys: HashSet<_> = pubkey_state.order_pairs_trie_state_history.keys().cloned().collect();
@@ -2385,3 +2807,242 @@ fn test_remove_and_purge_pubkey_pair_orders() {
     remove_and_purge_pubkey_pair_orders(&mut orderbook, &pubkey, &rick_morty_pair);
     check_if_orderbook_contains_only(&orderbook, &pubkey, &rick_kmd_orders);
 }
+
+/// The seed of the orders generated for the benches, so every run measures the same orderbook.
+const BENCH_RNG_SEED: u64 = 0x5eed;
+
+fn bench_rng() -> StdRng { StdRng::seed_from_u64(BENCH_RNG_SEED) }
+
+/// The orders of the `pubkeys_number` pubkeys placed to the `pairs_number` pairs "RICK/COIN{i}".
+fn orderbook_for_bench(pubkeys_number: usize, pairs_number: usize, orders_per_pair: usize) -> Orderbook {
+    let mut rng = bench_rng();
+    let mut orderbook = Orderbook::default();
+    for i in 0..pubkeys_number {
+        let (pubkey, secret) = pubkey_and_secret_for_test(&format!("passphrase-{}", i));
+        for pair in 0..pairs_number {
+            let orders = make_random_orders_with_rng(
+                &mut rng,
+                pubkey.clone(),
+                &secret,
+                "RICK".into(),
+                format!("COIN{}", pair),
+                orders_per_pair,
+            );
+            for order in orders {
+                orderbook.insert_or_update_order_update_trie(order);
+            }
+        }
+    }
+    orderbook
+}
+
+/// Inserts and removes one order of the orderbook of the `orders_number` orders of 100 pubkeys and 10 pairs,
+/// the orderbook size is scaled from 10k to 1M orders by the benches below.
+fn bench_orderbook_insert_remove_order(b: &mut Bencher, orders_number: usize) {
+    const PUBKEYS_NUMBER: usize = 100;
+    const PAIRS_NUMBER: usize = 10;
+
+    let mut orderbook = orderbook_for_bench(
+        PUBKEYS_NUMBER,
+        PAIRS_NUMBER,
+        orders_number / PUBKEYS_NUMBER / PAIRS_NUMBER,
+    );
+    let (pubkey, secret) = pubkey_and_secret_for_test("passphrase-0");
+    let order =
+        make_random_orders_with_rng(&mut bench_rng(), pubkey, &secret, "RICK".into(), "COIN0".into(), 1).remove(0);
+    b.iter(|| {
+        orderbook.insert_or_update_order_update_trie(order.clone());
+        black_box(orderbook.remove_order_trie_update(order.uuid))
+    });
+}
+
+#[bench]
+fn bench_orderbook_insert_remove_order_10k(b: &mut Bencher) { bench_orderbook_insert_remove_order(b, 10_000) }
+
+#[bench]
+fn bench_orderbook_insert_remove_order_100k(b: &mut Bencher) { bench_orderbook_insert_remove_order(b, 100_000) }
+
+#[bench]
+fn bench_orderbook_insert_remove_order_1m(b: &mut Bencher) { bench_orderbook_insert_remove_order(b, 1_000_000) }
+
+#[bench]
+fn bench_process_best_orders_p2p_request(b: &mut Bencher) {
+    let (ctx, _pubkey, _secret) = make_ctx_for_tests();
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+
+    let mut orderbook = orderbook_for_bench(10, 100, 10);
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+    *block_on(ordermatch_ctx.orderbook.lock()) = orderbook;
+
+    let volume = BigRational::from_integer(5.into());
+    b.iter(|| {
+        black_box(
+            block_on(best_orders::process_best_orders_p2p_request(
+                ctx.clone(),
+                "RICK".into(),
+                BestOrdersAction::Buy,
+                volume.clone(),
+            ))
+            .unwrap(),
+        )
+    });
+}
+
+#[bench]
+fn bench_process_best_orders_p2p_request_uncached(b: &mut Bencher) {
+    let (ctx, _pubkey, _secret) = make_ctx_for_tests();
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+
+    let mut orderbook = orderbook_for_bench(10, 100, 10);
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+    *block_on(ordermatch_ctx.orderbook.lock()) = orderbook;
+
+    let volume = BigRational::from_integer(5.into());
+    b.iter(|| {
+        *ordermatch_ctx.best_orders_cache.lock() = BestOrdersCache::default();
+        black_box(
+            block_on(best_orders::process_best_orders_p2p_request(
+                ctx.clone(),
+                "RICK".into(),
+                BestOrdersAction::Buy,
+                volume.clone(),
+            ))
+            .unwrap(),
+        )
+    });
+}
+
+#[bench]
+fn bench_orderbook_rpc(b: &mut Bencher) {
+    let conf = json!({
+        "coins": [
+            {"coin": "RICK", "protocol": {"type": "UTXO"}},
+            {"coin": "COIN0", "protocol": {"type": "UTXO"}},
+        ],
+    });
+    let ctx = MmCtxBuilder::new()
+        .with_conf(conf)
+        .with_secp256k1_key_pair(key_pair_from_seed("passphrase").unwrap())
+        .into_mm_arc();
+    ctx.init_metrics().unwrap();
+    let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
+
+    // the orderbook of the many pairs, the bids and the asks of the requested pair
+    let mut orderbook = orderbook_for_bench(10, 100, 10);
+    let mut rng = bench_rng();
+    for i in 0..10 {
+        let (pubkey, secret) = pubkey_and_secret_for_test(&format!("passphrase-{}", i));
+        for order in make_random_orders_with_rng(&mut rng, pubkey, &secret, "COIN0".into(), "RICK".into(), 10) {
+            orderbook.insert_or_update_order_update_trie(order);
+        }
+    }
+    // the orderbook is requested already, so it's not requested from the relays again
+    orderbook.topics_subscribed_to.insert(
+        orderbook_topic_from_base_rel("RICK", "COIN0"),
+        OrderbookRequestingState::Requested,
+    );
+    ordermatch_ctx.orderbook_snapshots.publish(&mut orderbook.orders);
+    *block_on(ordermatch_ctx.orderbook.lock()) = orderbook;
+
+    let req = json!({"base": "RICK", "rel": "COIN0"});
+    b.iter(|| black_box(block_on(orderbook_rpc(ctx.clone(), req.clone())).unwrap()));
+}
+
+/// Returns the context having the orders of the `pubkey` and the pair trie root the orders are synced to,
+/// the orders added since are expected to be synced by `process_sync_pubkey_orderbook_state`.
+fn sync_pubkey_orderbook_state_for_bench() -> (MmArc, String, HashMap<AlbOrderedOrderbookPair, H64>) {
+    let (ctx, pubkey, secret) = make_ctx_for_tests();
+    let alb_pair = alb_ordered_pair("RICK", "MORTY");
+    let ordermatch_ctx = OrdermatchContext::from_ctx(&ctx).unwrap();
+    let mut orderbook = block_on(ordermatch_ctx.orderbook.lock());
+    let mut rng = bench_rng();
+    for order in make_random_orders_with_rng(&mut rng, pubkey.clone(), &secret, "RICK".into(), "MORTY".into(), 1000) {
+        orderbook.insert_or_update_order_update_trie(order);
+    }
+    let synced_root = orderbook.pubkeys_state[&pubkey].trie_roots[&alb_pair];
+    for order in make_random_orders_with_rng(&mut rng, pubkey.clone(), &secret, "RICK".into(), "MORTY".into(), 10) {
+        orderbook.insert_or_update_order_update_trie(order);
+    }
+    drop(orderbook);
+
+    let trie_roots = HashMap::from_iter(iter::once((alb_pair, synced_root)));
+    (ctx, pubkey, trie_roots)
+}
+
+#[bench]
+fn bench_sync_pubkey_orderbook_state_delta(b: &mut Bencher) {
+    let (ctx, pubkey, trie_roots) = sync_pubkey_orderbook_state_for_bench();
+    b.iter(|| {
+        let res = block_on(process_sync_pubkey_orderbook_state(
+            ctx.clone(),
+            pubkey.clone(),
+            trie_roots.clone(),
+        ));
+        black_box(res.unwrap())
+    });
+}
+
+#[bench]
+fn bench_sync_pubkey_orderbook_state_full_trie(b: &mut Bencher) {
+    let (ctx, pubkey, mut trie_roots) = sync_pubkey_orderbook_state_for_bench();
+    // the root is unknown to the history, so the full trie is sent
+    for root in trie_roots.values_mut() {
+        *root = H64::default();
+    }
+    b.iter(|| {
+        let res = block_on(process_sync_pubkey_orderbook_state(
+            ctx.clone(),
+            pubkey.clone(),
+            trie_roots.clone(),
+        ));
+        black_box(res.unwrap())
+    });
+}
+
+/// Replays the gossip traffic of the many pubkeys: the signed order creation messages generated by the fixed seed
+/// are verified and applied to the empty orderbook.
+#[bench]
+fn bench_replay_gossip_maker_orders(b: &mut Bencher) {
+    let (ctx, _pubkey, _secret) = make_ctx_for_tests();
+    let mut rng = bench_rng();
+    let mut messages = Vec::new();
+    for i in 0..10 {
+        let (_pubkey, secret) = pubkey_and_secret_for_test(&format!("passphrase-{}", i));
+        for _ in 0..100 {
+            let created = new_protocol::MakerOrderCreated {
+                uuid: Uuid::from_bytes(rng.gen()).into(),
+                base: "RICK".into(),
+                rel: "MORTY".into(),
+                price: BigRational::new(rng.gen_range(2000u64, 10000000).into(), 1000000.into()),
+                max_volume: BigRational::from_integer(1.into()),
+                min_volume: BigRational::from_integer(0.into()),
+                conf_settings: OrderConfirmationsSettings::default(),
+                created_at: now_ms() / 1000,
+                timestamp: now_ms() / 1000,
+                pair_trie_root: H64::default(),
+            };
+            let message = new_protocol::OrdermatchMessage::MakerOrderCreated(created);
+            messages.push(encode_and_sign(&message, &secret).unwrap());
+        }
+    }
+
+    let ordermatch_ctx = Arc::new(OrdermatchContext::default());
+    let ordermatch_ctx_clone = ordermatch_ctx.clone();
+    OrdermatchContext::from_ctx.mock_safe(move |_| MockResult::Return(Ok(ordermatch_ctx_clone.clone())));
+    b.iter(|| {
+        *block_on(ordermatch_ctx.orderbook.lock()) = Orderbook::default();
+        for message in messages.iter() {
+            let decoded = decode_msg(&ctx, message).unwrap();
+            black_box(block_on(process_decoded_msg(
+                ctx.clone(),
+                "peer".into(),
+                decoded,
+                false,
+            )));
+        }
+    });
+}
@@ -72,6 +72,7 @@ pub fn dispatcher(req: Json, ctx: MmArc) -> DispatcherRes {
         "disable_coin" => hyres(disable_coin(ctx, req)),
         "electrum" => hyres(electrum(ctx, req)),
         "enable" => hyres(enable(ctx, req)),
+        "enable_coins" => hyres(enable_coins(ctx, req)),
         "get_enabled_coins" => hyres(get_enabled_coins(ctx)),
         "get_gossip_mesh" => hyres(get_gossip_mesh(ctx)),
         "get_gossip_peer_topics" => hyres(get_gossip_peer_topics(ctx)),
@@ -79,6 +80,7 @@ pub fn dispatcher(req: Json, ctx: MmArc) -> DispatcherRes {
         "get_my_peer_id" => hyres(get_my_peer_id(ctx)),
         "get_peers_info" => hyres(get_peers_info(ctx)),
         "get_relay_mesh" => hyres(get_relay_mesh(ctx)),
+        "get_request_traces" => hyres(get_request_traces(ctx, req)),
         "get_trade_fee" => hyres(get_trade_fee(ctx, req)),
         // "fundvalue" => lp_fundvalue (ctx, req, false),
         "help" => help(),
@@ -100,8 +102,8 @@ pub fn dispatcher(req: Json, ctx: MmArc) -> DispatcherRes {
         "min_trading_vol" => hyres(min_trading_vol(ctx, req)),
         "my_balance" => hyres(my_balance(ctx, req)),
         "my_orders" => hyres(my_orders(ctx)),
-        "my_recent_swaps" => my_recent_swaps(ctx, req),
-        "my_swap_status" => my_swap_status(ctx, req),
+        "my_recent_swaps" => hyres(my_recent_swaps(ctx, req)),
+        "my_swap_status" => hyres(my_swap_status(ctx, req)),
         "my_tx_history" => hyres(my_tx_history(ctx, req)),
         "orders_history_by_filter" => hyres(orders_history_by_filter(ctx, req)),
         "order_status" => hyres(order_status(ctx, req)),
@@ -122,6 +124,7 @@ pub fn dispatcher(req: Json, ctx: MmArc) -> DispatcherRes {
         "show_priv_key" => hyres(show_priv_key(ctx, req)),
         "send_raw_transaction" => hyres(send_raw_transaction(ctx, req)),
         "set_required_confirmations" => hyres(set_required_confirmations(ctx, req)),
+        "set_request_tracing" => hyres(set_request_tracing(ctx, req)),
         "set_requires_notarization" => hyres(set_requires_notarization(ctx, req)),
         "setprice" => hyres(set_price(ctx, req)),
         "stats_swap_status" => stats_swap_status(ctx, req),
@@ -148,11 +151,16 @@ pub async fn process_single_request(
     }
     try_s!(auth(&req, &ctx));
 
-    let handler = match dispatcher(req, ctx.clone()) {
-        DispatcherRes::Match(handler) => handler,
-        DispatcherRes::NoMatch(req) => return ERR!("No such method: {:?}", req["method"]),
+    let method = req["method"].as_str().unwrap_or_default().to_owned();
+    let tracer_ctx = ctx.clone();
+    // the handler is created within the traced future as far as some legacy handlers do the work right away
+    let request = async move {
+        match dispatcher(req, ctx) {
+            DispatcherRes::Match(handler) => handler.compat().await,
+            DispatcherRes::NoMatch(req) => ERR!("No such method: {:?}", req["method"]),
+        }
     };
-    Ok(try_s!(handler.compat().await))
+    Ok(try_s!(tracer_ctx.tracer.trace(|| method, request).await))
 }
 
 /// The set of functions that convert the result of the updated handlers into the legacy format.
@@ -27,7 +27,8 @@ pub async fn process_single_request(
     }
 
     auth(&request, &ctx)?;
-    dispatcher(request, ctx).await
+    let method = request.method.clone();
+    ctx.tracer.trace(|| method, dispatcher(request, ctx.clone())).await
 }
 
 /// # Example
@@ -18,13 +18,15 @@
 //
 
 use bigdecimal::BigDecimal;
-use coins::{disable_coin as disable_coin_impl, lp_coinfind, lp_coininit, MmCoinEnum};
+use coins::{coin_conf, disable_coin as disable_coin_impl, lp_coin_activate, lp_coin_spawn_loops, lp_coinfind,
+            lp_coininit, MmCoinEnum};
 use common::executor::{spawn, Timer};
 use common::log::error;
 use common::mm_ctx::MmArc;
 use common::mm_metrics::MetricsOps;
 use common::{rpc_err_response, rpc_response, HyRes};
 use futures::compat::Future01CompatExt;
+use futures::stream::{self, StreamExt};
 use http::Response;
 use serde_json::{self as json, Value as Json};
 use std::borrow::Cow;
@@ -130,6 +132,114 @@ pub async fn enable(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String>
     Ok(try_s!(Response::builder().body(res)))
 }
 
+/// The number of the coins activated concurrently by `enable_coins` if not specified.
+const ENABLE_COINS_CONCURRENCY: usize = 8;
+
+fn enable_coins_concurrency() -> usize { ENABLE_COINS_CONCURRENCY }
+
+#[derive(Deserialize)]
+struct EnableCoinsRequest {
+    /// The `electrum` or `enable` requests of the coins, the `method` field of every request is the activation mode.
+    coins: Vec<Json>,
+    #[serde(default = "enable_coins_concurrency")]
+    concurrency: usize,
+}
+
+/// Returns the `CoinInitResponse` of the activated coin.
+async fn coin_init_response(coin: &MmCoinEnum) -> Result<Json, String> {
+    let balance = try_s!(coin.my_balance().compat().await);
+    let res = CoinInitResponse {
+        result: "success",
+        address: try_s!(coin.my_address()),
+        balance: balance.spendable,
+        unspendable_balance: balance.unspendable,
+        coin: coin.ticker(),
+        required_confirmations: coin.required_confirmations(),
+        requires_notarization: coin.requires_notarization(),
+        mature_confirmations: coin.mature_confirmations(),
+    };
+    Ok(try_s!(json::to_value(&res)))
+}
+
+/// Enables several coins at once activating at most `concurrency` of them concurrently.
+///
+/// The tokens the platform coin of which is enabled by the same request (e.g. the QRC20 tokens of QTUM)
+/// are activated after the platform, so they reuse its Electrum connections.
+/// Every coin is logged once it's ready, and the tx history and balance loops are started after all of them are.
+/// The loops are started for every activated coin, even if its balance or address can't be returned,
+/// as the coin stays enabled (the same as `electrum`/`enable` do).
+/// The result contains the response of `electrum`/`enable` or the error of every coin in the order of the request.
+pub async fn enable_coins(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
+    let req: EnableCoinsRequest = try_s!(json::from_value(req));
+    let tickers: Vec<&str> = try_s!(req
+        .coins
+        .iter()
+        .map(|coin_req| coin_req["coin"].as_str().ok_or_else(|| ERRL!("No 'coin' field")))
+        .collect());
+    let is_token: Vec<bool> = tickers
+        .iter()
+        .map(|ticker| {
+            let conf = coin_conf(&ctx, ticker);
+            match conf["protocol"]["protocol_data"]["platform"].as_str() {
+                Some(platform) => platform != *ticker && tickers.contains(&platform),
+                None => false,
+            }
+        })
+        .collect();
+
+    type ActivationResult = Result<(MmCoinEnum, Result<Json, String>), String>;
+    let mut results: Vec<Option<ActivationResult>> = tickers.iter().map(|_| None).collect();
+    for tokens in &[false, true] {
+        let activated: Vec<_> = stream::iter((0..tickers.len()).filter(|idx| is_token[*idx] == *tokens))
+            .map(|idx| {
+                let ctx = &ctx;
+                let ticker = tickers[idx];
+                let coin_req = &req.coins[idx];
+                async move {
+                    let result = match lp_coin_activate(ctx, ticker, coin_req).await {
+                        Ok(coin) => {
+                            let res = coin_init_response(&coin).await;
+                            Ok((coin, res))
+                        },
+                        Err(e) => Err(e),
+                    };
+                    match &result {
+                        Ok((_, Ok(_))) => ctx.log.log("🙂", &[&"enable_coins", &ticker], "Ready"),
+                        Ok((_, Err(e))) | Err(e) => {
+                            ctx.log
+                                .log("🤒", &[&"enable_coins", &ticker], &format!("Failed: {}", e))
+                        },
+                    }
+                    (idx, result)
+                }
+            })
+            .buffer_unordered(req.concurrency.max(1))
+            .collect()
+            .await;
+        for (idx, result) in activated {
+            results[idx] = Some(result);
+        }
+    }
+
+    let mut response = Vec::with_capacity(results.len());
+    for (idx, result) in results.into_iter().enumerate() {
+        match result.expect("Every coin is activated once") {
+            Ok((coin, res)) => {
+                if let Err(e) = lp_coin_spawn_loops(&ctx, &coin, &req.coins[idx]) {
+                    error!("Error {} on starting the {} loops", e, tickers[idx]);
+                }
+                match res {
+                    Ok(res) => response.push(res),
+                    Err(e) => response.push(json!({"coin": tickers[idx], "error": e})),
+                }
+            },
+            Err(e) => response.push(json!({"coin": tickers[idx], "error": e})),
+        }
+    }
+    let res = try_s!(json::to_vec(&json!({ "result": response })));
+    Ok(try_s!(Response::builder().body(res)))
+}
+
 #[cfg(target_arch = "wasm32")]
 pub fn help() -> HyRes {
     rpc_response(
@@ -149,6 +259,7 @@ pub fn help() -> HyRes {
         buy(base, rel, price, relvolume, timeout=10, duration=3600)
         electrum(coin, urls)
         enable(coin, urls, swap_contract_address)
+        enable_coins(coins, concurrency=8)
         myprice(base, rel)
         my_balance(coin)
         my_swap_status(params/uuid)
@@ -317,6 +428,38 @@ pub async fn get_my_peer_id(ctx: MmArc) -> Result<Response<Vec<u8>>, String> {
     Ok(try_s!(Response::builder().body(res)))
 }
 
+#[derive(Deserialize)]
+struct RequestTracesReq {
+    #[serde(default = "ten")]
+    limit: usize,
+    /// Lists the traces of the RPC method or the swaps ("maker_swap", "taker_swap") only.
+    name: Option<String>,
+}
+
+const fn ten() -> usize { 10 }
+
+/// Lists the slowest of the recent RPC requests and swaps with the timings of their stages.
+pub async fn get_request_traces(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
+    let req: RequestTracesReq = try_s!(json::from_value(req));
+    let traces = ctx.tracer.slowest_traces(req.limit, req.name.as_deref());
+    let result = json!({
+        "result": {
+            "enabled": ctx.tracer.is_enabled(),
+            "traces": traces,
+        },
+    });
+    let res = try_s!(json::to_vec(&result));
+    Ok(try_s!(Response::builder().body(res)))
+}
+
+/// Enables or disables the tracing of the RPC requests and swaps, cf. `get_request_traces`.
+pub async fn set_request_tracing(ctx: MmArc, req: Json) -> Result<Response<Vec<u8>>, String> {
+    let enable = try_s!(req["enable"].as_bool().ok_or("No 'enable' field"));
+    ctx.tracer.set_enabled(enable);
+    let res = try_s!(json::to_vec(&json!({ "result": "success" })));
+    Ok(try_s!(Response::builder().body(res)))
+}
+
 construct_detailed!(DetailedMinTradingVol, min_trading_vol);
 
 #[derive(Serialize)]